@@ -1,10 +1,13 @@
 #include <boost/python.hpp>
 #include <boost/python/def.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 #include <scitbx/array_family/shared.h>
 #include <scitbx/array_family/flex_types.h>
 #include <vector>
 #include <dxtbx/imageset.h>
+#include <dxtbx/imageset_scanner.h>
+#include <dxtbx/imageset_statistics.h>
 #include <dxtbx/model/pixel_to_millimeter.h>
 #include <dxtbx/error.h>
 
@@ -16,45 +19,37 @@ namespace dxtbx { namespace boost_python {
   namespace detail {
 
     /**
-     * Pickle a python object to a string
+     * Unpickle a python object from a string. The pickle.loads function is
+     * looked up once and kept for the lifetime of the process.
      */
-    std::string pickle_dumps(boost::python::object x) {
-      boost::python::object main = boost::python::import("__main__");
-      boost::python::object global(main.attr("__dict__"));
-      boost::python::object result = exec(
-          "def dumps(x):import pickle; return pickle.dumps(x)",
-          global, global);
-      boost::python::object dumps = global["dumps"];
-      return boost::python::extract<std::string>(dumps(x))();
+    boost::python::object pickle_loads(std::string x) {
+      static boost::python::object *loads = new boost::python::object(
+          boost::python::import("pickle").attr("loads"));
+      if (x == "") {
+        return boost::python::object();
+      }
+      return (*loads)(boost::python::object(boost::python::handle<>(
+          PyBytes_FromStringAndSize(x.data(), x.size()))));
     }
 
     /**
-     * Unpickle a python object from a string
+     * Deep copy a python object. The copy.deepcopy function is looked up
+     * once and kept for the lifetime of the process.
      */
-    boost::python::object pickle_loads(std::string x) {
-      if (x == "") {
-        return boost::python::object();
+    boost::python::object deep_copy(boost::python::object x) {
+      static boost::python::object *deepcopy = new boost::python::object(
+          boost::python::import("copy").attr("deepcopy"));
+      if (x.is_none()) {
+        return x;
       }
-      boost::python::object main = boost::python::import("__main__");
-      boost::python::object global(main.attr("__dict__"));
-      boost::python::object result = exec(
-          "def loads(x):import pickle; return pickle.loads(x)",
-          global, global);
-      boost::python::object loads = global["loads"];
-      return loads(x);
+      return (*deepcopy)(x);
     }
 
     /**
      * Tuple from list
      */
     boost::python::tuple list_to_tuple(boost::python::list x) {
-      boost::python::object main = boost::python::import("__main__");
-      boost::python::object global(main.attr("__dict__"));
-      boost::python::object result = exec(
-          "def func_list_to_tuple(x):return tuple(x)",
-          global, global);
-      boost::python::object func_list_to_tuple = global["func_list_to_tuple"];
-      return boost::python::extract<boost::python::tuple>(func_list_to_tuple(x))();
+      return boost::python::tuple(x);
     }
   }
 
@@ -75,39 +70,46 @@ namespace dxtbx { namespace boost_python {
     // Set some stuff
     self->set_template(filename_template);
     self->set_vendor(vendor);
-    self->set_params(detail::pickle_dumps(params));
-    self->set_format(detail::pickle_dumps(format));
+    self->set_params(detail::deep_copy(params));
+    self->set_format(format);
 
     // Return the imageset data
     return self;
   }
 
   /**
-   * Set the parameters
+   * Set the parameters to a deep copy of a dict. The copy is made once here,
+   * so that get_params can return the stored dict without copying it and
+   * changes to the caller's dict do not reach the imageset data.
    */
-  boost::python::object ImageSetData_get_params(ImageSetData &self) {
-    return detail::pickle_loads(self.get_params());
+  void ImageSetData_set_params(ImageSetData &self, boost::python::dict params) {
+    self.set_params(detail::deep_copy(params));
   }
 
   /**
-   * Get the parameters
+   * Get the format class
    */
-  void ImageSetData_set_params(ImageSetData &self, boost::python::dict params) {
-    self.set_params(detail::pickle_dumps(params));
+  boost::python::object ImageSetData_get_format(ImageSetData &self) {
+    return self.get_format();
   }
 
   /**
    * Set the format class
    */
-  boost::python::object ImageSetData_get_format(ImageSetData &self) {
-    return detail::pickle_loads(self.get_format());
+  void ImageSetData_set_format(ImageSetData &self, boost::python::object format) {
+    self.set_format(format);
   }
 
   /**
-   * Get the format class
+   * Get the params or format from the pickled state. Older pickles hold
+   * these as pickled strings rather than as the objects themselves.
    */
-  void ImageSetData_set_format(ImageSetData &self, boost::python::dict format) {
-    self.set_format(detail::pickle_dumps(format));
+  boost::python::object ImageSetData_state_item(boost::python::object item) {
+    boost::python::extract<std::string> get_string(item);
+    if (get_string.check()) {
+      return detail::pickle_loads(get_string());
+    }
+    return item;
   }
 
 
@@ -161,42 +163,34 @@ namespace dxtbx { namespace boost_python {
       return self.get_scan(i);
     }
 
+    /**
+     * Get the list of unique models and, for each image, the index of its
+     * model in the list. Models are identified by pointer and the indices
+     * are returned as a flex.size_t array.
+     */
     template <typename Model, typename Func>
     static
-    boost::python::tuple get_model_list(ImageSetData obj, Func get) {
+    boost::python::tuple get_model_list(const ImageSetData &obj, Func get) {
 
-      // Create a list of models and a list of indices
-      std::vector< boost::shared_ptr<Model> > model_list;
-      std::vector<std::size_t> index_list;
+      // Create a list of models and an array of indices
+      typedef boost::unordered_map<const Model*, std::size_t> lookup_type;
+      lookup_type lookup;
+      boost::python::list models;
+      scitbx::af::shared<std::size_t> indices(obj.size());
       for (std::size_t i = 0; i < obj.size(); ++i) {
         boost::shared_ptr<Model> m = get(obj, i);
-        std::size_t k = model_list.size();
-        for (std::size_t j = 0; j < k; ++j) {
-          if (m.get() == model_list[j].get()) {
-            k = j;
-            break;
-          }
+        std::pair<typename lookup_type::iterator, bool> item =
+          lookup.insert(std::make_pair(m.get(), lookup.size()));
+        if (item.second) {
+          models.append(m);
         }
-        if (k == model_list.size()) {
-          model_list.push_back(m);
-        }
-        index_list.push_back(k);
-      }
-
-      // Convert to python lists and return tuple
-      boost::python::list models;
-      boost::python::list indices;
-      for (std::size_t i = 0; i < model_list.size(); ++i) {
-        models.append(model_list[i]);
-      }
-      for (std::size_t i = 0; i < index_list.size(); ++i) {
-        indices.append(index_list[i]);
+        indices[i] = item.first->second;
       }
       return boost::python::make_tuple(models, indices);
     }
 
     static
-    boost::python::tuple get_model_tuple(ImageSetData obj) {
+    boost::python::tuple get_model_tuple(const ImageSetData &obj) {
       return boost::python::make_tuple(
           ImageSetDataPickleSuite::get_model_list<BeamBase>(
             obj, &ImageSetDataPickleSuite::get_beam),
@@ -209,7 +203,7 @@ namespace dxtbx { namespace boost_python {
     }
 
     static
-    boost::python::tuple get_lookup_tuple(ImageSetData obj) {
+    boost::python::tuple get_lookup_tuple(const ImageSetData &obj) {
       return boost::python::make_tuple(
           boost::python::make_tuple(
             obj.external_lookup().mask().get_filename(),
@@ -229,7 +223,7 @@ namespace dxtbx { namespace boost_python {
     }
 
     static
-    boost::python::tuple getstate(ImageSetData obj) {
+    boost::python::tuple getstate(const ImageSetData &obj) {
       return boost::python::make_tuple(
           ImageSetDataPickleSuite::get_model_tuple(obj),
           ImageSetDataPickleSuite::get_lookup_tuple(obj),
@@ -243,22 +237,31 @@ namespace dxtbx { namespace boost_python {
     static
     void set_model_list(ImageSetData &obj, boost::python::tuple data, Func set) {
 
-      // Extract to python lists
+      // Extract the models to a c++ vector
       boost::python::list models = boost::python::extract<
         boost::python::list>(data[0])();
-      boost::python::list indices = boost::python::extract<
-        boost::python::list>(data[1])();
-
-      // Convert to c++ vectors
+      std::size_t n_models = boost::python::len(models);
       std::vector< boost::shared_ptr<Model> > model_list;
-      std::vector< std::size_t > index_list;
-      for (std::size_t i = 0; i < boost::python::len(models); ++i) {
+      model_list.reserve(n_models);
+      for (std::size_t i = 0; i < n_models; ++i) {
         model_list.push_back(
             boost::python::extract<
               boost::shared_ptr<Model> >(models[i])());
       }
-      for (std::size_t i = 0; i < boost::python::len(indices); ++i) {
-        index_list.push_back(boost::python::extract<std::size_t>(indices[i])());
+
+      // The indices are a flex.size_t array, or a list in older pickles
+      scitbx::af::shared<std::size_t> index_list;
+      boost::python::extract< scitbx::af::shared<std::size_t> > get_index_array(data[1]);
+      if (get_index_array.check()) {
+        index_list = get_index_array();
+      } else {
+        boost::python::list indices = boost::python::extract<
+          boost::python::list>(data[1])();
+        std::size_t n_indices = boost::python::len(indices);
+        index_list.reserve(n_indices);
+        for (std::size_t i = 0; i < n_indices; ++i) {
+          index_list.push_back(boost::python::extract<std::size_t>(indices[i])());
+        }
       }
 
       // Set the models
@@ -347,8 +350,8 @@ namespace dxtbx { namespace boost_python {
       // Set the properties
       obj.set_template(boost::python::extract<std::string>(state[2])());
       obj.set_vendor(boost::python::extract<std::string>(state[3])());
-      obj.set_params(boost::python::extract<std::string>(state[4])());
-      obj.set_format(boost::python::extract<std::string>(state[5])());
+      obj.set_params(ImageSetData_state_item(state[4]));
+      obj.set_format(ImageSetData_state_item(state[5]));
     }
   };
 
@@ -610,6 +613,64 @@ namespace dxtbx { namespace boost_python {
     }
   }
 
+  ImageSetScanTable ImageSetScanner_scan(
+      const ImageSetScanner &self,
+      ImageSet &imageset,
+      boost::python::object first,
+      boost::python::object last) {
+    std::size_t i0 = 0;
+    std::size_t i1 = imageset.size();
+    if (first != boost::python::object()) {
+      i0 = boost::python::extract<std::size_t>(first)();
+    }
+    if (last != boost::python::object()) {
+      i1 = boost::python::extract<std::size_t>(last)();
+    }
+    return self.scan(imageset, i0, i1);
+  }
+
+  /**
+   * Export the imageset scanner
+   */
+  void export_imageset_scanner() {
+    using namespace boost::python;
+
+    class_<ImageSetScanTable>("ImageSetScanTable", no_init)
+      .def("size", &ImageSetScanTable::size)
+      .def("__len__", &ImageSetScanTable::size)
+      .def("n_panels", &ImageSetScanTable::n_panels)
+      .def("indices", &ImageSetScanTable::indices)
+      .def("sum", &ImageSetScanTable::sum)
+      .def("raw_sum", &ImageSetScanTable::raw_sum)
+      .def("max", &ImageSetScanTable::max)
+      .def("raw_max", &ImageSetScanTable::raw_max)
+      .def("n_valid", &ImageSetScanTable::n_valid)
+      .def("n_overloads", &ImageSetScanTable::n_overloads)
+      .def("n_masked", &ImageSetScanTable::n_masked)
+      .def("n_hits", &ImageSetScanTable::n_hits)
+      .def("panel_sum", &ImageSetScanTable::panel_sum)
+      .def("panel_raw_sum", &ImageSetScanTable::panel_raw_sum)
+      .def("panel_max", &ImageSetScanTable::panel_max)
+      .def("panel_raw_max", &ImageSetScanTable::panel_raw_max)
+      .def("panel_n_valid", &ImageSetScanTable::panel_n_valid)
+      .def("panel_n_overloads", &ImageSetScanTable::panel_n_overloads)
+      .def("panel_n_masked", &ImageSetScanTable::panel_n_masked)
+      .def("panel_n_hits", &ImageSetScanTable::panel_n_hits)
+      ;
+
+    class_<ImageSetScanner>("ImageSetScanner", no_init)
+      .def(init<double, std::size_t>((
+              arg("hit_threshold"),
+              arg("batch_size")=32)))
+      .def("hit_threshold", &ImageSetScanner::hit_threshold)
+      .def("batch_size", &ImageSetScanner::batch_size)
+      .def("scan", &ImageSetScanner_scan, (
+            arg("imageset"),
+            arg("first")=boost::python::object(),
+            arg("last")=boost::python::object()))
+      ;
+  }
+
   /**
    * Export the imageset classes
    */
@@ -678,7 +739,7 @@ namespace dxtbx { namespace boost_python {
       .def("set_template", &ImageSetData::set_template)
       .def("get_vendor", &ImageSetData::get_vendor)
       .def("set_vendor", &ImageSetData::set_vendor)
-      .def("get_params", &ImageSetData_get_params)
+      .def("get_params", &ImageSetData::get_params)
       .def("set_params", &ImageSetData_set_params)
       .def("get_format_class", &ImageSetData_get_format)
       .def("set_format_class", &ImageSetData_set_format)
@@ -706,6 +767,8 @@ namespace dxtbx { namespace boost_python {
       .def("get_gain", &ImageSet_get_gain)
       .def("get_pedestal", &ImageSet_get_pedestal)
       .def("get_mask", &ImageSet_get_mask)
+      .def("get_mask_bits", &ImageSet::get_mask_bits)
+      .def("get_static_mask_bits", &ImageSet::get_static_mask_bits)
       .def("get_beam",
           &ImageSet::get_beam_for_image, (
             arg("index") = 0))
@@ -820,9 +883,44 @@ namespace dxtbx { namespace boost_python {
   }
 
 
+  scitbx::af::shared<std::size_t> ImageSetStatisticsAccumulator_accumulate(
+      const ImageSetStatisticsAccumulator &self,
+      ImageStatistics &stats,
+      ImageSet &imageset,
+      boost::python::object indices) {
+    scitbx::af::shared<std::size_t> index_array;
+    if (indices.is_none()) {
+      for (std::size_t i = 0; i < imageset.size(); ++i) {
+        index_array.push_back(i);
+      }
+    } else {
+      index_array = boost::python::extract< scitbx::af::shared<std::size_t> >(indices)();
+    }
+    return self.accumulate(stats, imageset, index_array.const_ref());
+  }
+
+  /**
+   * Export the imageset statistics accumulator
+   */
+  void export_imageset_statistics() {
+    using namespace boost::python;
+
+    class_<ImageSetStatisticsAccumulator>("ImageSetStatisticsAccumulator", no_init)
+      .def(init<std::size_t>((
+              arg("batch_size")=32)))
+      .def("batch_size", &ImageSetStatisticsAccumulator::batch_size)
+      .def("accumulate", &ImageSetStatisticsAccumulator_accumulate, (
+            arg("stats"),
+            arg("imageset"),
+            arg("indices")=boost::python::object()))
+      ;
+  }
+
   BOOST_PYTHON_MODULE(dxtbx_imageset_ext)
   {
     export_imageset();
+    export_imageset_scanner();
+    export_imageset_statistics();
   }
 
 }} //namespace dxtbx::boost_python
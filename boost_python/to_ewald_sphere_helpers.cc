@@ -12,66 +12,50 @@
 #include <boost/python/def.hpp>
 #include <scitbx/vec3.h>
 #include <scitbx/array_family/flex_types.h>
-#include <dxtbx/model/beam.h>
-#include <dxtbx/model/detector.h>
-#include <dxtbx/model/goniometer.h>
-#include <dxtbx/model/scan.h>
+#include <dxtbx/image_to_ewald_sphere.h>
 
 namespace dxtbx { namespace boost_python {
 
   using namespace boost::python;
 
-  using scitbx::vec2;
   using scitbx::vec3;
   using scitbx::af::flex_grid;
-  using dxtbx::model::Beam;
-  using dxtbx::model::Detector;
-  using dxtbx::model::Goniometer;
-  using dxtbx::model::Scan;
 
   typedef scitbx::af::flex<vec3<double> >::type flex_vec3_double;
 
-  class ImageToEwaldSphere {
-  public:
-    ImageToEwaldSphere(const Beam &beam, const Detector &detector,
-                       const Goniometer &gonio, const Scan &scan)
-      : beam_(beam),
-        detector_(detector),
-        gonio_(gonio),
-        scan_(scan) {}
-
-    flex_vec3_double operator()(int frame, std::size_t panel) {
-
-      // Check panel
-      DXTBX_ASSERT(panel < detector_.size());
-
-      // Get size and create array
-      std::size_t slow_size = detector_[0].get_image_size()[1];
-      std::size_t fast_size = detector_[0].get_image_size()[0];
-      flex_vec3_double x(flex_grid<>(slow_size, fast_size));
-
-      // Get rotation angle
-      double phi = scan_.get_angle_from_array_index(frame - 0.5);
-
-      // Get coordinate for each pixel
-      for (std::size_t j = 0; j < slow_size; ++j) {
-        for (std::size_t i = 0; i < fast_size; ++i) {
-          vec3<double> s1 = detector_[panel].get_pixel_lab_coord(vec2<double>(i, j));
-          x(j, i) = s1.normalize().unit_rotate_around_origin(
-            gonio_.get_rotation_axis(), phi) / beam_.get_wavelength();
-        }
-      }
-
-      // Return array
-      return x;
-    }
+  static
+  flex_vec3_double image_to_ewald_sphere_call(
+      const ImageToEwaldSphere &self,
+      int frame,
+      std::size_t panel) {
+    ImageToEwaldSphere::accessor_type size = self.panel_size(panel);
+    flex_vec3_double result(flex_grid<>(size[0], size[1]));
+    self.map(frame, panel, result.ref());
+    return result;
+  }
 
-    Beam beam_;
-    Detector detector_;
-    Goniometer gonio_;
-    Scan scan_;
-  };
+  static
+  flex_vec3_double image_to_ewald_sphere_map_frames(
+      const ImageToEwaldSphere &self,
+      int first,
+      int last) {
+    DXTBX_ASSERT(first <= last);
+    flex_vec3_double result((last - first) * self.n_pixels());
+    self.map_frames(first, last, result.ref());
+    return result;
+  }
 
+  static
+  boost::python::tuple image_to_ewald_sphere_map_masked(
+      const ImageToEwaldSphere &self,
+      int frame,
+      std::size_t panel,
+      const scitbx::af::const_ref< bool, scitbx::af::c_grid<2> > &mask) {
+    scitbx::af::shared<std::size_t> index;
+    scitbx::af::shared< vec3<double> > result;
+    self.map_masked(frame, panel, mask, index, result);
+    return boost::python::make_tuple(index, result);
+  }
 
   void export_to_ewald_sphere_helpers()
   {
@@ -84,7 +68,19 @@ namespace dxtbx { namespace boost_python {
           arg("detector"),
           arg("goniometer"),
           arg("scan"))))
-      .def("__call__", &ImageToEwaldSphere::operator());
+      .def("__call__", &image_to_ewald_sphere_call, (
+          arg("frame"),
+          arg("panel")))
+      .def("n_panels", &ImageToEwaldSphere::n_panels)
+      .def("n_pixels", &ImageToEwaldSphere::n_pixels)
+      .def("panel_offset", &ImageToEwaldSphere::panel_offset)
+      .def("map_frames", &image_to_ewald_sphere_map_frames, (
+          arg("first"),
+          arg("last")))
+      .def("map_masked", &image_to_ewald_sphere_map_masked, (
+          arg("frame"),
+          arg("panel"),
+          arg("mask")));
   }
 
 }} // namespace dxtbx::boost_python
@@ -22,6 +22,9 @@ master_params = master_phil_scope.fetch().extract()
 
 colour_schemes = {"greyscale": 0, "rainbow": 1, "heatmap": 2, "inverse_greyscale": 3}
 
+# The number of images held in memory at a time
+batch_size = 16
+
 
 def run(args):
     import os
@@ -55,7 +58,6 @@ dxtbx.export_bitmaps image_files [options]
     params = working_phil.extract()
 
     brightness = params.brightness / 100
-    vendortype = "made up"
 
     # check that binning is a power of 2
     binning = params.binning
@@ -68,67 +70,46 @@ dxtbx.export_bitmaps image_files [options]
     elif not os.path.exists(output_dir):
         os.makedirs(output_dir)
 
-    from rstbx.slip_viewer.tile_generation import (
-        _get_flex_image,
-        _get_flex_image_multipanel,
-    )
+    from dxtbx.format.image import BitmapRenderer
 
     for imageset in imagesets:
-        detector = imageset.get_detector()
-        panel = detector[0]
-        # XXX is this inclusive or exclusive?
-        saturation = panel.get_trusted_range()[1]
-        for i_image, image in enumerate(imageset):
-
-            if len(detector) > 1:
-                # FIXME This doesn't work properly, as flex_image.size2() is incorrect
-                # also binning doesn't work
-                assert binning == 1
-                flex_image = _get_flex_image_multipanel(
-                    brightness=brightness,
-                    panels=detector,
-                    raw_data=image,
-                    beam=imageset.get_beam(),
-                )
-            else:
-                flex_image = _get_flex_image(
-                    brightness=brightness,
-                    data=image,
-                    binning=binning,
-                    saturation=saturation,
-                    vendortype=vendortype,
-                )
-
-            flex_image.setWindow(0, 0, 1)
-            flex_image.adjust(color_scheme=colour_schemes.get(params.colour_scheme))
-
-            # now export as a bitmap
-            flex_image.prep_string()
-            try:
-                import PIL.Image as Image
-            except ImportError:
-                import Image
-            # XXX is size//binning safe here?
-            try:
-                pil_img = Image.fromstring(
-                    "RGB",
-                    (flex_image.size2() // binning, flex_image.size1() // binning),
-                    flex_image.export_string,
-                )
-            except NotImplementedError:
-                pil_img = Image.frombytes(
-                    "RGB",
-                    (flex_image.size2() // binning, flex_image.size1() // binning),
-                    flex_image.export_string,
-                )
+        renderer = BitmapRenderer(
+            imageset.get_detector(),
+            imageset.get_beam(),
+            binning=binning,
+            brightness=brightness,
+            colour_scheme=colour_schemes.get(params.colour_scheme),
+        )
 
+        paths = []
+        for i_image in range(len(imageset)):
             basename = os.path.basename(os.path.splitext(imageset.paths()[i_image])[0])
-            path = os.path.join(output_dir, basename + "." + params.format)
+            paths.append(os.path.join(output_dir, basename + "." + params.format))
+
+        # PNG files are rendered and encoded in parallel a batch at a time,
+        # other formats are rendered to RGB and saved with PIL
+        for first in range(0, len(imageset), batch_size):
+            last = min(first + batch_size, len(imageset))
+            images = [imageset[i_image] for i_image in range(first, last)]
+            for path in paths[first:last]:
+                print("Exporting %s" % path)
+            if params.format == "png":
+                renderer.write_png_batch(images, paths[first:last])
+            else:
+                for image, path in zip(images, paths[first:last]):
+                    save_bitmap(renderer, image, path, params.format)
+
 
-            print("Exporting %s" % path)
-            tmp_stream = open(path, "wb")
-            pil_img.save(tmp_stream, format=params.format)
-            tmp_stream.close()
+def save_bitmap(renderer, image, path, format):
+    try:
+        import PIL.Image as Image
+    except ImportError:
+        import Image
+    pil_img = Image.frombytes(
+        "RGB", (renderer.width(), renderer.height()), renderer.render(image)
+    )
+    with open(path, "wb") as tmp_stream:
+        pil_img.save(tmp_stream, format=format)
 
 
 if __name__ == "__main__":
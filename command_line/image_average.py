@@ -10,13 +10,13 @@ Average images of any dxtbx-supported format. Handles many individual images or
 
 from __future__ import absolute_import, division, print_function
 
-import copy
 import sys
 
 import libtbx.load_env
 from dxtbx.datablock import DataBlockFactory
 from dxtbx.format.cbf_writer import FullCBFWriter
 from dxtbx.format.FormatMultiImage import FormatMultiImage
+from dxtbx.format.image import ImageStatistics
 from dxtbx.format.Registry import Registry
 from libtbx import easy_mp, option_parser
 from libtbx.utils import Sorry, Usage
@@ -49,15 +49,37 @@ def splitit(l, n):
     return r
 
 
+def panel_data(data, panel):
+    """Prepare the raw data of a panel for ImageStatistics, which takes 2D
+    int or double arrays. Readers may return 1D arrays or other numeric
+    types, so anything other than int data is converted to double and the
+    result is shaped to the panel image size.
+    @param data The raw data of the panel
+    @param panel The panel model
+    @return The data as a 2D flex.int or flex.double
+    """
+    if not isinstance(data, (flex.int, flex.double)):
+        data = data.as_double()
+    fast, slow = panel.get_image_size()
+    if data.all() != (slow, fast):
+        assert data.size() == fast * slow, "Image data does not match panel size"
+        data = data.as_1d()
+        data.reshape(flex.grid(slow, fast))
+    return data
+
+
 class image_worker(object):
-    """ Class to compute running sums while reading image data """
+    """ Class to compute running statistics while reading image data """
 
-    # Deriving class should implement __init__, load and read
+    # Deriving class should implement __init__, load and read, or override
+    # __call__ to accumulate the statistics itself
 
     def __call__(self, subset):
         """ Worker function for multiprocessing """
         nfail = 0
-        nmemb = 0
+        stats = ImageStatistics()
+        sum_distance = 0
+        sum_wavelength = 0
 
         self.load()
 
@@ -71,28 +93,13 @@ class image_worker(object):
 
             assert isinstance(img, tuple)
 
-            # The sum-of-squares image is accumulated using long integers, as
-            # this delays the point where overflow occurs.  But really, this
-            # is just a band-aid...
-            if nmemb == 0:
-                max_img = list(copy.deepcopy(img))
-                sum_distance = distance
-                sum_img = list(copy.deepcopy(img))
-                ssq_img = [flex.pow2(p) for p in img]
-                sum_wavelength = wavelength
+            # The mean, variance and maximum are accumulated per pixel in a
+            # single numerically stable pass
+            stats.add(img)
+            sum_distance += distance
+            sum_wavelength += wavelength
 
-            else:
-                for p in xrange(len(img)):
-                    sel = (img[p] > max_img[p]).as_1d()
-                    max_img[p].set_selected(sel, img[p].select(sel))
-
-                    sum_img[p] += img[p]
-                    ssq_img[p] += flex.pow2(img[p])
-                sum_distance += distance
-                sum_wavelength += wavelength
-
-            nmemb += 1
-        return nfail, nmemb, max_img, sum_distance, sum_img, ssq_img, sum_wavelength
+        return nfail, stats, sum_distance, sum_wavelength
 
 
 class multi_image_worker(image_worker):
@@ -111,21 +118,30 @@ class multi_image_worker(image_worker):
             # Need to re-open the file if HDF5 as HDF5 file handles can't be pickled during multiprocessing
             self.imageset.reader().nullify_format_instance()
 
-    def read(self, n):
-        """ Read image at postion n"""
-        if self.command_line.options.verbose:
-            print("Processing %s: %d" % (self.path, n))
+    def __call__(self, subset):
+        """Worker function for multiprocessing. The pixel statistics are
+        accumulated over the imageset in C++, which reads the frames in
+        batches and reduces each batch across frames in parallel."""
+        from dxtbx.imageset import ImageSetStatisticsAccumulator
 
-        beam = self.imageset.get_beam(n)
-        detector = self.imageset.get_detector(n)
+        self.load()
+        if self.command_line.options.verbose:
+            print("Processing %s: %d images" % (self.path, len(subset)))
 
-        image_data = self.imageset[n]
-        if not isinstance(image_data, tuple):
-            image_data = (image_data,)
-        img = tuple([image_data[i].as_1d().as_double() for i in xrange(len(detector))])
-        wavelength = beam.get_wavelength()
+        stats = ImageStatistics()
+        skipped = ImageSetStatisticsAccumulator().accumulate(
+            stats, self.imageset, flex.size_t(list(subset))
+        )
+        skipped = set(skipped)
+        sum_distance = 0
+        sum_wavelength = 0
+        for n in subset:
+            if n not in skipped:
+                detector = self.imageset.get_detector(n)
+                sum_distance += detector.hierarchy().get_distance()
+                sum_wavelength += self.imageset.get_beam(n).get_wavelength()
 
-        return img, detector.hierarchy().get_distance(), wavelength
+        return len(skipped), stats, sum_distance, sum_wavelength
 
 
 class single_image_worker(image_worker):
@@ -152,7 +168,9 @@ class single_image_worker(image_worker):
         image_data = img_instance.get_raw_data()
         if not isinstance(image_data, tuple):
             image_data = (image_data,)
-        img = tuple([image_data[i].as_1d().as_double() for i in xrange(len(detector))])
+        img = tuple(
+            [panel_data(image_data[i], detector[i]) for i in xrange(len(detector))]
+        )
         wavelength = beam.get_wavelength()
 
         return img, detector.hierarchy().get_distance(), wavelength
@@ -329,37 +347,15 @@ def run(argv=None):
             )
 
     nfail = 0
-    nmemb = 0
-    for (
-        i,
-        (
-            r_nfail,
-            r_nmemb,
-            r_max_img,
-            r_sum_distance,
-            r_sum_img,
-            r_ssq_img,
-            r_sum_wavelength,
-        ),
-    ) in enumerate(results):
+    stats = ImageStatistics()
+    sum_distance = 0
+    sum_wavelength = 0
+    for r_nfail, r_stats, r_sum_distance, r_sum_wavelength in results:
         nfail += r_nfail
-        nmemb += r_nmemb
-        if i == 0:
-            max_img = r_max_img
-            sum_distance = r_sum_distance
-            sum_img = r_sum_img
-            ssq_img = r_ssq_img
-            sum_wavelength = r_sum_wavelength
-        else:
-            for p in xrange(len(sum_img)):
-                sel = (r_max_img[p] > max_img[p]).as_1d()
-                max_img[p].set_selected(sel, r_max_img[p].select(sel))
-
-                sum_img[p] += r_sum_img[p]
-                ssq_img[p] += r_ssq_img[p]
-
-            sum_distance += r_sum_distance
-            sum_wavelength += r_sum_wavelength
+        stats.merge(r_stats)
+        sum_distance += r_sum_distance
+        sum_wavelength += r_sum_wavelength
+    nmemb = stats.count()
 
     # Early exit if no statistics were accumulated.
     if command_line.options.verbose:
@@ -368,8 +364,7 @@ def run(argv=None):
         return 0
 
     # Calculate averages for measures where other statistics do not make
-    # sense.  Note that avg_img is required for stddev_img.
-    avg_img = tuple([sum_img[p].as_double() / nmemb for p in xrange(len(sum_img))])
+    # sense.
     avg_distance = sum_distance / nmemb
     avg_wavelength = sum_wavelength / nmemb
 
@@ -386,9 +381,8 @@ def run(argv=None):
     # Output the average image, maximum projection image, and standard
     # deviation image, if requested.
     if command_line.options.avg_path is not None:
-        for p in xrange(len(detector)):
-            fast, slow = detector[p].get_image_size()
-            avg_img[p].resize(flex.grid(slow, fast))
+        avg_img = stats.mean()
+        avg_img = tuple([avg_img.tile(p).data() for p in xrange(len(detector))])
 
         writer = FullCBFWriter(imageset=imageset)
         cbf = writer.get_cbf_handle(header_only=True)
@@ -396,10 +390,8 @@ def run(argv=None):
         writer.write_cbf(command_line.options.avg_path, cbf=cbf)
 
     if command_line.options.max_path is not None:
-        for p in xrange(len(detector)):
-            fast, slow = detector[p].get_image_size()
-            max_img[p].resize(flex.grid(slow, fast))
-        max_img = tuple(max_img)
+        max_img = stats.max()
+        max_img = tuple([max_img.tile(p).data() for p in xrange(len(detector))])
 
         writer = FullCBFWriter(imageset=imageset)
         cbf = writer.get_cbf_handle(header_only=True)
@@ -407,24 +399,10 @@ def run(argv=None):
         writer.write_cbf(command_line.options.max_path, cbf=cbf)
 
     if command_line.options.stddev_path is not None:
-        stddev_img = []
-        for p in xrange(len(detector)):
-            stddev_img.append(
-                ssq_img[p].as_double() - sum_img[p].as_double() * avg_img[p]
-            )
-
-            # Accumulating floating-point numbers introduces errors, which may
-            # cause negative variances.  Since a two-pass approach is
-            # unacceptable, the standard deviation is clamped at zero.
-            stddev_img[p].set_selected(stddev_img[p] < 0, 0)
-            if nmemb == 1:
-                stddev_img[p] = flex.sqrt(stddev_img[p])
-            else:
-                stddev_img[p] = flex.sqrt(stddev_img[p] / (nmemb - 1))
-
-            fast, slow = detector[p].get_image_size()
-            stddev_img[p].resize(flex.grid(slow, fast))
-        stddev_img = tuple(stddev_img)
+        stddev_img = stats.standard_deviation()
+        stddev_img = tuple(
+            [stddev_img.tile(p).data() for p in xrange(len(detector))]
+        )
 
         writer = FullCBFWriter(imageset=imageset)
         cbf = writer.get_cbf_handle(header_only=True)
@@ -3,14 +3,15 @@ from __future__ import absolute_import, division, print_function
 
 def overload(image_file):
     from dxtbx import load
+    from dxtbx.imageset import ImageSetScanner
 
     i = load(image_file)
-    data = i.get_raw_data()
-    if not isinstance(data, tuple):
-        data = (data,)
-    detector = i.get_detector()
-    for pid, (d, p) in enumerate(zip(data, detector)):
-        if max(d) > p.get_trusted_range()[1]:
+    imageset = i.get_imageset([image_file])
+    table = ImageSetScanner(hit_threshold=0).scan(imageset, 0, 1)
+    panel_max = table.panel_raw_max()
+    detector = imageset.get_detector()
+    for pid, p in enumerate(detector):
+        if panel_max[0, pid] > p.get_trusted_range()[1]:
             return True
     return False
 
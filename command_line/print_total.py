@@ -4,21 +4,24 @@ from __future__ import absolute_import, division, print_function
 def print_total():
     import sys
     from dxtbx.format.Registry import Registry
+    from dxtbx.imageset import ImageSetScanner
 
     # this will do the lookup for every frame - this is strictly not needed
     # if all frames are from the same instrument
 
+    scanner = ImageSetScanner(hit_threshold=0)
     for arg in sys.argv[1:]:
         print("=== %s ===" % arg)
         format_class = Registry.find(arg)
         print("Using header reader: %s" % format_class.__name__)
-        i = format_class(arg)
-        image_size = i.get_detector()[0].get_image_size()
-        d = i.get_raw_data()
-        if not isinstance(d, tuple):
-            d = (d,)
-        d = [p.as_1d() for p in d]
-        total = sum([sum(p.select(p >= 0)) for p in d])
+        imageset = format_class.get_imageset([arg])
+        image_size = imageset.get_detector()[0].get_image_size()
+        # Only the first image is read, as for a single image format
+        table = scanner.scan(imageset, 0, 1)
+        print(table.as_str(hits=False))
+        # The total is over all non-negative pixels, including masked and
+        # overloaded ones; the table shows the sum of the valid pixels
+        total = table.raw_sum()[0]
         print("Total Counts: %d" % total)
         print("Average Counts: %.2f" % (total / (image_size[0] * image_size[1])))
 
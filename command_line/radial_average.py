@@ -53,6 +53,13 @@ master_phil = libtbx.phil.parse(
     .type = int
   max_images = None
     .type = int
+  n_subdivide = 1
+    .type = int
+    .help = "Split each pixel into n x n sub-pixels when assigning it to bins"
+  solid_angle_correction = False
+    .type = bool
+  polarization_correction = False
+    .type = bool
 """
 )
 
@@ -61,9 +68,32 @@ def distance(a, b):
     return math.sqrt((math.pow(b[0] - a[0], 2) + math.pow(b[1] - a[1], 2)))
 
 
+def get_extent(beam, detector):
+    """The distance in pixels from the beam to the farthest corner of the
+    detector, used as the default number of bins"""
+    s0 = col(beam.get_s0())
+
+    # Search the detector for the panel farthest from the beam
+    panel_res = [p.get_max_resolution_at_corners(s0) for p in detector]
+    farthest_panel = detector[panel_res.index(min(panel_res))]
+    size2, size1 = farthest_panel.get_image_size()
+    corners = [(0, 0), (size1 - 1, 0), (0, size2 - 1), (size1 - 1, size2 - 1)]
+    corners_lab = [col(farthest_panel.get_pixel_lab_coord(c)) for c in corners]
+    corner_two_thetas = [farthest_panel.get_two_theta_at_pixel(s0, c) for c in corners]
+    extent_two_theta = max(corner_two_thetas)
+    max_corner = corners_lab[corner_two_thetas.index(extent_two_theta)]
+    return int(
+        math.ceil(
+            max_corner.length()
+            * math.sin(extent_two_theta)
+            / max(farthest_panel.get_pixel_size())
+        )
+    )
+
+
 def run(args, imageset=None):
-    from xfel import radial_average
     from scitbx.array_family import flex
+    from dxtbx.model import AzimuthalIntegrator
     from dxtbx.datablock import DataBlockFactory
     from dxtbx.model.experiment_list import ExperimentListFactory
 
@@ -141,6 +171,10 @@ def run(args, imageset=None):
         iterable = [imageset]
         load_func = lambda x: x
 
+    # The pixel to bin assignment is computed once and reused for as long as
+    # the beam and detector models do not change
+    integrator = None
+
     # Iterate over each file provided
     for item in iterable:
         iset = load_func(item)
@@ -155,88 +189,50 @@ def run(args, imageset=None):
         for image_number in subiterable:
             beam = iset.get_beam(image_number)
             detector = iset.get_detector(image_number)
-            s0 = col(beam.get_s0())
-
-            # Search the detector for the panel farthest from the beam. The number of bins in the radial average will be
-            # equal to the farthest point from the beam on the detector, in pixels, unless overridden at the command line
-            panel_res = [p.get_max_resolution_at_corners(s0) for p in detector]
-            farthest_panel = detector[panel_res.index(min(panel_res))]
-            size2, size1 = farthest_panel.get_image_size()
-            corners = [(0, 0), (size1 - 1, 0), (0, size2 - 1), (size1 - 1, size2 - 1)]
-            corners_lab = [col(farthest_panel.get_pixel_lab_coord(c)) for c in corners]
-            corner_two_thetas = [
-                farthest_panel.get_two_theta_at_pixel(s0, c) for c in corners
-            ]
-            extent_two_theta = max(corner_two_thetas)
-            max_corner = corners_lab[corner_two_thetas.index(extent_two_theta)]
-            extent = int(
-                math.ceil(
-                    max_corner.length()
-                    * math.sin(extent_two_theta)
-                    / max(farthest_panel.get_pixel_size())
-                )
-            )
-            extent_two_theta *= 180 / math.pi
 
-            if params.n_bins < extent:
-                params.n_bins = extent
-
-            # These arrays will store the radial average info
-            sums = flex.double(params.n_bins) * 0
-            sums_sq = flex.double(params.n_bins) * 0
-            counts = flex.int(params.n_bins) * 0
+            if integrator is None or not integrator.is_similar_to(beam, detector):
+                n_bins = max(params.n_bins, get_extent(beam, detector))
+                integrator = AzimuthalIntegrator(
+                    beam,
+                    detector,
+                    n_q_bins=n_bins,
+                    n_subdivide=params.n_subdivide,
+                    solid_angle=params.solid_angle_correction,
+                    polarization=params.polarization_correction,
+                )
 
             all_data = iset[image_number]
 
             if not isinstance(all_data, tuple):
                 all_data = (all_data,)
 
-            for tile, (panel, data) in enumerate(zip(detector, all_data)):
-                if params.panel is not None and tile != params.panel:
-                    continue
-
-                if params.mask is None:
-                    mask = flex.bool(flex.grid(data.focus()), True)
-                else:
-                    mask = params.mask[tile]
-
-                if hasattr(data, "as_double"):
-                    data = data.as_double()
-
-                logger.flush()
-                if params.verbose:
+            if params.verbose:
+                for tile, data in enumerate(all_data):
+                    if params.panel is not None and tile != params.panel:
+                        continue
+                    if hasattr(data, "as_double"):
+                        data = data.as_double()
                     logger.write(
                         "Average intensity tile %d: %9.3f\n" % (tile, flex.mean(data))
                     )
-                    logger.write("N bins: %d\n" % params.n_bins)
-                    logger.flush()
-
-                x1, y1, x2, y2 = (
-                    0,
-                    0,
-                    panel.get_image_size()[1],
-                    panel.get_image_size()[0],
+                logger.write("N bins: %d\n" % integrator.n_q_bins())
+                logger.flush()
+
+            if params.mask is None:
+                mask = tuple(
+                    flex.bool(flex.grid(data.focus()), True) for data in all_data
                 )
-                bc = panel.get_beam_centre_px(beam.get_s0())
-                bc = int(round(bc[1])), int(round(bc[0]))
-
-                # compute the average
-                radial_average(
-                    data,
-                    mask,
-                    bc,
-                    sums,
-                    sums_sq,
-                    counts,
-                    panel.get_pixel_size()[0],
-                    panel.get_distance(),
-                    (x1, y1),
-                    (x2, y2),
+            else:
+                mask = tuple(params.mask)
+            if params.panel is not None:
+                mask = tuple(
+                    m if tile == params.panel else flex.bool(m.accessor(), False)
+                    for tile, m in enumerate(mask)
                 )
 
-            # average the results, avoiding division by zero
-            results = sums.set_selected(counts <= 0, 0)
-            results /= counts.set_selected(counts <= 0, 1).as_double()
+            # compute the average
+            profile = integrator.integrate(all_data, mask)
+            results = profile.mean().as_1d()
 
             if params.median_filter_size is not None:
                 logger.write(
@@ -251,31 +247,18 @@ def run(args, imageset=None):
                 )
 
             # calculate standard devations
-            stddev_sel = ((sums_sq - sums * results) >= 0) & (counts > 0)
-            std_devs = flex.double(len(sums), 0)
-            std_devs.set_selected(
-                stddev_sel,
-                (
-                    sums_sq.select(stddev_sel)
-                    - sums.select(stddev_sel) * results.select(stddev_sel)
-                )
-                / counts.select(stddev_sel).as_double(),
-            )
-            std_devs = flex.sqrt(std_devs)
-
-            twotheta = (
-                flex.double(xrange(len(results))) * extent_two_theta / params.n_bins
-            )
-            q_vals = (
-                4 * math.pi * flex.sin(math.pi * twotheta / 360) / beam.get_wavelength()
-            )
-            # nlmbda = 2dsin(theta)
-            resolution = flex.double(len(twotheta), 0)
-            nonzero = twotheta > 0
+            std_devs = profile.standard_deviation().as_1d()
+
+            q_vals = integrator.q_centres()
+            wavelength = beam.get_wavelength()
+            twotheta = (360 / math.pi) * flex.asin(q_vals * wavelength / (4 * math.pi))
+            # d = 2 pi / q
+            resolution = flex.double(len(q_vals), 0)
+            nonzero = q_vals > 0
             resolution.set_selected(
                 nonzero,
-                beam.get_wavelength()
-                / (2 * flex.asin((math.pi / 180) * twotheta.select(nonzero) / 2)),
+                flex.double(nonzero.count(True), 2 * math.pi)
+                / q_vals.select(nonzero),
             )
 
             if params.low_max_two_theta_limit is None:
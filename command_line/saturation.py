@@ -3,32 +3,20 @@ from __future__ import absolute_import, division, print_function
 
 def saturation(image_file):
     from dxtbx import load
+    from dxtbx.imageset import ImageSetScanner
 
     i = load(image_file)
+    imageset = i.get_imageset([image_file])
+    table = ImageSetScanner(hit_threshold=0).scan(imageset, 0, 1)
+    panel_max = table.panel_raw_max()
     d = i.get_detector()
-    raw_data = i.get_raw_data()
-    if not isinstance(raw_data, tuple):
-        raw_data = (raw_data,)
+    s = max(
+        [panel_max[0, pid] / d[pid].get_trusted_range()[1] for pid in xrange(len(d))]
+    )
     if i.get_scan() is None:
-        return (
-            0,
-            max(
-                [
-                    max(raw_data[pid]) / d[pid].get_trusted_range()[1]
-                    for pid in xrange(len(d))
-                ]
-            ),
-        )
+        return 0, s
     else:
-        return (
-            i.get_scan().get_image_range()[0],
-            max(
-                [
-                    max(raw_data[pid]) / d[pid].get_trusted_range()[1]
-                    for pid in xrange(len(d))
-                ]
-            ),
-        )
+        return i.get_scan().get_image_range()[0], s
 
 
 if __name__ == "__main__":
@@ -1,11 +1,16 @@
 from __future__ import absolute_import, division, print_function
 
 import collections
+import hashlib
+import importlib
 import itertools
 import json
 import operator
+import os
+import sys
+import tempfile
 from math import floor, pi
-from os import listdir
+from os import listdir, stat
 from os.path import abspath, dirname, isdir, isfile, join, normpath, splitext
 
 import six.moves.cPickle as pickle
@@ -25,6 +30,7 @@ from dxtbx.sweep_filenames import (
     template_regex,
     template_string_number_index,
 )
+from libtbx import easy_mp
 from libtbx.utils import Sorry
 from scitbx import matrix
 
@@ -398,6 +404,206 @@ class FormatChecker(object):
             yield group_format, group_fnames
 
 
+def _read_file_models(format_class, filename, format_kwargs):
+    """ Read the beam, detector, goniometer and scan models from an image
+    file, using None for any that the format does not provide. """
+    fmt = format_class(filename, **format_kwargs)
+    models = []
+    for getter in (
+        fmt.get_beam,
+        fmt.get_detector,
+        fmt.get_goniometer,
+        fmt.get_scan,
+    ):
+        try:
+            models.append(getter())
+        except Exception:
+            models.append(None)
+    return tuple(models)
+
+
+def _format_class_name(format_class):
+    """ Get a name that uniquely identifies a format class. """
+    return "%s.%s" % (format_class.__module__, format_class.__name__)
+
+
+class _FormatClassLookup(dict):
+    """A dictionary of format classes by name which imports the format
+    modules on demand, holding None for classes that no longer exist."""
+
+    def __missing__(self, name):
+        Registry.setup_index()
+        module, _, class_name = name.rpartition(".")
+        try:
+            format_class = getattr(importlib.import_module(module), class_name)
+        except Exception:
+            format_class = None
+        self[name] = format_class
+        return format_class
+
+
+def _scan_file_metadata(args):
+    """Find the format class and read the models of a chunk of files. The
+    models are returned as dictionaries so that this can be used as the
+    worker function for a multiprocessing pool."""
+    filenames, format_kwargs = args
+    find_format = FormatChecker()
+    result = []
+    for filename in filenames:
+        fmt = find_format.find_format(filename)
+        if fmt is None:
+            result.append((filename, None, None))
+        elif fmt.ignore() or issubclass(fmt, FormatMultiImage):
+            result.append((filename, _format_class_name(fmt), None))
+        else:
+            models = _read_file_models(fmt, filename, format_kwargs)
+            models = tuple(None if m is None else m.to_dict() for m in models)
+            result.append((filename, _format_class_name(fmt), models))
+    return result
+
+
+def _copy_file_mode(filename, temp_filename):
+    """Give a temporary file the permissions of the file it will replace,
+    or the default for a new file, since mkstemp makes it private."""
+    if isfile(filename):
+        mode = stat(filename).st_mode & 0o777
+    else:
+        umask = os.umask(0)
+        os.umask(umask)
+        mode = 0o666 & ~umask
+    os.chmod(temp_filename, mode)
+
+
+def _replace_file(source, destination):
+    """Move a file over another in one step. os.replace is only available
+    from python 3.3; before that os.rename replaces the destination on
+    POSIX, but on Windows it must be removed first."""
+    if hasattr(os, "replace"):
+        os.replace(source, destination)
+    else:
+        if sys.platform == "win32" and isfile(destination):
+            os.remove(destination)
+        os.rename(source, destination)
+
+
+class FormatMetadataCache(object):
+    """A cache of the format class and the beam, detector, goniometer and
+    scan models of image files. Entries are keyed by the absolute path of
+    the file and the format keyword arguments used to read it, and are
+    only valid while its size and modification time are unchanged. Models
+    are stored once by the digest of their dictionary, so that files which
+    share a model share an entry. If a filename is given, the cache is
+    loaded from and saved to that file as JSON, which means that importing
+    the same files again does not need to open them."""
+
+    version = 1
+
+    def __init__(self, filename=None):
+        """ Load the cache if it exists. """
+        self._filename = filename
+        self._files = {}
+        self._models = {}
+        self._modified = False
+        if filename is not None and isfile(filename):
+            try:
+                with open(filename, "r") as infile:
+                    data = json.load(infile)
+                if data["version"] == FormatMetadataCache.version:
+                    self._files = data["files"]
+                    self._models = data["models"]
+            except Exception:
+                # A broken cache is simply rebuilt
+                self._files = {}
+                self._models = {}
+
+    @staticmethod
+    def _key(filename, format_kwargs=None):
+        """Get the key and the file size and modification time. The format
+        keyword arguments, if any, are added to the key in sorted order.
+        Raises TypeError if they cannot be written as JSON."""
+        filename = abspath(filename)
+        st = stat(filename)
+        key = filename
+        if format_kwargs:
+            key += "|" + json.dumps(format_kwargs, sort_keys=True)
+        return key, st.st_size, st.st_mtime
+
+    def get(self, filename, format_kwargs=None):
+        """Get the format class name and the model digests for a file read
+        with the given format keyword arguments, or None if the file is not
+        in the cache or has changed."""
+        try:
+            key, size, mtime = self._key(filename, format_kwargs)
+        except (OSError, TypeError):
+            return None
+        entry = self._files.get(key)
+        if entry is None or entry[0] != size or entry[1] != mtime:
+            return None
+        return entry[2], entry[3]
+
+    def set(self, filename, format_name, models, format_kwargs=None):
+        """Add a file read with the given format keyword arguments with its
+        format class name and model dictionaries, returning the model
+        digests. Files that cannot be found, or whose keyword arguments
+        cannot be written as JSON, are not added but their models are."""
+        digests = None
+        if models is not None:
+            digests = []
+            for model in models:
+                if model is None:
+                    digests.append(None)
+                    continue
+                string = json.dumps(model, sort_keys=True)
+                digest = hashlib.sha1(string.encode("utf-8")).hexdigest()
+                self._models[digest] = model
+                digests.append(digest)
+        try:
+            key, size, mtime = self._key(filename, format_kwargs)
+        except (OSError, TypeError):
+            return digests
+        self._files[key] = [size, mtime, format_name, digests]
+        self._modified = True
+        return digests
+
+    def model(self, digest):
+        """ Get a model dictionary from its digest. """
+        return self._models[digest]
+
+    def save(self):
+        """ Save the cache if it has a filename and has been modified. """
+        if self._filename is None or not self._modified:
+            return
+        used = set()
+        for entry in self._files.values():
+            if entry[3] is not None:
+                used.update(d for d in entry[3] if d is not None)
+        models = dict((d, m) for d, m in self._models.items() if d in used)
+
+        # Write to a temporary file next to the cache and move it into place,
+        # so that a crash or a concurrent reader never sees a partial file
+        directory = dirname(abspath(self._filename))
+        handle, temp_filename = tempfile.mkstemp(
+            dir=directory, prefix=".dxtbx_cache_", suffix=".tmp"
+        )
+        try:
+            with os.fdopen(handle, "w") as outfile:
+                json.dump(
+                    {
+                        "version": FormatMetadataCache.version,
+                        "files": self._files,
+                        "models": models,
+                    },
+                    outfile,
+                )
+            _copy_file_mode(self._filename, temp_filename)
+            _replace_file(temp_filename, self._filename)
+        except Exception:
+            if isfile(temp_filename):
+                os.remove(temp_filename)
+            raise
+        self._modified = False
+
+
 class DataBlockTemplateImporter(object):
     """ A class to import a datablock from a template. """
 
@@ -508,8 +714,12 @@ class DataBlockFilenameImporter(object):
         compare_goniometer=None,
         scan_tolerance=None,
         format_kwargs=None,
+        nproc=1,
+        format_cache=None,
     ):
-        """ Import the datablocks from the given filenames. """
+        """Import the datablocks from the given filenames. If nproc is
+        greater than one, the files are opened in parallel. The format cache
+        may be a FormatMetadataCache or the filename of one."""
         # Init the datablock list
         self.unhandled = []
         self.datablocks = []
@@ -524,8 +734,18 @@ class DataBlockFilenameImporter(object):
                 print("Added imageset to datablock %d" % (len(self.datablocks) - 1))
 
         # Iterate through groups of files by format class
-        find_format = FormatChecker(verbose=verbose)
-        for fmt, group in find_format.iter_groups(filenames):
+        if nproc > 1 or format_cache is not None:
+            if not isinstance(format_cache, FormatMetadataCache):
+                format_cache = FormatMetadataCache(format_cache)
+            groups = self._iter_groups_with_models(
+                filenames, format_cache, nproc, verbose, format_kwargs
+            )
+        else:
+            find_format = FormatChecker(verbose=verbose)
+            groups = (
+                (fmt, group, None) for fmt, group in find_format.iter_groups(filenames)
+            )
+        for fmt, group, models in groups:
             if fmt is None or fmt.ignore():
                 self.unhandled.extend(group)
             elif issubclass(fmt, FormatMultiImage):
@@ -545,6 +765,7 @@ class DataBlockFilenameImporter(object):
                     compare_goniometer,
                     scan_tolerance,
                     format_kwargs=format_kwargs,
+                    models=models,
                 )
                 for group, items in itertools.groupby(records, lambda r: r.group):
                     items = list(items)
@@ -553,6 +774,88 @@ class DataBlockFilenameImporter(object):
                     )
                     append_to_datablocks(imageset)
 
+        # Save any new entries in the cache
+        if format_cache is not None:
+            format_cache.save()
+
+    def _iter_groups_with_models(
+        self, filenames, cache, nproc, verbose=False, format_kwargs=None
+    ):
+        """Find the format class and read the models of all the files up
+        front, and yield groups of files by format class with the models of
+        each file. Files in the cache are not opened and the rest are read in
+        parallel. The models are only constructed when they differ from those
+        of the previous file, in which case the previous objects are used."""
+        if format_kwargs is None:
+            format_kwargs = {}
+        classes = _FormatClassLookup()
+
+        # Get the cached entries and read the metadata of the other files
+        entries = {}
+        missing = []
+        for filename in filenames:
+            entry = cache.get(filename, format_kwargs)
+            if entry is None or (entry[0] is not None and classes[entry[0]] is None):
+                missing.append(filename)
+            else:
+                entries[filename] = entry
+        if len(missing) > 0:
+            nproc = min(nproc, len(missing))
+            size = (len(missing) + nproc - 1) // nproc
+            chunks = [
+                (missing[i : i + size], format_kwargs)
+                for i in range(0, len(missing), size)
+            ]
+            if len(chunks) == 1:
+                results = [_scan_file_metadata(chunks[0])]
+            else:
+                results = easy_mp.parallel_map(
+                    func=_scan_file_metadata, iterable=chunks, processes=nproc
+                )
+            for result in results:
+                for filename, format_name, models in result:
+                    digests = cache.set(
+                        filename, format_name, models, format_kwargs
+                    )
+                    entries[filename] = (format_name, digests)
+
+        # Group the files by format, only constructing new models
+        factories = (BeamFactory, DetectorFactory, GoniometerFactory, ScanFactory)
+        last_digests = (None, None, None, None)
+        last_models = (None, None, None, None)
+        group_format = None
+        group_fnames = []
+        group_models = []
+        for filename in filenames:
+            format_name, digests = entries[filename]
+            fmt = None if format_name is None else classes[format_name]
+            models = None
+            if digests is not None:
+                models = []
+                for i, digest in enumerate(digests):
+                    if digest is None:
+                        models.append(None)
+                    elif factories[i] is not ScanFactory and digest == last_digests[i]:
+                        models.append(last_models[i])
+                    else:
+                        models.append(factories[i].from_dict(cache.model(digest)))
+                models = tuple(models)
+                last_digests = digests
+                last_models = models
+            if fmt == group_format:
+                group_fnames.append(filename)
+                group_models.append(models)
+            else:
+                if len(group_fnames) > 0:
+                    yield group_format, group_fnames, group_models
+                group_format = fmt
+                group_fnames = [filename]
+                group_models = [models]
+            if verbose and fmt is not None:
+                print("Using %s for %s" % (fmt.__name__, filename))
+        if len(group_fnames) > 0:
+            yield group_format, group_fnames, group_models
+
     def _extract_file_metadata(
         self,
         format_class,
@@ -562,8 +865,10 @@ class DataBlockFilenameImporter(object):
         compare_goniometer=None,
         scan_tolerance=None,
         format_kwargs=None,
+        models=None,
     ):
-        """ Extract the file meta data in order to sort them. """
+        """Extract the file meta data in order to sort them. If given, the
+        models of each file are used instead of reading them."""
         # If no comparison functions are set
         if compare_beam is None:
             compare_beam = operator.__eq__
@@ -598,28 +903,13 @@ class DataBlockFilenameImporter(object):
         # Loop through all the filenames
         records = []
         group = 0
-        for filename in filenames:
+        for i, filename in enumerate(filenames):
 
-            # Read the image
-            fmt = format_class(filename, **format_kwargs)
-
-            # Get the meta data from the format
-            try:
-                b = fmt.get_beam()
-            except Exception:
-                b = None
-            try:
-                d = fmt.get_detector()
-            except Exception:
-                d = None
-            try:
-                g = fmt.get_goniometer()
-            except Exception:
-                g = None
-            try:
-                s = fmt.get_scan()
-            except Exception:
-                s = None
+            # Read the meta data from the image
+            if models is None:
+                b, d, g, s = _read_file_models(format_class, filename, format_kwargs)
+            else:
+                b, d, g, s = models[i]
 
             # Get the template and index if possible
             if s is not None and abs(s.get_oscillation()[1]) > 0.0:
@@ -1049,8 +1339,12 @@ class DataBlockFactory(object):
         compare_goniometer=None,
         scan_tolerance=None,
         format_kwargs=None,
+        nproc=1,
+        format_cache=None,
     ):
-        """ Create a list of data blocks from a list of directory or file names. """
+        """Create a list of data blocks from a list of directory or file names.
+        The files are opened with nproc processes; a format cache (see
+        FormatMetadataCache) avoids opening files again on re-import."""
         filelist = []
         for f in sorted(filenames):
             if isfile(f):
@@ -1074,6 +1368,8 @@ class DataBlockFactory(object):
             compare_goniometer,
             scan_tolerance=scan_tolerance,
             format_kwargs=format_kwargs,
+            nproc=nproc,
+            format_cache=format_cache,
         )
         if unhandled is not None:
             unhandled.extend(importer.unhandled)
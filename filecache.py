@@ -42,6 +42,7 @@
 
 from __future__ import absolute_import, division, print_function
 import io
+import mmap
 import os
 from threading import Lock
 
@@ -176,6 +177,10 @@ class lazy_file_cache:
             self._all_cached = True
             self._close_file()
 
+    def cache_size(self):
+        """Return the number of bytes held in memory by this cache."""
+        return self._cache_size
+
     def _check_not_closed(self):
         if self._closed:
             self._debug("Instance tried to access closed cache")
@@ -340,6 +345,54 @@ class lazy_file_cache:
                 )
 
 
+class mmap_file_cache(lazy_file_cache):
+    """An object providing shared access to a memory mapped file. This has
+    the same interface as lazy_file_cache, but the operating system does the
+    caching, so there is no size limit and no memory is held by the cache
+    itself. The file object must be a plain local file."""
+
+    def __init__(self, file_object):
+        """Create a shared cache by memory mapping a file handle."""
+        self._file = file_object
+        self._file_lock = Lock()
+        self._cache_object = mmap.mmap(
+            file_object.fileno(), 0, access=mmap.ACCESS_READ
+        )
+        self._cache_size = len(self._cache_object)
+        self._all_cached = True
+        self._cache_limit_reached = False
+        self._closing = False
+        self._closed = False
+        self._reference_counter = 0
+        self._reference_counter_lock = Lock()
+
+    def cache_size(self):
+        """Return the number of bytes held in memory by this cache."""
+        return 0
+
+    def pass_read(self, start=0, maxbytes=None):
+        """Read from position start up to maxbytes bytes from file.
+        If maxbytes is not set, read the entire file."""
+        self._check_not_closed()
+        end = self._cache_size
+        if maxbytes is not None:
+            end = min(end, start + maxbytes)
+        data = self._cache_object[start:end]
+        return data, start + len(data)
+
+    def pass_readline(self, start=0, maxbytes=None):
+        """Read a line from file, but no more than maxbytes bytes."""
+        self._check_not_closed()
+        end = self._cache_size
+        if maxbytes is not None:
+            end = min(end, start + maxbytes)
+        newline = self._cache_object.find(b"\n", start, end)
+        if newline >= 0:
+            end = newline + 1
+        data = self._cache_object[start:end]
+        return data, start + len(data)
+
+
 class pseudo_file:
     """A file-like object that serves as frontend to a dxtbx lazy file cache."""
 
@@ -5,13 +5,20 @@
 #   This code is distributed under the BSD license, a copy of which is
 #   included in the root directory of this package.
 #
-# A simple cache controller. Caching only one file at a time.
+# Cache controllers, deciding which files are kept in a lazy file cache.
 
 from __future__ import absolute_import, division, print_function
+import collections
 import dxtbx.filecache
+import io
 import os
 import threading
 
+try:
+    _plain_file_types = (io.BufferedReader, file)
+except NameError:
+    _plain_file_types = (io.BufferedReader,)
+
 
 class simple_controller:
     """A simple cache controller. Caching one file at a time."""
@@ -77,6 +84,125 @@ class simple_controller:
             return self._cache.open()
 
 
+class lru_controller:
+    """A cache controller keeping many files cached at once. When the memory
+    held by the caches exceeds a budget, or too many files are cached, the
+    least recently used caches are dropped. Local files larger than a
+    threshold are memory mapped instead, which does not count towards the
+    budget. A cached file is dropped if its size or modification time has
+    changed. The budget is checked on each access, so it may be exceeded
+    by the reads made between two accesses."""
+
+    def __init__(
+        self, max_bytes=256 * 1024 * 1024, max_files=64, mmap_threshold=4 * 1024 * 1024
+    ):
+        """Create a controller with a memory budget in bytes, a maximum number
+        of files and the size above which local files are memory mapped (or
+        None to never memory map files)."""
+        self._max_bytes = max_bytes
+        self._max_files = max_files
+        self._mmap_threshold = mmap_threshold
+
+        # The caches and the file status when they were created, in order of
+        # last use
+        self._caches = collections.OrderedDict()
+
+        # Lock for concurrent access
+        self._lock = threading.Lock()
+
+        # Keep the current PID to detect the use of multiprocessing parallelization
+        # which breaks caching assumptions
+        self._pid = os.getpid()
+
+        self._hits = 0
+        self._misses = 0
+        self._evictions = 0
+
+    def __del__(self):
+        """Garbage collection. Tell all the caches to close as soon as
+        possible."""
+        if self._pid == os.getpid():
+            for cache, status in self._caches.values():
+                cache.close()
+
+    @staticmethod
+    def _status(tag):
+        """Get the size and modification time of a local file, or None."""
+        try:
+            st = os.stat(tag)
+        except Exception:
+            return None
+        return st.st_size, st.st_mtime
+
+    def _create(self, file_object):
+        """Create a cache for a file object, memory mapping it if it is a
+        large local file."""
+        if self._mmap_threshold is not None and isinstance(
+            file_object, _plain_file_types
+        ):
+            try:
+                size = os.fstat(file_object.fileno()).st_size
+                if size >= self._mmap_threshold:
+                    return dxtbx.filecache.mmap_file_cache(file_object)
+            except (EnvironmentError, ValueError):
+                pass
+        return dxtbx.filecache.lazy_file_cache(file_object)
+
+    def _evict(self):
+        """Drop the least recently used caches until within the budget. The
+        most recently used cache is always kept."""
+        total = sum(cache.cache_size() for cache, status in self._caches.values())
+        while len(self._caches) > 1 and (
+            total > self._max_bytes or len(self._caches) > self._max_files
+        ):
+            tag, (cache, status) = self._caches.popitem(last=False)
+            total -= cache.cache_size()
+            cache.close()
+            self._evictions += 1
+
+    def check(self, tag, open_method):
+        """The main cache controller access method. Checks if an object with name
+        "tag" is cached. If so, returns a (pseudo-, ie. cached) file handle to
+        this object.
+        Otherwise, create a cache first, using the passed open_method()
+        function, which returns a (true) file handle."""
+        with self._lock:
+            currentpid = os.getpid()
+            if currentpid != self._pid:
+                # Drop references to the caches of the parent process.
+                # NB: Explicitly do not close the caches in this case.
+                self._caches = collections.OrderedDict()
+                self._pid = currentpid
+
+            status = self._status(tag)
+            entry = self._caches.pop(tag, None)
+            if entry is not None and entry[1] != status:
+                entry[0].close()
+                entry = None
+            if entry is None:
+                self._misses += 1
+                entry = (self._create(open_method()), status)
+            else:
+                self._hits += 1
+            self._caches[tag] = entry
+            self._evict()
+            return entry[0].open()
+
+    def statistics(self):
+        """Return a dictionary with the number of cache hits, misses and
+        evictions, and the number of files and bytes currently cached."""
+        with self._lock:
+            return {
+                "hits": self._hits,
+                "misses": self._misses,
+                "evictions": self._evictions,
+                "files": len(self._caches),
+                "bytes": sum(
+                    cache.cache_size() for cache, status in self._caches.values()
+                ),
+            }
+
+
 class non_caching_controller:
     """A controller that does not do any caching."""
 
@@ -88,4 +214,4 @@ class non_caching_controller:
 
 
 # To disable all caching uncomment the following line:
-# simple_controller = non_caching_controller
+# simple_controller = lru_controller = non_caching_controller
@@ -7,7 +7,11 @@
 
 from __future__ import absolute_import, division, print_function
 
+import collections
+import os
 import sys
+import threading
+import weakref
 
 if sys.hexversion < 0x3040000:
     # try Python3.3 backport bz2 pypi module first.
@@ -71,13 +75,125 @@ class _MetaFormat(type):
             base._children.append(self)
         return
 
-    _cache_controller = dxtbx.filecache_controller.simple_controller()
+    _cache_controller = dxtbx.filecache_controller.lru_controller()
 
     @classmethod
     def get_cache_controller(cls):
         return cls._cache_controller
 
 
+def _freeze(value):
+    """ Convert dictionaries and lists to tuples so they can be hashed. """
+    if isinstance(value, dict):
+        return tuple(sorted((k, _freeze(v)) for k, v in value.items()))
+    if isinstance(value, (list, tuple)):
+        return tuple(_freeze(v) for v in value)
+    return value
+
+
+class FormatInstanceCache(object):
+    """A bounded, thread safe cache of format instances keyed by the format
+    class, filename and keyword arguments, dropping the least recently used
+    instance when full. The cache is emptied in a child process, since the
+    open file handles of an instance (e.g. to an HDF5 file) cannot be shared
+    across a fork."""
+
+    def __init__(self, max_size=16):
+        self._max_size = max_size
+        self._entries = collections.OrderedDict()
+        self._lock = threading.Lock()
+        self._pid = os.getpid()
+
+    def _check_pid(self):
+        """ Drop the instances of a parent process. Call with the lock held. """
+        if self._pid != os.getpid():
+            self._entries = collections.OrderedDict()
+            self._pid = os.getpid()
+
+    def get(self, format_class, filename, kwargs):
+        """Get a cached format instance, or create and cache a new one. The
+        instance is created without the lock held, so other threads are not
+        blocked while the file is read."""
+        try:
+            key = (format_class, filename, _freeze(kwargs))
+            hash(key)
+        except TypeError:
+            return format_class(filename, **kwargs)
+        with self._lock:
+            self._check_pid()
+            instance = self._entries.pop(key, None)
+            if instance is not None:
+                self._entries[key] = instance
+                return instance
+        instance = format_class(filename, **kwargs)
+        with self._lock:
+            self._check_pid()
+            self._entries[key] = instance
+            while len(self._entries) > self._max_size:
+                self._entries.popitem(last=False)
+        return instance
+
+    def find(self, format_class, filename):
+        """Get the most recently used instance of a format class for a file,
+        with any keyword arguments, or None."""
+        with self._lock:
+            self._check_pid()
+            for key in reversed(self._entries):
+                if key[0] is format_class and key[1] == filename:
+                    return self._entries[key]
+        return None
+
+    def clear(self, format_class=None, filename=None):
+        """Drop the instances of a format class and file, or all of them."""
+        with self._lock:
+            self._check_pid()
+            for key in list(self._entries):
+                if (format_class is None or key[0] is format_class) and (
+                    filename is None or key[1] == filename
+                ):
+                    del self._entries[key]
+
+
+class FormatInstanceHandle(object):
+    """A weak reference to the format instance last used by a reader or
+    masker, saving a lookup in the shared cache while the same file is read.
+    The handle does not keep the instance alive, so an instance dropped from
+    the bounded cache is released (along with any open files) once nothing
+    else uses it. The instance is not pickled and is dropped in a child
+    process."""
+
+    def __init__(self, format_class, kwargs):
+        self._format_class = format_class
+        self._kwargs = kwargs
+        self._state = None
+
+    def __getstate__(self):
+        return self._format_class, self._kwargs
+
+    def __setstate__(self, state):
+        self._format_class, self._kwargs = state
+        self._state = None
+
+    def get(self, filename):
+        """ Get the format instance for a file. """
+        instance = self.peek(filename)
+        if instance is None:
+            instance = self._format_class.get_instance(filename, **self._kwargs)
+            self._state = (os.getpid(), filename, weakref.ref(instance))
+        return instance
+
+    def peek(self, filename):
+        """ Get the format instance for a file if it is held, otherwise None. """
+        state = self._state
+        if state is None or state[0] != os.getpid() or state[1] != filename:
+            return None
+        return state[2]()
+
+    def reset(self):
+        """ Drop the format instance. """
+        self._state = None
+
+
 class Reader(object):
 
     _format_class_ = None
@@ -86,11 +202,10 @@ class Reader(object):
         self._kwargs = kwargs
         self.format_class = Reader._format_class_
         self._filenames = filenames
+        self._handle = FormatInstanceHandle(self.format_class, kwargs)
 
     def read(self, index):
-        format_instance = self.format_class.get_instance(
-            self._filenames[index], **self._kwargs
-        )
+        format_instance = self._handle.get(self._filenames[index])
         return format_instance.get_raw_data()
 
     def paths(self):
@@ -120,11 +235,10 @@ class Masker(object):
         self._kwargs = kwargs
         self.format_class = Masker._format_class_
         self._filenames = filenames
+        self._handle = FormatInstanceHandle(self.format_class, kwargs)
 
     def get(self, index, goniometer=None):
-        format_instance = self.format_class.get_instance(
-            self._filenames[index], **self._kwargs
-        )
+        format_instance = self._handle.get(self._filenames[index])
         return format_instance.get_mask(goniometer=goniometer)
 
     def has_dynamic_mask(self):
@@ -188,6 +302,13 @@ class Format(object):
     def __init__(self, image_file, **kwargs):
         """Initialize a class instance from an image file."""
 
+        self._initialise(image_file)
+
+        self.setup()
+
+    def _initialise(self, image_file):
+        """Set the image file and the model factories, with no models."""
+
         self._image_file = image_file
 
         self._goniometer_instance = None
@@ -200,8 +321,6 @@ class Format(object):
         self._beam_factory = BeamFactory
         self._scan_factory = ScanFactory
 
-        self.setup()
-
     def setup(self):
         """Read the image file, construct the information which we will be
         wanting about the experiment from this. N.B. in your implementation
@@ -303,17 +422,25 @@ class Format(object):
 
         return _detectorbase_proxy(self)
 
+    _instance_cache = FormatInstanceCache()
+
     @classmethod
     def get_instance(Class, filename, **kwargs):
-        if (
-            not hasattr(Class, "_current_instance_")
-            or Class._current_filename_ != filename
-            or Class._current_kwargs_ != kwargs
-        ):
-            Class._current_instance_ = Class(filename, **kwargs)
-            Class._current_filename_ = filename
-            Class._current_kwargs_ = kwargs
-        return Class._current_instance_
+        """Get an instance of the format class for a file from the shared
+        instance cache, creating it if necessary."""
+        return Format._instance_cache.get(Class, filename, kwargs)
+
+    @classmethod
+    def get_cached_instance(Class, filename):
+        """Get an instance of the format class for a file if one is in the
+        shared instance cache, otherwise None."""
+        return Format._instance_cache.find(Class, filename)
+
+    @classmethod
+    def clear_instance_cache(Class, filename=None):
+        """Drop the cached instances of the format class, for one file or
+        all of them."""
+        Format._instance_cache.clear(Class, filename)
 
     @classmethod
     def get_reader(Class):
@@ -424,7 +551,11 @@ class Format(object):
                 )
             )
 
-            # If any are None then read from format
+            # If any are None then read from format. The instance for the
+            # first file is reused, and models identical to those of the
+            # previous file are shared rather than kept as separate copies.
+            # Models are compared by all their serialised fields, since the
+            # model == operators allow a tolerance.
             if [beam, detector, goniometer, scan].count(None) != 0:
 
                 # Get list of models
@@ -432,11 +563,24 @@ class Format(object):
                 detector = []
                 goniometer = []
                 scan = []
-                for f in filenames:
-                    format_instance = Class(f, **format_kwargs)
-                    beam.append(format_instance.get_beam())
-                    detector.append(format_instance.get_detector())
-                    goniometer.append(format_instance.get_goniometer())
+                digests = [None, None, None]
+                for i, f in enumerate(filenames):
+                    if i > 0 or format_instance is None:
+                        format_instance = Class(f, **format_kwargs)
+                    for j, (models, model) in enumerate(
+                        (
+                            (beam, format_instance.get_beam()),
+                            (detector, format_instance.get_detector()),
+                            (goniometer, format_instance.get_goniometer()),
+                        )
+                    ):
+                        digest = None
+                        if model is not None:
+                            digest = _freeze(model.to_dict())
+                            if digest == digests[j]:
+                                model = models[-1]
+                        digests[j] = digest
+                        models.append(model)
                     scan.append(format_instance.get_scan())
 
             # Set the list of models
@@ -468,10 +612,11 @@ class Format(object):
                 goniometer = format_instance.get_goniometer()
             if scan is None and format_instance is not None:
                 scan = format_instance.get_scan()
-                if scan is not None:
+                if scan is not None and len(filenames) > 1:
+                    scans = [scan]
                     for f in filenames[1:]:
-                        format_instance = Class(f, **format_kwargs)
-                        scan += format_instance.get_scan()
+                        scans.append(Class.get_scan_from_file(f, **format_kwargs))
+                    scan = ScanFactory.add(scans)
 
             assert beam is not None, "Can't create Sweep without beam"
             assert detector is not None, "Can't create Sweep without detector"
@@ -497,6 +642,26 @@ class Format(object):
         # Return the imageset
         return iset
 
+    @classmethod
+    def get_scan_from_file(Class, image_file, **kwargs):
+        """Read the scan from an image file that this class is known to
+        understand. Where possible only the header is read and the other
+        models are not constructed; if the format needs more than that to
+        construct the scan, a full instance is created instead."""
+
+        if len(kwargs) == 0:
+            instance = Class.__new__(Class)
+            instance._initialise(image_file)
+            try:
+                instance._start()
+                try:
+                    return instance._scan()
+                finally:
+                    instance._end()
+            except Exception:
+                pass
+        return Class(image_file, **kwargs).get_scan()
+
     def get_image_file(self):
         """Get the image file provided to the constructor."""
 
@@ -1,15 +1,9 @@
 from __future__ import absolute_import, division, print_function
 
-try:
-    import bitshuffle
-except ImportError:
-    pass  # not available in conda
 import os
 import json
 import msgpack
-import numpy
 
-from scitbx.array_family import flex
 from dxtbx.format.Format import Format
 from dxtbx.model import Beam  # import dependency
 from dxtbx.model import Detector  # import dependency
@@ -101,39 +95,19 @@ class FormatEiger0MQDump(Format):
         return scan
 
     def get_raw_data(self):
+        from dxtbx.format.image import read_eiger_stream_frame
+
         nx = self._header["x_pixels_in_detector"]
         ny = self._header["y_pixels_in_detector"]
         depth = self._header["bit_depth_image"]
 
         assert self._header["pixel_mask_applied"] is True
+        assert depth in (16, 32)
 
-        if depth == 16:
-            dtype = numpy.uint16
-        elif depth == 32:
-            dtype = numpy.uint32
-        else:
-            dtype = 1 / 0
-
-        dt = numpy.dtype(dtype)
-
-        data = msgpack.unpackb(self.open_file(self._image_file).read(), raw=False)[2]
-
-        blob = numpy.fromstring(data[12:], dtype=numpy.uint8)
-        if dtype == numpy.uint32:
-            block = numpy.ndarray(shape=(), dtype=">u4", buffer=data[8:12]) / 4
-            image = bitshuffle.decompress_lz4(blob, (ny, nx), dt, block)
-        else:
-            image = bitshuffle.decompress_lz4(blob, (ny, nx), dt)
-
-        image = flex.int(image.astype("int32"))
-
-        # only need to overwrite values if read and used in 16-bit mode
-        if dtype == numpy.uint16:
-            bad = 2 ** 16 - 1
-            sel = image.as_1d() >= bad
-            image.as_1d().set_selected(sel, -1)
-
-        return image
+        # The frame is decoded directly into the image, with saturated
+        # values in 16-bit mode set to -1 as it is decoded
+        message = self.open_file(self._image_file).read()
+        return read_eiger_stream_frame(message, nx, ny, depth)
 
     def get_detectorbase(self, index=None):
         raise NotImplementedError
@@ -165,12 +165,15 @@ class FormatEigerStream(FormatMultiImage, Format):
 
         info = self.header["info"]
         data = injected_data["streamfile_3"]
-        if info["encoding"] == "lz4<":
+        if info["encoding"] in ("bs16-lz4<", "bs32-lz4<"):
+            # Decoded directly into the image, with saturated values set to -1
+            from dxtbx.format.image import decode_eiger_stream_frame
+
+            nx, ny = info["shape"]
+            depth = 8 * np.dtype(info["type"]).itemsize
+            return decode_eiger_stream_frame(data, nx, ny, depth)
+        elif info["encoding"] == "lz4<":
             data = self.readLZ4(data, info["shape"], info["type"], info["size"])
-        elif info["encoding"] == "bs16-lz4<":
-            data = self.readBS16LZ4(data, info["shape"], info["type"], info["size"])
-        elif info["encoding"] == "bs32-lz4<":
-            data = self.readBSLZ4(data, info["shape"], info["type"], info["size"])
         else:
             raise IOError("encoding %s is not implemented" % info["encoding"])
 
@@ -192,31 +195,6 @@ class FormatEigerStream(FormatMultiImage, Format):
     #   self.raw_data_cache = flex.int(data)
     #   return self.raw_data_cache
 
-    def readBSLZ4(self, data, shape, dtype, size):
-        """
-        Unpack bitshuffle-lz4 compressed frame and return np array image data
-        """
-        import numpy as np
-        import bitshuffle
-
-        blob = np.fromstring(data[12:], dtype=np.uint8)
-        # blocksize is big endian uint32 starting at byte 8, divided by element size
-        blocksize = np.ndarray(shape=(), dtype=">u4", buffer=data[8:12]) / 4
-        imgData = bitshuffle.decompress_lz4(
-            blob, shape[::-1], np.dtype(dtype), blocksize
-        )
-        return imgData
-
-    def readBS16LZ4(self, data, shape, dtype, size):
-        """
-        Unpack bitshuffle-lz4 compressed 16 bit frame and return np array image data
-        """
-        import bitshuffle
-        import numpy
-
-        blob = numpy.fromstring(data[12:], dtype=numpy.uint8)
-        return bitshuffle.decompress_lz4(blob, shape[::-1], numpy.dtype(dtype))
-
     def readLZ4(self, data, shape, dtype, size):
         """
         Unpack lz4 compressed frame and return np array image data
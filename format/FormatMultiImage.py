@@ -10,24 +10,27 @@ class Reader(object):
         self.format_class = Reader._format_class_
         assert len(filenames) == 1
         self._filename = filenames[0]
+        self._handle = FormatInstanceHandle(self.format_class, kwargs)
         if num_images is None:
             self._num_images = self.read_num_images()
         else:
             self._num_images = num_images
 
     def nullify_format_instance(self):
-        self.format_class._current_instance_ = None
-        self.format_class._current_filename_ = None
+        """Drop the format instance for the file, so it is opened again on
+        the next read."""
+        self._handle.reset()
+        self.format_class.clear_instance_cache(self._filename)
 
     def read(self, index):
-        format_instance = self.format_class.get_instance(self._filename, **self.kwargs)
+        format_instance = self._handle.get(self._filename)
         return format_instance.get_raw_data(index)
 
     def paths(self):
         return [self._filename]
 
     def read_num_images(self):
-        format_instance = self.format_class.get_instance(self._filename, **self.kwargs)
+        format_instance = self._handle.get(self._filename)
         return format_instance.get_num_images()
 
     def num_images(self):
@@ -58,20 +61,21 @@ class Masker(object):
         self.format_class = Masker._format_class_
         assert len(filenames) == 1
         self._filename = filenames[0]
+        self._handle = FormatInstanceHandle(self.format_class, kwargs)
         if num_images is None:
             self._num_images = self.read_num_images()
         else:
             self._num_images = num_images
 
     def get(self, index, goniometer=None):
-        format_instance = self.format_class.get_instance(self._filename, **self.kwargs)
+        format_instance = self._handle.get(self._filename)
         return format_instance.get_mask(index, goniometer)
 
     def paths(self):
         return [self._filename]
 
     def read_num_images(self):
-        format_instance = self.format_class.get_instance(self._filename, **self.kwargs)
+        format_instance = self._handle.get(self._filename)
         return format_instance.get_num_images()
 
     def num_images(self):
@@ -87,7 +91,7 @@ class Masker(object):
         return Masker(filenames)
 
 
-from dxtbx.format.Format import Format
+from dxtbx.format.Format import Format, FormatInstanceHandle
 
 
 class FormatMultiImage(Format):
@@ -4,10 +4,32 @@
 
 from __future__ import absolute_import, division, print_function
 
-from dxtbx.format.RegistryHelpers import LoadFormatClasses
+from dxtbx.format.RegistryHelpers import (
+    DefaultFormatIndexFile,
+    IndexFormatClasses,
+    LoadFormatClasses,
+    _LoadFormatModule,
+)
 from libtbx.utils import Sorry
 from .Format import Format
 
+# The leading bytes that a file must start with (after decompression) for
+# each of the root formats to understand it. Roots that are not listed are
+# always tried. Each entry must be a necessary condition of the understand
+# method of the format, as formats are skipped without being imported if
+# the file does not match.
+format_signatures = {
+    "FormatCBF": (b"###CBF",),
+    "FormatEDFALS733": (b"{\nHeaderID",),
+    "FormatHDF5": (b"\211HDF\r\n\032\n",),
+    "FormatPY": (b"(d", b"}q", b"\200\002}q"),
+    "FormatRAXIS": (b"RAXIS",),
+    "FormatRAXISII": (b"R-AXIS2",),
+    "FormatRAXISIVSPring8": (b"R-AXIS4",),
+    "FormatSMV": (b"{\nHEADER_BYTES=",),
+    "FormatTIFF": (b"II", b"MM"),
+}
+
 
 class SorryIOError(IOError, Sorry):
     """Fusion of Sorry and IO Errors.
@@ -41,6 +63,8 @@ class _Registry:
 
         self._setup = False
 
+        self._index = None
+
     def setup(self):
         """Look to import format defining modules from around the place -
         this will look in dxtbx/format and $HOME/.xia2/ for files starting
@@ -70,23 +94,96 @@ class _Registry:
 
         return tuple(self._formats)
 
+    def setup_index(self):
+        """Index the format classes without importing them, so that find
+        only needs to import the modules of formats that could understand
+        a file. Modules that cannot be indexed are imported now."""
+
+        if self._index is not None:
+            return
+
+        classes, unparsed = IndexFormatClasses(DefaultFormatIndexFile())
+        for name, fqname, path in unparsed:
+            _LoadFormatModule(name, fqname, path)
+
+        # Find the format classes, their children and the root formats
+        is_format = {"Format": True}
+
+        def check(name, visiting=()):
+            if name not in is_format:
+                if name not in classes or name in visiting:
+                    return False
+                is_format[name] = any(
+                    check(base, visiting + (name,)) for base in classes[name][3]
+                )
+            return is_format[name]
+
+        children = {}
+        roots = []
+        for name, (module, fqname, path, bases) in classes.items():
+            if not check(name):
+                continue
+            if "Format" in bases:
+                roots.append(name)
+            for base in bases:
+                children.setdefault(base, []).append(name)
+
+        self._index = classes
+        self._index_children = children
+        self._index_roots = roots
+
+    def _load(self, name):
+        """ Import a format class by name, returning None on failure. """
+
+        for format in self._formats:
+            if format.__name__ == name:
+                return format
+        module, fqname, path, bases = self._index[name]
+        module = _LoadFormatModule(module, fqname, path)
+        return getattr(module, name, None)
+
+    def _load_children(self, format):
+        """ Make sure that the child classes of a format are imported. """
+
+        for name in self._index_children.get(format.__name__, []):
+            self._load(name)
+
+    @staticmethod
+    def _read_signature(image_file):
+        """ Read the start of a file, or return None if it cannot be read. """
+
+        try:
+            return Format.open_file(image_file, "rb").read(64)
+        except Exception:
+            return None
+
     def find(self, image_file):
         """More useful - find the best format handler in the registry for your
-        image file. N.B. this is in principle a factory function."""
+        image file. N.B. this is in principle a factory function. Format
+        modules are only imported when the start of the file matches the
+        signature of the root format, or the format has no signature."""
 
-        self.setup()
+        self.setup_index()
 
         # Recursively check whether any of the children understand
         # image_file, in which case they are preferred over the parent
         # format.
         def recurse(format, image_file):
+            self._load_children(format)
             for child in sorted(format._children, key=lambda x: x.__name__):
                 if child.understand(image_file):
                     return recurse(child, image_file)
             return format
 
-        for format in sorted(self._formats, key=lambda x: x.__name__):
-            if format.understand(image_file):
+        signature = self._read_signature(image_file)
+        names = set(self._index_roots)
+        names.update(format.__name__ for format in self._formats)
+        for name in sorted(names):
+            if signature is not None and name in format_signatures:
+                if not any(signature.startswith(s) for s in format_signatures[name]):
+                    continue
+            format = self._load(name)
+            if format is not None and format.understand(image_file):
                 return recurse(format, image_file)
 
         # Try opening the file; this could be an easy reason for failure
@@ -2,16 +2,17 @@
 
 from __future__ import absolute_import, division, print_function
 
+import ast
+import json
 import os
 import sys
 import imp
 
 
-def LoadFormatClasses():
-    """Look for files named Format(something).py in the sensible
-    places (i.e. in the xia2 distribution and in the users home area)
-    and import the corresponding modules using their fully qualified
-    names."""
+def FormatModuleLocations():
+    """Find the files named Format(something).py in the sensible places
+    (i.e. in the dxtbx distribution and in the users home area) and return
+    a list of (name, fully qualified name, directory) for each module."""
 
     import dxtbx.format
 
@@ -26,20 +27,116 @@ def LoadFormatClasses():
     elif "HOME" in os.environ:
         home = os.environ["HOME"]
 
-    for f in os.listdir(format_dir):
+    locations = []
+    for f in sorted(os.listdir(format_dir)):
         if "Format" in f[:6] and ".py" in f[-3:]:
             name = f[:-3]
             fqname = dxtbx.format.__name__ + "." + name
-            _LoadFormatModule(name, fqname, format_dir)
+            locations.append((name, fqname, format_dir))
 
     format_dir = os.path.join(home, ".dxtbx")
     if os.path.exists(format_dir):
         if format_dir not in sys.path:
             sys.path.append(format_dir)
-        for f in os.listdir(format_dir):
+        for f in sorted(os.listdir(format_dir)):
             if "Format" in f[:6] and ".py" in f[-3:]:
                 name = f[:-3]
-                _LoadFormatModule(name, name, format_dir)
+                locations.append((name, name, format_dir))
+
+    return locations
+
+
+def LoadFormatClasses():
+    """Import all the format modules using their fully qualified names."""
+
+    for name, fqname, path in FormatModuleLocations():
+        _LoadFormatModule(name, fqname, path)
+
+
+def DefaultFormatIndexFile():
+    """Get the file in which the format class index is kept, or None if
+    there is no build directory to keep it in."""
+
+    try:
+        import libtbx.load_env
+
+        return libtbx.env.under_build(os.path.join("dxtbx", "format_index.json"))
+    except Exception:
+        return None
+
+
+def IndexFormatClasses(index_file=None):
+    """Find the classes defined in each format module without importing it,
+    by parsing the module source. Returns a tuple of a dictionary mapping
+    each class name to (name, fully qualified name, directory, base class
+    names) of its module, and a list of the locations of modules that could
+    not be parsed. The classes of each module are kept in the index file,
+    keyed by the module path, size and modification time, so a module is
+    only parsed again when it changes."""
+
+    index = {}
+    if index_file is not None and os.path.isfile(index_file):
+        try:
+            with open(index_file, "r") as infile:
+                index = json.load(infile)
+        except Exception:
+            index = {}
+
+    classes = {}
+    unparsed = []
+    modified = False
+    for name, fqname, path in FormatModuleLocations():
+        filename = os.path.join(path, name + ".py")
+        try:
+            st = os.stat(filename)
+        except OSError:
+            unparsed.append((name, fqname, path))
+            continue
+        entry = index.get(filename)
+        if entry is None or entry[0] != st.st_size or entry[1] != st.st_mtime:
+            entry = [st.st_size, st.st_mtime, _ParseFormatModule(filename)]
+            index[filename] = entry
+            modified = True
+        if entry[2] is None:
+            unparsed.append((name, fqname, path))
+            continue
+        for class_name, bases in entry[2]:
+            classes[class_name] = (name, fqname, path, bases)
+
+    if modified and index_file is not None:
+        try:
+            directory = os.path.dirname(index_file)
+            if not os.path.exists(directory):
+                os.makedirs(directory)
+            with open(index_file, "w") as outfile:
+                json.dump(index, outfile)
+        except Exception:
+            pass
+
+    return classes, unparsed
+
+
+def _ParseFormatModule(filename):
+    """Get a list of (class name, base class names) for the classes defined
+    at the top level of a module, or None if it cannot be parsed."""
+
+    try:
+        with open(filename, "r") as infile:
+            tree = ast.parse(infile.read(), filename)
+    except Exception:
+        return None
+
+    result = []
+    for node in tree.body:
+        if isinstance(node, ast.ClassDef):
+            bases = []
+            for base in node.bases:
+                if isinstance(base, ast.Name):
+                    bases.append(base.id)
+                elif isinstance(base, ast.Attribute):
+                    bases.append(base.attr)
+            result.append((node.name, bases))
+    return result
 
 
 def _LoadFormatModule(name, fqname, path):
@@ -0,0 +1,139 @@
+/*
+ * bit_image.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_BIT_IMAGE_H
+#define DXTBX_FORMAT_BIT_IMAGE_H
+
+#include <dxtbx/error.h>
+#include <dxtbx/format/image.h>
+#include <dxtbx/model/bit_tile.h>
+#include <scitbx/array_family/shared.h>
+
+namespace dxtbx { namespace format {
+
+  using model::BitTile;
+
+  /**
+   * A bit packed mask for all detector panels
+   */
+  class BitImage {
+  public:
+
+    typedef BitTile tile_type;
+
+    /**
+     * Construct empty
+     */
+    BitImage() {}
+
+    /**
+     * Construct with a single tile
+     */
+    BitImage(const BitTile &tile) {
+      tiles_.push_back(tile);
+    }
+
+    /**
+     * Pack a bool image
+     */
+    BitImage(const Image<bool> &image) {
+      for (std::size_t i = 0; i < image.n_tiles(); ++i) {
+        tiles_.push_back(BitTile(image.tile(i).data().const_ref()));
+      }
+    }
+
+    /**
+     * Add a tile
+     */
+    void push_back(const BitTile &tile) {
+      tiles_.push_back(tile);
+    }
+
+    /**
+     * Get an image tile
+     */
+    BitTile tile(std::size_t index) const {
+      DXTBX_ASSERT(index < n_tiles());
+      return tiles_[index];
+    }
+
+    /**
+     * Get the number of tiles
+     */
+    std::size_t n_tiles() const {
+      return tiles_.size();
+    }
+
+    /**
+     * Is the image empty
+     */
+    bool empty() const {
+      return tiles_.empty();
+    }
+
+    /**
+     * @returns The number of set pixels
+     */
+    std::size_t count() const {
+      std::size_t n = 0;
+      for (std::size_t i = 0; i < tiles_.size(); ++i) {
+        n += tiles_[i].count();
+      }
+      return n;
+    }
+
+    /**
+     * AND another image into this one
+     */
+    BitImage& operator&=(const BitImage &other) {
+      DXTBX_ASSERT(n_tiles() == other.n_tiles());
+      for (std::size_t i = 0; i < tiles_.size(); ++i) {
+        tiles_[i] &= other.tiles_[i];
+      }
+      return *this;
+    }
+
+    /**
+     * OR another image into this one
+     */
+    BitImage& operator|=(const BitImage &other) {
+      DXTBX_ASSERT(n_tiles() == other.n_tiles());
+      for (std::size_t i = 0; i < tiles_.size(); ++i) {
+        tiles_[i] |= other.tiles_[i];
+      }
+      return *this;
+    }
+
+    /**
+     * @returns A copy of the image with its own storage
+     */
+    BitImage deep_copy() const {
+      BitImage result;
+      for (std::size_t i = 0; i < tiles_.size(); ++i) {
+        result.push_back(tiles_[i].deep_copy());
+      }
+      return result;
+    }
+
+    /**
+     * Unpack into a bool image
+     */
+    Image<bool> as_image() const {
+      Image<bool> result;
+      for (std::size_t i = 0; i < tiles_.size(); ++i) {
+        result.push_back(ImageTile<bool>(tiles_[i].as_bool()));
+      }
+      return result;
+    }
+
+  protected:
+
+    scitbx::af::shared<BitTile> tiles_;
+  };
+
+}} // namespace dxtbx::format
+
+#endif // DXTBX_FORMAT_BIT_IMAGE_H
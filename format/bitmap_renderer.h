@@ -0,0 +1,602 @@
+/*
+ * bitmap_renderer.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_BITMAP_RENDERER_H
+#define DXTBX_FORMAT_BITMAP_RENDERER_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <limits>
+#include <fstream>
+#include <algorithm>
+#include <zlib.h>
+#include <boost/cstdint.hpp>
+#include <scitbx/vec2.h>
+#include <scitbx/vec3.h>
+#include <scitbx/mat3.h>
+#include <dxtbx/model/beam.h>
+#include <dxtbx/model/detector.h>
+#include <dxtbx/format/image.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace format {
+
+  using scitbx::vec2;
+  using scitbx::vec3;
+  using scitbx::mat3;
+  using model::BeamBase;
+  using model::Detector;
+
+  /**
+   * Write an 8 bit RGB PNG image a row at a time. The rows are compressed
+   * as they are written and emitted in IDAT chunks, so the full image is
+   * never held in memory.
+   */
+  class PngWriter {
+  public:
+
+    /**
+     * Write the PNG header
+     * @param stream The output stream (opened in binary mode)
+     * @param width The image width
+     * @param height The image height
+     * @param level The zlib compression level
+     */
+    PngWriter(std::ostream &stream,
+              std::size_t width,
+              std::size_t height,
+              int level)
+      : stream_(stream),
+        width_(width),
+        height_(height),
+        rows_(0),
+        buffer_(1 << 16),
+        row_(3 * width + 1, 0),
+        finished_(false) {
+      DXTBX_ASSERT(width > 0 && height > 0);
+      static const unsigned char signature[8] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+      };
+      stream_.write((const char *)signature, 8);
+      unsigned char header[13];
+      write_be32(&header[0], (boost::uint32_t)width);
+      write_be32(&header[4], (boost::uint32_t)height);
+      header[8] = 8;   // bit depth
+      header[9] = 2;   // RGB
+      header[10] = 0;  // deflate
+      header[11] = 0;  // adaptive filtering
+      header[12] = 0;  // no interlace
+      write_chunk("IHDR", header, 13);
+
+      zstream_.zalloc = Z_NULL;
+      zstream_.zfree = Z_NULL;
+      zstream_.opaque = Z_NULL;
+      if (deflateInit(&zstream_, level) != Z_OK) {
+        throw DXTBX_ERROR("Failed to initialise zlib");
+      }
+    }
+
+    ~PngWriter() {
+      deflateEnd(&zstream_);
+    }
+
+    /**
+     * Write a row of pixels
+     * @param rgb The 3 * width bytes of the row
+     */
+    void write_row(const unsigned char *rgb) {
+      DXTBX_ASSERT(rows_ < height_);
+      row_[0] = 0;  // no filter
+      std::copy(rgb, rgb + 3 * width_, row_.begin() + 1);
+      deflate_data(&row_[0], row_.size(), Z_NO_FLUSH);
+      rows_++;
+    }
+
+    /**
+     * Flush the compressed data and write the trailer
+     */
+    void finish() {
+      DXTBX_ASSERT(rows_ == height_);
+      DXTBX_ASSERT(!finished_);
+      deflate_data(NULL, 0, Z_FINISH);
+      write_chunk("IEND", NULL, 0);
+      finished_ = true;
+    }
+
+  protected:
+
+    static void write_be32(unsigned char *out, boost::uint32_t value) {
+      out[0] = (value >> 24) & 0xff;
+      out[1] = (value >> 16) & 0xff;
+      out[2] = (value >> 8) & 0xff;
+      out[3] = value & 0xff;
+    }
+
+    void write_chunk(const char *type, const unsigned char *data, std::size_t size) {
+      unsigned char word[4];
+      write_be32(word, (boost::uint32_t)size);
+      stream_.write((const char *)word, 4);
+      stream_.write(type, 4);
+      uLong crc = crc32(0L, (const Bytef *)type, 4);
+      if (size > 0) {
+        stream_.write((const char *)data, size);
+        crc = crc32(crc, (const Bytef *)data, (uInt)size);
+      }
+      write_be32(word, (boost::uint32_t)crc);
+      stream_.write((const char *)word, 4);
+    }
+
+    void deflate_data(const unsigned char *data, std::size_t size, int flush) {
+      zstream_.next_in = (Bytef *)data;
+      zstream_.avail_in = (uInt)size;
+      int status = Z_OK;
+      do {
+        zstream_.next_out = (Bytef *)&buffer_[0];
+        zstream_.avail_out = (uInt)buffer_.size();
+        status = deflate(&zstream_, flush);
+        DXTBX_ASSERT(status != Z_STREAM_ERROR);
+        std::size_t n = buffer_.size() - zstream_.avail_out;
+        if (n > 0) {
+          write_chunk("IDAT", &buffer_[0], n);
+        }
+      } while (zstream_.avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+    }
+
+    std::ostream &stream_;
+    std::size_t width_;
+    std::size_t height_;
+    std::size_t rows_;
+    std::vector<unsigned char> buffer_;
+    std::vector<unsigned char> row_;
+    bool finished_;
+    z_stream zstream_;
+  };
+
+  /**
+   * Render images as 8 bit RGB bitmaps.
+   *
+   * The pixels are first binned (averaged over binning x binning blocks).
+   * For a single panel the bitmap is the binned panel. For multiple panels
+   * each bitmap pixel is projected onto the detector along the ray from the
+   * sample, through a plane perpendicular to the beam, so the panels are
+   * assembled into a mosaic according to the detector geometry. The
+   * mapping from bitmap pixels to binned panel pixels is computed once and
+   * is then just a lookup for each frame.
+   *
+   * Pixel values are scaled so that, at a brightness of 1, four times the
+   * mean positive value of the frame is at the top of the colour map. Values
+   * at or above the trusted range of the panel are drawn at the top of the
+   * colour map.
+   */
+  class BitmapRenderer {
+  public:
+
+    enum ColourScheme {
+      Greyscale = 0,
+      Rainbow = 1,
+      Heatmap = 2,
+      InverseGreyscale = 3
+    };
+
+    /**
+     * Compute the mapping from bitmap pixels to panel pixels
+     * @param detector The detector model
+     * @param beam The beam model
+     * @param binning The binning (a power of 2)
+     * @param brightness The brightness
+     * @param colour_scheme The colour scheme
+     */
+    BitmapRenderer(
+        const Detector &detector,
+        const BeamBase &beam,
+        std::size_t binning,
+        double brightness,
+        int colour_scheme)
+      : binning_(binning),
+        brightness_(brightness),
+        colour_scheme_(colour_scheme) {
+      DXTBX_ASSERT(binning > 0 && (binning & (binning - 1)) == 0);
+      DXTBX_ASSERT(brightness >= 0);
+      DXTBX_ASSERT(colour_scheme >= Greyscale && colour_scheme <= InverseGreyscale);
+      DXTBX_ASSERT(detector.size() > 0);
+      for (std::size_t p = 0; p < detector.size(); ++p) {
+        std::size_t width = detector[p].get_image_size()[0];
+        std::size_t height = detector[p].get_image_size()[1];
+        image_size_.push_back(scitbx::af::tiny<std::size_t,2>(width, height));
+        binned_size_.push_back(scitbx::af::tiny<std::size_t,2>(
+              width / binning, height / binning));
+        scitbx::af::tiny<double,2> trusted_range = detector[p].get_trusted_range();
+        saturation_.push_back(trusted_range[1] > trusted_range[0]
+          ? trusted_range[1]
+          : std::numeric_limits<double>::infinity());
+      }
+      make_colour_map();
+      if (detector.size() == 1) {
+        make_single_panel_lookup();
+      } else {
+        make_mosaic_lookup(detector, beam);
+      }
+    }
+
+    /** @returns The bitmap width */
+    std::size_t width() const {
+      return width_;
+    }
+
+    /** @returns The bitmap height */
+    std::size_t height() const {
+      return height_;
+    }
+
+    /** @returns The binning */
+    std::size_t binning() const {
+      return binning_;
+    }
+
+    /** @returns The brightness */
+    double brightness() const {
+      return brightness_;
+    }
+
+    /** @returns The colour scheme */
+    int colour_scheme() const {
+      return colour_scheme_;
+    }
+
+    /**
+     * Render an image
+     * @param image The image
+     * @returns The RGB bytes of the bitmap, row by row
+     */
+    template <typename T>
+    std::string render(const Image<T> &image) const {
+      std::vector< std::vector<double> > binned = bin_tiles(tile_pointers(image));
+      double scale = compute_scale(binned);
+      std::string result(3 * width_ * height_, 0);
+      for (std::size_t j = 0; j < height_; ++j) {
+        render_row(binned, scale, j, (unsigned char *)&result[3 * width_ * j]);
+      }
+      return result;
+    }
+
+    /**
+     * Render an image and write it as a PNG file
+     * @param image The image
+     * @param filename The output filename
+     */
+    template <typename T>
+    void write_png(const Image<T> &image, const std::string &filename) const {
+      write_png_tiles(tile_pointers(image), filename);
+    }
+
+    /**
+     * Render many images and write them as PNG files. The images are
+     * rendered and encoded in parallel.
+     * @param images The images
+     * @param filenames The output filenames
+     */
+    template <typename T>
+    void write_png(
+        const std::vector< Image<T> > &images,
+        const std::vector<std::string> &filenames) const {
+      DXTBX_ASSERT(images.size() == filenames.size());
+
+      // Get the data pointers here so no arrays are shared between threads
+      std::vector< std::vector<const T*> > tiles;
+      for (std::size_t i = 0; i < images.size(); ++i) {
+        tiles.push_back(tile_pointers(images[i]));
+      }
+      int n = (int)images.size();
+      std::vector<std::string> errors(n);
+      #pragma omp parallel for
+      for (int i = 0; i < n; ++i) {
+        try {
+          write_png_tiles(tiles[i], filenames[i]);
+        } catch (std::exception const &e) {
+          errors[i] = e.what();
+        }
+      }
+      for (int i = 0; i < n; ++i) {
+        if (!errors[i].empty()) {
+          throw DXTBX_ERROR(errors[i]);
+        }
+      }
+    }
+
+  protected:
+
+    /**
+     * Check the image size and get the data of each tile
+     */
+    template <typename T>
+    std::vector<const T*> tile_pointers(const Image<T> &image) const {
+      DXTBX_ASSERT(image.n_tiles() == image_size_.size());
+      std::vector<const T*> result;
+      for (std::size_t p = 0; p < image.n_tiles(); ++p) {
+        DXTBX_ASSERT(image.tile(p).data().accessor()[0] == image_size_[p][1]);
+        DXTBX_ASSERT(image.tile(p).data().accessor()[1] == image_size_[p][0]);
+        result.push_back(image.tile(p).data().begin());
+      }
+      return result;
+    }
+
+    /**
+     * Render the tiles of an image to a PNG file
+     */
+    template <typename T>
+    void write_png_tiles(
+        const std::vector<const T*> &tiles,
+        const std::string &filename) const {
+      std::vector< std::vector<double> > binned = bin_tiles(tiles);
+      double scale = compute_scale(binned);
+      std::ofstream stream(filename.c_str(), std::ios::binary);
+      if (!stream) {
+        throw DXTBX_ERROR("Unable to open " + filename);
+      }
+      PngWriter writer(stream, width_, height_, Z_DEFAULT_COMPRESSION);
+      std::vector<unsigned char> row(3 * width_);
+      for (std::size_t j = 0; j < height_; ++j) {
+        render_row(binned, scale, j, &row[0]);
+        writer.write_row(&row[0]);
+      }
+      writer.finish();
+      if (!stream) {
+        throw DXTBX_ERROR("Error writing " + filename);
+      }
+    }
+
+    /**
+     * Average the pixels of each panel over binning x binning blocks.
+     * Pixels at or above the trusted range are flagged as infinite.
+     */
+    template <typename T>
+    std::vector< std::vector<double> > bin_tiles(
+        const std::vector<const T*> &tiles) const {
+      std::vector< std::vector<double> > result(tiles.size());
+      double n = (double)(binning_ * binning_);
+      for (std::size_t p = 0; p < tiles.size(); ++p) {
+        std::size_t width = image_size_[p][0];
+        std::size_t bwidth = binned_size_[p][0];
+        std::size_t bheight = binned_size_[p][1];
+        double saturation = saturation_[p];
+        std::vector<double> &binned = result[p];
+        binned.assign(bwidth * bheight, 0);
+        for (std::size_t j = 0; j < bheight * binning_; ++j) {
+          double *out = &binned[(j / binning_) * bwidth];
+          const T *in = &tiles[p][j * width];
+          for (std::size_t i = 0; i < bwidth * binning_; ++i) {
+            double value = in[i];
+            if (value >= saturation) {
+              value = std::numeric_limits<double>::infinity();
+            }
+            out[i / binning_] += value;
+          }
+        }
+        for (std::size_t i = 0; i < binned.size(); ++i) {
+          binned[i] /= n;
+        }
+      }
+      return result;
+    }
+
+    /**
+     * @returns The factor mapping pixel values to the colour map
+     */
+    double compute_scale(const std::vector< std::vector<double> > &binned) const {
+      double sum = 0;
+      std::size_t count = 0;
+      for (std::size_t p = 0; p < binned.size(); ++p) {
+        for (std::size_t i = 0; i < binned[p].size(); ++i) {
+          double value = binned[p][i];
+          if (value > 0 && value < std::numeric_limits<double>::infinity()) {
+            sum += value;
+            count++;
+          }
+        }
+      }
+      if (count == 0 || sum == 0) {
+        return 0;
+      }
+      return brightness_ * (colour_map_.size() / 3 - 1) / (4.0 * sum / count);
+    }
+
+    /**
+     * Render a row of the bitmap
+     */
+    void render_row(
+        const std::vector< std::vector<double> > &binned,
+        double scale,
+        std::size_t row,
+        unsigned char *rgb) const {
+      int top = (int)(colour_map_.size() / 3 - 1);
+      for (std::size_t i = 0; i < width_; ++i) {
+        std::size_t index = row * width_ + i;
+        int level = 0;
+        if (lookup_panel_[index] >= 0) {
+          double value = binned[lookup_panel_[index]][lookup_pixel_[index]];
+          if (value >= std::numeric_limits<double>::infinity()) {
+            level = top;
+          } else if (value > 0) {
+            level = (int)std::min(value * scale, (double)top);
+          }
+        }
+        rgb[3 * i + 0] = colour_map_[3 * level + 0];
+        rgb[3 * i + 1] = colour_map_[3 * level + 1];
+        rgb[3 * i + 2] = colour_map_[3 * level + 2];
+      }
+    }
+
+    /**
+     * Fill the 256 entry colour map for the colour scheme
+     */
+    void make_colour_map() {
+      colour_map_.resize(3 * 256);
+      for (std::size_t i = 0; i < 256; ++i) {
+        double f = i / 255.0;
+        double r = 0, g = 0, b = 0;
+        switch (colour_scheme_) {
+        case Greyscale:
+          r = g = b = 1.0 - f;
+          break;
+        case InverseGreyscale:
+          r = g = b = f;
+          break;
+        case Heatmap:
+          r = std::min(3.0 * f, 1.0);
+          g = std::min(std::max(3.0 * f - 1.0, 0.0), 1.0);
+          b = std::min(std::max(3.0 * f - 2.0, 0.0), 1.0);
+          break;
+        case Rainbow:
+          {
+            // Hue from blue (low) to red (high)
+            double h = 4.0 * (1.0 - f);
+            double x = 1.0 - std::abs(std::fmod(h, 2.0) - 1.0);
+            if (h < 1) {
+              r = 1; g = x;
+            } else if (h < 2) {
+              r = x; g = 1;
+            } else if (h < 3) {
+              g = 1; b = x;
+            } else {
+              g = x; b = 1;
+            }
+          }
+          break;
+        };
+        colour_map_[3 * i + 0] = (unsigned char)(255 * r + 0.5);
+        colour_map_[3 * i + 1] = (unsigned char)(255 * g + 0.5);
+        colour_map_[3 * i + 2] = (unsigned char)(255 * b + 0.5);
+      }
+    }
+
+    /**
+     * The bitmap is the binned panel
+     */
+    void make_single_panel_lookup() {
+      width_ = binned_size_[0][0];
+      height_ = binned_size_[0][1];
+      DXTBX_ASSERT(width_ > 0 && height_ > 0);
+      lookup_panel_.assign(width_ * height_, 0);
+      lookup_pixel_.resize(width_ * height_);
+      for (std::size_t i = 0; i < lookup_pixel_.size(); ++i) {
+        lookup_pixel_[i] = (int)i;
+      }
+    }
+
+    /**
+     * Project the panels onto a plane perpendicular to the beam, with the
+     * scale and in-plane orientation of the first panel, and find the
+     * binned panel pixel seen by each bitmap pixel.
+     */
+    void make_mosaic_lookup(const Detector &detector, const BeamBase &beam) {
+      vec3<double> z_axis = beam.get_s0().normalize();
+      vec3<double> fast = detector[0].get_fast_axis();
+      vec3<double> slow = detector[0].get_slow_axis();
+      vec3<double> x_axis = (fast - z_axis * (fast * z_axis)).normalize();
+      vec3<double> y_axis = (slow - z_axis * (slow * z_axis) - x_axis * (slow * x_axis));
+      if (y_axis.length() < 1e-6) {
+        y_axis = z_axis.cross(x_axis);
+      }
+      y_axis = y_axis.normalize();
+      double distance = std::abs(detector[0].get_distance());
+      DXTBX_ASSERT(distance > 0);
+      double pixel = detector[0].get_pixel_size()[0] * binning_;
+      double scale = distance / pixel;
+
+      // The bounding box of each panel on the bitmap plane
+      std::vector< scitbx::af::tiny<double,4> > bbox;
+      const double big = std::numeric_limits<double>::max();
+      double x0 = big, x1 = -big, y0 = big, y1 = -big;
+      for (std::size_t p = 0; p < detector.size(); ++p) {
+        double width = image_size_[p][0];
+        double height = image_size_[p][1];
+        scitbx::af::tiny<double,4> b(big, -big, big, -big);
+        bool visible = true;
+        for (std::size_t c = 0; c < 4; ++c) {
+          vec3<double> r = detector[p].get_pixel_lab_coord(
+              scitbx::af::tiny<double,2>((c & 1) ? width : 0, (c & 2) ? height : 0));
+          double rz = r * z_axis;
+          if (rz <= 0) {
+            visible = false;
+            break;
+          }
+          double u = scale * (r * x_axis) / rz;
+          double v = scale * (r * y_axis) / rz;
+          b[0] = std::min(b[0], u); b[1] = std::max(b[1], u);
+          b[2] = std::min(b[2], v); b[3] = std::max(b[3], v);
+        }
+        if (!visible) {
+          b = scitbx::af::tiny<double,4>(0, 0, 0, 0);
+        } else {
+          x0 = std::min(x0, b[0]); x1 = std::max(x1, b[1]);
+          y0 = std::min(y0, b[2]); y1 = std::max(y1, b[3]);
+        }
+        bbox.push_back(b);
+      }
+      DXTBX_ASSERT(x1 > x0 && y1 > y0);
+      x0 = std::floor(x0);
+      y0 = std::floor(y0);
+      width_ = (std::size_t)std::ceil(x1 - x0);
+      height_ = (std::size_t)std::ceil(y1 - y0);
+      lookup_panel_.assign(width_ * height_, -1);
+      lookup_pixel_.assign(width_ * height_, 0);
+
+      // Find the panel pixel behind each bitmap pixel
+      for (std::size_t p = 0; p < detector.size(); ++p) {
+        if (bbox[p][1] <= bbox[p][0]) {
+          continue;
+        }
+        mat3<double> D = detector[p].get_D_matrix();
+        std::size_t i0 = (std::size_t)std::max(std::floor(bbox[p][0] - x0), 0.0);
+        std::size_t i1 = std::min((std::size_t)std::ceil(bbox[p][1] - x0), width_);
+        std::size_t j0 = (std::size_t)std::max(std::floor(bbox[p][2] - y0), 0.0);
+        std::size_t j1 = std::min((std::size_t)std::ceil(bbox[p][3] - y0), height_);
+        for (std::size_t j = j0; j < j1; ++j) {
+          for (std::size_t i = i0; i < i1; ++i) {
+            std::size_t index = j * width_ + i;
+            if (lookup_panel_[index] >= 0) {
+              continue;
+            }
+            vec3<double> r = z_axis
+              + x_axis * ((x0 + i + 0.5) / scale)
+              + y_axis * ((y0 + j + 0.5) / scale);
+            vec3<double> v = D * r;
+            if (v[2] <= 0) {
+              continue;
+            }
+            vec2<double> xy = detector[p].millimeter_to_pixel(
+                vec2<double>(v[0] / v[2], v[1] / v[2]));
+            if (xy[0] < 0 || xy[1] < 0) {
+              continue;
+            }
+            std::size_t bx = (std::size_t)(xy[0] / binning_);
+            std::size_t by = (std::size_t)(xy[1] / binning_);
+            if (bx < binned_size_[p][0] && by < binned_size_[p][1]) {
+              lookup_panel_[index] = (int)p;
+              lookup_pixel_[index] = (int)(by * binned_size_[p][0] + bx);
+            }
+          }
+        }
+      }
+    }
+
+    std::size_t binning_;
+    double brightness_;
+    int colour_scheme_;
+    std::size_t width_;
+    std::size_t height_;
+    std::vector< scitbx::af::tiny<std::size_t,2> > image_size_;
+    std::vector< scitbx::af::tiny<std::size_t,2> > binned_size_;
+    std::vector<double> saturation_;
+    std::vector<unsigned char> colour_map_;
+    std::vector<int> lookup_panel_;
+    std::vector<int> lookup_pixel_;
+  };
+
+}} // namespace dxtbx::format
+
+#endif // DXTBX_FORMAT_BITMAP_RENDERER_H
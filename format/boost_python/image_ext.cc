@@ -17,11 +17,16 @@
 #include <scitbx/array_family/flex_types.h>
 #include <dxtbx/error.h>
 #include <dxtbx/format/image.h>
+#include <dxtbx/format/bit_image.h>
 #include <dxtbx/format/image_reader.h>
 #include <dxtbx/format/smv_reader.h>
 #include <dxtbx/format/tiff_reader.h>
 #include <dxtbx/format/cbf_reader.h>
 #include <dxtbx/format/hdf5_reader.h>
+#include <dxtbx/format/eiger_stream_reader.h>
+#include <dxtbx/format/stream_reader.h>
+#include <dxtbx/format/image_statistics.h>
+#include <dxtbx/format/bitmap_renderer.h>
 #include <vector>
 #include <hdf5.h>
 
@@ -30,6 +35,45 @@ namespace dxtbx { namespace format { namespace boost_python {
   using namespace boost::python;
 
 
+  /**
+   * Release the GIL for the lifetime of the object, while waiting for a
+   * stream without touching any python objects
+   */
+  class release_gil {
+  public:
+    release_gil() : state_(PyEval_SaveThread()) {}
+    ~release_gil() { PyEval_RestoreThread(state_); }
+  private:
+    PyThreadState *state_;
+  };
+
+  ImageBuffer StreamReader_image(const StreamReader &self, std::size_t index) {
+    release_gil nogil;
+    return self.image(index);
+  }
+
+  std::size_t StreamReader_poll(StreamReader &self) {
+    release_gil nogil;
+    return self.poll();
+  }
+
+  bool StreamReader_wait(StreamReader &self, double timeout) {
+    release_gil nogil;
+    return self.wait(timeout);
+  }
+
+#ifndef _WIN32
+  bool SharedMemoryStreamSink_send(
+      SharedMemoryStreamSink &self,
+      const std::string &type,
+      const std::string &data,
+      double timeout) {
+    DXTBX_ASSERT(type.size() == 1);
+    release_gil nogil;
+    return self.send(type[0], data, timeout);
+  }
+#endif
+
   template <typename ImageReaderType>
   void image_list_reader_suite(const char *name) {
 
@@ -49,6 +93,41 @@ namespace dxtbx { namespace format { namespace boost_python {
       ;
   }
 
+  /**
+   * Decode a bitshuffle-LZ4 Eiger stream frame to a flex int array
+   */
+  static
+  scitbx::af::flex_int decode_eiger_stream_frame_wrapper(
+      const std::string &data,
+      std::size_t nx,
+      std::size_t ny,
+      std::size_t bit_depth) {
+    scitbx::af::versa< int, scitbx::af::c_grid<2> > image =
+      decode_eiger_stream_frame(
+          (const unsigned char *)data.data(), data.size(), nx, ny, bit_depth);
+    return scitbx::af::flex_int(image.handle(), scitbx::af::flex_grid<>(ny, nx));
+  }
+
+  /**
+   * Decode the frame held in part of an Eiger stream message to a flex int
+   * array
+   */
+  static
+  scitbx::af::flex_int read_eiger_stream_frame(
+      const std::string &message,
+      std::size_t nx,
+      std::size_t ny,
+      std::size_t bit_depth,
+      std::size_t part) {
+    std::size_t first = 0;
+    std::size_t length = 0;
+    eiger_stream_detail::msgpack_array_item(
+        (const unsigned char *)message.data(), message.size(),
+        part, first, length);
+    return decode_eiger_stream_frame_wrapper(
+        message.substr(first, length), nx, ny, bit_depth);
+  }
+
   template <typename T>
   boost::shared_ptr< ImageTile<T> >
   make_image_tile(typename scitbx::af::flex<T>::type data) {
@@ -181,6 +260,302 @@ namespace dxtbx { namespace format { namespace boost_python {
   }
 
 
+  /**
+   * Get the tiles of an image given as a flex array or a tuple of flex
+   * arrays (one per panel)
+   */
+  boost::python::tuple image_tiles_from_object(boost::python::object data) {
+    if (boost::python::extract<scitbx::af::flex_int>(data).check() ||
+        boost::python::extract<scitbx::af::flex_double>(data).check()) {
+      return boost::python::make_tuple(data);
+    }
+    return boost::python::tuple(data);
+  }
+
+  /**
+   * Check if an Image, ImageBuffer, flex array or tuple of flex arrays
+   * holds int data
+   */
+  bool image_object_is_int(boost::python::object data) {
+    if (boost::python::extract< Image<int> >(data).check()) {
+      return true;
+    } else if (boost::python::extract< Image<double> >(data).check()) {
+      return false;
+    } else if (boost::python::extract<ImageBuffer>(data).check()) {
+      return boost::python::extract<ImageBuffer>(data)().is_int();
+    }
+    boost::python::tuple tiles = image_tiles_from_object(data);
+    bool is_int = true;
+    for (std::size_t i = 0; i < boost::python::len(tiles); ++i) {
+      is_int = is_int &&
+        boost::python::extract<scitbx::af::flex_int>(tiles[i]).check();
+    }
+    return is_int;
+  }
+
+  /**
+   * Get an int image from an Image, ImageBuffer, flex array or tuple of
+   * flex arrays for which image_object_is_int is true
+   */
+  Image<int> int_image_from_object(boost::python::object data) {
+    if (boost::python::extract< Image<int> >(data).check()) {
+      return boost::python::extract< Image<int> >(data)();
+    } else if (boost::python::extract<ImageBuffer>(data).check()) {
+      return boost::python::extract<ImageBuffer>(data)().as_int();
+    }
+    return *make_image_from_tuple<int>(image_tiles_from_object(data));
+  }
+
+  /**
+   * Get a double image from an Image, ImageBuffer, flex array or tuple of
+   * flex arrays. Int tiles are copied to double.
+   */
+  Image<double> double_image_from_object(boost::python::object data) {
+    typedef scitbx::af::versa<double, scitbx::af::c_grid<2> > double_array;
+    if (boost::python::extract< Image<double> >(data).check()) {
+      return boost::python::extract< Image<double> >(data)();
+    } else if (boost::python::extract<ImageBuffer>(data).check()) {
+      return boost::python::extract<ImageBuffer>(data)().as_double();
+    }
+    boost::python::tuple tiles = image_tiles_from_object(data);
+    Image<double> image;
+    for (std::size_t i = 0; i < boost::python::len(tiles); ++i) {
+      scitbx::af::flex_double a;
+      if (boost::python::extract<scitbx::af::flex_double>(tiles[i]).check()) {
+        a = boost::python::extract<scitbx::af::flex_double>(tiles[i])();
+      } else {
+        scitbx::af::flex_int b =
+          boost::python::extract<scitbx::af::flex_int>(tiles[i])();
+        a = scitbx::af::flex_double(b.accessor());
+        std::copy(b.begin(), b.end(), a.begin());
+      }
+      DXTBX_ASSERT(a.accessor().all().size() == 2);
+      image.push_back(ImageTile<double>(
+        double_array(a.handle(), scitbx::af::c_grid<2>(a.accessor()))));
+    }
+    return image;
+  }
+
+  /**
+   * Add an image to the statistics from an Image, ImageBuffer, a flex array
+   * or a tuple of flex arrays (one per panel)
+   */
+  void ImageStatistics_add(ImageStatistics &self, boost::python::object data) {
+    if (image_object_is_int(data)) {
+      self.add(int_image_from_object(data));
+    } else {
+      self.add(double_image_from_object(data));
+    }
+  }
+
+  /**
+   * Get the per pixel histograms of a panel as an array of (slow, fast,
+   * bin) counts
+   */
+  scitbx::af::flex_int ImageStatistics_histogram(
+      const ImageStatistics &self,
+      std::size_t panel) {
+    DXTBX_ASSERT(self.n_bins() > 0);
+    const ImageStatistics::Panel &p = self.panel(panel);
+    scitbx::af::flex_int result(
+        scitbx::af::flex_grid<>(p.height, p.width, self.n_bins()));
+    std::copy(p.histogram.begin(), p.histogram.end(), result.begin());
+    return result;
+  }
+
+  struct ImageStatisticsPickleSuite : boost::python::pickle_suite {
+
+    static
+    boost::python::tuple getinitargs(const ImageStatistics &obj) {
+      return boost::python::make_tuple(
+          obj.histogram_min(),
+          obj.histogram_max(),
+          obj.n_bins());
+    }
+
+    static
+    boost::python::tuple getstate(const ImageStatistics &obj) {
+      boost::python::list panels;
+      for (std::size_t i = 0; i < obj.n_panels(); ++i) {
+        const ImageStatistics::Panel &p = obj.panel(i);
+        panels.append(boost::python::make_tuple(
+            p.height, p.width, p.mean, p.m2, p.min, p.max, p.histogram));
+      }
+      return boost::python::make_tuple(obj.count(), panels);
+    }
+
+    static
+    void setstate(ImageStatistics &obj, boost::python::tuple state) {
+      DXTBX_ASSERT(boost::python::len(state) == 2);
+      boost::python::list panel_list =
+        boost::python::extract<boost::python::list>(state[1])();
+      scitbx::af::shared<ImageStatistics::Panel> panels;
+      for (std::size_t i = 0; i < boost::python::len(panel_list); ++i) {
+        boost::python::tuple item =
+          boost::python::extract<boost::python::tuple>(panel_list[i])();
+        ImageStatistics::Panel p;
+        p.height = boost::python::extract<std::size_t>(item[0])();
+        p.width = boost::python::extract<std::size_t>(item[1])();
+        p.mean = copy_array<double>(item[2]);
+        p.m2 = copy_array<double>(item[3]);
+        p.min = copy_array<double>(item[4]);
+        p.max = copy_array<double>(item[5]);
+        p.histogram = copy_array<int>(item[6]);
+        panels.push_back(p);
+      }
+      obj.set_state(boost::python::extract<std::size_t>(state[0])(), panels);
+    }
+
+    template <typename T>
+    static
+    scitbx::af::shared<T> copy_array(boost::python::object obj) {
+      typename scitbx::af::flex<T>::type a =
+        boost::python::extract<typename scitbx::af::flex<T>::type>(obj)();
+      return scitbx::af::shared<T>(a.begin(), a.end());
+    }
+
+  };
+
+  /**
+   * Render an image as RGB bytes
+   */
+  boost::python::object BitmapRenderer_render(
+      const BitmapRenderer &self,
+      boost::python::object image) {
+    std::string result = image_object_is_int(image)
+      ? self.render(int_image_from_object(image))
+      : self.render(double_image_from_object(image));
+    return boost::python::object(boost::python::handle<>(
+          PyBytes_FromStringAndSize(result.data(), result.size())));
+  }
+
+  /**
+   * Render an image to a PNG file
+   */
+  void BitmapRenderer_write_png(
+      const BitmapRenderer &self,
+      boost::python::object image,
+      const std::string &filename) {
+    if (image_object_is_int(image)) {
+      self.write_png(int_image_from_object(image), filename);
+    } else {
+      self.write_png(double_image_from_object(image), filename);
+    }
+  }
+
+  /**
+   * Render a list of images to PNG files in parallel
+   */
+  void BitmapRenderer_write_png_batch(
+      const BitmapRenderer &self,
+      boost::python::object images,
+      boost::python::object filenames) {
+    DXTBX_ASSERT(boost::python::len(images) == boost::python::len(filenames));
+    std::vector<std::string> names;
+    bool is_int = true;
+    for (std::size_t i = 0; i < boost::python::len(images); ++i) {
+      names.push_back(boost::python::extract<std::string>(filenames[i])());
+      is_int = is_int && image_object_is_int(images[i]);
+    }
+    if (is_int) {
+      std::vector< Image<int> > data;
+      for (std::size_t i = 0; i < boost::python::len(images); ++i) {
+        data.push_back(int_image_from_object(images[i]));
+      }
+      self.write_png(data, names);
+    } else {
+      std::vector< Image<double> > data;
+      for (std::size_t i = 0; i < boost::python::len(images); ++i) {
+        data.push_back(double_image_from_object(images[i]));
+      }
+      self.write_png(data, names);
+    }
+  }
+
+  boost::shared_ptr<BitTile> make_bit_tile(scitbx::af::flex_bool data) {
+    DXTBX_ASSERT(data.accessor().all().size() == 2);
+    return boost::make_shared<BitTile>(
+        scitbx::af::const_ref< bool, scitbx::af::c_grid<2> >(
+          data.begin(),
+          scitbx::af::c_grid<2>(data.accessor())));
+  }
+
+  boost::python::tuple bit_tile_accessor(const BitTile &self) {
+    return boost::python::make_tuple(self.accessor()[0], self.accessor()[1]);
+  }
+
+  BitTile& bit_tile_iand(BitTile &self, const BitTile &other) {
+    return self &= other;
+  }
+
+  BitTile& bit_tile_ior(BitTile &self, const BitTile &other) {
+    return self |= other;
+  }
+
+  BitImage& bit_image_iand(BitImage &self, const BitImage &other) {
+    return self &= other;
+  }
+
+  BitImage& bit_image_ior(BitImage &self, const BitImage &other) {
+    return self |= other;
+  }
+
+  struct BitTilePickleSuite : boost::python::pickle_suite {
+
+    static
+    boost::python::tuple getinitargs(const BitTile &obj) {
+      return boost::python::make_tuple(obj.as_bool());
+    }
+
+  };
+
+  struct BitImagePickleSuite : boost::python::pickle_suite {
+
+    static
+    boost::python::tuple getinitargs(const BitImage &obj) {
+      return boost::python::make_tuple(obj.as_image());
+    }
+
+  };
+
+  void bit_image_wrapper() {
+
+    class_<BitTile>("BitTile", no_init)
+      .def("__init__", make_constructor(&make_bit_tile))
+      .def("accessor", &bit_tile_accessor)
+      .def("words_per_row", &BitTile::words_per_row)
+      .def("empty", &BitTile::empty)
+      .def("get", &BitTile::get)
+      .def("set", &BitTile::set)
+      .def("fill", &BitTile::fill)
+      .def("count", &BitTile::count)
+      .def("invert", &BitTile::invert)
+      .def("deep_copy", &BitTile::deep_copy)
+      .def("as_bool", &BitTile::as_bool)
+      .def("__iand__", &bit_tile_iand, return_self<>())
+      .def("__ior__", &bit_tile_ior, return_self<>())
+      .def_pickle(BitTilePickleSuite())
+      ;
+
+    class_<BitImage>("BitImage")
+      .def(init<const BitTile&>())
+      .def(init<const Image<bool>&>())
+      .def("__getitem__", &BitImage::tile)
+      .def("tile", &BitImage::tile)
+      .def("n_tiles", &BitImage::n_tiles)
+      .def("empty", &BitImage::empty)
+      .def("append", &BitImage::push_back)
+      .def("count", &BitImage::count)
+      .def("deep_copy", &BitImage::deep_copy)
+      .def("as_image", &BitImage::as_image)
+      .def("__len__", &BitImage::n_tiles)
+      .def("__iand__", &bit_image_iand, return_self<>())
+      .def("__ior__", &bit_image_ior, return_self<>())
+      .def_pickle(BitImagePickleSuite())
+      ;
+  }
+
+
   BOOST_PYTHON_MODULE(dxtbx_format_image_ext)
   {
     image_tile_wrapper<bool>("ImageTileBool");
@@ -189,6 +564,7 @@ namespace dxtbx { namespace format { namespace boost_python {
     image_wrapper<bool>("ImageBool");
     image_wrapper<int>("ImageInt");
     image_wrapper<double>("ImageDouble");
+    bit_image_wrapper();
 
     class_<ImageBuffer>("ImageBuffer")
       .def(init< Image<int> >())
@@ -248,6 +624,161 @@ namespace dxtbx { namespace format { namespace boost_python {
       .def("__len__", &HDF5Reader::size)
       ;
 
+    class_<EigerStreamReader>("EigerStreamReader", no_init)
+      .def(init<const scitbx::af::const_ref<std::string>&,
+                std::size_t,
+                std::size_t,
+                std::size_t,
+                std::size_t>((
+                    arg("filenames"),
+                    arg("nx"),
+                    arg("ny"),
+                    arg("bit_depth"),
+                    arg("part") = 2)))
+      .def("filenames", &EigerStreamReader::filenames)
+      .def("image", &EigerStreamReader::image, (
+            arg("index")))
+      .def("decode_message", &EigerStreamReader::decode_message, (
+            arg("message")))
+      .def("__len__", &EigerStreamReader::size)
+      ;
+
+    class_<ImageStatistics>("ImageStatistics")
+      .def(init<double, double, std::size_t>((
+              arg("histogram_min"),
+              arg("histogram_max"),
+              arg("n_bins"))))
+      .def("add", &ImageStatistics_add, (
+            arg("image")))
+      .def("merge", &ImageStatistics::merge, (
+            arg("other")))
+      .def("count", &ImageStatistics::count)
+      .def("n_panels", &ImageStatistics::n_panels)
+      .def("histogram_min", &ImageStatistics::histogram_min)
+      .def("histogram_max", &ImageStatistics::histogram_max)
+      .def("n_bins", &ImageStatistics::n_bins)
+      .def("mean", &ImageStatistics::mean)
+      .def("variance", &ImageStatistics::variance)
+      .def("standard_deviation", &ImageStatistics::standard_deviation)
+      .def("min", &ImageStatistics::min)
+      .def("max", &ImageStatistics::max)
+      .def("histogram", &ImageStatistics_histogram, (
+            arg("panel")))
+      .def_pickle(ImageStatisticsPickleSuite())
+      ;
+
+    class_<BitmapRenderer>("BitmapRenderer", no_init)
+      .def(init<const model::Detector&,
+                const model::BeamBase&,
+                std::size_t,
+                double,
+                int>((
+              arg("detector"),
+              arg("beam"),
+              arg("binning")=1,
+              arg("brightness")=1.0,
+              arg("colour_scheme")=0)))
+      .def("width", &BitmapRenderer::width)
+      .def("height", &BitmapRenderer::height)
+      .def("binning", &BitmapRenderer::binning)
+      .def("brightness", &BitmapRenderer::brightness)
+      .def("colour_scheme", &BitmapRenderer::colour_scheme)
+      .def("render", &BitmapRenderer_render, (
+            arg("image")))
+      .def("write_png", &BitmapRenderer_write_png, (
+            arg("image"),
+            arg("filename")))
+      .def("write_png_batch", &BitmapRenderer_write_png_batch, (
+            arg("images"),
+            arg("filenames")))
+      ;
+
+    class_<StreamSource, boost::shared_ptr<StreamSource>, boost::noncopyable>(
+        "StreamSource", no_init)
+      ;
+
+#ifndef _WIN32
+    class_<SocketStreamSource,
+           boost::shared_ptr<SocketStreamSource>,
+           bases<StreamSource>,
+           boost::noncopyable>("SocketStreamSource", no_init)
+      .def(init<const std::string&>((
+              arg("path"))))
+      .def("path", &SocketStreamSource::path)
+      ;
+
+    class_<SharedMemoryStreamSource,
+           boost::shared_ptr<SharedMemoryStreamSource>,
+           bases<StreamSource>,
+           boost::noncopyable>("SharedMemoryStreamSource", no_init)
+      .def(init<const std::string&>((
+              arg("name"))))
+      .def("name", &SharedMemoryStreamSource::name)
+      .def("n_slots", &SharedMemoryStreamSource::n_slots)
+      ;
+
+    class_<SharedMemoryStreamSink, boost::noncopyable>(
+        "SharedMemoryStreamSink", no_init)
+      .def(init<const std::string&>((
+              arg("filename"))))
+      .def("name", &SharedMemoryStreamSink::name)
+      .def("n_slots", &SharedMemoryStreamSink::n_slots)
+      .def("slot_size", &SharedMemoryStreamSink::slot_size)
+      .def("send", &SharedMemoryStreamSink_send, (
+            arg("type"),
+            arg("data"),
+            arg("timeout") = -1.0))
+      ;
+
+    implicitly_convertible<
+      boost::shared_ptr<SocketStreamSource>,
+      boost::shared_ptr<StreamSource> >();
+    implicitly_convertible<
+      boost::shared_ptr<SharedMemoryStreamSource>,
+      boost::shared_ptr<StreamSource> >();
+#endif
+
+    class_<StreamReader>("StreamReader", no_init)
+      .def(init<boost::shared_ptr<StreamSource>,
+                std::size_t,
+                std::size_t,
+                double>((
+                    arg("source"),
+                    arg("num_images") = 0,
+                    arg("window") = 100,
+                    arg("timeout") = 30.0)))
+      .def("image", &StreamReader_image, (
+            arg("index")))
+      .def("poll", &StreamReader_poll)
+      .def("wait", &StreamReader_wait, (
+            arg("timeout")))
+      .def("set_size", &StreamReader::set_size, (
+            arg("num_images")))
+      .def("window", &StreamReader::window)
+      .def("n_held", &StreamReader::n_held)
+      .def("n_received", &StreamReader::n_received)
+      .def("finished", &StreamReader::finished)
+      .def("n_headers", &StreamReader::n_headers)
+      .def("header", &StreamReader::header, (
+            arg("index")))
+      .def("header_first_frame", &StreamReader::header_first_frame, (
+            arg("index")))
+      .def("__len__", &StreamReader::size)
+      ;
+
+    def("decode_eiger_stream_frame", &decode_eiger_stream_frame_wrapper, (
+          arg("data"),
+          arg("nx"),
+          arg("ny"),
+          arg("bit_depth")));
+
+    def("read_eiger_stream_frame", &read_eiger_stream_frame, (
+          arg("message"),
+          arg("nx"),
+          arg("ny"),
+          arg("bit_depth"),
+          arg("part") = 2));
+
     image_list_reader_suite<SMVReader>("SMVImageListReader");
     image_list_reader_suite<TIFFReader>("TIFFImageListReader");
     image_list_reader_suite<CBFFastReader>("CBFFastImageListReader");
@@ -0,0 +1,517 @@
+/*
+ * eiger_stream_reader.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_EIGER_STREAM_READER_H
+#define DXTBX_FORMAT_EIGER_STREAM_READER_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+#include <dxtbx/format/image.h>
+#include <dxtbx/format/image_reader.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace format {
+
+  namespace eiger_stream_detail {
+
+    /**
+     * Read a big endian 32 bit unsigned integer
+     */
+    inline
+    std::size_t read_be32(const unsigned char *p) {
+      return ((std::size_t)p[0] << 24) |
+             ((std::size_t)p[1] << 16) |
+             ((std::size_t)p[2] << 8) |
+             ((std::size_t)p[3]);
+    }
+
+    /**
+     * Read a big endian 64 bit unsigned integer
+     */
+    inline
+    std::size_t read_be64(const unsigned char *p) {
+      unsigned long long value = 0;
+      for (std::size_t i = 0; i < 8; ++i) {
+        value = (value << 8) | p[i];
+      }
+      return (std::size_t)value;
+    }
+
+    /**
+     * Read a big endian unsigned integer of n bytes from a msgpack buffer
+     */
+    inline
+    std::size_t msgpack_uint(
+        const unsigned char *data,
+        std::size_t size,
+        std::size_t pos,
+        std::size_t n) {
+      if (pos + n > size) {
+        throw DXTBX_ERROR("Truncated msgpack data");
+      }
+      std::size_t value = 0;
+      for (std::size_t i = 0; i < n; ++i) {
+        value = (value << 8) | data[pos + i];
+      }
+      return value;
+    }
+
+    /**
+     * Parse the header of the msgpack object at pos. On return, pos points
+     * to the start of the object payload, length is the number of payload
+     * bytes and children is the number of nested objects which follow.
+     * @returns True if the object is a string or binary blob
+     */
+    inline
+    bool msgpack_header(
+        const unsigned char *data,
+        std::size_t size,
+        std::size_t &pos,
+        std::size_t &length,
+        std::size_t &children) {
+      if (pos >= size) {
+        throw DXTBX_ERROR("Truncated msgpack data");
+      }
+      unsigned char code = data[pos++];
+      length = 0;
+      children = 0;
+      if (code <= 0x7f || code >= 0xe0) {
+        return false;
+      } else if (code <= 0x8f) {
+        children = 2 * (code & 0x0f);
+        return false;
+      } else if (code <= 0x9f) {
+        children = code & 0x0f;
+        return false;
+      } else if (code <= 0xbf) {
+        length = code & 0x1f;
+        return true;
+      }
+      switch (code) {
+      case 0xc0: case 0xc2: case 0xc3:
+        return false;
+      case 0xc4: case 0xd9:
+        length = msgpack_uint(data, size, pos, 1); pos += 1;
+        return true;
+      case 0xc5: case 0xda:
+        length = msgpack_uint(data, size, pos, 2); pos += 2;
+        return true;
+      case 0xc6: case 0xdb:
+        length = msgpack_uint(data, size, pos, 4); pos += 4;
+        return true;
+      case 0xc7:
+        length = msgpack_uint(data, size, pos, 1) + 1; pos += 1;
+        return false;
+      case 0xc8:
+        length = msgpack_uint(data, size, pos, 2) + 1; pos += 2;
+        return false;
+      case 0xc9:
+        length = msgpack_uint(data, size, pos, 4) + 1; pos += 4;
+        return false;
+      case 0xca: length = 4; return false;
+      case 0xcb: length = 8; return false;
+      case 0xcc: case 0xd0: length = 1; return false;
+      case 0xcd: case 0xd1: length = 2; return false;
+      case 0xce: case 0xd2: length = 4; return false;
+      case 0xcf: case 0xd3: length = 8; return false;
+      case 0xd4: length = 2; return false;
+      case 0xd5: length = 3; return false;
+      case 0xd6: length = 5; return false;
+      case 0xd7: length = 9; return false;
+      case 0xd8: length = 17; return false;
+      case 0xdc:
+        children = msgpack_uint(data, size, pos, 2); pos += 2;
+        return false;
+      case 0xdd:
+        children = msgpack_uint(data, size, pos, 4); pos += 4;
+        return false;
+      case 0xde:
+        children = 2 * msgpack_uint(data, size, pos, 2); pos += 2;
+        return false;
+      case 0xdf:
+        children = 2 * msgpack_uint(data, size, pos, 4); pos += 4;
+        return false;
+      default:
+        throw DXTBX_ERROR("Invalid msgpack type code");
+      };
+      return false;
+    }
+
+    /**
+     * Skip over the msgpack object at pos, including any nested objects
+     */
+    inline
+    void msgpack_skip(
+        const unsigned char *data,
+        std::size_t size,
+        std::size_t &pos) {
+      std::size_t remaining = 1;
+      while (remaining > 0) {
+        std::size_t length = 0;
+        std::size_t children = 0;
+        msgpack_header(data, size, pos, length, children);
+        if (length > size - pos) {
+          throw DXTBX_ERROR("Truncated msgpack data");
+        }
+        pos += length;
+        remaining += children;
+        remaining -= 1;
+      }
+    }
+
+    /**
+     * Find a string or binary item of a top level msgpack array without
+     * unpacking the rest of the message.
+     * @param data The message
+     * @param size The message size
+     * @param index The index of the item in the array
+     * @param first The offset of the item data
+     * @param length The number of bytes of item data
+     */
+    inline
+    void msgpack_array_item(
+        const unsigned char *data,
+        std::size_t size,
+        std::size_t index,
+        std::size_t &first,
+        std::size_t &length) {
+      if (size == 0 ||
+          ((data[0] & 0xf0) != 0x90 && data[0] != 0xdc && data[0] != 0xdd)) {
+        throw DXTBX_ERROR("Eiger stream message is not a msgpack array");
+      }
+      std::size_t pos = 0;
+      std::size_t children = 0;
+      msgpack_header(data, size, pos, length, children);
+      if (index >= children) {
+        throw DXTBX_ERROR("Eiger stream message has too few items");
+      }
+      for (std::size_t i = 0; i < index; ++i) {
+        msgpack_skip(data, size, pos);
+      }
+      std::size_t nested = 0;
+      if (!msgpack_header(data, size, pos, length, nested)) {
+        throw DXTBX_ERROR("Eiger stream frame is not a binary item");
+      }
+      if (length > size - pos) {
+        throw DXTBX_ERROR("Truncated msgpack data");
+      }
+      first = pos;
+    }
+
+    /**
+     * Decompress a raw LZ4 block
+     * @param src The compressed data
+     * @param src_size The number of compressed bytes
+     * @param dst The output buffer
+     * @param dst_size The expected number of output bytes
+     */
+    inline
+    void lz4_decompress_block(
+        const unsigned char *src,
+        std::size_t src_size,
+        unsigned char *dst,
+        std::size_t dst_size) {
+      const unsigned char *ip = src;
+      const unsigned char *ip_end = src + src_size;
+      unsigned char *op = dst;
+      unsigned char *op_end = dst + dst_size;
+      while (ip < ip_end) {
+
+        // Copy the literals
+        unsigned char token = *ip++;
+        std::size_t length = token >> 4;
+        if (length == 15) {
+          unsigned char s = 255;
+          while (s == 255) {
+            if (ip >= ip_end) {
+              throw DXTBX_ERROR("Corrupt LZ4 block");
+            }
+            s = *ip++;
+            length += s;
+          }
+        }
+        if (length > (std::size_t)(ip_end - ip) ||
+            length > (std::size_t)(op_end - op)) {
+          throw DXTBX_ERROR("Corrupt LZ4 block");
+        }
+        std::copy(ip, ip + length, op);
+        ip += length;
+        op += length;
+
+        // The last sequence has no match
+        if (ip == ip_end) {
+          break;
+        }
+
+        // Copy the match, which may overlap the output
+        if (ip_end - ip < 2) {
+          throw DXTBX_ERROR("Corrupt LZ4 block");
+        }
+        std::size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (std::size_t)(op - dst)) {
+          throw DXTBX_ERROR("Corrupt LZ4 block");
+        }
+        length = token & 0x0f;
+        if (length == 15) {
+          unsigned char s = 255;
+          while (s == 255) {
+            if (ip >= ip_end) {
+              throw DXTBX_ERROR("Corrupt LZ4 block");
+            }
+            s = *ip++;
+            length += s;
+          }
+        }
+        length += 4;
+        if (length > (std::size_t)(op_end - op)) {
+          throw DXTBX_ERROR("Corrupt LZ4 block");
+        }
+        const unsigned char *match = op - offset;
+        for (std::size_t i = 0; i < length; ++i) {
+          *op++ = *match++;
+        }
+      }
+      if (op != op_end) {
+        throw DXTBX_ERROR("LZ4 block has unexpected size");
+      }
+    }
+
+    /**
+     * Undo the bit shuffle of a block of n elements (n a multiple of 8) and
+     * write the values to the output, mapping the saturated value to -1.
+     * Bit k of byte j of element i is stored in bit i % 8 of byte i / 8 of
+     * row 8 * j + k.
+     */
+    inline
+    void bitunshuffle_block(
+        const unsigned char *src,
+        std::size_t n,
+        std::size_t elem_size,
+        std::vector<unsigned int> &buffer,
+        int *dst) {
+      std::size_t row_size = n / 8;
+      buffer.assign(n, 0);
+      unsigned int *value = &buffer[0];
+      for (std::size_t b = 0; b < 8 * elem_size; ++b) {
+        const unsigned char *row = src + b * row_size;
+        unsigned int bit = 1u << b;
+        for (std::size_t m = 0; m < row_size; ++m) {
+          unsigned char v = row[m];
+          if (v != 0) {
+            unsigned int *v8 = value + 8 * m;
+            for (std::size_t t = 0; t < 8; ++t) {
+              if (v & (1 << t)) {
+                v8[t] |= bit;
+              }
+            }
+          }
+        }
+      }
+      unsigned int saturated = elem_size == 2 ? 0xffffu : 0xffffffffu;
+      for (std::size_t i = 0; i < n; ++i) {
+        dst[i] = value[i] >= saturated ? -1 : (int)value[i];
+      }
+    }
+
+    /**
+     * Copy unshuffled little endian elements to the output, mapping the
+     * saturated value to -1
+     */
+    inline
+    void copy_elements(
+        const unsigned char *src,
+        std::size_t n,
+        std::size_t elem_size,
+        int *dst) {
+      unsigned int saturated = elem_size == 2 ? 0xffffu : 0xffffffffu;
+      for (std::size_t i = 0; i < n; ++i) {
+        unsigned int value = 0;
+        for (std::size_t j = 0; j < elem_size; ++j) {
+          value |= (unsigned int)src[i * elem_size + j] << (8 * j);
+        }
+        dst[i] = value >= saturated ? -1 : (int)value;
+      }
+    }
+
+  }
+
+  /**
+   * Decode an Eiger stream frame compressed with bitshuffle-LZ4 straight
+   * into an int image. The frame starts with a 12 byte header holding the
+   * big endian uncompressed size (u64) and block size in bytes (u32),
+   * followed by the blocks, each a big endian compressed size (u32) and a
+   * raw LZ4 block. Saturated pixels (0xffff for 16 bit data) are set to -1
+   * as they are decoded.
+   * @param data The frame data
+   * @param size The frame size
+   * @param nx The fast image dimension
+   * @param ny The slow image dimension
+   * @param bit_depth The bit depth of the image (16 or 32)
+   * @returns The image data
+   */
+  inline
+  scitbx::af::versa< int, scitbx::af::c_grid<2> > decode_eiger_stream_frame(
+      const unsigned char *data,
+      std::size_t size,
+      std::size_t nx,
+      std::size_t ny,
+      std::size_t bit_depth) {
+    using namespace eiger_stream_detail;
+    if (bit_depth != 16 && bit_depth != 32) {
+      throw DXTBX_ERROR("Eiger stream bit depth must be 16 or 32");
+    }
+    std::size_t elem_size = bit_depth / 8;
+    std::size_t nelem = nx * ny;
+    if (size < 12) {
+      throw DXTBX_ERROR("Truncated Eiger stream frame");
+    }
+    if (read_be64(data) != nelem * elem_size) {
+      throw DXTBX_ERROR("Eiger stream frame size does not match image size");
+    }
+
+    // The block size in elements; bitshuffle's default if not given
+    std::size_t block_size = read_be32(data + 8) / elem_size;
+    if (block_size == 0) {
+      block_size = std::max((std::size_t)128, ((8192 / elem_size) / 8) * 8);
+    }
+    if (block_size % 8 != 0) {
+      throw DXTBX_ERROR("Eiger stream block size is not a multiple of 8");
+    }
+
+    scitbx::af::versa< int, scitbx::af::c_grid<2> > result(
+        scitbx::af::c_grid<2>(ny, nx),
+        scitbx::af::init_functor_null<int>());
+    int *out = result.begin();
+    std::vector<unsigned char> shuffled(block_size * elem_size);
+    std::vector<unsigned int> buffer;
+    std::size_t pos = 12;
+    std::size_t done = 0;
+    std::size_t blocked = nelem - nelem % 8;
+    while (done < blocked) {
+      std::size_t n = std::min(block_size, blocked - done);
+      if (size - pos < 4) {
+        throw DXTBX_ERROR("Truncated Eiger stream frame");
+      }
+      std::size_t nbytes = read_be32(data + pos);
+      pos += 4;
+      if (nbytes > size - pos) {
+        throw DXTBX_ERROR("Truncated Eiger stream frame");
+      }
+      lz4_decompress_block(data + pos, nbytes, &shuffled[0], n * elem_size);
+      bitunshuffle_block(&shuffled[0], n, elem_size, buffer, out + done);
+      pos += nbytes;
+      done += n;
+    }
+
+    // Any elements left over are stored uncompressed
+    std::size_t leftover = nelem - done;
+    if (size - pos < leftover * elem_size) {
+      throw DXTBX_ERROR("Truncated Eiger stream frame");
+    }
+    copy_elements(data + pos, leftover, elem_size, out + done);
+    return result;
+  }
+
+  /**
+   * A class to read images from Eiger 0MQ stream dump files. Each file
+   * holds a msgpack array of the stream message parts with the frame data
+   * at the given index. Frames are decoded directly into int images.
+   */
+  class EigerStreamReader : public MultiImageReader {
+  public:
+
+    /**
+     * Initialise with the filenames
+     * @param filenames The frame filenames
+     * @param nx The fast image dimension
+     * @param ny The slow image dimension
+     * @param bit_depth The bit depth of the image (16 or 32)
+     * @param part The index of the frame data in the message
+     */
+    EigerStreamReader(
+        const scitbx::af::const_ref<std::string> &filenames,
+        std::size_t nx,
+        std::size_t ny,
+        std::size_t bit_depth,
+        std::size_t part)
+      : filenames_(filenames.begin(), filenames.end()),
+        nx_(nx),
+        ny_(ny),
+        bit_depth_(bit_depth),
+        part_(part) {
+      DXTBX_ASSERT(nx > 0 && ny > 0);
+      DXTBX_ASSERT(bit_depth == 16 || bit_depth == 32);
+    }
+
+    /**
+     * Return the filenames
+     */
+    scitbx::af::shared<std::string> filenames() const {
+      return filenames_;
+    }
+
+    /**
+     * Return the number of images
+     */
+    std::size_t size() const {
+      return filenames_.size();
+    }
+
+    /**
+     * Return the image
+     */
+    ImageBuffer image(std::size_t index) const {
+      DXTBX_ASSERT(index < filenames_.size());
+      std::ifstream handle(filenames_[index].c_str(), std::ifstream::binary);
+      if (!handle.is_open()) {
+        throw DXTBX_ERROR("Unable to open file " + filenames_[index]);
+      }
+      std::vector<char> buffer(
+          (std::istreambuf_iterator<char>(handle)),
+          std::istreambuf_iterator<char>());
+      return decode(buffer);
+    }
+
+    /**
+     * Decode an image from a stream message held in memory
+     */
+    ImageBuffer decode_message(const std::string &message) const {
+      return decode(std::vector<char>(message.begin(), message.end()));
+    }
+
+  protected:
+
+    ImageBuffer decode(const std::vector<char> &message) const {
+      if (message.empty()) {
+        throw DXTBX_ERROR("Empty Eiger stream message");
+      }
+      const unsigned char *data = (const unsigned char *)&message[0];
+      std::size_t first = 0;
+      std::size_t length = 0;
+      eiger_stream_detail::msgpack_array_item(
+          data, message.size(), part_, first, length);
+      return ImageBuffer(Image<int>(ImageTile<int>(
+          decode_eiger_stream_frame(
+            data + first, length, nx_, ny_, bit_depth_))));
+    }
+
+    scitbx::af::shared<std::string> filenames_;
+    std::size_t nx_;
+    std::size_t ny_;
+    std::size_t bit_depth_;
+    std::size_t part_;
+  };
+
+}} // namespace dxtbx::format
+
+#endif // DXTBX_FORMAT_EIGER_STREAM_READER_H
@@ -0,0 +1,328 @@
+/*
+ * image_statistics.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_IMAGE_STATISTICS_H
+#define DXTBX_FORMAT_IMAGE_STATISTICS_H
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+#include <dxtbx/format/image.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace format {
+
+  /**
+   * Accumulate per pixel statistics over a stream of images in a single
+   * pass. The mean and variance are updated with Welford's algorithm, so
+   * they stay accurate (and do not overflow) over very many images, and
+   * the minimum and maximum are tracked alongside. Optionally a histogram
+   * of values is kept for every pixel.
+   *
+   * Accumulators over different subsets of the images can be combined
+   * with merge (using the pairwise update of Chan et al.), so the images
+   * can be split over processes and the partial states reduced at the end.
+   * The update of each image is parallelised over pixels when OpenMP is
+   * available.
+   */
+  class ImageStatistics {
+  public:
+
+    /**
+     * The accumulated state for one panel. The histogram holds n_bins
+     * counts for each pixel in turn.
+     */
+    struct Panel {
+      std::size_t height;
+      std::size_t width;
+      scitbx::af::shared<double> mean;
+      scitbx::af::shared<double> m2;
+      scitbx::af::shared<double> min;
+      scitbx::af::shared<double> max;
+      scitbx::af::shared<int> histogram;
+    };
+
+    /**
+     * Initialise without histograms
+     */
+    ImageStatistics()
+      : count_(0),
+        histogram_min_(0),
+        histogram_max_(0),
+        n_bins_(0) {}
+
+    /**
+     * Initialise with per pixel histograms. Values outside the range are
+     * counted in the first or last bin.
+     * @param histogram_min The lower edge of the first bin
+     * @param histogram_max The upper edge of the last bin
+     * @param n_bins The number of bins
+     */
+    ImageStatistics(
+        double histogram_min,
+        double histogram_max,
+        std::size_t n_bins)
+      : count_(0),
+        histogram_min_(histogram_min),
+        histogram_max_(histogram_max),
+        n_bins_(n_bins) {
+      DXTBX_ASSERT(n_bins == 0 || histogram_max > histogram_min);
+    }
+
+    /** @returns The number of images accumulated */
+    std::size_t count() const {
+      return count_;
+    }
+
+    /** @returns The number of panels */
+    std::size_t n_panels() const {
+      return panels_.size();
+    }
+
+    /** @returns The lower edge of the histograms */
+    double histogram_min() const {
+      return histogram_min_;
+    }
+
+    /** @returns The upper edge of the histograms */
+    double histogram_max() const {
+      return histogram_max_;
+    }
+
+    /** @returns The number of histogram bins (0 for no histograms) */
+    std::size_t n_bins() const {
+      return n_bins_;
+    }
+
+    /**
+     * Add an image
+     * @param image The image
+     */
+    template <typename T>
+    void add(const Image<T> &image) {
+      if (count_ == 0) {
+        panels_.clear();
+        for (std::size_t i = 0; i < image.n_tiles(); ++i) {
+          panels_.push_back(make_panel(image.tile(i).data().accessor()));
+        }
+      }
+      DXTBX_ASSERT(image.n_tiles() == panels_.size());
+      for (std::size_t i = 0; i < image.n_tiles(); ++i) {
+        DXTBX_ASSERT(image.tile(i).data().accessor()[0] == panels_[i].height);
+        DXTBX_ASSERT(image.tile(i).data().accessor()[1] == panels_[i].width);
+      }
+      count_ += 1;
+      for (std::size_t i = 0; i < image.n_tiles(); ++i) {
+        add_tile(panels_[i], image.tile(i).data().const_ref().begin());
+      }
+    }
+
+    /**
+     * Add an image held in a buffer
+     * @param buffer The image buffer
+     */
+    void add(const ImageBuffer &buffer) {
+      if (buffer.is_int()) {
+        add(buffer.as_int());
+      } else if (buffer.is_double()) {
+        add(buffer.as_double());
+      } else {
+        throw DXTBX_ERROR("ImageBuffer is empty");
+      }
+    }
+
+    /**
+     * Merge the statistics accumulated over other images
+     * @param other The other accumulator
+     */
+    void merge(const ImageStatistics &other) {
+      DXTBX_ASSERT(other.n_bins_ == n_bins_);
+      DXTBX_ASSERT(other.histogram_min_ == histogram_min_);
+      DXTBX_ASSERT(other.histogram_max_ == histogram_max_);
+      if (other.count_ == 0) {
+        return;
+      }
+      if (count_ == 0) {
+        count_ = other.count_;
+        panels_.clear();
+        for (std::size_t i = 0; i < other.panels_.size(); ++i) {
+          panels_.push_back(copy_panel(other.panels_[i]));
+        }
+        return;
+      }
+      DXTBX_ASSERT(other.panels_.size() == panels_.size());
+      double na = count_;
+      double nb = other.count_;
+      double n = na + nb;
+      for (std::size_t p = 0; p < panels_.size(); ++p) {
+        Panel &a = panels_[p];
+        const Panel &b = other.panels_[p];
+        DXTBX_ASSERT(a.height == b.height && a.width == b.width);
+        int size = (int)a.mean.size();
+        #pragma omp parallel for
+        for (int i = 0; i < size; ++i) {
+          double d = b.mean[i] - a.mean[i];
+          a.mean[i] += d * (nb / n);
+          a.m2[i] += b.m2[i] + d * d * (na * nb / n);
+          a.min[i] = std::min(a.min[i], b.min[i]);
+          a.max[i] = std::max(a.max[i], b.max[i]);
+        }
+        for (std::size_t i = 0; i < a.histogram.size(); ++i) {
+          a.histogram[i] += b.histogram[i];
+        }
+      }
+      count_ += other.count_;
+    }
+
+    /** @returns The mean image */
+    Image<double> mean() const {
+      return make_image(&Panel::mean);
+    }
+
+    /** @returns The sample variance image (n - 1 in the denominator) */
+    Image<double> variance() const {
+      return make_variance_image(false);
+    }
+
+    /** @returns The sample standard deviation image */
+    Image<double> standard_deviation() const {
+      return make_variance_image(true);
+    }
+
+    /** @returns The minimum image */
+    Image<double> min() const {
+      return make_image(&Panel::min);
+    }
+
+    /** @returns The maximum image */
+    Image<double> max() const {
+      return make_image(&Panel::max);
+    }
+
+    /** @returns The accumulated state of a panel */
+    const Panel& panel(std::size_t index) const {
+      DXTBX_ASSERT(index < panels_.size());
+      return panels_[index];
+    }
+
+    /**
+     * Restore an accumulated state, e.g. after pickling
+     * @param count The number of images
+     * @param panels The state of each panel
+     */
+    void set_state(std::size_t count, const scitbx::af::shared<Panel> &panels) {
+      for (std::size_t i = 0; i < panels.size(); ++i) {
+        std::size_t size = panels[i].height * panels[i].width;
+        DXTBX_ASSERT(panels[i].mean.size() == size);
+        DXTBX_ASSERT(panels[i].m2.size() == size);
+        DXTBX_ASSERT(panels[i].min.size() == size);
+        DXTBX_ASSERT(panels[i].max.size() == size);
+        DXTBX_ASSERT(panels[i].histogram.size() == size * n_bins_);
+      }
+      count_ = count;
+      panels_ = panels;
+    }
+
+  protected:
+
+    Panel make_panel(const scitbx::af::c_grid<2> &grid) const {
+      Panel panel;
+      panel.height = grid[0];
+      panel.width = grid[1];
+      std::size_t size = panel.height * panel.width;
+      panel.mean.resize(size, 0);
+      panel.m2.resize(size, 0);
+      panel.min.resize(size, std::numeric_limits<double>::max());
+      panel.max.resize(size, -std::numeric_limits<double>::max());
+      panel.histogram.resize(size * n_bins_, 0);
+      return panel;
+    }
+
+    static Panel copy_panel(const Panel &other) {
+      Panel panel;
+      panel.height = other.height;
+      panel.width = other.width;
+      panel.mean = other.mean.deep_copy();
+      panel.m2 = other.m2.deep_copy();
+      panel.min = other.min.deep_copy();
+      panel.max = other.max.deep_copy();
+      panel.histogram = other.histogram.deep_copy();
+      return panel;
+    }
+
+    /**
+     * Update the panel state with a tile, count_ already including it
+     */
+    template <typename T>
+    void add_tile(Panel &panel, const T *data) {
+      double n = count_;
+      double scale = n_bins_ > 0 ? n_bins_ / (histogram_max_ - histogram_min_) : 0;
+      int n_bins = (int)n_bins_;
+      int size = (int)panel.mean.size();
+      #pragma omp parallel for
+      for (int i = 0; i < size; ++i) {
+        double x = data[i];
+        double d = x - panel.mean[i];
+        panel.mean[i] += d / n;
+        panel.m2[i] += d * (x - panel.mean[i]);
+        if (x < panel.min[i]) panel.min[i] = x;
+        if (x > panel.max[i]) panel.max[i] = x;
+        if (n_bins > 0) {
+          int bin = (int)std::floor((x - histogram_min_) * scale);
+          bin = std::min(std::max(bin, 0), n_bins - 1);
+          panel.histogram[i * n_bins + bin] += 1;
+        }
+      }
+    }
+
+    /**
+     * Build an image from a panel array
+     */
+    Image<double> make_image(scitbx::af::shared<double> Panel::*array) const {
+      Image<double> result;
+      for (std::size_t p = 0; p < panels_.size(); ++p) {
+        const scitbx::af::shared<double> &source = panels_[p].*array;
+        scitbx::af::versa< double, scitbx::af::c_grid<2> > data(
+            scitbx::af::c_grid<2>(panels_[p].height, panels_[p].width));
+        std::copy(source.begin(), source.end(), data.begin());
+        result.push_back(ImageTile<double>(data));
+      }
+      return result;
+    }
+
+    /**
+     * Build the variance or standard deviation image
+     */
+    Image<double> make_variance_image(bool standard_deviation) const {
+      DXTBX_ASSERT(count_ > 0);
+      double scale = 1.0 / std::max((std::size_t)1, count_ - 1);
+      Image<double> result = make_image(&Panel::m2);
+      for (std::size_t p = 0; p < result.n_tiles(); ++p) {
+        scitbx::af::versa< double, scitbx::af::c_grid<2> > data =
+          result.tile(p).data();
+        for (std::size_t i = 0; i < data.size(); ++i) {
+          data[i] = std::max(data[i], 0.0) * scale;
+          if (standard_deviation) {
+            data[i] = std::sqrt(data[i]);
+          }
+        }
+      }
+      return result;
+    }
+
+    std::size_t count_;
+    double histogram_min_;
+    double histogram_max_;
+    std::size_t n_bins_;
+    scitbx::af::shared<Panel> panels_;
+  };
+
+}} // namespace dxtbx::format
+
+#endif // DXTBX_FORMAT_IMAGE_STATISTICS_H
@@ -0,0 +1,132 @@
+from __future__ import absolute_import, division, print_function
+
+# Producers for the live detector streams read by dxtbx.format.image.StreamReader.
+#
+# A stream is a sequence of messages, each a one byte type and a payload:
+#
+#   "H" header: JSON with "nimages" and the dxtbx models as dictionaries
+#       ("beam", "detector", "goniometer", "scan"), applying to the frames
+#       which follow it
+#   "F" frame: u64 index, u32 nx, u32 ny, u32 encoding, image data
+#   "E" end of stream
+#
+# Messages are sent either over a local (unix domain) stream socket, as the
+# type byte, a u64 payload size and the payload, or through a ring buffer in
+# POSIX shared memory, laid out and synchronised as described for
+# SharedMemoryRing in format/stream_reader.h. All integers are little endian.
+
+import json
+import os
+import socket
+import struct
+
+HEADER = b"H"
+FRAME = b"F"
+END = b"E"
+
+# Frame encodings
+INT32 = 0
+UINT16 = 1
+BSLZ4_UINT16 = 2
+BSLZ4_UINT32 = 3
+
+RING_MAGIC = b"DXTBXRNG"
+RING_HEADER_SIZE = 64
+
+
+def header_message(nimages, beam=None, detector=None, goniometer=None, scan=None):
+    """Encode a header message from the models of the frames which follow."""
+    header = {"nimages": nimages}
+    for name, model in (
+        ("beam", beam),
+        ("detector", detector),
+        ("goniometer", goniometer),
+        ("scan", scan),
+    ):
+        if model is not None:
+            header[name] = model if isinstance(model, dict) else model.to_dict()
+    return HEADER, json.dumps(header).encode("utf-8")
+
+
+def frame_message(index, nx, ny, data, encoding=INT32):
+    """Encode a frame message. data is the encoded image as bytes, or a
+    sequence of values for the uncompressed encodings."""
+    if not isinstance(data, bytes):
+        fmt = {INT32: "i", UINT16: "H"}[encoding]
+        data = struct.pack("<%d%s" % (len(data), fmt), *data)
+    return FRAME, struct.pack("<QIII", index, nx, ny, encoding) + data
+
+
+def end_message():
+    """Encode an end of stream message."""
+    return END, b""
+
+
+class SocketStreamProducer(object):
+    """Serve stream messages to a single consumer over a unix domain socket.
+    Sends block while the consumer is not reading, once the socket buffer is
+    full."""
+
+    def __init__(self, path):
+        if os.path.exists(path):
+            os.remove(path)
+        self._path = path
+        self._server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self._server.bind(path)
+        self._server.listen(1)
+        self._connection = None
+
+    def accept(self, timeout=None):
+        """Wait for the consumer to connect."""
+        self._server.settimeout(timeout)
+        self._connection, _ = self._server.accept()
+        self._connection.settimeout(None)
+
+    def send(self, message):
+        if self._connection is None:
+            self.accept()
+        kind, payload = message
+        self._connection.sendall(kind + struct.pack("<Q", len(payload)) + payload)
+
+    def close(self):
+        if self._connection is not None:
+            self._connection.close()
+        self._server.close()
+        if os.path.exists(self._path):
+            os.remove(self._path)
+
+
+class SharedMemoryStreamProducer(object):
+    """Write stream messages to a ring buffer in POSIX shared memory. Sends
+    wait while all the slots in the ring hold messages not yet read. The
+    slots are written and published by a
+    dxtbx.format.image.SharedMemoryStreamSink, which orders the writes as
+    the consumer expects."""
+
+    def __init__(self, name, n_slots=16, slot_size=1 << 22, shm_dir="/dev/shm"):
+        from dxtbx.format.image import SharedMemoryStreamSink
+
+        self._filename = os.path.join(shm_dir, name.lstrip("/"))
+        size = RING_HEADER_SIZE + n_slots * slot_size
+
+        # Initialise the ring under a temporary name, so a consumer never
+        # sees it half written
+        temporary = self._filename + ".tmp"
+        with open(temporary, "wb") as fh:
+            fh.truncate(size)
+        with open(temporary, "r+b") as fh:
+            fh.write(RING_MAGIC + struct.pack("<QQQQ", n_slots, slot_size, 0, 0))
+        os.rename(temporary, self._filename)
+        self._sink = SharedMemoryStreamSink(self._filename)
+
+    def send(self, message, timeout=None):
+        kind, payload = message
+        if timeout is None:
+            timeout = -1
+        if not self._sink.send(kind, payload, timeout):
+            raise RuntimeError("Timed out waiting for the stream consumer")
+
+    def close(self):
+        self._sink = None
+        if os.path.exists(self._filename):
+            os.remove(self._filename)
@@ -0,0 +1,748 @@
+/*
+ * stream_reader.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_FORMAT_STREAM_READER_H
+#define DXTBX_FORMAT_STREAM_READER_H
+
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <boost/shared_ptr.hpp>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+#include <dxtbx/format/image.h>
+#include <dxtbx/format/image_reader.h>
+#include <dxtbx/format/eiger_stream_reader.h>
+#include <dxtbx/error.h>
+
+#ifndef _WIN32
+#include <ctime>
+#include <cerrno>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#endif
+
+namespace dxtbx { namespace format {
+
+  /**
+   * A message received from a live detector stream. Header messages hold
+   * the (JSON) description of the experimental models, frame messages hold
+   * one image and an end message closes the stream.
+   *
+   * A frame message payload is laid out as:
+   *
+   *   u64   frame index
+   *   u32   fast size (nx)
+   *   u32   slow size (ny)
+   *   u32   encoding (see StreamMessage::Encoding)
+   *   char  image data
+   *
+   * All integers are little endian.
+   */
+  struct StreamMessage {
+
+    enum Type { Header = 'H', Frame = 'F', End = 'E' };
+
+    enum Encoding {
+      Int32 = 0,
+      UInt16 = 1,
+      BitshuffleLZ4UInt16 = 2,
+      BitshuffleLZ4UInt32 = 3
+    };
+
+    char type;
+    std::string data;
+  };
+
+  namespace stream_detail {
+
+    /**
+     * Read a little endian unsigned integer of n bytes
+     */
+    inline
+    std::size_t read_le(const char *data, std::size_t n) {
+      unsigned long long value = 0;
+      for (std::size_t i = 0; i < n; ++i) {
+        value |= (unsigned long long)(unsigned char)data[i] << (8 * i);
+      }
+      return (std::size_t)value;
+    }
+
+    /**
+     * Write a little endian unsigned integer of n bytes
+     */
+    inline
+    void write_le(char *data, std::size_t value, std::size_t n) {
+      for (std::size_t i = 0; i < n; ++i) {
+        data[i] = (char)(((unsigned long long)value >> (8 * i)) & 0xff);
+      }
+    }
+
+    /**
+     * A mutex, so that a stream can be read from several threads. Streams
+     * are only received on posix systems, so elsewhere this does nothing.
+     */
+    class Mutex {
+    public:
+#ifndef _WIN32
+      Mutex() { pthread_mutex_init(&mutex_, NULL); }
+      ~Mutex() { pthread_mutex_destroy(&mutex_); }
+      void lock() { pthread_mutex_lock(&mutex_); }
+      void unlock() { pthread_mutex_unlock(&mutex_); }
+    private:
+      pthread_mutex_t mutex_;
+#else
+      void lock() {}
+      void unlock() {}
+#endif
+    private:
+      Mutex(const Mutex &);
+      Mutex& operator=(const Mutex &);
+    };
+
+    /**
+     * Hold a mutex for the lifetime of the lock
+     */
+    class ScopedLock {
+    public:
+      ScopedLock(Mutex &mutex) : mutex_(mutex) { mutex_.lock(); }
+      ~ScopedLock() { mutex_.unlock(); }
+    private:
+      Mutex &mutex_;
+    };
+
+  }
+
+  /**
+   * The interface for a source of stream messages
+   */
+  class StreamSource {
+  public:
+
+    virtual ~StreamSource() {}
+
+    /**
+     * Receive the next message
+     * @param message The message
+     * @param timeout The time to wait in seconds (negative to wait forever)
+     * @returns False if no message arrived within the timeout
+     */
+    virtual bool receive(StreamMessage &message, double timeout) = 0;
+  };
+
+#ifndef _WIN32
+
+  namespace stream_detail {
+
+    /**
+     * @returns The current time in seconds
+     */
+    inline
+    double now() {
+      timeval tv;
+      gettimeofday(&tv, NULL);
+      return tv.tv_sec + 1e-6 * tv.tv_usec;
+    }
+
+  }
+
+  /**
+   * Receive messages from a local (unix domain) stream socket. Each message
+   * is sent as a one byte type and a u64 little endian payload size
+   * followed by the payload. Messages are only read from the socket when
+   * requested, so a producer that gets ahead of the consumer blocks once
+   * the socket buffer is full.
+   */
+  class SocketStreamSource : public StreamSource {
+  public:
+
+    /**
+     * Connect to the socket
+     * @param path The socket path
+     */
+    SocketStreamSource(const std::string &path)
+      : path_(path),
+        fd_(-1) {
+      sockaddr_un address;
+      if (path.size() >= sizeof(address.sun_path)) {
+        throw DXTBX_ERROR("Socket path is too long: " + path);
+      }
+      std::memset(&address, 0, sizeof(address));
+      address.sun_family = AF_UNIX;
+      std::strcpy(address.sun_path, path.c_str());
+      fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (fd_ < 0) {
+        throw DXTBX_ERROR("Unable to create socket");
+      }
+      if (connect(fd_, (sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd_);
+        throw DXTBX_ERROR("Unable to connect to socket " + path);
+      }
+    }
+
+    ~SocketStreamSource() {
+      close(fd_);
+    }
+
+    /** @returns The socket path */
+    std::string path() const {
+      return path_;
+    }
+
+    bool receive(StreamMessage &message, double timeout) {
+      char header[9];
+      if (!wait(timeout)) {
+        return false;
+      }
+      read_exactly(header, 9);
+      message.type = header[0];
+      message.data.resize(stream_detail::read_le(header + 1, 8));
+      if (message.data.size() > 0) {
+        read_exactly(&message.data[0], message.data.size());
+      }
+      return true;
+    }
+
+  protected:
+
+    bool wait(double timeout) {
+      double deadline = stream_detail::now() + timeout;
+      for (;;) {
+        pollfd p;
+        p.fd = fd_;
+        p.events = POLLIN;
+        int ms = -1;
+        if (timeout >= 0) {
+          ms = std::max(0, (int)((deadline - stream_detail::now()) * 1000));
+        }
+        int result = poll(&p, 1, ms);
+        if (result >= 0) {
+          return result > 0;
+        }
+        if (errno != EINTR) {
+          throw DXTBX_ERROR("Error polling socket " + path_);
+        }
+      }
+    }
+
+    void read_exactly(char *buffer, std::size_t size) {
+      while (size > 0) {
+        ssize_t n = read(fd_, buffer, size);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          throw DXTBX_ERROR("Stream socket closed unexpectedly");
+        }
+        buffer += n;
+        size -= n;
+      }
+    }
+
+    std::string path_;
+    int fd_;
+
+  private:
+
+    SocketStreamSource(const SocketStreamSource &);
+    SocketStreamSource& operator=(const SocketStreamSource &);
+  };
+
+  /**
+   * A ring buffer in shared memory passing messages from a single producer
+   * to a single consumer. The memory is laid out as:
+   *
+   *   char[8]  magic "DXTBXRNG"
+   *   u64      number of slots
+   *   u64      slot size in bytes
+   *   u64      number of messages written (head)
+   *   u64      number of messages read (tail)
+   *   char[24] padding
+   *   slots, each holding a u64 type, a u64 payload size and the payload
+   *
+   * Only the producer writes head and only the consumer writes tail. The
+   * producer fills slot head % n_slots, which it may only do while
+   * head - tail is less than the number of slots, and then publishes the
+   * message with a release store of head + 1. The consumer loads head with
+   * acquire ordering, so once it sees the new head it also sees the whole
+   * slot. In the same way the consumer frees a slot with a release store of
+   * tail + 1 after copying the message out, and the producer loads tail
+   * with acquire ordering before it reuses the slot.
+   */
+  class SharedMemoryRing {
+  public:
+
+    /**
+     * Map the ring buffer
+     * @param fd The open shared memory file, which is closed here
+     * @param name The name of the ring, for error messages
+     */
+    SharedMemoryRing(int fd, const std::string &name)
+      : name_(name),
+        data_(NULL),
+        size_(0) {
+      struct stat info;
+      if (fstat(fd, &info) != 0 || info.st_size < 64) {
+        close(fd);
+        throw DXTBX_ERROR("Shared memory is too small for a ring buffer");
+      }
+      size_ = info.st_size;
+      void *data = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      close(fd);
+      if (data == MAP_FAILED) {
+        throw DXTBX_ERROR("Unable to map shared memory " + name);
+      }
+      data_ = (char *)data;
+      if (std::memcmp(data_, "DXTBXRNG", 8) != 0) {
+        munmap(data_, size_);
+        throw DXTBX_ERROR("Shared memory is not a dxtbx ring buffer");
+      }
+      n_slots_ = stream_detail::read_le(data_ + 8, 8);
+      slot_size_ = stream_detail::read_le(data_ + 16, 8);
+      if (n_slots_ == 0 || slot_size_ < 16 ||
+          n_slots_ > (size_ - 64) / slot_size_) {
+        munmap(data_, size_);
+        throw DXTBX_ERROR("Inconsistent ring buffer size");
+      }
+    }
+
+    virtual ~SharedMemoryRing() {
+      munmap(data_, size_);
+    }
+
+    /** @returns The name of the ring */
+    std::string name() const {
+      return name_;
+    }
+
+    /** @returns The number of slots in the ring */
+    std::size_t n_slots() const {
+      return n_slots_;
+    }
+
+    /** @returns The slot size in bytes */
+    std::size_t slot_size() const {
+      return slot_size_;
+    }
+
+  protected:
+
+    unsigned long long* head() const {
+      return (unsigned long long *)(data_ + 24);
+    }
+
+    unsigned long long* tail() const {
+      return (unsigned long long *)(data_ + 32);
+    }
+
+    char* slot(unsigned long long index) const {
+      return data_ + 64 + (index % n_slots_) * slot_size_;
+    }
+
+    /**
+     * Wait until a counter differs from a value, or the timeout passes
+     * @returns The last value of the counter read
+     */
+    static unsigned long long wait_for_change(
+        const unsigned long long *counter,
+        unsigned long long value,
+        unsigned long long offset,
+        double timeout) {
+      double deadline = stream_detail::now() + timeout;
+      for (;;) {
+        unsigned long long current = __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+        if (current + offset != value) {
+          return current;
+        }
+        if (timeout >= 0 && stream_detail::now() >= deadline) {
+          return current;
+        }
+        // Interrupted sleeps just poll again
+        timespec delay = { 0, 100000 };
+        nanosleep(&delay, NULL);
+      }
+    }
+
+    std::string name_;
+    char *data_;
+    std::size_t size_;
+    std::size_t n_slots_;
+    std::size_t slot_size_;
+
+  private:
+
+    SharedMemoryRing(const SharedMemoryRing &);
+    SharedMemoryRing& operator=(const SharedMemoryRing &);
+  };
+
+  namespace stream_detail {
+
+    inline
+    int open_shared_memory(const std::string &name) {
+      int fd = shm_open(name.c_str(), O_RDWR, 0);
+      if (fd < 0) {
+        throw DXTBX_ERROR("Unable to open shared memory " + name);
+      }
+      return fd;
+    }
+
+    inline
+    int open_file(const std::string &filename) {
+      int fd = open(filename.c_str(), O_RDWR);
+      if (fd < 0) {
+        throw DXTBX_ERROR("Unable to open ring buffer file " + filename);
+      }
+      return fd;
+    }
+
+  }
+
+  /**
+   * Receive messages from a ring buffer in POSIX shared memory. This is the
+   * consumer side of the protocol described in SharedMemoryRing.
+   */
+  class SharedMemoryStreamSource : public StreamSource,
+                                   public SharedMemoryRing {
+  public:
+
+    /**
+     * Map the ring buffer
+     * @param name The shared memory object name
+     */
+    SharedMemoryStreamSource(const std::string &name)
+      : SharedMemoryRing(stream_detail::open_shared_memory(name), name) {}
+
+    bool receive(StreamMessage &message, double timeout) {
+      unsigned long long tail = *this->tail();
+      unsigned long long head = wait_for_change(this->head(), tail, 0, timeout);
+      if (head == tail) {
+        return false;
+      }
+      const char *slot = this->slot(tail);
+      std::size_t length = stream_detail::read_le(slot + 8, 8);
+      if (length > slot_size_ - 16) {
+        throw DXTBX_ERROR("Corrupt ring buffer slot");
+      }
+      message.type = (char)stream_detail::read_le(slot, 8);
+      message.data.assign(slot + 16, length);
+      __atomic_store_n(this->tail(), tail + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+  };
+
+  /**
+   * Send messages through a ring buffer in shared memory. This is the
+   * producer side of the protocol described in SharedMemoryRing; the ring
+   * itself is created and initialised by the caller.
+   */
+  class SharedMemoryStreamSink : public SharedMemoryRing {
+  public:
+
+    /**
+     * Map the ring buffer
+     * @param filename The path of the shared memory file
+     */
+    SharedMemoryStreamSink(const std::string &filename)
+      : SharedMemoryRing(stream_detail::open_file(filename), filename) {}
+
+    /**
+     * Send a message, waiting while the ring is full
+     * @param type The message type
+     * @param data The message payload
+     * @param timeout The time to wait in seconds (negative to wait forever)
+     * @returns False if no slot was freed within the timeout
+     */
+    bool send(char type, const std::string &data, double timeout) {
+      if (data.size() > slot_size_ - 16) {
+        throw DXTBX_ERROR("Message is too large for the ring buffer slots");
+      }
+      unsigned long long head = *this->head();
+      unsigned long long tail = wait_for_change(this->tail(), head, n_slots_, timeout);
+      if (head - tail >= n_slots_) {
+        return false;
+      }
+      char *slot = this->slot(head);
+      stream_detail::write_le(slot, (unsigned char)type, 8);
+      stream_detail::write_le(slot + 8, data.size(), 8);
+      std::memcpy(slot + 16, data.data(), data.size());
+      __atomic_store_n(this->head(), head + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+  };
+
+#endif
+
+  /**
+   * Read images from a live stream. Decoded frames are held in a bounded
+   * window which slides forward as frames are requested: asking for frame
+   * i releases frames older than i - window + 1. Messages are only taken
+   * from the source when a frame is requested or the reader is polled, and
+   * polling stops when the window is full, so a producer that gets ahead
+   * is held back by the transport. Header messages are kept along with the
+   * index of the first frame they apply to. Copies of the reader share the
+   * stream.
+   *
+   * A reader may be used from several threads. Messages are received one
+   * thread at a time, and the accessors only wait for a message being
+   * handled, never for one to arrive, so the Python bindings release the
+   * GIL while a frame is awaited.
+   */
+  class StreamReader : public MultiImageReader {
+  public:
+
+    /**
+     * Initialise with the source
+     * @param source The message source
+     * @param num_images The number of images in the stream
+     * @param window The maximum number of frames to hold
+     * @param timeout The time to wait for a frame in seconds
+     */
+    StreamReader(
+        boost::shared_ptr<StreamSource> source,
+        std::size_t num_images,
+        std::size_t window,
+        double timeout)
+      : state_(new State()) {
+      DXTBX_ASSERT(source.get() != NULL);
+      DXTBX_ASSERT(window > 0);
+      state_->source = source;
+      state_->num_images = num_images;
+      state_->window = window;
+      state_->timeout = timeout;
+      state_->next_index = 0;
+      state_->finished = false;
+    }
+
+    /** @returns The number of images */
+    std::size_t size() const {
+      stream_detail::ScopedLock lock(state_->mutex);
+      return state_->num_images;
+    }
+
+    /** Set the number of images, e.g. from a header */
+    void set_size(std::size_t num_images) {
+      stream_detail::ScopedLock lock(state_->mutex);
+      state_->num_images = num_images;
+    }
+
+    /** @returns The maximum number of frames held */
+    std::size_t window() const {
+      return state_->window;
+    }
+
+    /** @returns The number of frames held */
+    std::size_t n_held() const {
+      stream_detail::ScopedLock lock(state_->mutex);
+      return state_->frames.size();
+    }
+
+    /** @returns The index after the last frame received */
+    std::size_t n_received() const {
+      stream_detail::ScopedLock lock(state_->mutex);
+      return state_->next_index;
+    }
+
+    /** @returns Has the end of stream message been received */
+    bool finished() const {
+      stream_detail::ScopedLock lock(state_->mutex);
+      return state_->finished;
+    }
+
+    /** @returns The number of headers received */
+    std::size_t n_headers() const {
+      stream_detail::ScopedLock lock(state_->mutex);
+      return state_->headers.size();
+    }
+
+    /** @returns A header message */
+    std::string header(std::size_t index) const {
+      stream_detail::ScopedLock lock(state_->mutex);
+      DXTBX_ASSERT(index < state_->headers.size());
+      return state_->headers[index];
+    }
+
+    /** @returns The index of the first frame a header applies to */
+    std::size_t header_first_frame(std::size_t index) const {
+      stream_detail::ScopedLock lock(state_->mutex);
+      DXTBX_ASSERT(index < state_->header_first_frame.size());
+      return state_->header_first_frame[index];
+    }
+
+    /**
+     * Receive any messages which are already available, while there is
+     * room in the window.
+     * @returns The number of messages received
+     */
+    std::size_t poll() {
+      stream_detail::ScopedLock receiving(state_->receive_mutex);
+      std::size_t count = 0;
+      while (!finished() && n_held() < state_->window) {
+        if (!receive(0)) {
+          break;
+        }
+        ++count;
+      }
+      return count;
+    }
+
+    /**
+     * Wait for the next message
+     * @param timeout The time to wait in seconds (negative to wait forever)
+     * @returns False if the stream has ended or no message arrived
+     */
+    bool wait(double timeout) {
+      stream_detail::ScopedLock receiving(state_->receive_mutex);
+      if (finished()) {
+        return false;
+      }
+      return receive(timeout);
+    }
+
+    /**
+     * Get an image, waiting for it to arrive if necessary
+     * @param index The frame index
+     * @returns The image
+     */
+    ImageBuffer image(std::size_t index) const {
+      DXTBX_ASSERT(index < size());
+
+      // Only this thread changes the frames while the receive mutex is held,
+      // so they can be read without the state mutex
+      stream_detail::ScopedLock receiving(state_->receive_mutex);
+      std::map<std::size_t, ImageBuffer> &frames = state_->frames;
+
+      // Slide the window forward
+      if (index + 1 > state_->window) {
+        stream_detail::ScopedLock lock(state_->mutex);
+        frames.erase(frames.begin(), frames.lower_bound(index + 1 - state_->window));
+      }
+
+      // Wait for the frame
+      while (frames.find(index) == frames.end()) {
+        if (index < state_->next_index) {
+          throw DXTBX_ERROR("Frame is no longer held by the stream reader");
+        }
+        if (state_->finished) {
+          throw DXTBX_ERROR("Stream ended before the frame was received");
+        }
+        if (frames.size() >= state_->window) {
+          stream_detail::ScopedLock lock(state_->mutex);
+          frames.erase(frames.begin());
+        }
+        if (!receive(state_->timeout)) {
+          throw DXTBX_ERROR("Timed out waiting for a frame from the stream");
+        }
+      }
+      return frames.find(index)->second;
+    }
+
+  protected:
+
+    struct State {
+      boost::shared_ptr<StreamSource> source;
+      std::size_t num_images;
+      std::size_t window;
+      double timeout;
+      std::size_t next_index;
+      bool finished;
+      std::map<std::size_t, ImageBuffer> frames;
+      std::vector<std::string> headers;
+      std::vector<std::size_t> header_first_frame;
+      stream_detail::Mutex receive_mutex;
+      stream_detail::Mutex mutex;
+    };
+
+    /**
+     * Receive and handle one message. The receive mutex must be held; the
+     * state mutex is only taken once a message has arrived.
+     */
+    bool receive(double timeout) const {
+      StreamMessage message;
+      if (!state_->source->receive(message, timeout)) {
+        return false;
+      }
+      ImageBuffer buffer;
+      std::size_t index = 0;
+      if (message.type == StreamMessage::Frame) {
+        buffer = decode_frame(message.data, index);
+      }
+      stream_detail::ScopedLock lock(state_->mutex);
+      switch (message.type) {
+      case StreamMessage::Header:
+        state_->headers.push_back(message.data);
+        state_->header_first_frame.push_back(state_->next_index);
+        break;
+      case StreamMessage::Frame:
+        state_->frames[index] = buffer;
+        state_->next_index = std::max(state_->next_index, index + 1);
+        break;
+      case StreamMessage::End:
+        state_->finished = true;
+        break;
+      default:
+        throw DXTBX_ERROR("Unknown stream message type");
+      };
+      return true;
+    }
+
+    /**
+     * Decode a frame message
+     */
+    static ImageBuffer decode_frame(const std::string &data, std::size_t &index) {
+      using stream_detail::read_le;
+      if (data.size() < 20) {
+        throw DXTBX_ERROR("Truncated stream frame");
+      }
+      const char *p = data.data();
+      index = read_le(p, 8);
+      std::size_t nx = read_le(p + 8, 4);
+      std::size_t ny = read_le(p + 12, 4);
+      std::size_t encoding = read_le(p + 16, 4);
+      const unsigned char *image = (const unsigned char *)p + 20;
+      std::size_t size = data.size() - 20;
+      scitbx::af::versa< int, scitbx::af::c_grid<2> > result;
+      switch (encoding) {
+      case StreamMessage::Int32:
+      case StreamMessage::UInt16:
+        {
+          std::size_t elem_size = encoding == StreamMessage::Int32 ? 4 : 2;
+          if (size != nx * ny * elem_size) {
+            throw DXTBX_ERROR("Stream frame size does not match image size");
+          }
+          result = scitbx::af::versa< int, scitbx::af::c_grid<2> >(
+              scitbx::af::c_grid<2>(ny, nx),
+              scitbx::af::init_functor_null<int>());
+          eiger_stream_detail::copy_elements(image, nx * ny, elem_size, result.begin());
+        }
+        break;
+      case StreamMessage::BitshuffleLZ4UInt16:
+        result = decode_eiger_stream_frame(image, size, nx, ny, 16);
+        break;
+      case StreamMessage::BitshuffleLZ4UInt32:
+        result = decode_eiger_stream_frame(image, size, nx, ny, 32);
+        break;
+      default:
+        throw DXTBX_ERROR("Unknown stream frame encoding");
+      };
+      return ImageBuffer(Image<int>(ImageTile<int>(result)));
+    }
+
+    boost::shared_ptr<State> state_;
+  };
+
+}} // namespace dxtbx::format
+
+#endif // DXTBX_FORMAT_STREAM_READER_H
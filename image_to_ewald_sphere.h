@@ -0,0 +1,222 @@
+/*
+ * image_to_ewald_sphere.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_IMAGE_TO_EWALD_SPHERE_H
+#define DXTBX_IMAGE_TO_EWALD_SPHERE_H
+
+#include <scitbx/vec2.h>
+#include <scitbx/vec3.h>
+#include <scitbx/mat3.h>
+#include <scitbx/math/r3_rotation.h>
+#include <scitbx/array_family/ref.h>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+#include <dxtbx/model/beam.h>
+#include <dxtbx/model/detector.h>
+#include <dxtbx/model/goniometer.h>
+#include <dxtbx/model/scan.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx {
+
+  using scitbx::vec2;
+  using scitbx::vec3;
+  using scitbx::mat3;
+  using scitbx::math::r3_rotation::axis_and_angle_as_matrix;
+  using model::Beam;
+  using model::Detector;
+  using model::Goniometer;
+  using model::Scan;
+
+  /**
+   * Map image pixels to reciprocal space vectors on the Ewald sphere.
+   *
+   * The unit diffracted beam vector of every pixel of every panel is computed
+   * once on construction and stored as separate x, y and z arrays. Mapping a
+   * frame then only needs the rotation matrix for the frame angle to be
+   * applied to each pixel, which the compiler can vectorise. Results are
+   * written into caller provided buffers so that the same storage can be
+   * reused from frame to frame.
+   */
+  class ImageToEwaldSphere {
+  public:
+
+    typedef scitbx::af::c_grid<2> accessor_type;
+
+    /**
+     * Precompute the unit s1 vectors for all the panels
+     * @param beam The beam model
+     * @param detector The detector model
+     * @param gonio The goniometer model
+     * @param scan The scan model
+     */
+    ImageToEwaldSphere(const Beam &beam, const Detector &detector,
+                       const Goniometer &gonio, const Scan &scan)
+      : wavelength_(beam.get_wavelength()),
+        rotation_axis_(gonio.get_rotation_axis()),
+        scan_(scan) {
+      DXTBX_ASSERT(wavelength_ > 0);
+      offset_.push_back(0);
+      for (std::size_t p = 0; p < detector.size(); ++p) {
+        std::size_t fast_size = detector[p].get_image_size()[0];
+        std::size_t slow_size = detector[p].get_image_size()[1];
+        size_.push_back(accessor_type(slow_size, fast_size));
+        offset_.push_back(offset_.back() + slow_size * fast_size);
+        for (std::size_t j = 0; j < slow_size; ++j) {
+          for (std::size_t i = 0; i < fast_size; ++i) {
+            vec3<double> s1 = detector[p].get_pixel_lab_coord(
+                vec2<double>(i, j)).normalize();
+            x_.push_back(s1[0]);
+            y_.push_back(s1[1]);
+            z_.push_back(s1[2]);
+          }
+        }
+      }
+    }
+
+    /** @returns The number of panels */
+    std::size_t n_panels() const {
+      return size_.size();
+    }
+
+    /** @returns The (slow, fast) size of the panel */
+    accessor_type panel_size(std::size_t panel) const {
+      DXTBX_ASSERT(panel < n_panels());
+      return size_[panel];
+    }
+
+    /** @returns The number of pixels in a frame over all panels */
+    std::size_t n_pixels() const {
+      return offset_.back();
+    }
+
+    /** @returns The offset of the first pixel of a panel within a frame */
+    std::size_t panel_offset(std::size_t panel) const {
+      DXTBX_ASSERT(panel < n_panels());
+      return offset_[panel];
+    }
+
+    /**
+     * Get the matrix which maps unit s1 vectors to reciprocal space at the
+     * middle of the frame
+     * @param frame The array index of the frame
+     * @returns The rotation matrix scaled by 1 / wavelength
+     */
+    mat3<double> frame_matrix(int frame) const {
+      double phi = scan_.get_angle_from_array_index(frame - 0.5);
+      return axis_and_angle_as_matrix(rotation_axis_, phi) * (1.0 / wavelength_);
+    }
+
+    /**
+     * Map a panel of a frame into a buffer
+     * @param frame The array index of the frame
+     * @param panel The panel number
+     * @param result The buffer with one element per pixel of the panel
+     */
+    void map(
+        int frame,
+        std::size_t panel,
+        scitbx::af::ref< vec3<double> > result) const {
+      DXTBX_ASSERT(panel < n_panels());
+      DXTBX_ASSERT(result.size() == offset_[panel+1] - offset_[panel]);
+      map_range(frame_matrix(frame), offset_[panel], result.size(), result.begin());
+    }
+
+    /**
+     * Map all the panels of a range of frames into a buffer. The buffer is
+     * ordered by frame, then panel, then pixel; frames are processed in
+     * parallel when OpenMP is available.
+     * @param first The first frame
+     * @param last The last frame (exclusive)
+     * @param result The buffer of (last - first) * n_pixels() elements
+     */
+    void map_frames(
+        int first,
+        int last,
+        scitbx::af::ref< vec3<double> > result) const {
+      DXTBX_ASSERT(first <= last);
+      DXTBX_ASSERT(result.size() == (last - first) * n_pixels());
+      int n = (last - first) * (int)n_panels();
+      vec3<double> *out = result.begin();
+      #pragma omp parallel for
+      for (int k = 0; k < n; ++k) {
+        int f = k / (int)n_panels();
+        std::size_t p = k % n_panels();
+        std::size_t n_pix = offset_[p+1] - offset_[p];
+        map_range(
+            frame_matrix(first + f),
+            offset_[p],
+            n_pix,
+            out + f * n_pixels() + offset_[p]);
+      }
+    }
+
+    /**
+     * Map only the pixels of a panel which are set in the mask
+     * @param frame The array index of the frame
+     * @param panel The panel number
+     * @param mask The pixel mask of the panel
+     * @param index The output indices of the mapped pixels within the panel
+     * @param result The output reciprocal space vectors
+     */
+    void map_masked(
+        int frame,
+        std::size_t panel,
+        const scitbx::af::const_ref< bool, accessor_type > &mask,
+        scitbx::af::shared<std::size_t> &index,
+        scitbx::af::shared< vec3<double> > &result) const {
+      DXTBX_ASSERT(panel < n_panels());
+      DXTBX_ASSERT(mask.accessor().all_eq(size_[panel]));
+      mat3<double> R = frame_matrix(frame);
+      std::size_t o = offset_[panel];
+      for (std::size_t i = 0; i < mask.size(); ++i) {
+        if (mask[i]) {
+          index.push_back(i);
+          result.push_back(R * vec3<double>(x_[o+i], y_[o+i], z_[o+i]));
+        }
+      }
+    }
+
+  protected:
+
+    /**
+     * Apply the matrix to a contiguous range of unit s1 vectors
+     */
+    void map_range(
+        const mat3<double> &R,
+        std::size_t first,
+        std::size_t n,
+        vec3<double> *out) const {
+      if (n == 0) {
+        return;
+      }
+      const double *x = &x_[first];
+      const double *y = &y_[first];
+      const double *z = &z_[first];
+      double r0 = R[0], r1 = R[1], r2 = R[2];
+      double r3 = R[3], r4 = R[4], r5 = R[5];
+      double r6 = R[6], r7 = R[7], r8 = R[8];
+      double *o = out[0].begin();
+      for (std::size_t i = 0; i < n; ++i) {
+        o[3*i+0] = r0 * x[i] + r1 * y[i] + r2 * z[i];
+        o[3*i+1] = r3 * x[i] + r4 * y[i] + r5 * z[i];
+        o[3*i+2] = r6 * x[i] + r7 * y[i] + r8 * z[i];
+      }
+    }
+
+    double wavelength_;
+    vec3<double> rotation_axis_;
+    Scan scan_;
+    scitbx::af::shared<accessor_type> size_;
+    scitbx::af::shared<std::size_t> offset_;
+    scitbx::af::shared<double> x_;
+    scitbx::af::shared<double> y_;
+    scitbx::af::shared<double> z_;
+  };
+
+} // namespace dxtbx
+
+#endif // DXTBX_IMAGE_TO_EWALD_SPHERE_H
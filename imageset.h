@@ -13,6 +13,7 @@
 #define DXTBX_IMAGESET_H
 
 #include <map>
+#include <vector>
 
 #include <boost/python.hpp>
 
@@ -24,7 +25,9 @@
 #include <dxtbx/model/detector.h>
 #include <dxtbx/model/goniometer.h>
 #include <dxtbx/model/scan.h>
+#include <dxtbx/model/panel_mask.h>
 #include <dxtbx/format/image.h>
+#include <dxtbx/format/bit_image.h>
 #include <dxtbx/error.h>
 
 namespace dxtbx {
@@ -38,6 +41,7 @@ namespace dxtbx {
   using format::ImageTile;
   using format::Image;
   using format::ImageBuffer;
+  using format::BitImage;
 
   namespace detail {
 
@@ -455,30 +459,32 @@ namespace dxtbx {
     }
 
     /**
-     * @returns the params
+     * @returns the params (a python dict of format arguments). The dict is
+     * not copied, so it must be treated as read only; use set_params to
+     * change the params.
      */
-    std::string get_params() const {
+    boost::python::object get_params() const {
       return params_;
     }
 
     /**
      * @param x the params
      */
-    void set_params(std::string x) {
+    void set_params(boost::python::object x) {
       params_ = x;
     }
 
     /**
-     * @returns the format
+     * @returns the format class
      */
-    std::string get_format() const {
+    boost::python::object get_format() const {
       return format_;
     }
 
     /**
-     * @param x the format
+     * @param x the format class
      */
-    void set_format(std::string x) {
+    void set_format(boost::python::object x) {
       format_ = x;
     }
 
@@ -555,8 +561,8 @@ namespace dxtbx {
 
     std::string template_;
     std::string vendor_;
-    std::string params_;
-    std::string format_;
+    boost::python::object params_;
+    boost::python::object format_;
   };
 
 
@@ -585,6 +591,16 @@ namespace dxtbx {
         : index(-1) {}
     };
 
+    /**
+     * Cache the compiled panel masks of a detector
+     */
+    class MaskCache {
+    public:
+
+      detector_ptr detector;
+      std::vector<model::PanelMask> masks;
+    };
+
 
     /**
      * Default constructor throws an exception.
@@ -858,7 +874,9 @@ namespace dxtbx {
      * @returns The mask
      */
     Image<bool> get_empty_mask() const {
-      Detector detector = detail::safe_dereference(get_detector_for_image(0));
+      detector_ptr pointer = get_detector_for_image(0);
+      DXTBX_ASSERT(pointer != NULL);
+      const Detector &detector = *pointer;
       Image<bool> mask;
       for (std::size_t i = 0; i < detector.size(); ++i) {
         std::size_t xsize = detector[i].get_image_size()[0];
@@ -878,7 +896,9 @@ namespace dxtbx {
      * @returns The mask
      */
     Image<bool> get_untrusted_rectangle_mask(Image<bool> mask) const {
-      Detector detector = detail::safe_dereference(get_detector_for_image(0));
+      detector_ptr pointer = get_detector_for_image(0);
+      DXTBX_ASSERT(pointer != NULL);
+      const Detector &detector = *pointer;
       DXTBX_ASSERT(mask.n_tiles() == detector.size());
       for (std::size_t i = 0; i < detector.size(); ++i) {
         detector[i].apply_untrusted_rectangle_mask(mask.tile(i).data().ref());
@@ -937,8 +957,30 @@ namespace dxtbx {
      * @returns The mask
      */
     Image<bool> get_trusted_range_mask(Image<bool> mask, std::size_t index) {
-      Detector detector = detail::safe_dereference(get_detector_for_image(index));
-      Image<double> data = get_raw_data(index).as_double();
+      detector_ptr pointer = get_detector_for_image(index);
+      DXTBX_ASSERT(pointer != NULL);
+      const Detector &detector = *pointer;
+      ImageBuffer buffer = get_raw_data(index);
+      if (buffer.is_int()) {
+        apply_trusted_range_mask(detector, buffer.as_int(), mask);
+      } else {
+        apply_trusted_range_mask(detector, buffer.as_double(), mask);
+      }
+      return mask;
+    }
+
+    /**
+     * Apply the trusted range mask in the native type of the image so that
+     * integer images are not first converted to double.
+     * @param detector The detector model
+     * @param data The image data
+     * @param mask The mask to write into
+     */
+    template <typename T>
+    void apply_trusted_range_mask(
+        const Detector &detector,
+        const Image<T> &data,
+        Image<bool> &mask) const {
       DXTBX_ASSERT(mask.n_tiles() == data.n_tiles());
       DXTBX_ASSERT(data.n_tiles() == detector.size());
       for (std::size_t i = 0; i < detector.size(); ++i) {
@@ -946,7 +988,6 @@ namespace dxtbx {
             data.tile(i).data().const_ref(),
             mask.tile(i).data().ref());
       }
-      return mask;
     }
 
     /**
@@ -956,7 +997,17 @@ namespace dxtbx {
      */
     Image<bool> get_dynamic_mask(std::size_t index) {
       Image<bool> dyn_mask = data_.get_mask(indices_[index]);
-      return get_trusted_range_mask(get_static_mask(dyn_mask), index);
+      Image<bool> mask = get_external_mask(
+          dyn_mask.empty() ? get_empty_mask() : dyn_mask);
+      const std::vector<model::PanelMask> &panel_masks =
+        get_panel_masks(get_detector_for_image(index));
+      ImageBuffer buffer = get_raw_data(index);
+      if (buffer.is_int()) {
+        apply_panel_masks(panel_masks, buffer.as_int(), mask);
+      } else {
+        apply_panel_masks(panel_masks, buffer.as_double(), mask);
+      }
+      return mask;
     }
 
     /**
@@ -968,6 +1019,116 @@ namespace dxtbx {
       return get_dynamic_mask(index);
     }
 
+    /**
+     * Get the static mask common to all images as packed bits
+     * @returns The packed mask
+     */
+    BitImage get_static_mask_bits() {
+      const std::vector<model::PanelMask> &panel_masks =
+        get_panel_masks(get_detector_for_image(0));
+      BitImage mask;
+      for (std::size_t i = 0; i < panel_masks.size(); ++i) {
+        mask.push_back(panel_masks[i].get_static_bits());
+      }
+      Image<bool> external_mask = external_lookup().mask().get_data();
+      if (!external_mask.empty()) {
+        mask &= BitImage(external_mask);
+      }
+      return mask;
+    }
+
+    /**
+     * Compute the mask as packed bits. The static and trusted range masks
+     * are applied a word at a time so no intermediate bool images are made.
+     * @param index The image index
+     * @returns The packed mask
+     */
+    BitImage get_mask_bits(std::size_t index) {
+      BitImage mask = get_static_mask_bits();
+      Image<bool> dyn_mask = data_.get_mask(indices_[index]);
+      if (!dyn_mask.empty()) {
+        mask &= BitImage(dyn_mask);
+      }
+      const std::vector<model::PanelMask> &panel_masks =
+        get_panel_masks(get_detector_for_image(index));
+      ImageBuffer buffer = get_raw_data(index);
+      if (buffer.is_int()) {
+        apply_trusted_range_mask_bits(panel_masks, buffer.as_int(), mask);
+      } else {
+        apply_trusted_range_mask_bits(panel_masks, buffer.as_double(), mask);
+      }
+      return mask;
+    }
+
+    /**
+     * Get the compiled masks of the panels of a detector. The masks are
+     * compiled on first use and kept until the detector is replaced or the
+     * image size, trusted range or untrusted rectangles of a panel change.
+     * @param detector The detector model
+     * @returns The panel masks
+     */
+    const std::vector<model::PanelMask>& get_panel_masks(
+        const detector_ptr &detector) {
+      DXTBX_ASSERT(detector != NULL);
+      const Detector &d = *detector;
+      std::vector<model::PanelMask> &masks = mask_cache_.masks;
+      if (mask_cache_.detector != detector || masks.size() != d.size()) {
+        mask_cache_.detector = detector;
+        masks.clear();
+        masks.reserve(d.size());
+        for (std::size_t i = 0; i < d.size(); ++i) {
+          masks.push_back(model::PanelMask(d[i]));
+        }
+      } else {
+        for (std::size_t i = 0; i < d.size(); ++i) {
+          if (!masks[i].is_valid_for(d[i])) {
+            masks[i] = model::PanelMask(d[i]);
+          }
+        }
+      }
+      return masks;
+    }
+
+    /**
+     * Apply the untrusted rectangles and trusted range to a bool mask in a
+     * single pass, in the native type of the image
+     * @param panel_masks The compiled panel masks
+     * @param data The image data
+     * @param mask The mask to write into
+     */
+    template <typename T>
+    void apply_panel_masks(
+        const std::vector<model::PanelMask> &panel_masks,
+        const Image<T> &data,
+        Image<bool> &mask) const {
+      DXTBX_ASSERT(mask.n_tiles() == data.n_tiles());
+      DXTBX_ASSERT(data.n_tiles() == panel_masks.size());
+      for (std::size_t i = 0; i < panel_masks.size(); ++i) {
+        panel_masks[i].apply(
+            data.tile(i).data().const_ref(),
+            mask.tile(i).data().ref());
+      }
+    }
+
+    /**
+     * Apply the trusted range to a packed mask in the native type of the image
+     * @param panel_masks The compiled panel masks
+     * @param data The image data
+     * @param mask The packed mask to write into
+     */
+    template <typename T>
+    void apply_trusted_range_mask_bits(
+        const std::vector<model::PanelMask> &panel_masks,
+        const Image<T> &data,
+        BitImage &mask) const {
+      DXTBX_ASSERT(mask.n_tiles() == data.n_tiles());
+      DXTBX_ASSERT(data.n_tiles() == panel_masks.size());
+      for (std::size_t i = 0; i < panel_masks.size(); ++i) {
+        panel_masks[i].apply_packed(
+            data.tile(i).data().const_ref(), mask.tile(i));
+      }
+    }
+
     /**
      * @param index The image index
      * @returns the beam at index
@@ -1157,6 +1318,7 @@ namespace dxtbx {
     ImageSetData data_;
     scitbx::af::shared<std::size_t> indices_;
     DataCache data_cache_;
+    MaskCache mask_cache_;
   };
 
 
@@ -51,6 +51,88 @@ class MemMasker(object):
         return len(self._images)
 
 
+class StreamReader(object):
+    """A reader for frames arriving on a live detector stream. Frames are
+    read and decoded by a dxtbx.format.image.StreamReader, which holds a
+    sliding window of the most recent frames."""
+
+    def __init__(self, stream):
+        self._stream = stream
+        self._n_headers = 0
+
+    def stream(self):
+        return self._stream
+
+    def paths(self):
+        return ["" for i in range(len(self))]
+
+    def identifiers(self):
+        return ["stream-%d" % i for i in range(len(self))]
+
+    def __len__(self):
+        return len(self._stream)
+
+    def read(self, index):
+        image = self._stream.image(index).as_int()
+        return tuple(image.tile(i).data() for i in range(image.n_tiles()))
+
+    def is_single_file_reader(self):
+        return False
+
+    def master_path(self):
+        return ""
+
+    def update_models(self, imageset):
+        """Set the models of the imageset from any header messages received
+        since the last update. Each header applies to the frames from the
+        one following it onwards.
+
+        Returns: The number of headers applied"""
+        import json
+        from dxtbx.model.beam import BeamFactory
+        from dxtbx.model.detector import DetectorFactory
+        from dxtbx.model.goniometer import GoniometerFactory
+        from dxtbx.model.scan import ScanFactory
+
+        factories = (
+            ("beam", BeamFactory, imageset.set_beam),
+            ("detector", DetectorFactory, imageset.set_detector),
+            ("goniometer", GoniometerFactory, imageset.set_goniometer),
+            ("scan", ScanFactory, imageset.set_scan),
+        )
+        n_headers = self._stream.n_headers()
+        for i in range(self._n_headers, n_headers):
+            header = json.loads(self._stream.header(i))
+            first = self._stream.header_first_frame(i)
+            for name, factory, setter in factories:
+                if name in header:
+                    model = factory.from_dict(header[name])
+                    for index in range(first, len(imageset)):
+                        setter(model, index)
+        count = n_headers - self._n_headers
+        self._n_headers = n_headers
+        return count
+
+
+class StreamMasker(object):
+    """A masker for a live detector stream, which carries no masks"""
+
+    def __init__(self, num_images):
+        self._num_images = num_images
+
+    def get(self, index, goniometer=None):
+        return None
+
+    def paths(self):
+        return ["" for i in range(len(self))]
+
+    def identifiers(self):
+        return self.paths()
+
+    def __len__(self):
+        return self._num_images
+
+
 class ImageSetAux(boost.python.injector, ImageSet):
     """
     A class to inject additional methods into the imageset class
@@ -100,7 +182,8 @@ class ImageSetAux(boost.python.injector, ImageSet):
         return self.data().get_format_class()
 
     def params(self):
-        """ Get the parameters """
+        """ Get the parameters. The dict is shared with the imageset data and
+        must not be modified. """
         return self.data().get_params()
 
     def get_detectorbase(self, index):
@@ -150,18 +233,27 @@ class ImageSetLazy(ImageSet):
     it sets the model using the format class and then returns the model
     """
 
+    def _get_cached_format_instance(self, index):
+        """Get the format instance for an image if one has been created,
+        either by the reader or through the shared instance cache."""
+        if self.data().has_single_file_reader():
+            path = self.data().get_master_path()
+        else:
+            path = self.get_path(index)
+        handle = getattr(self.reader(), "_handle", None)
+        if handle is not None and handle.peek(path) is not None:
+            return handle.peek(path)
+        return self.get_format_class().get_cached_instance(path)
+
     def get_detector(self, index=None):
         if index is None:
             index = 0
         detector = super(ImageSetLazy, self).get_detector(index)
         if detector is None:
-            # If check_format=False was used, then _current_instance_ will not be set, so assume a None is correct
-            format_class = self.get_format_class()
-            if (
-                hasattr(format_class, "_current_instance_")
-                and format_class._current_instance_ is not None
-            ):
-                format_instance = format_class._current_instance_
+            # If check_format=False was used, then no format instance will have
+            # been created, so assume a None is correct
+            format_instance = self._get_cached_format_instance(index)
+            if format_instance is not None:
                 detector = format_instance.get_detector(self.indices()[index])
                 self.set_detector(detector, index)
         return detector
@@ -171,13 +263,10 @@ class ImageSetLazy(ImageSet):
             index = 0
         beam = super(ImageSetLazy, self).get_beam(index)
         if beam is None:
-            # If check_format=False was used, then _current_instance_ will not be set, so assume a None is correct
-            format_class = self.get_format_class()
-            if (
-                hasattr(format_class, "_current_instance_")
-                and format_class._current_instance_ is not None
-            ):
-                format_instance = format_class._current_instance_
+            # If check_format=False was used, then no format instance will have
+            # been created, so assume a None is correct
+            format_instance = self._get_cached_format_instance(index)
+            if format_instance is not None:
                 beam = format_instance.get_beam(self.indices()[index])
                 self.set_beam(beam, index)
         return beam
@@ -187,13 +276,10 @@ class ImageSetLazy(ImageSet):
             index = 0
         goniometer = super(ImageSetLazy, self).get_goniometer(index)
         if goniometer is None:
-            # If check_format=False was used, then _current_instance_ will not be set, so assume a None is correct
-            format_class = self.get_format_class()
-            if (
-                hasattr(format_class, "_current_instance_")
-                and format_class._current_instance_ is not None
-            ):
-                format_instance = format_class._current_instance_
+            # If check_format=False was used, then no format instance will have
+            # been created, so assume a None is correct
+            format_instance = self._get_cached_format_instance(index)
+            if format_instance is not None:
                 goniometer = format_instance.get_goniometer(self.indices()[index])
                 self.set_goniometer(goniometer, index)
         return goniometer
@@ -203,13 +289,10 @@ class ImageSetLazy(ImageSet):
             index = 0
         scan = super(ImageSetLazy, self).get_scan(index)
         if scan is None:
-            # If check_format=False was used, then _current_instance_ will not be set, so assume a None is correct
-            format_class = self.get_format_class()
-            if (
-                hasattr(format_class, "_current_instance_")
-                and format_class._current_instance_ is not None
-            ):
-                format_instance = format_class._current_instance_
+            # If check_format=False was used, then no format instance will have
+            # been created, so assume a None is correct
+            format_instance = self._get_cached_format_instance(index)
+            if format_instance is not None:
                 scan = format_instance.get_scan(self.indices()[index])
                 self.set_scan(scan, index)
         return scan
@@ -273,6 +356,38 @@ class ImageSweepAux(boost.python.injector, ImageSweep):
         return self.data().get_template()
 
 
+class ImageSetScanTableAux(boost.python.injector, ImageSetScanTable):
+    def as_str(self, hits=True):
+        """Format the table with one line per image
+
+        Params:
+            hits Include the hit pixel counts
+
+        Returns:
+            The table as a string
+
+        """
+        columns = ["Image", "Total", "Max", "Valid", "Overloads", "Masked"]
+        rows = [
+            self.indices(),
+            self.sum(),
+            self.max(),
+            self.n_valid(),
+            self.n_overloads(),
+            self.n_masked(),
+        ]
+        if hits:
+            columns.append("Hits")
+            rows.append(self.n_hits())
+        lines = [" ".join("%12s" % c for c in columns)]
+        for values in zip(*rows):
+            lines.append(
+                "%12d %12.0f %12.0f" % values[0:3]
+                + "".join(" %12d" % v for v in values[3:])
+            )
+        return "\n".join(lines)
+
+
 class FilenameAnalyser(object):
     """Group images by filename into image sets."""
 
@@ -629,6 +744,39 @@ class ImageSetFactory(object):
         # Return the sweep
         return sweep
 
+    @staticmethod
+    def from_stream(source, num_images=None, window=100, timeout=30.0):
+        """Create an imageset reading frames from a live detector stream
+
+        Params:
+            source A SocketStreamSource or SharedMemoryStreamSource
+            num_images The number of images (from the first header if None)
+            window The maximum number of frames to hold
+            timeout The time to wait for a message in seconds
+
+        Returns:
+            The imageset. Call imageset.reader().update_models(imageset) to
+            apply models from headers received while reading frames.
+
+        """
+        import json
+        from dxtbx.format.image import StreamReader as StreamFrameReader
+
+        stream = StreamFrameReader(source, 0, window, timeout)
+
+        # Wait for the first header for the models and number of images
+        while stream.n_headers() == 0:
+            if not stream.wait(timeout):
+                raise RuntimeError("No header received from the stream")
+        if num_images is None:
+            num_images = json.loads(stream.header(0))["nimages"]
+        stream.set_size(num_images)
+
+        reader = StreamReader(stream)
+        imageset = ImageSet(ImageSetData(reader, StreamMasker(num_images)))
+        reader.update_models(imageset)
+        return imageset
+
     @staticmethod
     def imageset_from_anyset(imageset):
         """ Create a new ImageSet object from an imageset object. Converts ImageSweep to ImageSet. """
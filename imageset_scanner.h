@@ -0,0 +1,397 @@
+/*
+ * imageset_scanner.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+
+#ifndef DXTBX_IMAGESET_SCANNER_H
+#define DXTBX_IMAGESET_SCANNER_H
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+#include <scitbx/array_family/tiny_types.h>
+#include <dxtbx/imageset.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx {
+
+  using scitbx::af::tiny;
+
+  /**
+   * The summary statistics of a range of images, with one row per image and
+   * one column per panel.
+   *
+   * Pixels which are masked, or below the trusted range, are counted as
+   * masked. Of the remaining pixels those at or above the top of the
+   * trusted range are counted as overloads and the others as valid. The
+   * sum is over the valid pixels, the maximum over all unmasked pixels and
+   * the hit count is the number of valid pixels at or above the hit
+   * threshold. The raw sum is over all pixels which are not negative and
+   * the raw maximum is over all pixels, both ignoring the masks and the
+   * trusted range.
+   */
+  class ImageSetScanTable {
+  public:
+
+    typedef scitbx::af::versa< double, scitbx::af::c_grid<2> > double_array;
+    typedef scitbx::af::versa< int, scitbx::af::c_grid<2> > int_array;
+
+    ImageSetScanTable() {}
+
+    /**
+     * Initialise the table
+     * @param indices The imageset indices of the rows
+     * @param n_panels The number of panels
+     */
+    ImageSetScanTable(
+          const scitbx::af::shared<std::size_t> &indices,
+          std::size_t n_panels)
+      : indices_(indices),
+        sum_(scitbx::af::c_grid<2>(indices.size(), n_panels), 0),
+        raw_sum_(scitbx::af::c_grid<2>(indices.size(), n_panels), 0),
+        max_(scitbx::af::c_grid<2>(indices.size(), n_panels),
+             -std::numeric_limits<double>::max()),
+        raw_max_(scitbx::af::c_grid<2>(indices.size(), n_panels),
+             -std::numeric_limits<double>::max()),
+        n_valid_(scitbx::af::c_grid<2>(indices.size(), n_panels), 0),
+        n_overloads_(scitbx::af::c_grid<2>(indices.size(), n_panels), 0),
+        n_masked_(scitbx::af::c_grid<2>(indices.size(), n_panels), 0),
+        n_hits_(scitbx::af::c_grid<2>(indices.size(), n_panels), 0) {}
+
+    /** @returns The number of rows */
+    std::size_t size() const {
+      return indices_.size();
+    }
+
+    /** @returns The number of panels */
+    std::size_t n_panels() const {
+      return sum_.accessor()[1];
+    }
+
+    /** @returns The imageset index of each row */
+    scitbx::af::shared<std::size_t> indices() const {
+      return indices_;
+    }
+
+    /** @returns The sum of valid pixels for each image and panel */
+    double_array panel_sum() const {
+      return sum_;
+    }
+
+    /** @returns The sum of non-negative pixels for each image and panel */
+    double_array panel_raw_sum() const {
+      return raw_sum_;
+    }
+
+    /** @returns The maximum unmasked pixel for each image and panel */
+    double_array panel_max() const {
+      return max_;
+    }
+
+    /** @returns The maximum pixel for each image and panel */
+    double_array panel_raw_max() const {
+      return raw_max_;
+    }
+
+    /** @returns The number of valid pixels for each image and panel */
+    int_array panel_n_valid() const {
+      return n_valid_;
+    }
+
+    /** @returns The number of overloads for each image and panel */
+    int_array panel_n_overloads() const {
+      return n_overloads_;
+    }
+
+    /** @returns The number of masked pixels for each image and panel */
+    int_array panel_n_masked() const {
+      return n_masked_;
+    }
+
+    /** @returns The number of hit pixels for each image and panel */
+    int_array panel_n_hits() const {
+      return n_hits_;
+    }
+
+    /** @returns The sum of valid pixels for each image */
+    scitbx::af::shared<double> sum() const {
+      return row_sum(sum_);
+    }
+
+    /** @returns The sum of non-negative pixels for each image */
+    scitbx::af::shared<double> raw_sum() const {
+      return row_sum(raw_sum_);
+    }
+
+    /** @returns The maximum unmasked pixel for each image */
+    scitbx::af::shared<double> max() const {
+      return row_max(max_);
+    }
+
+    /** @returns The maximum pixel for each image */
+    scitbx::af::shared<double> raw_max() const {
+      return row_max(raw_max_);
+    }
+
+    /** @returns The number of valid pixels for each image */
+    scitbx::af::shared<int> n_valid() const {
+      return row_sum(n_valid_);
+    }
+
+    /** @returns The number of overloads for each image */
+    scitbx::af::shared<int> n_overloads() const {
+      return row_sum(n_overloads_);
+    }
+
+    /** @returns The number of masked pixels for each image */
+    scitbx::af::shared<int> n_masked() const {
+      return row_sum(n_masked_);
+    }
+
+    /** @returns The number of hit pixels for each image */
+    scitbx::af::shared<int> n_hits() const {
+      return row_sum(n_hits_);
+    }
+
+  protected:
+
+    friend class ImageSetScanner;
+
+    template <typename T>
+    scitbx::af::shared<T> row_sum(
+        const scitbx::af::versa< T, scitbx::af::c_grid<2> > &a) const {
+      scitbx::af::shared<T> result(size(), 0);
+      for (std::size_t i = 0; i < size(); ++i) {
+        for (std::size_t j = 0; j < n_panels(); ++j) {
+          result[i] += a[i * n_panels() + j];
+        }
+      }
+      return result;
+    }
+
+    scitbx::af::shared<double> row_max(const double_array &a) const {
+      scitbx::af::shared<double> result(size());
+      for (std::size_t i = 0; i < size(); ++i) {
+        result[i] = -std::numeric_limits<double>::max();
+        for (std::size_t j = 0; j < n_panels(); ++j) {
+          result[i] = std::max(result[i], a[i * n_panels() + j]);
+        }
+      }
+      return result;
+    }
+
+    scitbx::af::shared<std::size_t> indices_;
+    double_array sum_;
+    double_array raw_sum_;
+    double_array max_;
+    double_array raw_max_;
+    int_array n_valid_;
+    int_array n_overloads_;
+    int_array n_masked_;
+    int_array n_hits_;
+  };
+
+  /**
+   * Compute summary statistics (total counts, overloads, masked pixels and
+   * a simple hit score) for every image of an imageset in one pass over
+   * each image.
+   *
+   * Images are read in batches, since reading may call back into python,
+   * and the images of each batch are then scanned in parallel with OpenMP.
+   */
+  class ImageSetScanner {
+  public:
+
+    /**
+     * @param hit_threshold Valid pixels at or above this value are hits
+     * @param batch_size The number of images to read at a time
+     */
+    ImageSetScanner(double hit_threshold, std::size_t batch_size)
+      : hit_threshold_(hit_threshold),
+        batch_size_(batch_size) {
+      DXTBX_ASSERT(batch_size > 0);
+    }
+
+    /** @returns The hit threshold */
+    double hit_threshold() const {
+      return hit_threshold_;
+    }
+
+    /** @returns The number of images read at a time */
+    std::size_t batch_size() const {
+      return batch_size_;
+    }
+
+    /**
+     * Scan all the images
+     * @param imageset The imageset
+     * @returns The table of statistics
+     */
+    ImageSetScanTable scan(ImageSet &imageset) const {
+      return scan(imageset, 0, imageset.size());
+    }
+
+    /**
+     * Scan a range of images
+     * @param imageset The imageset
+     * @param first The first image
+     * @param last One past the last image
+     * @returns The table of statistics
+     */
+    ImageSetScanTable scan(
+        ImageSet &imageset,
+        std::size_t first,
+        std::size_t last) const {
+      DXTBX_ASSERT(first <= last && last <= imageset.size());
+      scitbx::af::shared<std::size_t> indices;
+      for (std::size_t i = first; i < last; ++i) {
+        indices.push_back(i);
+      }
+      Image<bool> static_mask = imageset.get_static_mask();
+      ImageSetScanTable table(indices, static_mask.n_tiles());
+      ImageSetData data = imageset.data();
+      scitbx::af::shared<std::size_t> data_indices = imageset.indices();
+
+      for (std::size_t start = first; start < last; start += batch_size_) {
+        std::size_t end = std::min(start + batch_size_, last);
+
+        // Read the batch of images and masks. Pointers to the data of each
+        // tile are collected here so no arrays are shared between threads.
+        std::vector< Image<int> > int_images;
+        std::vector< Image<double> > double_images;
+        std::vector< Image<bool> > masks;
+        std::vector<TileData> tiles;
+        for (std::size_t i = start; i < end; ++i) {
+          ImageBuffer buffer = imageset.get_raw_data(i);
+          Image<bool> mask = data.get_mask(data_indices[i]);
+          Detector detector = detail::safe_dereference(
+              imageset.get_detector_for_image(i));
+          DXTBX_ASSERT(detector.size() == static_mask.n_tiles());
+          DXTBX_ASSERT(mask.empty() || mask.n_tiles() == detector.size());
+          if (buffer.is_int()) {
+            int_images.push_back(buffer.as_int());
+          } else {
+            double_images.push_back(buffer.as_double());
+          }
+          masks.push_back(mask);
+          for (std::size_t j = 0; j < detector.size(); ++j) {
+            TileData tile;
+            tile.size = static_mask.tile(j).data().size();
+            tile.static_mask = static_mask.tile(j).data().begin();
+            tile.dynamic_mask = NULL;
+            if (!mask.empty()) {
+              DXTBX_ASSERT(mask.tile(j).data().size() == tile.size);
+              tile.dynamic_mask = mask.tile(j).data().begin();
+            }
+            tile.int_data = NULL;
+            tile.double_data = NULL;
+            if (buffer.is_int()) {
+              DXTBX_ASSERT(int_images.back().n_tiles() == detector.size());
+              DXTBX_ASSERT(int_images.back().tile(j).data().size() == tile.size);
+              tile.int_data = int_images.back().tile(j).data().begin();
+            } else {
+              DXTBX_ASSERT(double_images.back().n_tiles() == detector.size());
+              DXTBX_ASSERT(double_images.back().tile(j).data().size() == tile.size);
+              tile.double_data = double_images.back().tile(j).data().begin();
+            }
+            tile.trusted_range = detector[j].get_trusted_range();
+            tiles.push_back(tile);
+          }
+        }
+
+        // Scan the images in parallel
+        std::size_t n_panels = static_mask.n_tiles();
+        int n = (int)(end - start);
+        #pragma omp parallel for
+        for (int k = 0; k < n; ++k) {
+          std::size_t row = start - first + k;
+          for (std::size_t p = 0; p < n_panels; ++p) {
+            const TileData &tile = tiles[k * n_panels + p];
+            if (tile.int_data != NULL) {
+              scan_tile(tile.int_data, tile, table, row, p);
+            } else {
+              scan_tile(tile.double_data, tile, table, row, p);
+            }
+          }
+        }
+      }
+      return table;
+    }
+
+  protected:
+
+    /**
+     * The data, masks and trusted range of one tile of an image
+     */
+    struct TileData {
+      std::size_t size;
+      const int *int_data;
+      const double *double_data;
+      const bool *static_mask;
+      const bool *dynamic_mask;
+      tiny<double,2> trusted_range;
+    };
+
+    /**
+     * Fill a cell of the table from a tile
+     */
+    template <typename T>
+    void scan_tile(
+        const T *data,
+        const TileData &tile,
+        ImageSetScanTable &table,
+        std::size_t row,
+        std::size_t panel) const {
+      double lower = tile.trusted_range[0];
+      double upper = tile.trusted_range[1];
+      double sum = 0;
+      double raw_sum = 0;
+      double max = -std::numeric_limits<double>::max();
+      double raw_max = -std::numeric_limits<double>::max();
+      int n_valid = 0, n_overloads = 0, n_masked = 0, n_hits = 0;
+      for (std::size_t i = 0; i < tile.size; ++i) {
+        double value = data[i];
+        if (value >= 0) {
+          raw_sum += value;
+        }
+        raw_max = std::max(raw_max, value);
+        if (!tile.static_mask[i] ||
+            (tile.dynamic_mask != NULL && !tile.dynamic_mask[i]) ||
+            value <= lower) {
+          n_masked++;
+          continue;
+        }
+        max = std::max(max, value);
+        if (value >= upper) {
+          n_overloads++;
+          continue;
+        }
+        n_valid++;
+        sum += value;
+        if (value >= hit_threshold_) {
+          n_hits++;
+        }
+      }
+      std::size_t index = row * table.n_panels() + panel;
+      table.sum_[index] = sum;
+      table.raw_sum_[index] = raw_sum;
+      table.max_[index] = max;
+      table.raw_max_[index] = raw_max;
+      table.n_valid_[index] = n_valid;
+      table.n_overloads_[index] = n_overloads;
+      table.n_masked_[index] = n_masked;
+      table.n_hits_[index] = n_hits;
+    }
+
+    double hit_threshold_;
+    std::size_t batch_size_;
+  };
+
+} // namespace dxtbx
+
+#endif // DXTBX_IMAGESET_SCANNER_H
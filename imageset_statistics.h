@@ -0,0 +1,189 @@
+/*
+ * imageset_statistics.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+
+#ifndef DXTBX_IMAGESET_STATISTICS_H
+#define DXTBX_IMAGESET_STATISTICS_H
+
+#include <vector>
+#include <algorithm>
+#include <boost/python.hpp>
+#include <scitbx/array_family/ref.h>
+#include <scitbx/array_family/shared.h>
+#include <dxtbx/imageset.h>
+#include <dxtbx/format/image_statistics.h>
+#include <dxtbx/error.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace dxtbx {
+
+  using format::ImageStatistics;
+
+  /**
+   * Accumulate per pixel ImageStatistics over the images of an imageset in
+   * a single streaming pass.
+   *
+   * Images are read in batches on the calling thread, since reading may
+   * call back into python. Each batch is then shared out between the OpenMP
+   * threads in contiguous chunks, and every thread adds its images to its
+   * own partial statistics, so the frames are reduced in parallel without
+   * any locking. The partial states are merged, in thread order, once all
+   * the images have been read. Each partial holds the full per pixel
+   * state, so memory use grows with the number of threads.
+   */
+  class ImageSetStatisticsAccumulator {
+  public:
+
+    /**
+     * @param batch_size The number of images to read at a time
+     */
+    ImageSetStatisticsAccumulator(std::size_t batch_size)
+      : batch_size_(batch_size) {
+      DXTBX_ASSERT(batch_size > 0);
+    }
+
+    /** @returns The number of images read at a time */
+    std::size_t batch_size() const {
+      return batch_size_;
+    }
+
+    /**
+     * Add images of an imageset to the statistics. Images which can not be
+     * read are skipped.
+     * @param stats The statistics to add to
+     * @param imageset The imageset
+     * @param indices The indices of the images in the imageset
+     * @returns The indices of the images skipped
+     */
+    scitbx::af::shared<std::size_t> accumulate(
+        ImageStatistics &stats,
+        ImageSet &imageset,
+        const scitbx::af::const_ref<std::size_t> &indices) const {
+      std::size_t n_threads = 1;
+#ifdef _OPENMP
+      n_threads = std::max(1, omp_get_max_threads());
+#endif
+
+      // Copies of an empty accumulator would share their panel array, so
+      // each partial state is constructed separately
+      std::vector<ImageStatistics> partials;
+      partials.reserve(n_threads);
+      for (std::size_t t = 0; t < n_threads; ++t) {
+        partials.push_back(ImageStatistics(
+            stats.histogram_min(),
+            stats.histogram_max(),
+            stats.n_bins()));
+      }
+
+      // The tile sizes every image must have, from the statistics so far or
+      // the first image read
+      std::vector<std::size_t> heights, widths;
+      for (std::size_t i = 0; i < stats.n_panels(); ++i) {
+        heights.push_back(stats.panel(i).height);
+        widths.push_back(stats.panel(i).width);
+      }
+
+      scitbx::af::shared<std::size_t> skipped;
+      for (std::size_t start = 0; start < indices.size(); start += batch_size_) {
+        std::size_t end = std::min(start + batch_size_, indices.size());
+
+        // Read and check the batch here, since an error raised inside the
+        // parallel region can not be propagated
+        std::vector<ImageBuffer> images;
+        for (std::size_t i = start; i < end; ++i) {
+          DXTBX_ASSERT(indices[i] < imageset.size());
+          ImageBuffer buffer;
+          try {
+            buffer = imageset.get_raw_data(indices[i]);
+          } catch (const boost::python::error_already_set&) {
+            if (PyErr_ExceptionMatches(PyExc_KeyboardInterrupt)) {
+              throw;
+            }
+            PyErr_Clear();
+            skipped.push_back(indices[i]);
+            continue;
+          } catch (const std::exception&) {
+            skipped.push_back(indices[i]);
+            continue;
+          }
+          check_image(buffer, heights, widths);
+          images.push_back(buffer);
+        }
+
+        // Add contiguous chunks of the batch to each partial state
+        int n_chunks = (int)n_threads;
+        std::size_t n_images = images.size();
+        bool failed = false;
+        #pragma omp parallel for schedule(static)
+        for (int t = 0; t < n_chunks; ++t) {
+          std::size_t first = t * n_images / n_chunks;
+          std::size_t last = (t + 1) * n_images / n_chunks;
+          try {
+            for (std::size_t i = first; i < last; ++i) {
+              partials[t].add(images[i]);
+            }
+          } catch (const std::exception&) {
+            #pragma omp critical
+            failed = true;
+          }
+        }
+        if (failed) {
+          throw DXTBX_ERROR("Error accumulating image statistics");
+        }
+      }
+
+      // Reduce the partial states
+      for (std::size_t t = 0; t < partials.size(); ++t) {
+        stats.merge(partials[t]);
+      }
+      return skipped;
+    }
+
+  protected:
+
+    /**
+     * Check an image has the tile sizes of the others, setting them from
+     * the first image
+     */
+    static void check_image(
+        const ImageBuffer &buffer,
+        std::vector<std::size_t> &heights,
+        std::vector<std::size_t> &widths) {
+      std::vector<std::size_t> h, w;
+      if (buffer.is_int()) {
+        tile_sizes(buffer.as_int(), h, w);
+      } else if (buffer.is_double()) {
+        tile_sizes(buffer.as_double(), h, w);
+      } else {
+        throw DXTBX_ERROR("ImageBuffer is empty");
+      }
+      if (heights.empty()) {
+        heights = h;
+        widths = w;
+      }
+      DXTBX_ASSERT(h == heights && w == widths);
+    }
+
+    template <typename T>
+    static void tile_sizes(
+        const Image<T> &image,
+        std::vector<std::size_t> &heights,
+        std::vector<std::size_t> &widths) {
+      for (std::size_t i = 0; i < image.n_tiles(); ++i) {
+        heights.push_back(image.tile(i).data().accessor()[0]);
+        widths.push_back(image.tile(i).data().accessor()[1]);
+      }
+    }
+
+    std::size_t batch_size_;
+  };
+
+} // namespace dxtbx
+
+#endif // DXTBX_IMAGESET_STATISTICS_H
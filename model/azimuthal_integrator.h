@@ -0,0 +1,569 @@
+/*
+ * azimuthal_integrator.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_AZIMUTHAL_INTEGRATOR_H
+#define DXTBX_MODEL_AZIMUTHAL_INTEGRATOR_H
+
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <scitbx/vec2.h>
+#include <scitbx/vec3.h>
+#include <scitbx/mat3.h>
+#include <scitbx/constants.h>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+#include <dxtbx/model/beam.h>
+#include <dxtbx/model/detector.h>
+#include <dxtbx/format/image.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace model {
+
+  using scitbx::vec3;
+  using format::Image;
+
+  /**
+   * The result of an azimuthal integration: the weighted sum, sum of squares
+   * and total weight of the corrected pixel values in each (chi, q) bin.
+   */
+  class AzimuthalProfile {
+  public:
+
+    typedef scitbx::af::versa< double, scitbx::af::c_grid<2> > array_type;
+
+    AzimuthalProfile() {}
+
+    /**
+     * Initialise with all bins empty
+     * @param n_chi_bins The number of azimuthal bins
+     * @param n_q_bins The number of radial bins
+     */
+    AzimuthalProfile(std::size_t n_chi_bins, std::size_t n_q_bins)
+      : sum_(scitbx::af::c_grid<2>(n_chi_bins, n_q_bins), 0),
+        sum_sq_(scitbx::af::c_grid<2>(n_chi_bins, n_q_bins), 0),
+        count_(scitbx::af::c_grid<2>(n_chi_bins, n_q_bins), 0) {}
+
+    /** @returns The weighted sum of values in each bin */
+    array_type sum() const {
+      return sum_;
+    }
+
+    /** @returns The weighted sum of squared values in each bin */
+    array_type sum_sq() const {
+      return sum_sq_;
+    }
+
+    /** @returns The total pixel weight in each bin */
+    array_type count() const {
+      return count_;
+    }
+
+    /** @returns The mean value in each bin (0 for empty bins) */
+    array_type mean() const {
+      array_type result(sum_.accessor(), 0);
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        if (count_[i] > 0) {
+          result[i] = sum_[i] / count_[i];
+        }
+      }
+      return result;
+    }
+
+    /** @returns The standard deviation of the values in each bin */
+    array_type standard_deviation() const {
+      array_type result(sum_.accessor(), 0);
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        if (count_[i] > 0) {
+          double mean = sum_[i] / count_[i];
+          result[i] = std::sqrt(std::max(sum_sq_[i] / count_[i] - mean * mean, 0.0));
+        }
+      }
+      return result;
+    }
+
+    /**
+     * Add the bins of another profile, e.g. to accumulate over frames
+     * @param other The other profile
+     */
+    void add(const AzimuthalProfile &other) {
+      DXTBX_ASSERT(other.sum_.size() == sum_.size());
+      for (std::size_t i = 0; i < sum_.size(); ++i) {
+        sum_[i] += other.sum_[i];
+        sum_sq_[i] += other.sum_sq_[i];
+        count_[i] += other.count_[i];
+      }
+    }
+
+  protected:
+
+    friend class AzimuthalIntegrator;
+
+    array_type sum_;
+    array_type sum_sq_;
+    array_type count_;
+  };
+
+  /**
+   * Azimuthal integration of images in (chi, q) bins.
+   *
+   * The assignment of pixels to bins depends only on the beam and detector
+   * models, so it is computed once when the integrator is constructed, as a
+   * sparse matrix from pixels to bins. Each pixel is split into n x n
+   * sub-pixels which are assigned to bins separately, giving the fraction
+   * of the pixel that falls in each bin. Integrating a frame is then a
+   * sparse matrix-vector product, parallelised over bins with OpenMP.
+   *
+   * Optionally each pixel value is divided by the relative solid angle of
+   * the pixel (normalised to the largest on the detector) and by the
+   * polarization factor of the beam. The chi angle is measured around the
+   * beam from the laboratory x axis.
+   */
+  class AzimuthalIntegrator {
+  public:
+
+    /**
+     * Compute the pixel to bin assignment
+     * @param beam The beam model
+     * @param detector The detector model
+     * @param n_q_bins The number of radial bins
+     * @param n_chi_bins The number of azimuthal bins
+     * @param n_subdivide The number of sub-pixels along each pixel edge
+     * @param solid_angle Correct for the pixel solid angle
+     * @param polarization Correct for the polarization of the beam
+     * @param q_min The lower edge of the first radial bin
+     * @param q_max The upper edge of the last radial bin. If not greater
+     *              than q_min the range covered by the detector is used.
+     */
+    AzimuthalIntegrator(
+        const BeamBase &beam,
+        const Detector &detector,
+        std::size_t n_q_bins,
+        std::size_t n_chi_bins,
+        std::size_t n_subdivide,
+        bool solid_angle,
+        bool polarization,
+        double q_min,
+        double q_max)
+      : n_q_bins_(n_q_bins),
+        n_chi_bins_(n_chi_bins),
+        n_subdivide_(n_subdivide),
+        solid_angle_(solid_angle),
+        polarization_(polarization),
+        q_min_(q_min),
+        q_max_(q_max) {
+      DXTBX_ASSERT(n_q_bins > 0);
+      DXTBX_ASSERT(n_chi_bins > 0);
+      DXTBX_ASSERT(n_subdivide > 0);
+      DXTBX_ASSERT(detector.size() > 0);
+
+      // Axes perpendicular to the beam from which chi is measured
+      vec3<double> s0 = beam.get_s0();
+      DXTBX_ASSERT(s0.length() > 0);
+      vec3<double> unit_s0 = s0.normalize();
+      vec3<double> x_axis(1, 0, 0);
+      if (std::abs(x_axis * unit_s0) > 0.999) {
+        x_axis = vec3<double>(0, 1, 0);
+      }
+      x_axis_ = (x_axis - unit_s0 * (x_axis * unit_s0)).normalize();
+      y_axis_ = unit_s0.cross(x_axis_);
+
+      fingerprint_ = make_fingerprint(beam, detector);
+      if (!(q_max_ > q_min_)) {
+        compute_q_range(s0, detector);
+      }
+      DXTBX_ASSERT(q_max_ > q_min_);
+
+      // Compute the corrections and the sparse matrix of each panel. The
+      // correction is stored as the reciprocal of the factor.
+      double max_solid_angle = 0;
+      for (std::size_t p = 0; p < detector.size(); ++p) {
+        panels_.push_back(PanelMatrix());
+        max_solid_angle = std::max(max_solid_angle,
+          compute_corrections(beam, detector[p], panels_.back()));
+      }
+      for (std::size_t p = 0; p < detector.size(); ++p) {
+        PanelMatrix &matrix = panels_[p];
+        for (std::size_t i = 0; i < matrix.correction.size(); ++i) {
+          double factor = matrix.correction[i];
+          if (solid_angle_) {
+            factor /= max_solid_angle;
+          }
+          matrix.correction[i] = factor > 0 ? 1.0 / factor : 0.0;
+        }
+        compute_matrix(s0, detector[p], matrix);
+      }
+    }
+
+    /** @returns The number of radial bins */
+    std::size_t n_q_bins() const {
+      return n_q_bins_;
+    }
+
+    /** @returns The number of azimuthal bins */
+    std::size_t n_chi_bins() const {
+      return n_chi_bins_;
+    }
+
+    /** @returns The number of sub-pixels along each pixel edge */
+    std::size_t n_subdivide() const {
+      return n_subdivide_;
+    }
+
+    /** @returns The lower edge of the first radial bin */
+    double q_min() const {
+      return q_min_;
+    }
+
+    /** @returns The upper edge of the last radial bin */
+    double q_max() const {
+      return q_max_;
+    }
+
+    /** @returns The centre of each radial bin */
+    scitbx::af::shared<double> q_centres() const {
+      scitbx::af::shared<double> result(n_q_bins_);
+      double width = (q_max_ - q_min_) / n_q_bins_;
+      for (std::size_t i = 0; i < n_q_bins_; ++i) {
+        result[i] = q_min_ + (i + 0.5) * width;
+      }
+      return result;
+    }
+
+    /** @returns The centre of each azimuthal bin (radians) */
+    scitbx::af::shared<double> chi_centres() const {
+      scitbx::af::shared<double> result(n_chi_bins_);
+      double width = 2.0 * scitbx::constants::pi / n_chi_bins_;
+      for (std::size_t i = 0; i < n_chi_bins_; ++i) {
+        result[i] = -scitbx::constants::pi + (i + 0.5) * width;
+      }
+      return result;
+    }
+
+    /** @returns The number of non-zero elements of the sparse matrix */
+    std::size_t n_elements() const {
+      std::size_t count = 0;
+      for (std::size_t p = 0; p < panels_.size(); ++p) {
+        count += panels_[p].column.size();
+      }
+      return count;
+    }
+
+    /** @returns The total pixel weight assigned to each bin */
+    AzimuthalProfile::array_type bin_weights() const {
+      AzimuthalProfile::array_type result(
+          scitbx::af::c_grid<2>(n_chi_bins_, n_q_bins_), 0);
+      for (std::size_t p = 0; p < panels_.size(); ++p) {
+        const PanelMatrix &matrix = panels_[p];
+        for (std::size_t b = 0; b < result.size(); ++b) {
+          for (std::size_t k = matrix.row[b]; k < matrix.row[b+1]; ++k) {
+            result[b] += matrix.weight[k];
+          }
+        }
+      }
+      return result;
+    }
+
+    /**
+     * Check if the assignment can be reused for another set of models
+     * @param beam The beam model
+     * @param detector The detector model
+     * @param tolerance The tolerance on the vectors and lengths
+     * @returns True if the geometry is the same
+     */
+    bool is_similar_to(
+        const BeamBase &beam,
+        const Detector &detector,
+        double tolerance) const {
+      std::vector<double> other = make_fingerprint(beam, detector);
+      if (other.size() != fingerprint_.size()) {
+        return false;
+      }
+      for (std::size_t i = 0; i < other.size(); ++i) {
+        if (std::abs(other[i] - fingerprint_[i]) > tolerance) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /**
+     * Integrate an image
+     * @param image The image
+     * @returns The profile
+     */
+    template <typename T>
+    AzimuthalProfile integrate(const Image<T> &image) const {
+      return integrate(image, Image<bool>());
+    }
+
+    /**
+     * Integrate the unmasked pixels of an image
+     * @param image The image
+     * @param mask The mask (true for good pixels), or an empty image
+     * @returns The profile
+     */
+    template <typename T>
+    AzimuthalProfile integrate(
+        const Image<T> &image,
+        const Image<bool> &mask) const {
+      DXTBX_ASSERT(image.n_tiles() == panels_.size());
+      DXTBX_ASSERT(mask.n_tiles() == 0 || mask.n_tiles() == panels_.size());
+      AzimuthalProfile result(n_chi_bins_, n_q_bins_);
+      double *sum = &result.sum_[0];
+      double *sum_sq = &result.sum_sq_[0];
+      double *count = &result.count_[0];
+      int n_bins = (int)(n_chi_bins_ * n_q_bins_);
+      for (std::size_t p = 0; p < panels_.size(); ++p) {
+        const PanelMatrix &matrix = panels_[p];
+        DXTBX_ASSERT(image.tile(p).data().accessor()[0] == matrix.height);
+        DXTBX_ASSERT(image.tile(p).data().accessor()[1] == matrix.width);
+        const T *data = image.tile(p).data().begin();
+        const bool *good = NULL;
+        if (mask.n_tiles() > 0) {
+          DXTBX_ASSERT(mask.tile(p).data().accessor()[0] == matrix.height);
+          DXTBX_ASSERT(mask.tile(p).data().accessor()[1] == matrix.width);
+          good = mask.tile(p).data().begin();
+        }
+        #pragma omp parallel for
+        for (int b = 0; b < n_bins; ++b) {
+          double s = 0, ss = 0, c = 0;
+          for (std::size_t k = matrix.row[b]; k < matrix.row[b+1]; ++k) {
+            int i = matrix.column[k];
+            if (good == NULL || good[i]) {
+              double w = matrix.weight[k];
+              double v = data[i] * matrix.correction[i];
+              s += w * v;
+              ss += w * v * v;
+              c += w;
+            }
+          }
+          sum[b] += s;
+          sum_sq[b] += ss;
+          count[b] += c;
+        }
+      }
+      return result;
+    }
+
+  protected:
+
+    /**
+     * The sparse matrix for one panel in compressed row format: the pixels
+     * contributing to bin b are column[row[b]] .. column[row[b+1]-1].
+     */
+    struct PanelMatrix {
+      std::size_t height;
+      std::size_t width;
+      std::vector<double> correction;
+      std::vector<std::size_t> row;
+      std::vector<int> column;
+      std::vector<double> weight;
+    };
+
+    /**
+     * The parameters on which the assignment depends
+     */
+    std::vector<double> make_fingerprint(
+        const BeamBase &beam,
+        const Detector &detector) const {
+      std::vector<double> result;
+      vec3<double> s0 = beam.get_s0();
+      vec3<double> pn = beam.get_polarization_normal();
+      result.insert(result.end(), s0.begin(), s0.end());
+      result.insert(result.end(), pn.begin(), pn.end());
+      result.push_back(beam.get_polarization_fraction());
+      for (std::size_t p = 0; p < detector.size(); ++p) {
+        const Panel &panel = detector[p];
+        scitbx::mat3<double> d = panel.get_d_matrix();
+        result.insert(result.end(), d.begin(), d.end());
+        result.push_back(panel.get_pixel_size()[0]);
+        result.push_back(panel.get_pixel_size()[1]);
+        result.push_back(panel.get_image_size()[0]);
+        result.push_back(panel.get_image_size()[1]);
+      }
+      return result;
+    }
+
+    /**
+     * @returns The q of the ray through a lab coordinate
+     */
+    static double compute_q(vec3<double> s0, vec3<double> r) {
+      vec3<double> s1 = r.normalize() * s0.length();
+      return 2.0 * scitbx::constants::pi * (s1 - s0).length();
+    }
+
+    /**
+     * @returns The chi of a lab coordinate in [-pi, pi]
+     */
+    double compute_chi(vec3<double> r) const {
+      return std::atan2(r * y_axis_, r * x_axis_);
+    }
+
+    /**
+     * Find the q range covered by the pixel corners of all panels, from 0
+     * if the beam meets the detector
+     */
+    void compute_q_range(vec3<double> s0, const Detector &detector) {
+      q_min_ = std::numeric_limits<double>::max();
+      q_max_ = 0;
+      for (std::size_t p = 0; p < detector.size(); ++p) {
+        const Panel &panel = detector[p];
+        std::size_t width = panel.get_image_size()[0];
+        std::size_t height = panel.get_image_size()[1];
+        for (std::size_t j = 0; j <= height; ++j) {
+          for (std::size_t i = 0; i <= width; ++i) {
+            double q = compute_q(s0, panel.get_pixel_lab_coord(
+                  scitbx::af::tiny<double,2>(i, j)));
+            q_min_ = std::min(q_min_, q);
+            q_max_ = std::max(q_max_, q);
+          }
+        }
+        try {
+          scitbx::vec2<double> xy = panel.get_ray_intersection_px(s0);
+          if (panel.is_coord_valid(xy)) {
+            q_min_ = 0;
+          }
+        } catch (dxtbx::error const&) {
+          // The beam does not meet the panel
+        }
+      }
+    }
+
+    /**
+     * Compute the solid angle and polarization factor of each pixel. The
+     * solid angle is normalised afterwards over the whole detector.
+     * @returns The largest solid angle of a pixel
+     */
+    double compute_corrections(
+        const BeamBase &beam,
+        const Panel &panel,
+        PanelMatrix &matrix) const {
+      matrix.width = panel.get_image_size()[0];
+      matrix.height = panel.get_image_size()[1];
+      matrix.correction.resize(matrix.width * matrix.height);
+      vec3<double> s0 = beam.get_s0();
+      vec3<double> pn = beam.get_polarization_normal();
+      double fa = beam.get_polarization_fraction();
+      vec3<double> normal = panel.get_normal();
+      double area = panel.get_pixel_size()[0] * panel.get_pixel_size()[1];
+      double max_solid_angle = 0;
+      for (std::size_t j = 0; j < matrix.height; ++j) {
+        for (std::size_t i = 0; i < matrix.width; ++i) {
+          vec3<double> r = panel.get_pixel_lab_coord(
+              scitbx::af::tiny<double,2>(i + 0.5, j + 0.5));
+          double length = r.length();
+          double factor = 1.0;
+          if (solid_angle_) {
+            double solid_angle =
+              area * std::abs(normal * r) / (length * length * length);
+            max_solid_angle = std::max(max_solid_angle, solid_angle);
+            factor *= solid_angle;
+          }
+          if (polarization_) {
+            double p1 = (pn * r) / length;
+            double p2 = (1.0 - 2.0 * fa) * (1.0 - p1 * p1);
+            double p3 = (s0 * r) / (s0.length() * length);
+            double p4 = fa * (1.0 + p3 * p3);
+            factor *= p2 + p4;
+          }
+          matrix.correction[i + j * matrix.width] = factor;
+        }
+      }
+      return max_solid_angle;
+    }
+
+    /**
+     * Assign the sub-pixels of each pixel of a panel to bins and build the
+     * sparse matrix
+     */
+    void compute_matrix(
+        vec3<double> s0,
+        const Panel &panel,
+        PanelMatrix &matrix) const {
+      std::size_t n_bins = n_chi_bins_ * n_q_bins_;
+      double q_scale = n_q_bins_ / (q_max_ - q_min_);
+      double chi_scale = n_chi_bins_ / (2.0 * scitbx::constants::pi);
+      double sub_weight = 1.0 / (n_subdivide_ * n_subdivide_);
+
+      // The (bin, pixel, weight) elements, in pixel order
+      std::vector<std::size_t> bins;
+      std::vector<int> pixels;
+      std::vector<double> weights;
+      std::vector<std::size_t> pixel_bins;
+      for (std::size_t j = 0; j < matrix.height; ++j) {
+        for (std::size_t i = 0; i < matrix.width; ++i) {
+          pixel_bins.clear();
+          for (std::size_t sj = 0; sj < n_subdivide_; ++sj) {
+            for (std::size_t si = 0; si < n_subdivide_; ++si) {
+              vec3<double> r = panel.get_pixel_lab_coord(
+                  scitbx::af::tiny<double,2>(
+                    i + (si + 0.5) / n_subdivide_,
+                    j + (sj + 0.5) / n_subdivide_));
+              double q = compute_q(s0, r);
+              int iq = (int)std::floor((q - q_min_) * q_scale);
+              if (q == q_max_) {
+                iq = (int)n_q_bins_ - 1;
+              }
+              if (iq < 0 || iq >= (int)n_q_bins_) {
+                continue;
+              }
+              int ichi = (int)std::floor(
+                  (compute_chi(r) + scitbx::constants::pi) * chi_scale);
+              ichi = std::min(std::max(ichi, 0), (int)n_chi_bins_ - 1);
+              pixel_bins.push_back(ichi * n_q_bins_ + iq);
+            }
+          }
+          std::sort(pixel_bins.begin(), pixel_bins.end());
+          for (std::size_t k = 0; k < pixel_bins.size(); ) {
+            std::size_t l = k;
+            while (l < pixel_bins.size() && pixel_bins[l] == pixel_bins[k]) {
+              ++l;
+            }
+            bins.push_back(pixel_bins[k]);
+            pixels.push_back((int)(i + j * matrix.width));
+            weights.push_back((l - k) * sub_weight);
+            k = l;
+          }
+        }
+      }
+
+      // Sort the elements by bin
+      matrix.row.assign(n_bins + 1, 0);
+      for (std::size_t k = 0; k < bins.size(); ++k) {
+        matrix.row[bins[k] + 1] += 1;
+      }
+      for (std::size_t b = 0; b < n_bins; ++b) {
+        matrix.row[b + 1] += matrix.row[b];
+      }
+      matrix.column.resize(bins.size());
+      matrix.weight.resize(bins.size());
+      std::vector<std::size_t> next(matrix.row.begin(), matrix.row.end() - 1);
+      for (std::size_t k = 0; k < bins.size(); ++k) {
+        std::size_t index = next[bins[k]]++;
+        matrix.column[index] = pixels[k];
+        matrix.weight[index] = weights[k];
+      }
+    }
+
+    std::size_t n_q_bins_;
+    std::size_t n_chi_bins_;
+    std::size_t n_subdivide_;
+    bool solid_angle_;
+    bool polarization_;
+    double q_min_;
+    double q_max_;
+    vec3<double> x_axis_;
+    vec3<double> y_axis_;
+    std::vector<double> fingerprint_;
+    std::vector<PanelMatrix> panels_;
+  };
+
+}} // namespace dxtbx::model
+
+#endif // DXTBX_MODEL_AZIMUTHAL_INTEGRATOR_H
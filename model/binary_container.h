@@ -0,0 +1,406 @@
+/*
+ * binary_container.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_BINARY_CONTAINER_H
+#define DXTBX_MODEL_BINARY_CONTAINER_H
+
+#include <string>
+#include <vector>
+#include <limits>
+#include <fstream>
+#include <iterator>
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <scitbx/array_family/ref.h>
+#include <scitbx/array_family/shared.h>
+#include <dxtbx/error.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace dxtbx { namespace model {
+
+  /**
+   * A flat binary container of records referring to items in a number of
+   * pools. It is used to store experiment lists: each pool holds the
+   * serialised models of one kind (identifiers, beams, detectors, ...)
+   * and each record holds, for one experiment, the index of its model in
+   * each pool (or -1 for none). Shared models are stored once.
+   *
+   * The layout is:
+   *
+   *   char[8]  magic "DXTBXBIN"
+   *   u64      version
+   *   u64      number of pools (P)
+   *   u64      number of records (R)
+   *   u64[P]   number of items in each pool
+   *   i64[R*P] record table
+   *   for each pool with N items: u64[N+1] item offsets into the data
+   *   char[]   item data
+   *
+   * All integers are little endian. The positions of all the tables follow
+   * from the header, so a reader can access any record or item directly
+   * without parsing the rest of the buffer.
+   */
+  class BinaryContainerWriter {
+  public:
+
+    /**
+     * Initialise the container
+     * @param n_pools The number of item pools
+     */
+    BinaryContainerWriter(std::size_t n_pools)
+      : items_(n_pools) {
+      DXTBX_ASSERT(n_pools > 0);
+    }
+
+    /** @returns The number of pools */
+    std::size_t n_pools() const {
+      return items_.size();
+    }
+
+    /** @returns The number of records */
+    std::size_t n_records() const {
+      return records_.size() / n_pools();
+    }
+
+    /** @returns The number of items in a pool */
+    std::size_t n_items(std::size_t pool) const {
+      DXTBX_ASSERT(pool < n_pools());
+      return items_[pool].size();
+    }
+
+    /**
+     * Add an item to a pool
+     * @param pool The pool
+     * @param data The item data
+     * @returns The index of the item in the pool
+     */
+    std::size_t add_item(std::size_t pool, const std::string &data) {
+      DXTBX_ASSERT(pool < n_pools());
+      items_[pool].push_back(data);
+      return items_[pool].size() - 1;
+    }
+
+    /**
+     * Add a record
+     * @param indices The index of an item in each pool, or -1 for none
+     */
+    void add_record(const scitbx::af::const_ref<int> &indices) {
+      DXTBX_ASSERT(indices.size() == n_pools());
+      for (std::size_t i = 0; i < indices.size(); ++i) {
+        DXTBX_ASSERT(indices[i] >= -1 && indices[i] < (int)n_items(i));
+        records_.push_back(indices[i]);
+      }
+    }
+
+    /**
+     * @returns The serialised container
+     */
+    std::string data() const {
+      std::string result;
+      result.append(magic(), 8);
+      write_u64(result, version());
+      write_u64(result, n_pools());
+      write_u64(result, n_records());
+      for (std::size_t i = 0; i < n_pools(); ++i) {
+        write_u64(result, items_[i].size());
+      }
+      for (std::size_t i = 0; i < records_.size(); ++i) {
+        write_u64(result, (unsigned long long)(long long)records_[i]);
+      }
+      std::size_t offset = 0;
+      for (std::size_t i = 0; i < n_pools(); ++i) {
+        write_u64(result, offset);
+        for (std::size_t j = 0; j < items_[i].size(); ++j) {
+          offset += items_[i][j].size();
+          write_u64(result, offset);
+        }
+      }
+      for (std::size_t i = 0; i < n_pools(); ++i) {
+        for (std::size_t j = 0; j < items_[i].size(); ++j) {
+          result.append(items_[i][j]);
+        }
+      }
+      return result;
+    }
+
+    /** @returns The magic bytes at the start of the container */
+    static const char* magic() {
+      return "DXTBXBIN";
+    }
+
+    /** @returns The version of the layout */
+    static std::size_t version() {
+      return 2;
+    }
+
+  protected:
+
+    static void write_u64(std::string &buffer, unsigned long long value) {
+      for (std::size_t i = 0; i < 8; ++i) {
+        buffer.push_back((char)((value >> (8 * i)) & 0xff));
+      }
+    }
+
+    std::vector< std::vector<std::string> > items_;
+    std::vector<int> records_;
+  };
+
+  /**
+   * The bytes of a container, either held in memory or mapped read only
+   * from a file. On Windows files are read into memory instead.
+   */
+  class BinaryContainerBuffer : boost::noncopyable {
+  public:
+
+    /**
+     * Hold a copy of the data in memory
+     * @param data The container data
+     */
+    BinaryContainerBuffer(const std::string &data)
+      : data_(data),
+        mapping_(NULL),
+        size_(data.size()) {}
+
+    /**
+     * Map a file
+     * @param filename The container file
+     * @param map_file Map the file rather than reading it
+     */
+    BinaryContainerBuffer(const std::string &filename, bool map_file)
+      : mapping_(NULL),
+        size_(0) {
+#ifndef _WIN32
+      if (map_file) {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+          throw DXTBX_ERROR("Unable to open " + filename);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+          close(fd);
+          throw DXTBX_ERROR("Unable to stat " + filename);
+        }
+        size_ = info.st_size;
+        if (size_ > 0) {
+          void *mapping = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+          if (mapping == MAP_FAILED) {
+            close(fd);
+            throw DXTBX_ERROR("Unable to map " + filename);
+          }
+          mapping_ = (const char *)mapping;
+        }
+        close(fd);
+        return;
+      }
+#endif
+      std::ifstream stream(filename.c_str(), std::ios::binary);
+      if (!stream) {
+        throw DXTBX_ERROR("Unable to open " + filename);
+      }
+      data_.assign(std::istreambuf_iterator<char>(stream),
+                   std::istreambuf_iterator<char>());
+      size_ = data_.size();
+    }
+
+    ~BinaryContainerBuffer() {
+#ifndef _WIN32
+      if (mapping_ != NULL) {
+        munmap((void *)mapping_, size_);
+      }
+#endif
+    }
+
+    /** @returns The first byte */
+    const char* begin() const {
+      return mapping_ != NULL ? mapping_ : data_.data();
+    }
+
+    /** @returns The number of bytes */
+    std::size_t size() const {
+      return size_;
+    }
+
+  protected:
+
+    std::string data_;
+    const char *mapping_;
+    std::size_t size_;
+  };
+
+  /**
+   * Read a container written by BinaryContainerWriter. Only the header is
+   * read on construction; records and items are read on request, so when
+   * the container is mapped from a file only the pages used are read.
+   */
+  class BinaryContainerReader {
+  public:
+
+    /**
+     * Initialise from the serialised container
+     * @param buffer The container data
+     */
+    BinaryContainerReader(const std::string &buffer)
+      : buffer_(new BinaryContainerBuffer(buffer)) {
+      read_header();
+    }
+
+    /**
+     * Initialise from a container file
+     * @param filename The container file
+     * @param map_file Map the file rather than reading it into memory
+     */
+    BinaryContainerReader(const std::string &filename, bool map_file)
+      : buffer_(new BinaryContainerBuffer(filename, map_file)) {
+      read_header();
+    }
+
+    /** @returns The number of pools */
+    std::size_t n_pools() const {
+      return n_pools_;
+    }
+
+    /** @returns The number of records */
+    std::size_t n_records() const {
+      return n_records_;
+    }
+
+    /** @returns The number of items in a pool */
+    std::size_t n_items(std::size_t pool) const {
+      DXTBX_ASSERT(pool < n_pools_);
+      return n_items_[pool];
+    }
+
+    /**
+     * @param index The record index
+     * @returns The item index in each pool, or -1 for none
+     */
+    scitbx::af::shared<int> record(std::size_t index) const {
+      DXTBX_ASSERT(index < n_records_);
+      scitbx::af::shared<int> result(n_pools_);
+      std::size_t offset = records_offset_ + 8 * index * n_pools_;
+      for (std::size_t i = 0; i < n_pools_; ++i) {
+        result[i] = (int)(long long)read_u64(offset + 8 * i);
+      }
+      return result;
+    }
+
+    /**
+     * @param pool The pool
+     * @param index The item index
+     * @returns The item data
+     */
+    std::string item(std::size_t pool, std::size_t index) const {
+      DXTBX_ASSERT(pool < n_pools_);
+      DXTBX_ASSERT(index < n_items_[pool]);
+      std::size_t first = read_size(item_table_offset_[pool] + 8 * index);
+      std::size_t last = read_size(item_table_offset_[pool] + 8 * (index + 1));
+      DXTBX_ASSERT(first <= last);
+      check_data(last);
+      return std::string(buffer_->begin() + data_offset_ + first, last - first);
+    }
+
+  protected:
+
+    /**
+     * Read the header and compute the positions of the tables
+     */
+    void read_header() {
+      if (buffer_->size() < 32 ||
+          std::string(buffer_->begin(), 8) != BinaryContainerWriter::magic()) {
+        throw DXTBX_ERROR("Not a dxtbx binary container");
+      }
+      if (read_u64(8) != BinaryContainerWriter::version()) {
+        throw DXTBX_ERROR("Unsupported dxtbx binary container version");
+      }
+
+      // The counts come from the file, so each table is checked against the
+      // remaining buffer before any offsets are multiplied out
+      n_pools_ = read_size(16);
+      n_records_ = read_size(24);
+      check_table(32, n_pools_);
+      n_items_.resize(n_pools_);
+      for (std::size_t i = 0; i < n_pools_; ++i) {
+        n_items_[i] = read_size(32 + 8 * i);
+      }
+      records_offset_ = 32 + 8 * n_pools_;
+      if (n_pools_ > 0) {
+        check_table(records_offset_, 0);
+        if (n_records_ > (buffer_->size() - records_offset_) / 8 / n_pools_) {
+          throw DXTBX_ERROR("Truncated dxtbx binary container");
+        }
+      }
+      std::size_t offset = records_offset_ + 8 * n_records_ * n_pools_;
+      item_table_offset_.resize(n_pools_);
+      for (std::size_t i = 0; i < n_pools_; ++i) {
+        check_table(offset, n_items_[i]);
+        check_table(offset + 8 * n_items_[i], 1);
+        item_table_offset_[i] = offset;
+        offset += 8 * (n_items_[i] + 1);
+      }
+      data_offset_ = offset;
+      if (n_pools_ > 0) {
+        std::size_t last = n_pools_ - 1;
+        check_data(read_size(item_table_offset_[last] + 8 * n_items_[last]));
+      }
+    }
+
+    /**
+     * Check that a table of n 8 byte values at an offset lies within the
+     * buffer, without forming any product which could overflow
+     */
+    void check_table(std::size_t offset, std::size_t n) const {
+      if (offset > buffer_->size() || n > (buffer_->size() - offset) / 8) {
+        throw DXTBX_ERROR("Truncated dxtbx binary container");
+      }
+    }
+
+    /**
+     * Check that the data section holds at least size bytes
+     */
+    void check_data(std::size_t size) const {
+      if (size > buffer_->size() - data_offset_) {
+        throw DXTBX_ERROR("Truncated dxtbx binary container");
+      }
+    }
+
+    unsigned long long read_u64(std::size_t offset) const {
+      const char *data = buffer_->begin() + offset;
+      unsigned long long value = 0;
+      for (std::size_t i = 0; i < 8; ++i) {
+        value |= (unsigned long long)(unsigned char)data[i] << (8 * i);
+      }
+      return value;
+    }
+
+    /**
+     * Read a count or offset, which must fit in a std::size_t
+     */
+    std::size_t read_size(std::size_t offset) const {
+      unsigned long long value = read_u64(offset);
+      if (value > (unsigned long long)std::numeric_limits<std::size_t>::max()) {
+        throw DXTBX_ERROR("Truncated dxtbx binary container");
+      }
+      return (std::size_t)value;
+    }
+
+    boost::shared_ptr<BinaryContainerBuffer> buffer_;
+    std::size_t n_pools_;
+    std::size_t n_records_;
+    std::vector<std::size_t> n_items_;
+    std::size_t records_offset_;
+    std::vector<std::size_t> item_table_offset_;
+    std::size_t data_offset_;
+  };
+
+}} // namespace dxtbx::model
+
+#endif // DXTBX_MODEL_BINARY_CONTAINER_H
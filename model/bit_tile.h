@@ -0,0 +1,267 @@
+/*
+ * bit_tile.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_BIT_TILE_H
+#define DXTBX_MODEL_BIT_TILE_H
+
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <dxtbx/error.h>
+#include <scitbx/array_family/ref.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+
+namespace dxtbx { namespace model {
+
+  namespace detail {
+
+    /**
+     * Count the set bits in a word
+     */
+    inline
+    std::size_t popcount(boost::uint64_t w) {
+#if defined(__GNUC__) || defined(__clang__)
+      return __builtin_popcountll(w);
+#else
+      w = w - ((w >> 1) & 0x5555555555555555ULL);
+      w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+      w = (w + (w >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+      return (std::size_t)((w * 0x0101010101010101ULL) >> 56);
+#endif
+    }
+
+  }
+
+
+  /**
+   * A bit packed mask for a single detector panel. Each row of the tile is
+   * stored as a whole number of 64 bit words with one bit per pixel; the
+   * padding bits at the end of each row are always zero so that whole word
+   * operations (and, or, popcount) can be used everywhere. Like ImageTile,
+   * copies share the same underlying storage.
+   */
+  class BitTile {
+  public:
+
+    typedef boost::uint64_t word_type;
+    typedef scitbx::af::c_grid<2> accessor_type;
+
+    enum { bits_per_word = 64 };
+
+    /**
+     * Construct an empty tile
+     */
+    BitTile()
+      : accessor_(0, 0),
+        words_per_row_(0) {}
+
+    /**
+     * Construct a tile with all pixels set to a value
+     */
+    BitTile(accessor_type accessor, bool value)
+      : accessor_(accessor),
+        words_per_row_(words_for(accessor[1])),
+        words_(words_per_row_ * accessor[0], word_type(0)) {
+      if (value) {
+        fill(true);
+      }
+    }
+
+    /**
+     * Pack a bool mask
+     */
+    BitTile(const scitbx::af::const_ref< bool, accessor_type > &mask)
+      : accessor_(mask.accessor()),
+        words_per_row_(words_for(accessor_[1])),
+        words_(words_per_row_ * accessor_[0], word_type(0)) {
+      std::size_t xsize = accessor_[1];
+      for (std::size_t y = 0; y < accessor_[0]; ++y) {
+        const bool *row = &mask[y * xsize];
+        word_type *out = &words_[y * words_per_row_];
+        for (std::size_t k = 0; k < words_per_row_; ++k) {
+          std::size_t x0 = k * bits_per_word;
+          std::size_t n = std::min((std::size_t)bits_per_word, xsize - x0);
+          word_type w = 0;
+          for (std::size_t b = 0; b < n; ++b) {
+            w |= (word_type)row[x0 + b] << b;
+          }
+          out[k] = w;
+        }
+      }
+    }
+
+    /**
+     * @returns The number of words needed for a row of pixels
+     */
+    static std::size_t words_for(std::size_t xsize) {
+      return (xsize + bits_per_word - 1) / bits_per_word;
+    }
+
+    /**
+     * Get the accessor (slow, fast)
+     */
+    accessor_type accessor() const {
+      return accessor_;
+    }
+
+    /**
+     * Get the number of words per row
+     */
+    std::size_t words_per_row() const {
+      return words_per_row_;
+    }
+
+    /**
+     * Is the tile empty
+     */
+    bool empty() const {
+      return words_.empty();
+    }
+
+    /**
+     * Get the packed words
+     */
+    scitbx::af::ref<word_type> words() {
+      return words_.ref();
+    }
+
+    /**
+     * Get the packed words
+     */
+    scitbx::af::const_ref<word_type> words() const {
+      return words_.const_ref();
+    }
+
+    /**
+     * Get a pixel
+     */
+    bool get(std::size_t y, std::size_t x) const {
+      DXTBX_ASSERT(y < accessor_[0] && x < accessor_[1]);
+      word_type w = words_[y * words_per_row_ + x / bits_per_word];
+      return (w >> (x % bits_per_word)) & 1;
+    }
+
+    /**
+     * Set a pixel
+     */
+    void set(std::size_t y, std::size_t x, bool value) {
+      DXTBX_ASSERT(y < accessor_[0] && x < accessor_[1]);
+      word_type &w = words_[y * words_per_row_ + x / bits_per_word];
+      word_type m = word_type(1) << (x % bits_per_word);
+      w = value ? (w | m) : (w & ~m);
+    }
+
+    /**
+     * Set all pixels to a value
+     */
+    void fill(bool value) {
+      std::fill(words_.begin(), words_.end(), value ? ~word_type(0) : 0);
+      if (value) {
+        clear_padding();
+      }
+    }
+
+    /**
+     * @returns The number of set pixels
+     */
+    std::size_t count() const {
+      std::size_t n = 0;
+      for (std::size_t i = 0; i < words_.size(); ++i) {
+        n += detail::popcount(words_[i]);
+      }
+      return n;
+    }
+
+    /**
+     * AND another tile into this one
+     */
+    BitTile& operator&=(const BitTile &other) {
+      check_same_size(other);
+      word_type *a = words_.begin();
+      const word_type *b = other.words_.begin();
+      for (std::size_t i = 0; i < words_.size(); ++i) {
+        a[i] &= b[i];
+      }
+      return *this;
+    }
+
+    /**
+     * OR another tile into this one
+     */
+    BitTile& operator|=(const BitTile &other) {
+      check_same_size(other);
+      word_type *a = words_.begin();
+      const word_type *b = other.words_.begin();
+      for (std::size_t i = 0; i < words_.size(); ++i) {
+        a[i] |= b[i];
+      }
+      return *this;
+    }
+
+    /**
+     * Invert all the pixels
+     */
+    void invert() {
+      word_type *a = words_.begin();
+      for (std::size_t i = 0; i < words_.size(); ++i) {
+        a[i] = ~a[i];
+      }
+      clear_padding();
+    }
+
+    /**
+     * @returns A copy of the tile with its own storage
+     */
+    BitTile deep_copy() const {
+      BitTile result;
+      result.accessor_ = accessor_;
+      result.words_per_row_ = words_per_row_;
+      result.words_ = scitbx::af::shared<word_type>(words_.begin(), words_.end());
+      return result;
+    }
+
+    /**
+     * Unpack into a bool array
+     */
+    scitbx::af::versa< bool, accessor_type > as_bool() const {
+      scitbx::af::versa< bool, accessor_type > result(accessor_, false);
+      std::size_t xsize = accessor_[1];
+      for (std::size_t y = 0; y < accessor_[0]; ++y) {
+        const word_type *row = &words_[y * words_per_row_];
+        bool *out = &result[y * xsize];
+        for (std::size_t x = 0; x < xsize; ++x) {
+          out[x] = (row[x / bits_per_word] >> (x % bits_per_word)) & 1;
+        }
+      }
+      return result;
+    }
+
+  protected:
+
+    void check_same_size(const BitTile &other) const {
+      DXTBX_ASSERT(accessor_.all_eq(other.accessor_));
+    }
+
+    void clear_padding() {
+      std::size_t used = accessor_[1] % bits_per_word;
+      if (used == 0) {
+        return;
+      }
+      word_type m = (word_type(1) << used) - 1;
+      for (std::size_t y = 0; y < accessor_[0]; ++y) {
+        words_[(y + 1) * words_per_row_ - 1] &= m;
+      }
+    }
+
+    accessor_type accessor_;
+    std::size_t words_per_row_;
+    scitbx::af::shared<word_type> words_;
+  };
+
+}} // namespace dxtbx::model
+
+#endif // DXTBX_MODEL_BIT_TILE_H
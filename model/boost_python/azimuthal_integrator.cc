@@ -0,0 +1,119 @@
+/*
+ * azimuthal_integrator.cc
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#include <boost/python.hpp>
+#include <boost/python/def.hpp>
+#include <scitbx/array_family/flex_types.h>
+#include <dxtbx/model/azimuthal_integrator.h>
+
+namespace dxtbx { namespace model { namespace boost_python {
+
+  using namespace boost::python;
+  using format::ImageTile;
+
+  /**
+   * Get the tiles of an image given as a flex array or a tuple of arrays
+   */
+  static
+  boost::python::tuple image_tiles(boost::python::object data) {
+    if (boost::python::extract<scitbx::af::flex_int>(data).check() ||
+        boost::python::extract<scitbx::af::flex_double>(data).check() ||
+        boost::python::extract<scitbx::af::flex_bool>(data).check()) {
+      return boost::python::make_tuple(data);
+    }
+    return boost::python::tuple(data);
+  }
+
+  /**
+   * Wrap a tuple of flex arrays as an image without copying
+   */
+  template <typename T>
+  Image<T> image_from_tuple(boost::python::tuple tiles) {
+    typedef typename scitbx::af::flex<T>::type flex_type;
+    Image<T> result;
+    for (std::size_t i = 0; i < boost::python::len(tiles); ++i) {
+      flex_type a = boost::python::extract<flex_type>(tiles[i])();
+      DXTBX_ASSERT(a.accessor().all().size() == 2);
+      result.push_back(ImageTile<T>(
+        scitbx::af::versa<T, scitbx::af::c_grid<2> >(
+          a.handle(),
+          scitbx::af::c_grid<2>(a.accessor()))));
+    }
+    return result;
+  }
+
+  static
+  AzimuthalProfile azimuthal_integrator_integrate(
+      const AzimuthalIntegrator &self,
+      boost::python::object data,
+      boost::python::object mask) {
+    Image<bool> mask_image;
+    if (mask != boost::python::object()) {
+      mask_image = image_from_tuple<bool>(image_tiles(mask));
+    }
+    boost::python::tuple tiles = image_tiles(data);
+    bool is_int = true;
+    for (std::size_t i = 0; i < boost::python::len(tiles); ++i) {
+      is_int = is_int &&
+        boost::python::extract<scitbx::af::flex_int>(tiles[i]).check();
+    }
+    if (is_int) {
+      return self.integrate(image_from_tuple<int>(tiles), mask_image);
+    }
+    return self.integrate(image_from_tuple<double>(tiles), mask_image);
+  }
+
+  void export_azimuthal_integrator()
+  {
+    class_<AzimuthalProfile>("AzimuthalProfile", no_init)
+      .def("sum", &AzimuthalProfile::sum)
+      .def("sum_sq", &AzimuthalProfile::sum_sq)
+      .def("count", &AzimuthalProfile::count)
+      .def("mean", &AzimuthalProfile::mean)
+      .def("standard_deviation", &AzimuthalProfile::standard_deviation)
+      .def("add", &AzimuthalProfile::add, (
+        arg("other")))
+      ;
+
+    class_<AzimuthalIntegrator>("AzimuthalIntegrator", no_init)
+      .def(init<const BeamBase&,
+                const Detector&,
+                std::size_t,
+                std::size_t,
+                std::size_t,
+                bool,
+                bool,
+                double,
+                double>((
+        arg("beam"),
+        arg("detector"),
+        arg("n_q_bins"),
+        arg("n_chi_bins")=1,
+        arg("n_subdivide")=1,
+        arg("solid_angle")=false,
+        arg("polarization")=false,
+        arg("q_min")=0,
+        arg("q_max")=0)))
+      .def("n_q_bins", &AzimuthalIntegrator::n_q_bins)
+      .def("n_chi_bins", &AzimuthalIntegrator::n_chi_bins)
+      .def("n_subdivide", &AzimuthalIntegrator::n_subdivide)
+      .def("q_min", &AzimuthalIntegrator::q_min)
+      .def("q_max", &AzimuthalIntegrator::q_max)
+      .def("q_centres", &AzimuthalIntegrator::q_centres)
+      .def("chi_centres", &AzimuthalIntegrator::chi_centres)
+      .def("n_elements", &AzimuthalIntegrator::n_elements)
+      .def("bin_weights", &AzimuthalIntegrator::bin_weights)
+      .def("is_similar_to", &AzimuthalIntegrator::is_similar_to, (
+        arg("beam"),
+        arg("detector"),
+        arg("tolerance")=1e-6))
+      .def("integrate", &azimuthal_integrator_integrate, (
+        arg("data"),
+        arg("mask")=boost::python::object()))
+      ;
+  }
+
+}}} // namespace dxtbx::model::boost_python
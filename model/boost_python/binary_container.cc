@@ -0,0 +1,82 @@
+/*
+ * binary_container.cc
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#include <boost/python.hpp>
+#include <boost/python/def.hpp>
+#include <scitbx/array_family/flex_types.h>
+#include <dxtbx/model/binary_container.h>
+
+namespace dxtbx { namespace model { namespace boost_python {
+
+  using namespace boost::python;
+
+  /**
+   * Convert a string to python bytes
+   */
+  static
+  object as_bytes(const std::string &data) {
+    return object(handle<>(PyBytes_FromStringAndSize(data.data(), data.size())));
+  }
+
+  static
+  object BinaryContainerWriter_data(const BinaryContainerWriter &self) {
+    return as_bytes(self.data());
+  }
+
+  static
+  object BinaryContainerReader_item(
+      const BinaryContainerReader &self,
+      std::size_t pool,
+      std::size_t index) {
+    return as_bytes(self.item(pool, index));
+  }
+
+  static
+  BinaryContainerReader BinaryContainerReader_from_file(
+      const std::string &filename,
+      bool map_file) {
+    return BinaryContainerReader(filename, map_file);
+  }
+
+  void export_binary_container()
+  {
+    class_<BinaryContainerWriter>("BinaryContainerWriter", no_init)
+      .def(init<std::size_t>((
+        arg("n_pools"))))
+      .def("n_pools", &BinaryContainerWriter::n_pools)
+      .def("n_records", &BinaryContainerWriter::n_records)
+      .def("n_items", &BinaryContainerWriter::n_items, (
+        arg("pool")))
+      .def("add_item", &BinaryContainerWriter::add_item, (
+        arg("pool"),
+        arg("data")))
+      .def("add_record", &BinaryContainerWriter::add_record, (
+        arg("indices")))
+      .def("data", &BinaryContainerWriter_data)
+      .def("magic", &BinaryContainerWriter::magic)
+      .staticmethod("magic")
+      ;
+
+    class_<BinaryContainerReader>("BinaryContainerReader", no_init)
+      .def(init<const std::string&>((
+        arg("data"))))
+      .def("n_pools", &BinaryContainerReader::n_pools)
+      .def("n_records", &BinaryContainerReader::n_records)
+      .def("n_items", &BinaryContainerReader::n_items, (
+        arg("pool")))
+      .def("record", &BinaryContainerReader::record, (
+        arg("index")))
+      .def("item", &BinaryContainerReader_item, (
+        arg("pool"),
+        arg("index")))
+      .def("from_file", &BinaryContainerReader_from_file, (
+        arg("filename"),
+        arg("map_file")=true))
+      .staticmethod("from_file")
+      ;
+  }
+
+}}} // namespace dxtbx::model::boost_python
@@ -350,6 +350,8 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("get_B_at_scan_point", &CrystalBase::get_B_at_scan_point)
       .def("get_U_at_scan_point", &CrystalBase::get_U_at_scan_point)
       .def("get_unit_cell_at_scan_point", &CrystalBase::get_unit_cell_at_scan_point)
+      .def("get_U_at_scan_points", &CrystalBase::get_U_at_scan_points)
+      .def("get_B_at_scan_points", &CrystalBase::get_B_at_scan_points)
       .def("reset_scan_points", &CrystalBase::reset_scan_points)
       .def("change_basis", &CrystalBase::change_basis)
       .def("update", &CrystalBase::update)
@@ -371,6 +373,8 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("get_cell_parameter_sd", &CrystalBase::get_cell_parameter_sd)
       .def("get_cell_volume_sd", &CrystalBase::get_cell_volume_sd)
       .def("get_cell_parameter_sd_at_scan_point", &CrystalBase::get_cell_parameter_sd_at_scan_point)
+      .def("get_cell_parameter_sd_at_scan_points", &CrystalBase::get_cell_parameter_sd_at_scan_points)
+      .def("get_cell_volume_sd_at_scan_points", &CrystalBase::get_cell_volume_sd_at_scan_points)
       .def("reset_unit_cell_errors", &CrystalBase::reset_unit_cell_errors)
       .def("__eq__", &CrystalBase::operator==)
       .def("__ne__", &CrystalBase::operator!=);
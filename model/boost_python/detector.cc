@@ -440,6 +440,8 @@ namespace dxtbx { namespace model { namespace boost_python {
             arg("fast_axis"),
             arg("slow_axis"),
             arg("origin")))
+      .def("is_dirty",
+          &Detector::Node::is_dirty)
       .def("__eq__",
           &Detector::Node::operator==)
       .def("__ne__",
@@ -476,6 +478,12 @@ namespace dxtbx { namespace model { namespace boost_python {
       .def("add_panel",
         (Detector::node_pointer(Detector::*)(const Panel&))&Detector::add_panel,
         return_internal_reference<>())
+      .def("begin_batch_update",
+        &Detector::begin_batch_update)
+      .def("commit",
+        &Detector::commit)
+      .def("is_batch_updating",
+        &Detector::is_batch_updating)
       .def("__len__",
         &Detector::size)
       .def("__setitem__",
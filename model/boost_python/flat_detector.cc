@@ -0,0 +1,120 @@
+/*
+ * flat_detector.cc
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#include <boost/python.hpp>
+#include <boost/python/def.hpp>
+#include <scitbx/array_family/flex_types.h>
+#include <dxtbx/model/flat_detector.h>
+
+namespace dxtbx { namespace model { namespace boost_python {
+
+  using namespace boost::python;
+
+  static
+  scitbx::af::shared< vec2<double> > to_vec2_array(
+      const scitbx::af::const_ref< tiny<double,2> > &a) {
+    scitbx::af::shared< vec2<double> > result(a.size());
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      result[i] = vec2<double>(a[i][0], a[i][1]);
+    }
+    return result;
+  }
+
+  static
+  scitbx::af::shared< vec2<double> > flat_detector_pixel_sizes(
+      const FlatDetector &self) {
+    return to_vec2_array(self.pixel_sizes().const_ref());
+  }
+
+  static
+  scitbx::af::shared< vec2<double> > flat_detector_trusted_ranges(
+      const FlatDetector &self) {
+    return to_vec2_array(self.trusted_ranges().const_ref());
+  }
+
+  static
+  boost::python::list flat_detector_image_sizes(const FlatDetector &self) {
+    scitbx::af::shared< tiny<std::size_t,2> > sizes = self.image_sizes();
+    boost::python::list result;
+    for (std::size_t i = 0; i < sizes.size(); ++i) {
+      result.append(boost::python::make_tuple(sizes[i][0], sizes[i][1]));
+    }
+    return result;
+  }
+
+  static
+  mat3<double> flat_detector_get_d_matrix(
+      const FlatDetector &self, std::size_t panel) {
+    return self.get_d_matrix(panel);
+  }
+
+  static
+  mat3<double> flat_detector_get_D_matrix(
+      const FlatDetector &self, std::size_t panel) {
+    return self.get_D_matrix(panel);
+  }
+
+  static
+  boost::python::tuple flat_detector_get_ray_intersections(
+      const FlatDetector &self,
+      const scitbx::af::const_ref< vec3<double> > &s1) {
+    scitbx::af::shared<int> panel(s1.size());
+    scitbx::af::shared< vec2<double> > xy(s1.size());
+    self.get_ray_intersections(s1, panel.ref(), xy.ref());
+    return boost::python::make_tuple(panel, xy);
+  }
+
+  void export_flat_detector()
+  {
+    enum_ <FlatDetector::StrategyTag> ("FlatDetectorStrategy")
+      .value("Simple", FlatDetector::SimpleStrategy)
+      .value("ParallaxCorrected", FlatDetector::ParallaxCorrectedStrategy)
+      .value("Offset", FlatDetector::OffsetStrategy)
+      .value("OffsetParallaxCorrected", FlatDetector::OffsetParallaxCorrectedStrategy)
+      .value("Other", FlatDetector::OtherStrategy)
+      ;
+
+    class_<FlatDetector>("FlatDetector")
+      .def(init<const Detector&>((
+        arg("detector"))))
+      .def("__len__", &FlatDetector::size)
+      .def("version", &FlatDetector::version)
+      .def("is_valid_for", &FlatDetector::is_valid_for, (
+        arg("detector")))
+      .def("d_matrices", &FlatDetector::d_matrices)
+      .def("D_matrices", &FlatDetector::D_matrices)
+      .def("normals", &FlatDetector::normals)
+      .def("pixel_sizes", &flat_detector_pixel_sizes)
+      .def("image_sizes", &flat_detector_image_sizes)
+      .def("trusted_ranges", &flat_detector_trusted_ranges)
+      .def("thicknesses", &FlatDetector::thicknesses)
+      .def("mus", &FlatDetector::mus)
+      .def("strategies", &FlatDetector::strategies)
+      .def("get_d_matrix", &flat_detector_get_d_matrix, (
+        arg("panel")))
+      .def("get_D_matrix", &flat_detector_get_D_matrix, (
+        arg("panel")))
+      .def("pixel_to_millimeter", &FlatDetector::pixel_to_millimeter, (
+        arg("panel"),
+        arg("xy")))
+      .def("millimeter_to_pixel", &FlatDetector::millimeter_to_pixel, (
+        arg("panel"),
+        arg("xy")))
+      .def("get_pixel_lab_coord", &FlatDetector::get_pixel_lab_coord, (
+        arg("panel"),
+        arg("xy")))
+      .def("get_ray_intersection", &FlatDetector::get_ray_intersection, (
+        arg("s1")))
+      .def("get_ray_intersections", &flat_detector_get_ray_intersections, (
+        arg("s1")))
+      .def("is_value_in_trusted_range",
+        &FlatDetector::is_value_in_trusted_range, (
+          arg("panel"),
+          arg("value")))
+      ;
+  }
+
+}}} // namespace dxtbx::model::boost_python
@@ -20,14 +20,19 @@ namespace dxtbx { namespace model { namespace boost_python {
   void export_kappa_goniometer();
   void export_multi_axis_goniometer();
   void export_panel();
+  void export_panel_mask();
+  void export_azimuthal_integrator();
   void export_detector();
+  void export_flat_detector();
   void export_scan();
   void export_scan_helpers();
   void export_crystal();
   void export_parallax_correction();
   void export_pixel_to_millimeter();
   void export_experiment();
+  void export_scan_varying_model_evaluator();
   void export_experiment_list();
+  void export_binary_container();
 
   BOOST_PYTHON_MODULE(dxtbx_model_ext)
   {
@@ -36,14 +41,19 @@ namespace dxtbx { namespace model { namespace boost_python {
     export_kappa_goniometer();
     export_multi_axis_goniometer();
     export_panel();
+    export_panel_mask();
+    export_azimuthal_integrator();
     export_detector();
+    export_flat_detector();
     export_scan();
     export_scan_helpers();
     export_crystal();
     export_parallax_correction();
     export_pixel_to_millimeter();
     export_experiment();
+    export_scan_varying_model_evaluator();
     export_experiment_list();
+    export_binary_container();
   }
 
 }}} // namespace dxtbx::model::boost_python
@@ -384,6 +384,10 @@ namespace dxtbx { namespace model { namespace boost_python {
         &VirtualPanelFrame::get_d_matrix)
       .def("get_D_matrix",
         &VirtualPanelFrame::get_D_matrix)
+      .def("get_d_matrix_derivatives",
+        &VirtualPanelFrame::get_d_matrix_derivatives)
+      .def("get_D_matrix_derivatives",
+        &VirtualPanelFrame::get_D_matrix_derivatives)
       .def("get_origin",
         &VirtualPanelFrame::get_origin)
       .def("get_fast_axis",
@@ -0,0 +1,83 @@
+/*
+ * panel_mask.cc
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#include <boost/python.hpp>
+#include <boost/python/def.hpp>
+#include <scitbx/array_family/flex_types.h>
+#include <dxtbx/model/panel_mask.h>
+
+namespace dxtbx { namespace model { namespace boost_python {
+
+  using namespace boost::python;
+
+  static
+  boost::python::tuple panel_mask_image_size(const PanelMask &self) {
+    tiny<std::size_t,2> size = self.image_size();
+    return boost::python::make_tuple(size[0], size[1]);
+  }
+
+  static
+  boost::python::tuple panel_mask_trusted_range(const PanelMask &self) {
+    tiny<double,2> trusted_range = self.trusted_range();
+    return boost::python::make_tuple(trusted_range[0], trusted_range[1]);
+  }
+
+  static
+  boost::python::list panel_mask_spans(const PanelMask &self) {
+    scitbx::af::shared<int3> spans = self.spans();
+    boost::python::list result;
+    for (std::size_t i = 0; i < spans.size(); ++i) {
+      result.append(boost::python::make_tuple(spans[i][0], spans[i][1], spans[i][2]));
+    }
+    return result;
+  }
+
+  static
+  scitbx::af::versa< bool, scitbx::af::c_grid<2> > panel_mask_get_static_mask(
+      const PanelMask &self) {
+    tiny<std::size_t,2> size = self.image_size();
+    scitbx::af::versa< bool, scitbx::af::c_grid<2> > mask(
+        scitbx::af::c_grid<2>(size[1], size[0]), true);
+    self.apply_static(mask.ref());
+    return mask;
+  }
+
+  void export_panel_mask()
+  {
+    class_<PanelMask>("PanelMask")
+      .def(init<const Panel&>((
+        arg("panel"))))
+      .def("image_size", &panel_mask_image_size)
+      .def("trusted_range", &panel_mask_trusted_range)
+      .def("words_per_row", &PanelMask::words_per_row)
+      .def("spans", &panel_mask_spans)
+      .def("num_untrusted", &PanelMask::num_untrusted)
+      .def("is_valid_for", &PanelMask::is_valid_for, (
+        arg("panel")))
+      .def("get_static_mask", &panel_mask_get_static_mask)
+      .def("get_static_bits", &PanelMask::get_static_bits)
+      .def("apply_static", &PanelMask::apply_static, (
+        arg("mask")))
+      .def("apply", &PanelMask::apply<int>, (
+        arg("data"),
+        arg("mask")))
+      .def("apply", &PanelMask::apply<double>, (
+        arg("data"),
+        arg("mask")))
+      .def("get_mask", &PanelMask::get_mask<int>, (
+        arg("data")))
+      .def("get_mask", &PanelMask::get_mask<double>, (
+        arg("data")))
+      .def("apply_sentinel", &PanelMask::apply_sentinel<int>, (
+        arg("data"),
+        arg("value")))
+      .def("apply_sentinel", &PanelMask::apply_sentinel<double>, (
+        arg("data"),
+        arg("value")))
+      ;
+  }
+
+}}} // namespace dxtbx::model::boost_python
@@ -170,7 +170,10 @@ namespace dxtbx { namespace model { namespace boost_python {
 
   static
   Scan scan_deepcopy(const Scan &scan, boost::python::object dict){
-    return Scan(scan);
+    Scan result(scan);
+    result.set_exposure_times(scan.get_exposure_times());
+    result.set_epochs(scan.get_epochs());
+    return result;
   }
 
   static
@@ -271,14 +274,25 @@ namespace dxtbx { namespace model { namespace boost_python {
   }
 
   static
-  scitbx::af::shared<bool> is_angle_valid_array(const Scan &scan, scitbx::af::const_ref<double> angle, bool deg) {
-    scitbx::af::shared<bool> result(angle.size());
-    for (std::size_t i = 0; i < angle.size(); ++i) {
-      result[i] = scan.is_angle_valid(deg ? deg_as_rad(angle[i]) : angle[i]);
+  scitbx::af::shared<double> angles_as_rad(
+      scitbx::af::const_ref<double> const &angle, bool deg) {
+    scitbx::af::shared<double> result(angle.begin(), angle.end());
+    if (deg) {
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        result[i] = deg_as_rad(result[i]);
+      }
     }
     return result;
   }
 
+  static
+  scitbx::af::shared<bool> is_angle_valid_array(const Scan &scan, scitbx::af::const_ref<double> angle, bool deg) {
+    if (!deg) {
+      return scan.is_angle_valid(angle);
+    }
+    return scan.is_angle_valid(angles_as_rad(angle, deg).const_ref());
+  }
+
   static
   double get_angle_from_image_index(const Scan &scan, double index,
       bool deg) {
@@ -297,9 +311,11 @@ namespace dxtbx { namespace model { namespace boost_python {
   scitbx::af::shared<double> get_angle_from_array_index_multiple(
       const Scan &scan, scitbx::af::const_ref<double> const &index,
       bool deg) {
-    scitbx::af::shared<double> result((scitbx::af::reserve(index.size())));
-    for(std::size_t i = 0; i < index.size(); i++) {
-      result.push_back(get_angle_from_array_index(scan, index[i], deg));
+    scitbx::af::shared<double> result = scan.get_angle_from_array_index(index);
+    if (deg) {
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        result[i] = rad_as_deg(result[i]);
+      }
     }
     return result;
   }
@@ -321,11 +337,10 @@ namespace dxtbx { namespace model { namespace boost_python {
   scitbx::af::shared<double> get_array_index_from_angle_multiple(
       const Scan &scan, scitbx::af::const_ref<double> const &angle,
       bool deg) {
-    scitbx::af::shared<double> result((scitbx::af::reserve(angle.size())));
-    for(std::size_t i = 0; i < angle.size(); i++) {
-      result.push_back(get_array_index_from_angle(scan, angle[i], deg));
+    if (!deg) {
+      return scan.get_array_index_from_angle(angle);
     }
-    return result;
+    return scan.get_array_index_from_angle(angles_as_rad(angle, deg).const_ref());
   }
 
   static
@@ -341,6 +356,26 @@ namespace dxtbx { namespace model { namespace boost_python {
       deg ? deg_as_rad(angle) : angle);
   }
 
+  static
+  boost::python::tuple get_array_indices_with_angle_multiple(
+      const Scan &scan, scitbx::af::const_ref<double> const &angle,
+      double padding, bool deg) {
+    scitbx::af::shared<std::size_t> offsets;
+    scitbx::af::shared<double> angles;
+    scitbx::af::shared<double> frames;
+    if (deg) {
+      scan.get_array_indices_with_angle(angles_as_rad(angle, deg).const_ref(),
+        padding, deg, offsets, angles, frames);
+      for (std::size_t i = 0; i < angles.size(); ++i) {
+        angles[i] = rad_as_deg(angles[i]);
+      }
+    } else {
+      scan.get_array_indices_with_angle(angle, padding, deg,
+        offsets, angles, frames);
+    }
+    return boost::python::make_tuple(offsets, angles, frames);
+  }
+
   static
   Scan getitem_single(const Scan &scan, int index)
   {
@@ -368,30 +403,8 @@ namespace dxtbx { namespace model { namespace boost_python {
       stop = extract<int>(index.stop());
     }
 
-    // Check ranges
-    DXTBX_ASSERT(start >= 0);
-    DXTBX_ASSERT(stop <= scan.get_num_images());
-    DXTBX_ASSERT(start < stop);
-
-    // Create the new epoch array
-    int first_image_index = scan.get_image_range()[0] + start;
-    int last_image_index = scan.get_image_range()[0] + stop - 1;
-    scitbx::af::shared<double> new_epochs(stop - start);
-    for (std::size_t i = 0; i < new_epochs.size(); ++i) {
-      new_epochs[i] = scan.get_image_epoch(first_image_index + i);
-    }
-
-    // Create the new epoch array
-    scitbx::af::shared<double> new_exposure_times(stop - start);
-    for (std::size_t i = 0; i < new_exposure_times.size(); ++i) {
-      new_exposure_times[i] = scan.get_image_exposure_time(first_image_index + i);
-    }
-
     // Create the new scan object
-    return Scan(
-      vec2<int>(first_image_index, last_image_index),
-      scan.get_image_oscillation(first_image_index),
-      new_exposure_times, new_epochs, scan.get_batch_offset());
+    return scan.slice(start, stop);
   }
 
   void scan_swap(Scan &lhs, Scan &rhs) {
@@ -521,6 +534,11 @@ namespace dxtbx { namespace model { namespace boost_python {
         &get_array_indices_with_angle, (
           arg("angle"),
           arg("deg") = true))
+      .def("get_array_indices_with_angle",
+        &get_array_indices_with_angle_multiple, (
+          arg("angle"),
+          arg("padding") = 0,
+          arg("deg") = true))
       .def("__getitem__", &getitem_single)
       .def("__getitem__", &getitem_slice)
       .def(self == self)
@@ -66,6 +66,27 @@ namespace dxtbx { namespace model { namespace boost_python {
     return result;
   }
 
+  static boost::python::tuple
+  get_mod2pi_angles_in_range_multiple_wrapper(vec2 <double> range,
+      scitbx::af::const_ref<double> const &angle, bool deg) {
+    scitbx::af::shared<std::size_t> offsets;
+    scitbx::af::shared<double> result;
+    if (deg) {
+      scitbx::af::shared<double> angle_rad(angle.begin(), angle.end());
+      for (std::size_t i = 0; i < angle_rad.size(); ++i) {
+        angle_rad[i] = deg_as_rad(angle_rad[i]);
+      }
+      get_mod2pi_angles_in_range(deg_as_rad(range), angle_rad.const_ref(),
+        offsets, result);
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        result[i] = rad_as_deg(result[i]);
+      }
+    } else {
+      get_mod2pi_angles_in_range(range, angle, offsets, result);
+    }
+    return boost::python::make_tuple(offsets, result);
+  }
+
   void export_scan_helpers()
   {
     def("is_angle_in_range", &is_angle_in_range_wrapper, (
@@ -76,6 +97,10 @@ namespace dxtbx { namespace model { namespace boost_python {
 
     def("get_mod2pi_angles_in_range", &get_mod2pi_angles_in_range_wrapper, (
         arg("range"), arg("angle"), arg("deg") = false));
+
+    def("get_mod2pi_angles_in_range",
+        &get_mod2pi_angles_in_range_multiple_wrapper, (
+        arg("range"), arg("angle"), arg("deg") = false));
   }
 
 }}} // namespace = dxtbx::model::boost_python
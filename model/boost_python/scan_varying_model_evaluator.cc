@@ -0,0 +1,68 @@
+/*
+ * scan_varying_model_evaluator.cc
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#include <boost/python.hpp>
+#include <boost/python/def.hpp>
+#include <scitbx/array_family/flex_types.h>
+#include <dxtbx/model/scan_varying_model_evaluator.h>
+
+namespace dxtbx { namespace model { namespace boost_python {
+
+  using namespace boost::python;
+
+  void export_scan_varying_model_evaluator()
+  {
+    typedef ScanVaryingModelEvaluator evaluator_type;
+    typedef scitbx::af::const_ref<double> frame_type;
+
+    vec3<double> (evaluator_type::*get_s0_single)(double) const =
+      &evaluator_type::get_s0;
+    mat3<double> (evaluator_type::*get_setting_rotation_single)(double) const =
+      &evaluator_type::get_setting_rotation;
+    mat3<double> (evaluator_type::*get_A_single)(double) const =
+      &evaluator_type::get_A;
+    mat3<double> (evaluator_type::*get_rotation_single)(double) const =
+      &evaluator_type::get_rotation;
+
+    scitbx::af::shared< vec3<double> > (evaluator_type::*get_s0_multiple)(
+        const frame_type&) const = &evaluator_type::get_s0;
+    scitbx::af::shared< mat3<double> > (evaluator_type::*get_setting_rotation_multiple)(
+        const frame_type&) const = &evaluator_type::get_setting_rotation;
+    scitbx::af::shared< mat3<double> > (evaluator_type::*get_A_multiple)(
+        const frame_type&) const = &evaluator_type::get_A;
+    scitbx::af::shared< mat3<double> > (evaluator_type::*get_rotation_multiple)(
+        const frame_type&) const = &evaluator_type::get_rotation;
+
+    enum_ <evaluator_type::Interpolation> ("ScanVaryingInterpolation")
+      .value("Linear", evaluator_type::Linear)
+      .value("Slerp", evaluator_type::Slerp)
+      ;
+
+    class_<evaluator_type>("ScanVaryingModelEvaluator", no_init)
+      .def(init<const Experiment&, evaluator_type::Interpolation>((
+        arg("experiment"),
+        arg("interpolation") = evaluator_type::Linear)))
+      .def("get_interpolation", &evaluator_type::get_interpolation)
+      .def("get_s0", get_s0_single, (
+        arg("frame")))
+      .def("get_s0", get_s0_multiple, (
+        arg("frame")))
+      .def("get_setting_rotation", get_setting_rotation_single, (
+        arg("frame")))
+      .def("get_setting_rotation", get_setting_rotation_multiple, (
+        arg("frame")))
+      .def("get_A", get_A_single, (
+        arg("frame")))
+      .def("get_A", get_A_multiple, (
+        arg("frame")))
+      .def("get_rotation", get_rotation_single, (
+        arg("frame")))
+      .def("get_rotation", get_rotation_multiple, (
+        arg("frame")))
+      ;
+  }
+
+}}} // namespace dxtbx::model::boost_python
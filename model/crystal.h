@@ -13,6 +13,7 @@
 
 #include <iostream>
 #include <cmath>
+#include <vector>
 #include <scitbx/vec3.h>
 #include <scitbx/vec2.h>
 #include <scitbx/constants.h>
@@ -199,6 +200,10 @@ namespace dxtbx { namespace model {
     virtual mat3<double> get_B_at_scan_point(std::size_t index) const = 0;
     // Get the unit cell at the scan point
     virtual cctbx::uctbx::unit_cell get_unit_cell_at_scan_point(std::size_t index) const = 0;
+    // Get the U matrix at scan points
+    virtual scitbx::af::shared< mat3<double> > get_U_at_scan_points() const = 0;
+    // Get the B matrix at scan points
+    virtual scitbx::af::shared< mat3<double> > get_B_at_scan_points() const = 0;
     // Reset the scan points
     virtual void reset_scan_points() = 0;
     // Returns a copy of the current crystal model transformed by the given
@@ -229,11 +234,16 @@ namespace dxtbx { namespace model {
     virtual scitbx::af::small<double,6> get_cell_parameter_sd() = 0;
     virtual scitbx::af::small<double,6> get_cell_parameter_sd_no_calc() const = 0;
     virtual scitbx::af::small<double,6> get_cell_parameter_sd_at_scan_point(std::size_t index) = 0;
+    // Get the cell parameter standard deviations at all scan points
+    virtual scitbx::af::versa< double, scitbx::af::c_grid<2> > get_cell_parameter_sd_at_scan_points() = 0;
+    // Get the cell volume standard deviations at all scan points
+    virtual scitbx::af::shared<double> get_cell_volume_sd_at_scan_points() = 0;
     // Get the cell volume standard deviation
     virtual double get_cell_volume_sd_no_calc() const = 0;
     // Get the cell volume standard deviation
     virtual double get_cell_volume_sd() = 0;
     virtual void calc_cell_parameter_sd() = 0;
+    virtual void calc_cell_parameter_sd_at_scan_points() = 0;
     // Reset unit cell errors
     virtual void reset_unit_cell_errors() = 0;
   };
@@ -270,7 +280,10 @@ namespace dxtbx { namespace model {
           other.A_at_scan_points_.end()),
         cov_B_(other.cov_B_.accessor()),
         cell_sd_(other.cell_sd_),
-        cell_volume_sd_(other.cell_volume_sd_) {
+        cell_volume_sd_(other.cell_volume_sd_),
+        unit_cell_at_scan_points_(other.unit_cell_at_scan_points_),
+        U_at_scan_points_(other.U_at_scan_points_),
+        B_at_scan_points_(other.B_at_scan_points_) {
       std::copy(
           other.cov_B_.begin(),
           other.cov_B_.end(),
@@ -352,10 +365,12 @@ namespace dxtbx { namespace model {
         unit_cell_(unit_cell),
         U_(U),
         B_(B),
-        A_at_scan_points_(A_at_scan_points),
+        A_at_scan_points_(A_at_scan_points.begin(), A_at_scan_points.end()),
         cov_B_(cov_B),
         cell_sd_(cell_sd),
-        cell_volume_sd_(cell_volume_sd) {}
+        cell_volume_sd_(cell_volume_sd) {
+      update_scan_point_decomposition();
+    }
 
 
 
@@ -492,17 +507,23 @@ namespace dxtbx { namespace model {
     }
 
     /**
-     * Set the A matrix at scan points
+     * Set the A matrix at scan points. The unit cell, U and B matrices at
+     * the scan points are computed here.
      */
     void set_A_at_scan_points(const scitbx::af::const_ref< mat3<double> > &A) {
       A_at_scan_points_ = scitbx::af::shared< mat3<double> >(A.begin(), A.end());
+      cov_B_at_scan_points_ = scitbx::af::versa<double, scitbx::af::c_grid<3> >();
+      update_scan_point_decomposition();
+      reset_cell_sd_at_scan_points();
     }
 
     /**
-     * Get the A matrix at scan points
+     * Get a copy of the A matrix at scan points
      */
     scitbx::af::shared< mat3<double> > get_A_at_scan_points() const {
-      return A_at_scan_points_;
+      return scitbx::af::shared< mat3<double> >(
+          A_at_scan_points_.begin(),
+          A_at_scan_points_.end());
     }
 
     /**
@@ -517,32 +538,52 @@ namespace dxtbx { namespace model {
      * Get the U matrix at the scan point
      */
     mat3<double> get_U_at_scan_point(std::size_t index) const {
-      mat3<double> A = get_A_at_scan_point(index);
-      mat3<double> B = get_B_at_scan_point(index);
-      return A * B.inverse();
+      DXTBX_ASSERT(index < U_at_scan_points_.size());
+      return U_at_scan_points_[index];
     }
 
     /**
      * Get the B matrix at the scan point
      */
     mat3<double> get_B_at_scan_point(std::size_t index) const {
-      return get_unit_cell_at_scan_point(index).fractionalization_matrix().transpose();
+      DXTBX_ASSERT(index < B_at_scan_points_.size());
+      return B_at_scan_points_[index];
     }
 
     /**
      * Get the unit cell at the scan point
      */
     cctbx::uctbx::unit_cell get_unit_cell_at_scan_point(std::size_t index) const {
-      mat3<double> A = get_A_at_scan_point(index);
-      return cctbx::uctbx::unit_cell(A.transpose().inverse());
+      DXTBX_ASSERT(index < unit_cell_at_scan_points_.size());
+      return unit_cell_at_scan_points_[index];
+    }
+
+    /**
+     * Get the U matrix at scan points
+     */
+    scitbx::af::shared< mat3<double> > get_U_at_scan_points() const {
+      return scitbx::af::shared< mat3<double> >(
+          U_at_scan_points_.begin(),
+          U_at_scan_points_.end());
+    }
+
+    /**
+     * Get the B matrix at scan points
+     */
+    scitbx::af::shared< mat3<double> > get_B_at_scan_points() const {
+      return scitbx::af::shared< mat3<double> >(
+          B_at_scan_points_.begin(),
+          B_at_scan_points_.end());
     }
 
     /**
      * Reset the scan points
      */
     void reset_scan_points() {
-      A_at_scan_points_.clear();
+      A_at_scan_points_ = scitbx::af::shared< mat3<double> >();
       cov_B_at_scan_points_ = scitbx::af::versa<double, scitbx::af::c_grid<3> >();
+      update_scan_point_decomposition();
+      reset_cell_sd_at_scan_points();
     }
 
     /**
@@ -625,13 +666,16 @@ namespace dxtbx { namespace model {
       // Update U
       U_ = R * U_;
 
-      // Update A at scan points
-      for (std::size_t i = 0; i < get_num_scan_points(); ++i) {
-        mat3<double> At = get_A_at_scan_point(i);
-        mat3<double> Bt = get_B_at_scan_point(i);
-        mat3<double> Ut = R * (At * Bt.inverse());
-        A_at_scan_points_[i] = Ut * Bt;
+      // Update A at scan points. The unit cell is unchanged so only the U
+      // matrices of the decomposition change. The A matrices are replaced
+      // rather than modified in place as the storage may be shared with a
+      // copy of this crystal.
+      scitbx::af::shared< mat3<double> > A_at_scan_points(get_num_scan_points());
+      for (std::size_t i = 0; i < A_at_scan_points.size(); ++i) {
+        U_at_scan_points_[i] = R * U_at_scan_points_[i];
+        A_at_scan_points[i] = U_at_scan_points_[i] * B_at_scan_points_[i];
       }
+      A_at_scan_points_ = A_at_scan_points;
     }
 
     /**
@@ -775,6 +819,7 @@ namespace dxtbx { namespace model {
       DXTBX_ASSERT(cov.accessor()[2] == 9);
       cov_B_at_scan_points_ = scitbx::af::versa<double, scitbx::af::c_grid<3> >(cov.accessor());
       std::copy(cov.begin(), cov.end(), cov_B_at_scan_points_.begin());
+      reset_cell_sd_at_scan_points();
     }
 
     scitbx::af::versa< double, scitbx::af::c_grid<2> > get_B_covariance_at_scan_point(std::size_t index) const {
@@ -806,14 +851,46 @@ namespace dxtbx { namespace model {
     }
 
     scitbx::af::small<double,6> get_cell_parameter_sd_at_scan_point(std::size_t index) {
-      mat3<double> B = get_B_at_scan_point(index);
-      scitbx::af::versa< double, scitbx::af::c_grid<2> > cov_B = get_B_covariance_at_scan_point(index);
+      DXTBX_ASSERT(index < cov_B_at_scan_points_.accessor()[0]);
       scitbx::af::small<double,6> cell_sd;
-      double cell_volume;
-      calc_cell_parameter_sd(B, cov_B, cell_sd, cell_volume);
+      if (cell_volume_sd_at_scan_points_.size() > 0) {
+        const double *sd = &cell_sd_at_scan_points_[index * 6];
+        cell_sd.resize(6);
+        std::copy(sd, sd + 6, cell_sd.begin());
+      } else {
+        double cell_volume_sd;
+        calc_cell_parameter_sd(
+            get_B_at_scan_point(index),
+            &cov_B_at_scan_points_[index * 81],
+            cell_sd,
+            cell_volume_sd);
+      }
       return cell_sd;
     }
 
+    /**
+     * Get the cell parameter standard deviations at all scan points as an
+     * array of (num_scan_points, 6) elements, or an empty array if there is
+     * no covariance at scan points.
+     */
+    scitbx::af::versa< double, scitbx::af::c_grid<2> > get_cell_parameter_sd_at_scan_points() {
+      if (cell_volume_sd_at_scan_points_.size() == 0) {
+        calc_cell_parameter_sd_at_scan_points();
+      }
+      return cell_sd_at_scan_points_;
+    }
+
+    /**
+     * Get the cell volume standard deviations at all scan points, or an empty
+     * array if there is no covariance at scan points.
+     */
+    scitbx::af::shared<double> get_cell_volume_sd_at_scan_points() {
+      if (cell_volume_sd_at_scan_points_.size() == 0) {
+        calc_cell_parameter_sd_at_scan_points();
+      }
+      return cell_volume_sd_at_scan_points_;
+    }
+
     /**
      * Get the cell parameter standard deviation
      */
@@ -844,32 +921,80 @@ namespace dxtbx { namespace model {
       calc_cell_parameter_sd(B_, cov_B_, cell_sd_, cell_volume_sd_);
     }
 
+    /**
+     * Calculate the cell parameter and volume standard deviations at all the
+     * scan points and store them. The scan points are processed in parallel
+     * when OpenMP is available.
+     */
+    void calc_cell_parameter_sd_at_scan_points() {
+      std::size_t n = cov_B_at_scan_points_.accessor()[0];
+      cell_sd_at_scan_points_ = scitbx::af::versa< double, scitbx::af::c_grid<2> >(
+          scitbx::af::c_grid<2>(n, 6));
+      cell_volume_sd_at_scan_points_ = scitbx::af::shared<double>(n);
+      if (n == 0) {
+        return;
+      }
+
+      // Check the inputs here since an exception thrown inside the parallel
+      // region cannot propagate out of it
+      const std::vector< mat3<double> > &B = B_at_scan_points_;
+      DXTBX_ASSERT(n == B.size());
+      for (std::size_t i = 0; i < n; ++i) {
+        DXTBX_ASSERT(B[i].determinant() != 0);
+      }
+      const double *cov_B = cov_B_at_scan_points_.begin();
+      double *sd = cell_sd_at_scan_points_.begin();
+      double *volume_sd = cell_volume_sd_at_scan_points_.begin();
+      bool failed = false;
+      #pragma omp parallel for
+      for (int i = 0; i < (int)n; ++i) {
+        try {
+          scitbx::af::small<double,6> cell_sd;
+          calc_cell_parameter_sd(B[i], cov_B + i * 81, cell_sd, volume_sd[i]);
+          std::copy(cell_sd.begin(), cell_sd.end(), sd + i * 6);
+        } catch (const std::exception&) {
+          #pragma omp critical
+          failed = true;
+        }
+      }
+      if (failed) {
+        reset_cell_sd_at_scan_points();
+        DXTBX_ERROR("Unable to calculate cell parameter errors at scan points");
+      }
+    }
 
     void calc_cell_parameter_sd(
         const mat3<double> &B,
         const scitbx::af::versa< double, scitbx::af::c_grid<2> > &cov_B,
         scitbx::af::small<double,6> &cell_sd,
-        double &cell_volume_sd) {
+        double &cell_volume_sd) const {
+      calc_cell_parameter_sd(B, &cov_B[0], cell_sd, cell_volume_sd);
+    }
+
+    /**
+     * Calculate the cell parameter and volume standard deviations
+     * @param B The B matrix
+     * @param cov_B The 9x9 covariance matrix of the elements of B
+     * @param cell_sd The cell parameter standard deviations
+     * @param cell_volume_sd The cell volume standard deviation
+     */
+    void calc_cell_parameter_sd(
+        const mat3<double> &B,
+        const double *cov_B,
+        scitbx::af::small<double,6> &cell_sd,
+        double &cell_volume_sd) const {
       // self._cov_B is the covariance matrix of elements of the B matrix. We
       // need to construct the covariance matrix of elements of the
       // transpose of B. The vector of elements of B is related to the
-      // vector of elements of its transpose by a permutation, P.
-      double P[81] = {1,0,0,0,0,0,0,0,0,
-                      0,0,0,1,0,0,0,0,0,
-                      0,0,0,0,0,0,1,0,0,
-                      0,1,0,0,0,0,0,0,0,
-                      0,0,0,0,1,0,0,0,0,
-                      0,0,0,0,0,0,0,1,0,
-                      0,0,1,0,0,0,0,0,0,
-                      0,0,0,0,0,1,0,0,0,
-                      0,0,0,0,0,0,0,0,1};
-
-      // We can use P to replace var_cov with the covariance matrix of
-      // elements of the transpose of B.
-      scitbx::af::small<double,81> PcovB(81,0);
+      // vector of elements of its transpose by a permutation, P, so
+      // P cov_B P is just cov_B with its rows and columns reordered.
+      const std::size_t P[9] = { 0, 3, 6, 1, 4, 7, 2, 5, 8 };
       scitbx::af::small<double,81> var_cov(81,0);
-      scitbx::matrix::multiply(&P[0], &cov_B[0], 9, 9, 9, &PcovB[0]);
-      scitbx::matrix::multiply(&PcovB[0], &P[0], 9, 9, 9, &var_cov[0]);
+      for (std::size_t i = 0; i < 9; ++i) {
+        for (std::size_t j = 0; j < 9; ++j) {
+          var_cov[i * 9 + j] = cov_B[P[i] * 9 + P[j]];
+        }
+      }
 
       // From B = (O^-1)^T we can convert this
       // to the covariance matrix of the real space orthogonalisation matrix
@@ -1004,10 +1129,42 @@ namespace dxtbx { namespace model {
       cov_B_at_scan_points_ = scitbx::af::versa<double, scitbx::af::c_grid<3> >();
       cell_sd_ = scitbx::af::small<double,6>();
       cell_volume_sd_ = 0;
+      reset_cell_sd_at_scan_points();
     }
 
   protected:
 
+    /**
+     * Clear the stored cell parameter errors at scan points
+     */
+    void reset_cell_sd_at_scan_points() {
+      cell_sd_at_scan_points_ = scitbx::af::versa< double, scitbx::af::c_grid<2> >();
+      cell_volume_sd_at_scan_points_ = scitbx::af::shared<double>();
+    }
+
+    /**
+     * Compute the unit cell, B and U matrices at all scan points from the A
+     * matrices. This is called whenever the A matrices are replaced so that
+     * the const getters only ever read.
+     */
+    void update_scan_point_decomposition() {
+      std::size_t n = A_at_scan_points_.size();
+      unit_cell_at_scan_points_.clear();
+      U_at_scan_points_.clear();
+      B_at_scan_points_.clear();
+      unit_cell_at_scan_points_.reserve(n);
+      U_at_scan_points_.reserve(n);
+      B_at_scan_points_.reserve(n);
+      for (std::size_t i = 0; i < n; ++i) {
+        mat3<double> A = A_at_scan_points_[i];
+        cctbx::uctbx::unit_cell uc(A.transpose().inverse());
+        mat3<double> B = uc.fractionalization_matrix().transpose();
+        unit_cell_at_scan_points_.push_back(uc);
+        B_at_scan_points_.push_back(B);
+        U_at_scan_points_.push_back(A * B.inverse());
+      }
+    }
+
     cctbx::sgtbx::space_group space_group_;
     cctbx::uctbx::unit_cell unit_cell_;
     mat3<double> U_;
@@ -1017,6 +1174,11 @@ namespace dxtbx { namespace model {
     scitbx::af::versa<double, scitbx::af::c_grid<3> > cov_B_at_scan_points_;
     scitbx::af::small<double,6> cell_sd_;
     double cell_volume_sd_;
+    scitbx::af::versa<double, scitbx::af::c_grid<2> > cell_sd_at_scan_points_;
+    scitbx::af::shared<double> cell_volume_sd_at_scan_points_;
+    std::vector<cctbx::uctbx::unit_cell> unit_cell_at_scan_points_;
+    std::vector< mat3<double> > U_at_scan_points_;
+    std::vector< mat3<double> > B_at_scan_points_;
   };
 
   /* Extended Crystal class adding a simple value for mosaicity.
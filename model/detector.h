@@ -151,7 +151,9 @@ namespace dxtbx { namespace model {
       Node(Detector *detector)
         : detector_(detector),
           parent_(NULL),
-          is_panel_(false) {}
+          is_panel_(false),
+          dirty_(false),
+          frame_staged_(false) {}
 
       /**
        * Construct using a parent detector reference. The detector reference keeps
@@ -162,7 +164,9 @@ namespace dxtbx { namespace model {
         : Panel(panel),
           detector_(detector),
           parent_(NULL),
-          is_panel_(false) {}
+          is_panel_(false),
+          dirty_(false),
+          frame_staged_(false) {}
 
       /**
        * Add a group to the detector node.
@@ -372,6 +376,14 @@ namespace dxtbx { namespace model {
       void set_frame(const vec3<double> &d1,
                      const vec3<double> &d2,
                      const vec3<double> &d0) {
+        if (is_batch_updating()) {
+          // The local frame depends on the parent global frame, which may
+          // itself be staged, so only record the global frame here; the
+          // local frame is computed from it on commit
+          stage_frame(d1, d2, d0);
+          mark_dirty();
+          return;
+        }
         Panel::set_frame(d1, d2, d0);
         for (std::size_t i = 0; i < children_.size(); ++i) {
           children_[i].set_parent_frame(
@@ -391,6 +403,12 @@ namespace dxtbx { namespace model {
       void set_local_frame(const vec3<double> &d1,
                            const vec3<double> &d2,
                            const vec3<double> &d0) {
+        if (is_batch_updating()) {
+          assign_local_frame(d1, d2, d0);
+          frame_staged_ = false;
+          mark_dirty();
+          return;
+        }
         Panel::set_local_frame(d1, d2, d0);
         for (std::size_t i = 0; i < children_.size(); ++i) {
           children_[i].set_parent_frame(
@@ -410,6 +428,11 @@ namespace dxtbx { namespace model {
       void set_parent_frame(const vec3<double> &d1,
                             const vec3<double> &d2,
                             const vec3<double> &d0) {
+        if (is_batch_updating()) {
+          assign_parent_frame(d1, d2, d0);
+          mark_dirty();
+          return;
+        }
         Panel::set_parent_frame(d1, d2, d0);
         for (std::size_t i = 0; i < children_.size(); ++i) {
           children_[i].set_parent_frame(
@@ -419,6 +442,55 @@ namespace dxtbx { namespace model {
         }
       }
 
+      /**
+       * Is the node waiting for a staged frame change to be applied
+       */
+      bool is_dirty() const {
+        return dirty_;
+      }
+
+      /**
+       * Copy the staged global frame of another node, so that a copy of a
+       * detector in the middle of a batch update commits to the same frames
+       */
+      void copy_staged_frame(const Node &other) {
+        frame_staged_ = other.frame_staged_;
+        staged_fast_axis_ = other.staged_fast_axis_;
+        staged_slow_axis_ = other.staged_slow_axis_;
+        staged_origin_ = other.staged_origin_;
+      }
+
+      /**
+       * Recompute the global frames of the subtree below this node. Nodes
+       * which have staged frame changes, and all their descendants, have their
+       * parent frame refreshed and their global frame recomputed exactly once;
+       * untouched subtrees are only visited. A node with a staged global
+       * frame has its local frame computed from it relative to the committed
+       * frame of its parent.
+       * @param parent_changed The global frame of the parent has changed
+       */
+      void commit_subtree(bool parent_changed) {
+        bool changed = dirty_ || parent_changed;
+        if (changed) {
+          if (parent_ != NULL) {
+            assign_parent_frame(
+                parent_->get_fast_axis(),
+                parent_->get_slow_axis(),
+                parent_->get_origin());
+          }
+          if (frame_staged_) {
+            frame_staged_ = false;
+            Panel::set_frame(staged_fast_axis_, staged_slow_axis_, staged_origin_);
+          } else {
+            update_global_frame();
+          }
+        }
+        dirty_ = false;
+        for (std::size_t i = 0; i < children_.size(); ++i) {
+          children_[i].commit_subtree(changed);
+        }
+      }
+
       /**
        * Test if everything is equal
        */
@@ -484,10 +556,47 @@ namespace dxtbx { namespace model {
 
     protected:
 
+      /**
+       * Is the owning detector staging frame changes
+       */
+      bool is_batch_updating() const {
+        return detector_ != NULL && detector_->is_batch_updating();
+      }
+
+      /**
+       * Flag the node for recomputation on commit
+       */
+      void mark_dirty() {
+        dirty_ = true;
+        detector_->data_->pending = true;
+      }
+
+      /**
+       * Record a global frame to be applied on commit. The axes are checked
+       * now so that invalid frames are reported by the call that sets them.
+       */
+      void stage_frame(const vec3<double> &d1,
+                       const vec3<double> &d2,
+                       const vec3<double> &d0) {
+        const double EPS = 1e-7;
+        DXTBX_ASSERT(d1.length() > 0);
+        DXTBX_ASSERT(d2.length() > 0);
+        DXTBX_ASSERT((double)(d1 * d2) < EPS);
+        frame_staged_ = true;
+        staged_fast_axis_ = d1.normalize();
+        staged_slow_axis_ = d2.normalize();
+        staged_origin_ = d0;
+      }
+
       Detector *detector_;
       pointer parent_;
       boost::ptr_vector<Node> children_;
       bool is_panel_;
+      bool dirty_;
+      bool frame_staged_;
+      vec3<double> staged_fast_axis_;
+      vec3<double> staged_slow_axis_;
+      vec3<double> staged_origin_;
     };
 
 
@@ -506,13 +615,19 @@ namespace dxtbx { namespace model {
     public:
 
       DetectorData(Detector *detector)
-        : root(detector) {}
+        : root(detector),
+          batch_update(false),
+          pending(false) {}
 
       DetectorData(Detector *detector, const Panel &panel)
-        : root(detector, panel) {}
+        : root(detector, panel),
+          batch_update(false),
+          pending(false) {}
 
       Node root;
       std::vector<Node::pointer> panels;
+      bool batch_update;
+      bool pending;
     };
 
     /**
@@ -528,6 +643,12 @@ namespace dxtbx { namespace model {
         : data_(boost::make_shared<DetectorData>(this, *(other.root()))) {
       // The initializer copies the main panel data; now do the rest
       copy_node_subtree(root(), other.root());
+      // If the other detector had staged frame changes then the global
+      // frames copied from it are stale so recompute everything
+      if (other.data_->pending) {
+        data_->root.copy_staged_frame(*other.root());
+        data_->root.commit_subtree(true);
+      }
       // Validate that everything appears to have been copied
       DXTBX_ASSERT(size() == other.size());
       for (std::size_t i = 0; i < size(); ++i) {
@@ -571,6 +692,42 @@ namespace dxtbx { namespace model {
       return data_->root.add_panel(panel);
     }
 
+    /**
+     * Start staging frame changes. Until commit() is called, calls to
+     * set_local_frame and set_parent_frame on nodes in the hierarchy only
+     * record the new frame and do not propagate it to the children. The global
+     * frames of the affected nodes are therefore stale until commit().
+     */
+    void begin_batch_update() {
+      data_->batch_update = true;
+    }
+
+    /**
+     * Apply any staged frame changes, recomputing each affected subtree once,
+     * and leave batch update mode.
+     */
+    void commit() {
+      commit_pending();
+      data_->batch_update = false;
+    }
+
+    /**
+     * Apply any staged frame changes without leaving batch update mode
+     */
+    void commit_pending() {
+      if (data_->pending) {
+        data_->root.commit_subtree(false);
+        data_->pending = false;
+      }
+    }
+
+    /**
+     * @returns True/False frame changes are being staged
+     */
+    bool is_batch_updating() const {
+      return data_->batch_update;
+    }
+
     /**
      * Get the root node
      */
@@ -845,9 +1002,11 @@ namespace dxtbx { namespace model {
     void copy_node_subtree(Node::pointer dest, Node::const_pointer source) {
      for (Node::const_iterator it = source->begin(); it != source->end(); ++it) {
        if (it->is_panel()) {
-         dest->add_panel(*it, it->index());
+         dest->add_panel(*it, it->index())->copy_staged_frame(*it);
        } else {
-         copy_node_subtree(dest->add_group(*it), &*it);
+         Node::pointer group = dest->add_group(*it);
+         group->copy_staged_frame(*it);
+         copy_node_subtree(group, &*it);
        }
      }
     }
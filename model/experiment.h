@@ -72,6 +72,51 @@ namespace dxtbx { namespace model {
         scaling_model_(scaling_model),
         identifier_(identifier) {}
 
+    /**
+     * Copy the models of another experiment. The modification counter
+     * belongs to the list holding an experiment, so it is not copied; the
+     * copy is not attached to any list.
+     */
+    Experiment(const Experiment &other)
+      : beam_(other.beam_),
+        detector_(other.detector_),
+        goniometer_(other.goniometer_),
+        scan_(other.scan_),
+        crystal_(other.crystal_),
+        profile_(other.profile_),
+        imageset_(other.imageset_),
+        scaling_model_(other.scaling_model_),
+        identifier_(other.identifier_) {}
+
+    /**
+     * Assign the models of another experiment. As for the copy constructor
+     * the modification counter of the other experiment is not copied: this
+     * experiment keeps its own, which is incremented so that a list holding
+     * this experiment sees the change.
+     */
+    Experiment& operator=(const Experiment &other) {
+      beam_ = other.beam_;
+      detector_ = other.detector_;
+      goniometer_ = other.goniometer_;
+      scan_ = other.scan_;
+      crystal_ = other.crystal_;
+      profile_ = other.profile_;
+      imageset_ = other.imageset_;
+      scaling_model_ = other.scaling_model_;
+      identifier_ = other.identifier_;
+      modified();
+      return *this;
+    }
+
+    /**
+     * Set a counter to be incremented whenever a model or the identifier of
+     * the experiment is changed. This is used by ExperimentList to know when
+     * its lookup indices need to be rebuilt.
+     */
+    void set_modification_counter(boost::shared_ptr<std::size_t> counter) {
+      modification_counter_ = counter;
+    }
+
     /**
      * Check if the beam model is the same.
      */
@@ -170,6 +215,7 @@ namespace dxtbx { namespace model {
      */
     void set_beam(boost::shared_ptr<BeamBase> beam) {
       beam_ = beam;
+      modified();
     }
 
     /**
@@ -184,6 +230,7 @@ namespace dxtbx { namespace model {
      */
     void set_detector(boost::shared_ptr<Detector> detector) {
       detector_ = detector;
+      modified();
     }
 
     /**
@@ -198,6 +245,7 @@ namespace dxtbx { namespace model {
      */
     void set_goniometer(boost::shared_ptr<Goniometer> goniometer) {
       goniometer_ = goniometer;
+      modified();
     }
 
     /**
@@ -212,6 +260,7 @@ namespace dxtbx { namespace model {
      */
     void set_scan(boost::shared_ptr<Scan> scan) {
       scan_ = scan;
+      modified();
     }
 
     /**
@@ -226,6 +275,7 @@ namespace dxtbx { namespace model {
      */
     void set_crystal(boost::shared_ptr<CrystalBase> crystal) {
       crystal_ = crystal;
+      modified();
     }
 
     /**
@@ -240,6 +290,7 @@ namespace dxtbx { namespace model {
      */
     void set_profile(boost::python::object profile) {
       profile_ = profile;
+      modified();
     }
 
     /**
@@ -254,6 +305,7 @@ namespace dxtbx { namespace model {
      */
     void set_imageset(boost::python::object imageset) {
       imageset_ = imageset;
+      modified();
     }
 
     /**
@@ -268,6 +320,7 @@ namespace dxtbx { namespace model {
     */
     void set_scaling_model(boost::python::object scaling_model) {
       scaling_model_ = scaling_model;
+      modified();
     }
 
     /**
@@ -282,6 +335,7 @@ namespace dxtbx { namespace model {
      */
     void set_identifier(std::string identifier) {
       identifier_ = identifier;
+      modified();
     }
 
     /**
@@ -293,6 +347,13 @@ namespace dxtbx { namespace model {
 
   protected:
 
+    /** Increment the modification counter if set */
+    void modified() {
+      if (modification_counter_) {
+        ++(*modification_counter_);
+      }
+    }
+
     boost::shared_ptr<BeamBase> beam_;
     boost::shared_ptr<Detector> detector_;
     boost::shared_ptr<Goniometer> goniometer_;
@@ -302,6 +363,7 @@ namespace dxtbx { namespace model {
     boost::python::object imageset_;
     boost::python::object scaling_model_;
     std::string identifier_;
+    boost::shared_ptr<std::size_t> modification_counter_;
 
   };
 
@@ -14,6 +14,8 @@
 #include <iostream>
 #include <cmath>
 #include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include <boost/python.hpp>
 #include <boost/python/def.hpp>
 #include <scitbx/vec3.h>
@@ -26,6 +28,12 @@ namespace dxtbx { namespace model {
 
   /**
    * This class contains a list of experiments
+   *
+   * Lookups by identifier and by model (beam, detector, goniometer, scan
+   * and crystal) go through hash indices which are extended as experiments
+   * are appended. The experiments in the list share a modification counter
+   * with it, so that changing an experiment in place (e.g. from python)
+   * causes the indices to be rebuilt on the next lookup.
    */
   class ExperimentList {
   public:
@@ -35,13 +43,20 @@ namespace dxtbx { namespace model {
     typedef shared_type::const_iterator const_iterator;
     typedef shared_type::iterator iterator;
 
-    ExperimentList() {}
+    ExperimentList()
+      : modification_counter_(new std::size_t(0)),
+        indexed_(false) {}
 
     /**
      * Initialize from the data
      */
     ExperimentList(const const_ref_type &data)
-      : data_(data.begin(), data.end()) {
+      : data_(data.begin(), data.end()),
+        modification_counter_(new std::size_t(0)),
+        indexed_(false) {
+      for (std::size_t i = 0; i < data_.size(); ++i) {
+        data_[i].set_modification_counter(modification_counter_);
+      }
       DXTBX_ASSERT(is_consistent());
     }
 
@@ -74,38 +89,57 @@ namespace dxtbx { namespace model {
     void erase(std::size_t index) {
       DXTBX_ASSERT(index < data_.size());
       data_.erase(data_.begin()+index, data_.begin()+index+1);
+      indexed_ = false;
     }
 
     /**
      * Remove experiments from the experiment list based on experiment identifiers
      */
     void remove_on_experiment_identifiers(boost::python::list identifiers) {
-        boost::python::ssize_t n = boost::python::len(identifiers);
-        for (boost::python::ssize_t i=0; i<n; i++){
-            boost::python::object elem = identifiers[i];
-            std::string elem_str = boost::python::extract<std::string>(elem);
-            std::size_t j = find(elem_str);
-            erase(j);
+
+      // As each identifier removes the first experiment it matches, count
+      // the number of experiments to remove for each identifier
+      boost::unordered_map<std::string, std::size_t> remaining;
+      boost::python::ssize_t n = boost::python::len(identifiers);
+      for (boost::python::ssize_t i = 0; i < n; ++i) {
+        remaining[boost::python::extract<std::string>(identifiers[i])()]++;
+      }
+
+      // Check there are enough experiments to remove before changing the list
+      boost::unordered_map<std::string, std::size_t> available;
+      for (std::size_t i = 0; i < data_.size(); ++i) {
+        if (remaining.count(data_[i].get_identifier()) > 0) {
+          available[data_[i].get_identifier()]++;
         }
+      }
+      for (boost::unordered_map<std::string, std::size_t>::const_iterator it =
+          remaining.begin(); it != remaining.end(); ++it) {
+        DXTBX_ASSERT(available[it->first] >= it->second);
+      }
+
+      // Remove them in a single pass, preserving the order of the others
+      std::size_t j = 0;
+      for (std::size_t i = 0; i < data_.size(); ++i) {
+        boost::unordered_map<std::string, std::size_t>::iterator it =
+          remaining.find(data_[i].get_identifier());
+        if (it != remaining.end() && it->second > 0) {
+          it->second--;
+          continue;
+        }
+        if (i != j) {
+          data_[j] = data_[i];
+        }
+        ++j;
+      }
+      data_.erase(data_.begin() + j, data_.end());
+      indexed_ = false;
     }
+
     /**
     * Select experiments from the experiment list based on experiment identifiers
     */
     void select_on_experiment_identifiers(boost::python::list identifiers) {
-        boost::python::ssize_t n = boost::python::len(identifiers);
-        int n_exp = data_.size();
-        for (int i=n_exp; i > 0; i--) {
-            std::string iden = data_[i-1].get_identifier();
-            bool in_list = false;
-            for (boost::python::ssize_t j=0; j<n; j++){
-                boost::python::object elem = identifiers[j];
-                std::string elem_str = boost::python::extract<std::string>(elem);
-                if (elem_str == iden)
-                  in_list = true;
-            }
-            if (in_list == false)
-                erase(i-1);
-        }
+      compact(identifier_set(identifiers), true);
     }
 
     /**
@@ -148,6 +182,7 @@ namespace dxtbx { namespace model {
      */
     void clear() {
       data_.clear();
+      indexed_ = false;
     }
 
     /**
@@ -175,10 +210,11 @@ namespace dxtbx { namespace model {
 
       // If id is empty then skip
       if (identifier != "") {
-        for (std::size_t i = 0; i < data_.size(); ++i) {
-          if (data_[i].get_identifier() == identifier) {
-            return i;
-          }
+        update_index();
+        identifier_index_type::const_iterator it =
+          identifier_index_.find(identifier);
+        if (it != identifier_index_.end()) {
+          return it->second;
         }
       }
 
@@ -195,8 +231,23 @@ namespace dxtbx { namespace model {
       int index = find(experiment.get_identifier());
       DXTBX_ASSERT(index < 0);
 
-      // Add the experiment
+      // Add the experiment. Copies do not keep the modification counter, so
+      // if the array was reallocated the counter is set on all experiments.
+      const Experiment *first = data_.begin();
       data_.push_back(experiment);
+      if (data_.begin() != first) {
+        for (std::size_t i = 0; i < data_.size(); ++i) {
+          data_[i].set_modification_counter(modification_counter_);
+        }
+      } else {
+        data_.back().set_modification_counter(modification_counter_);
+      }
+
+      // Add the experiment to the indices
+      if (indexed_) {
+        add_to_index(data_.size() - 1);
+        indexed_size_ = data_.size();
+      }
     }
 
     /**
@@ -212,60 +263,35 @@ namespace dxtbx { namespace model {
      * Check if an experiment contains the beam model
      */
     bool contains(const boost::shared_ptr<BeamBase> &beam) const {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].contains(beam)) {
-          return true;
-        }
-      }
-      return false;
+      return has_model(BeamSlot, beam.get());
     }
 
     /**
      * Check if an experiment contains the detector model
      */
     bool contains(const boost::shared_ptr<Detector> &detector) const {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].contains(detector)) {
-          return true;
-        }
-      }
-      return false;
+      return has_model(DetectorSlot, detector.get());
     }
 
     /**
      * Check if an experiment contains the goniometer model
      */
     bool contains(const boost::shared_ptr<Goniometer> &goniometer) const {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].contains(goniometer)) {
-          return true;
-        }
-      }
-      return false;
+      return has_model(GoniometerSlot, goniometer.get());
     }
 
     /**
      * Check if an experiment contains the scan model
      */
     bool contains(const boost::shared_ptr<Scan> &scan) const {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].contains(scan)) {
-          return true;
-        }
-      }
-      return false;
+      return has_model(ScanSlot, scan.get());
     }
 
     /**
      * Check if an experiment contains the crystal model
      */
     bool contains(const boost::shared_ptr<CrystalBase> &crystal) const {
-      for (std::size_t i = 0; i < size(); ++i) {
-        if (data_[i].contains(crystal)) {
-          return true;
-        }
-      }
-      return false;
+      return has_model(CrystalSlot, crystal.get());
     }
 
     /**
@@ -397,65 +423,35 @@ namespace dxtbx { namespace model {
      * Get indices which have this model
      */
     scitbx::af::shared<std::size_t> indices(const boost::shared_ptr<BeamBase> &obj) const {
-      scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
-         if (data_[i].get_beam() == obj) {
-             result.push_back(i);
-         }
-      }
-      return result;
+      return model_indices(BeamSlot, obj.get());
     }
 
     /**
      * Get indices which have this model
      */
     scitbx::af::shared<std::size_t> indices(const boost::shared_ptr<Detector> &obj) const {
-      scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
-         if (data_[i].get_detector() == obj) {
-             result.push_back(i);
-         }
-      }
-      return result;
+      return model_indices(DetectorSlot, obj.get());
     }
 
     /**
      * Get indices which have this model
      */
     scitbx::af::shared<std::size_t> indices(const boost::shared_ptr<Goniometer> &obj) const {
-      scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
-         if (data_[i].get_goniometer() == obj) {
-             result.push_back(i);
-         }
-      }
-      return result;
+      return model_indices(GoniometerSlot, obj.get());
     }
 
     /**
      * Get indices which have this model
      */
     scitbx::af::shared<std::size_t> indices(const boost::shared_ptr<Scan> &obj) const {
-      scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
-         if (data_[i].get_scan() == obj) {
-             result.push_back(i);
-         }
-      }
-      return result;
+      return model_indices(ScanSlot, obj.get());
     }
 
     /**
      * Get indices which have this model
      */
     scitbx::af::shared<std::size_t> indices(const boost::shared_ptr<CrystalBase> &obj) const {
-      scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
-         if (data_[i].get_crystal() == obj) {
-             result.push_back(i);
-         }
-      }
-      return result;
+      return model_indices(CrystalSlot, obj.get());
     }
 
     /**
@@ -501,8 +497,32 @@ namespace dxtbx { namespace model {
         boost::python::object profile,
         boost::python::object imageset,
         boost::python::object scaling_model) const {
+
+      // Start from the shortest list of experiments with one of the given
+      // models, or from all the experiments if no models are given
+      update_index();
+      const void* models[NumModelSlots] = {
+        beam.get(), detector.get(), goniometer.get(), scan.get(), crystal.get()
+      };
+      const scitbx::af::shared<std::size_t> *candidates = NULL;
+      for (std::size_t slot = 0; slot < NumModelSlots; ++slot) {
+        if (models[slot] == NULL) {
+          continue;
+        }
+        model_index_type::const_iterator it = model_index_[slot].find(models[slot]);
+        if (it == model_index_[slot].end()) {
+          return scitbx::af::shared<std::size_t>();
+        }
+        if (candidates == NULL || it->second.size() < candidates->size()) {
+          candidates = &it->second;
+        }
+      }
+      std::size_t n = candidates != NULL ? candidates->size() : size();
+
+      // Check the remaining models of each candidate
       scitbx::af::shared<std::size_t> result;
-      for (std::size_t i = 0; i < size(); ++i) {
+      for (std::size_t k = 0; k < n; ++k) {
+        std::size_t i = candidates != NULL ? (*candidates)[k] : k;
         if (beam && data_[i].get_beam() != beam) {
           continue;
         }
@@ -556,7 +576,138 @@ namespace dxtbx { namespace model {
 
   protected:
 
+    enum ModelSlot {
+      BeamSlot = 0,
+      DetectorSlot,
+      GoniometerSlot,
+      ScanSlot,
+      CrystalSlot,
+      NumModelSlots
+    };
+
+    typedef boost::unordered_map<std::string, std::size_t> identifier_index_type;
+    typedef boost::unordered_map<
+      const void*,
+      scitbx::af::shared<std::size_t> > model_index_type;
+
+    /**
+     * Get the set of identifiers in a python list
+     */
+    static
+    boost::unordered_set<std::string> identifier_set(boost::python::list identifiers) {
+      boost::unordered_set<std::string> result;
+      boost::python::ssize_t n = boost::python::len(identifiers);
+      for (boost::python::ssize_t i = 0; i < n; ++i) {
+        result.insert(boost::python::extract<std::string>(identifiers[i])());
+      }
+      return result;
+    }
+
+    /**
+     * Keep either only the experiments with an identifier in the set or
+     * only those without, preserving their order
+     */
+    void compact(const boost::unordered_set<std::string> &identifiers, bool keep) {
+      std::size_t j = 0;
+      for (std::size_t i = 0; i < data_.size(); ++i) {
+        bool found = identifiers.count(data_[i].get_identifier()) > 0;
+        if (found == keep) {
+          if (i != j) {
+            data_[j] = data_[i];
+          }
+          ++j;
+        }
+      }
+      data_.erase(data_.begin() + j, data_.end());
+      indexed_ = false;
+    }
+
+    /**
+     * Get the model in the given slot of an experiment
+     */
+    static
+    const void* get_model(const Experiment &experiment, std::size_t slot) {
+      switch (slot) {
+      case BeamSlot:
+        return experiment.get_beam().get();
+      case DetectorSlot:
+        return experiment.get_detector().get();
+      case GoniometerSlot:
+        return experiment.get_goniometer().get();
+      case ScanSlot:
+        return experiment.get_scan().get();
+      case CrystalSlot:
+        return experiment.get_crystal().get();
+      }
+      return NULL;
+    }
+
+    /**
+     * Add the experiment at the given index to the lookup indices
+     */
+    void add_to_index(std::size_t index) const {
+      const Experiment &experiment = data_[index];
+      std::string identifier = experiment.get_identifier();
+      if (identifier != "") {
+        identifier_index_.insert(std::make_pair(identifier, index));
+      }
+      for (std::size_t slot = 0; slot < NumModelSlots; ++slot) {
+        model_index_[slot][get_model(experiment, slot)].push_back(index);
+      }
+    }
+
+    /**
+     * Rebuild the lookup indices if any experiment has been added, removed
+     * or modified since they were built
+     */
+    void update_index() const {
+      if (indexed_
+          && indexed_size_ == data_.size()
+          && indexed_modification_count_ == *modification_counter_) {
+        return;
+      }
+      identifier_index_.clear();
+      for (std::size_t slot = 0; slot < NumModelSlots; ++slot) {
+        model_index_[slot].clear();
+      }
+      for (std::size_t i = 0; i < data_.size(); ++i) {
+        add_to_index(i);
+      }
+      indexed_ = true;
+      indexed_size_ = data_.size();
+      indexed_modification_count_ = *modification_counter_;
+    }
+
+    /**
+     * Check if any experiment has the model in the given slot
+     */
+    bool has_model(std::size_t slot, const void *model) const {
+      update_index();
+      return model_index_[slot].count(model) > 0;
+    }
+
+    /**
+     * Get the indices of the experiments with the model in the given slot
+     */
+    scitbx::af::shared<std::size_t> model_indices(
+        std::size_t slot,
+        const void *model) const {
+      update_index();
+      model_index_type::const_iterator it = model_index_[slot].find(model);
+      if (it == model_index_[slot].end()) {
+        return scitbx::af::shared<std::size_t>();
+      }
+      return scitbx::af::shared<std::size_t>(
+          it->second.begin(), it->second.end());
+    }
+
     shared_type data_;
+    boost::shared_ptr<std::size_t> modification_counter_;
+    mutable bool indexed_;
+    mutable std::size_t indexed_size_;
+    mutable std::size_t indexed_modification_count_;
+    mutable identifier_index_type identifier_index_;
+    mutable model_index_type model_index_[NumModelSlots];
   };
 
 }} // namespace dxtbx::model
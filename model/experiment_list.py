@@ -2,6 +2,7 @@ from __future__ import absolute_import, division, print_function
 
 import collections
 import json
+import struct
 from copy import deepcopy
 from os.path import abspath, dirname, splitext
 
@@ -22,6 +23,8 @@ from dxtbx.format.image import ImageBool, ImageDouble
 from dxtbx.imageset import ImageGrid, ImageSet, ImageSetFactory, ImageSweep
 from dxtbx.model import (
     BeamFactory,
+    BinaryContainerReader,
+    BinaryContainerWriter,
     CrystalFactory,
     DetectorFactory,
     Experiment,
@@ -34,10 +37,12 @@ from dxtbx.serialize import xds
 from dxtbx.serialize.filename import load_path
 from dxtbx.serialize.load import _decode_dict
 from dxtbx.sweep_filenames import template_image_range
+from scitbx.array_family import flex
 
 __all__ = [
     "BeamComparison",
     "DetectorComparison",
+    "ExperimentListBinaryReader",
     "ExperimentListFactory",
     "GoniometerComparison",
     "SweepDiff",
@@ -483,6 +488,195 @@ class ExperimentListDict(object):
             raise IOError("unable to read file, %s" % filename)
 
 
+# The pools of a binary experiment list container, in record order. The
+# identifiers are stored as utf-8 and the models and imagesets as their
+# to_dict dictionaries (see _encode_binary_item).
+_binary_pools = (
+    "identifier",
+    "beam",
+    "detector",
+    "goniometer",
+    "scan",
+    "crystal",
+    "profile",
+    "imageset",
+    "scaling_model",
+)
+
+# Lists of floats with fewer values than this are left in the JSON
+_binary_array_min_size = 16
+
+
+def _float_array(value):
+    """ Get the shape and values of a rectangular nested list of floats. """
+    if all(isinstance(v, float) for v in value):
+        return [len(value)], list(value)
+    if value and all(isinstance(v, (list, tuple)) for v in value):
+        parts = [_float_array(v) for v in value]
+        shape = parts[0][0]
+        if shape is not None and all(p[0] == shape for p in parts):
+            return [len(value)] + shape, [x for p in parts for x in p[1]]
+    return None, None
+
+
+def _encode_binary_item(obj):
+    """Encode a model dictionary for a binary container.
+
+    The item is the length of the JSON text (a little endian u64), the JSON
+    text and then the values of the large arrays of floats in the dictionary
+    as little endian doubles. Each such array is replaced in the JSON by its
+    offset into the values and its shape."""
+    arrays = []
+
+    def encode(value):
+        if isinstance(value, dict):
+            return collections.OrderedDict((k, encode(v)) for k, v in value.items())
+        if isinstance(value, (list, tuple)):
+            shape, values = _float_array(value)
+            if shape is not None and len(values) >= _binary_array_min_size:
+                offset = sum(len(a) for a in arrays)
+                arrays.append(values)
+                return {"__array__": offset, "shape": shape}
+            return [encode(v) for v in value]
+        return value
+
+    text = json.dumps(encode(obj)).encode("utf-8")
+    data = [struct.pack("<Q", len(text)), text]
+    for values in arrays:
+        data.append(struct.pack("<%dd" % len(values), *values))
+    return b"".join(data)
+
+
+def _decode_binary_item(data):
+    """ Decode a model dictionary written by _encode_binary_item. """
+    (length,) = struct.unpack_from("<Q", data, 0)
+    first = 8 + length
+
+    def unflatten(values, shape):
+        if len(shape) == 1:
+            return list(values)
+        step = len(values) // shape[0]
+        return [
+            unflatten(values[i * step : (i + 1) * step], shape[1:])
+            for i in range(shape[0])
+        ]
+
+    def decode(value):
+        if isinstance(value, dict) and "__array__" in value:
+            shape = value["shape"]
+            size = 1
+            for n in shape:
+                size *= n
+            values = struct.unpack_from(
+                "<%dd" % size, data, first + 8 * value["__array__"]
+            )
+            return unflatten(values, shape)
+        return value
+
+    return json.loads(
+        data[8:first].decode("utf-8"), object_hook=lambda d: decode(_decode_dict(d))
+    )
+
+
+class ExperimentListBinaryReader(object):
+    """Random access to the experiments in a binary experiment list.
+
+    Only the container header is read up front, and files are mapped rather
+    than read. Each model is decoded from its dictionary the first time an
+    experiment using it is accessed, and models shared between experiments
+    in the file are shared between the loaded experiments.
+    """
+
+    def __init__(self, reader, check_format=True, directory=None):
+        if not isinstance(reader, BinaryContainerReader):
+            reader = BinaryContainerReader(reader)
+        self._reader = reader
+        if self._reader.n_pools() != len(_binary_pools):
+            raise InvalidExperimentListError("Unexpected binary experiment list")
+        self._check_format = check_format
+        self._directory = directory
+        self._models = [{} for _ in _binary_pools]
+        self._imagesets = {}
+
+    @staticmethod
+    def from_file(filename, check_format=True):
+        filename = abspath(filename)
+        return ExperimentListBinaryReader(
+            BinaryContainerReader.from_file(filename),
+            check_format=check_format,
+            directory=dirname(filename),
+        )
+
+    def __len__(self):
+        return self._reader.n_records()
+
+    def _model(self, pool, index):
+        if index < 0:
+            return None
+        models = self._models[pool]
+        if index not in models:
+            data = self._reader.item(pool, index)
+            if pool == 0:
+                if not isinstance(data, str):
+                    data = data.decode("utf-8")
+                models[index] = data
+            elif _binary_pools[pool] == "imageset":
+                models[index] = _decode_binary_item(data)
+            else:
+                from_dict = getattr(
+                    ExperimentListDict, "_%s_from_dict" % _binary_pools[pool]
+                )
+                models[index] = from_dict(_decode_binary_item(data))
+        return models[index]
+
+    def __getitem__(self, index):
+        if index < 0:
+            index += len(self)
+        if not 0 <= index < len(self):
+            raise IndexError("experiment index out of range")
+        record = self._reader.record(index)
+        models = dict(
+            (name, self._model(pool, record[pool]))
+            for pool, name in enumerate(_binary_pools)
+        )
+        models["identifier"] = models["identifier"] or ""
+
+        # Build the imageset as when loading from JSON, once for each pair
+        # of imageset and scan
+        imageset_data = models["imageset"]
+        models["imageset"] = None
+        if imageset_data is not None:
+            key = (
+                record[_binary_pools.index("imageset")],
+                record[_binary_pools.index("scan")],
+            )
+            if key not in self._imagesets:
+                obj = {"__id__": "ExperimentList", "experiment": [{"imageset": 0}]}
+                decoder = ExperimentListDict(
+                    obj, check_format=self._check_format, directory=self._directory
+                )
+                decoder._ilist = [imageset_data]
+                for name, attr in [
+                    ("beam", "_blist"),
+                    ("detector", "_dlist"),
+                    ("goniometer", "_glist"),
+                    ("scan", "_slist"),
+                    ("crystal", "_clist"),
+                    ("profile", "_plist"),
+                    ("scaling_model", "_scalelist"),
+                ]:
+                    setattr(decoder, attr, [models[name]])
+                    if models[name] is not None:
+                        decoder._obj["experiment"][0][name] = 0
+                self._imagesets[key] = decoder._extract_experiments()[0].imageset
+            models["imageset"] = self._imagesets[key]
+        return Experiment(**models)
+
+    def experiments(self):
+        """ Load all the experiments as an experiment list. """
+        return ExperimentList([self[i] for i in range(len(self))])
+
+
 class ExperimentListDumper(object):
     """ A class to help writing JSON files. """
 
@@ -605,17 +799,46 @@ class ExperimentListDumper(object):
         else:
             return text
 
+    def as_binary(self, filename=None, **kwargs):
+        """Dump experiment list as a binary container.
+
+        Each unique model is stored once, as in the JSON, and each experiment
+        is stored as a record of model indices, so single experiments can be
+        read back without loading the whole file (see
+        ExperimentListBinaryReader)."""
+        obj = self._experiment_list.to_dict()
+        writer = BinaryContainerWriter(len(_binary_pools))
+        for pool, name in enumerate(_binary_pools[1:], 1):
+            for model in obj.get(name, []):
+                writer.add_item(pool, _encode_binary_item(model))
+        for eobj in obj["experiment"]:
+            record = flex.int([writer.add_item(0, eobj["identifier"].encode("utf-8"))])
+            for name in _binary_pools[1:]:
+                record.append(eobj.get(name, -1))
+            writer.add_record(record)
+        data = writer.data()
+
+        # Write the file
+        if filename:
+            with open(filename, "wb") as outfile:
+                outfile.write(data)
+        else:
+            return data
+
     def as_file(self, filename, **kwargs):
         """ Dump experiment list as file. """
         ext = splitext(filename)[1]
         j_ext = [".json"]
         p_ext = [".p", ".pkl", ".pickle"]
+        b_ext = [".bin"]
         if ext.lower() in j_ext:
             return self.as_json(filename, **kwargs)
         elif ext.lower() in p_ext:
             return self.as_pickle(filename, **kwargs)
+        elif ext.lower() in b_ext:
+            return self.as_binary(filename, **kwargs)
         else:
-            ext_str = "|".join(j_ext + p_ext)
+            ext_str = "|".join(j_ext + p_ext + b_ext)
             raise RuntimeError("expected extension {%s}, got %s" % (ext_str, ext))
 
 
@@ -831,6 +1054,13 @@ class ExperimentListFactory(object):
         assert isinstance(obj, ExperimentList)
         return obj
 
+    @staticmethod
+    def from_binary_file(filename, check_format=True):
+        """ Decode an experiment list from a binary container file. """
+        return ExperimentListBinaryReader.from_file(
+            filename, check_format=check_format
+        ).experiments()
+
     @staticmethod
     def from_xds(xds_inp, xds_other):
         """ Generate an experiment list from XDS files. """
@@ -859,6 +1089,13 @@ class ExperimentListFactory(object):
         except Exception:
             pass
 
+        # Then as a binary container, which holds only JSON and arrays
+        with open(filename, "rb") as infile:
+            magic = BinaryContainerWriter.magic()
+            is_binary = infile.read(len(magic)) == magic.encode("ascii")
+        if is_binary:
+            return ExperimentListFactory.from_binary_file(filename, check_format)
+
         # Now try as a pickle file
         return ExperimentListFactory.from_pickle_file(filename)
 
@@ -0,0 +1,397 @@
+/*
+ * flat_detector.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_FLAT_DETECTOR_H
+#define DXTBX_MODEL_FLAT_DETECTOR_H
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <scitbx/vec2.h>
+#include <scitbx/vec3.h>
+#include <scitbx/mat3.h>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/tiny_types.h>
+#include <dxtbx/model/detector.h>
+#include <dxtbx/model/pixel_to_millimeter.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace model {
+
+  using scitbx::vec2;
+  using scitbx::vec3;
+  using scitbx::mat3;
+  using scitbx::af::tiny;
+
+  /**
+   * A read-only, flattened snapshot of the panel geometry of a detector.
+   *
+   * The detector hierarchy stores its panels as individually allocated nodes
+   * in a tree; this class copies the quantities needed by per-pixel and
+   * prediction loops into contiguous arrays (one entry per panel) so that they
+   * can be evaluated without chasing pointers or going through the virtual
+   * pixel to millimeter strategy for the common case. Since the snapshot is
+   * never modified after construction it can be shared between threads.
+   *
+   * The version number is a digest of the geometry at the time the snapshot
+   * was taken; use is_valid_for() to check whether the snapshot is still
+   * consistent with a (possibly modified) detector.
+   */
+  class FlatDetector {
+  public:
+
+    /** The pixel to millimeter strategy of each panel */
+    enum StrategyTag {
+      SimpleStrategy = 0,
+      ParallaxCorrectedStrategy = 1,
+      OffsetStrategy = 2,
+      OffsetParallaxCorrectedStrategy = 3,
+      OtherStrategy = 4
+    };
+
+    /** Construct an empty snapshot */
+    FlatDetector()
+      : version_(0) {}
+
+    /**
+     * Construct the snapshot from a detector
+     * @param detector The detector model
+     */
+    FlatDetector(const Detector &detector) {
+      std::size_t n = detector.size();
+      d_.reserve(n);
+      D_.reserve(n);
+      has_D_.reserve(n);
+      normal_.reserve(n);
+      pixel_size_.reserve(n);
+      image_size_.reserve(n);
+      trusted_range_.reserve(n);
+      thickness_.reserve(n);
+      mu_.reserve(n);
+      strategy_.reserve(n);
+      strategy_mu_.reserve(n);
+      strategy_t0_.reserve(n);
+      for (std::size_t i = 0; i < n; ++i) {
+        const Panel &panel = detector[i];
+        d_.push_back(panel.get_d_matrix());
+        normal_.push_back(panel.get_normal());
+        try {
+          D_.push_back(panel.get_D_matrix());
+          has_D_.push_back(true);
+        } catch (dxtbx::error) {
+          D_.push_back(mat3<double>(0,0,0,0,0,0,0,0,0));
+          has_D_.push_back(false);
+        }
+        pixel_size_.push_back(panel.get_pixel_size());
+        image_size_.push_back(panel.get_image_size());
+        trusted_range_.push_back(panel.get_trusted_range());
+        thickness_.push_back(panel.get_thickness());
+        mu_.push_back(panel.get_mu());
+
+        // Classify the pixel to millimeter strategy. Panels with the simple
+        // or parallax corrected strategies are evaluated directly from the
+        // arrays; the others keep a copy of the panel data for the fallback.
+        boost::shared_ptr<PxMmStrategy> strategy = panel.get_px_mm_strategy();
+        int tag = OtherStrategy;
+        double strategy_mu = 0.0;
+        double strategy_t0 = 0.0;
+        if (dynamic_cast<OffsetParallaxCorrectedPxMmStrategy*>(strategy.get())) {
+          tag = OffsetParallaxCorrectedStrategy;
+        } else if (ParallaxCorrectedPxMmStrategy *p =
+            dynamic_cast<ParallaxCorrectedPxMmStrategy*>(strategy.get())) {
+          tag = ParallaxCorrectedStrategy;
+          strategy_mu = p->mu();
+          strategy_t0 = p->t0();
+        } else if (dynamic_cast<OffsetPxMmStrategy*>(strategy.get())) {
+          tag = OffsetStrategy;
+        } else if (dynamic_cast<SimplePxMmStrategy*>(strategy.get())) {
+          tag = SimpleStrategy;
+        }
+        strategy_.push_back(tag);
+        strategy_mu_.push_back(strategy_mu);
+        strategy_t0_.push_back(strategy_t0);
+        if (tag != SimpleStrategy && tag != ParallaxCorrectedStrategy) {
+          fallback_index_.push_back(fallback_panel_.size());
+          fallback_panel_.push_back(panel);
+        } else {
+          fallback_index_.push_back(-1);
+        }
+      }
+      version_ = compute_version(detector);
+    }
+
+    /** @returns The number of panels */
+    std::size_t size() const {
+      return d_.size();
+    }
+
+    /** @returns The version (a digest of the geometry) of the snapshot */
+    std::size_t version() const {
+      return version_;
+    }
+
+    /**
+     * Check the snapshot still describes the detector
+     * @param detector The detector model
+     * @returns True/False the geometry is unchanged
+     */
+    bool is_valid_for(const Detector &detector) const {
+      return detector.size() == size() && compute_version(detector) == version_;
+    }
+
+    /** @returns The array of d matrices */
+    scitbx::af::shared< mat3<double> > d_matrices() const {
+      return copy(d_);
+    }
+
+    /** @returns The array of D matrices */
+    scitbx::af::shared< mat3<double> > D_matrices() const {
+      return copy(D_);
+    }
+
+    /** @returns The array of panel normals */
+    scitbx::af::shared< vec3<double> > normals() const {
+      return copy(normal_);
+    }
+
+    /** @returns The array of pixel sizes */
+    scitbx::af::shared< tiny<double,2> > pixel_sizes() const {
+      return copy(pixel_size_);
+    }
+
+    /** @returns The array of image sizes */
+    scitbx::af::shared< tiny<std::size_t,2> > image_sizes() const {
+      return copy(image_size_);
+    }
+
+    /** @returns The array of trusted ranges */
+    scitbx::af::shared< tiny<double,2> > trusted_ranges() const {
+      return copy(trusted_range_);
+    }
+
+    /** @returns The array of sensor thicknesses */
+    scitbx::af::shared<double> thicknesses() const {
+      return copy(thickness_);
+    }
+
+    /** @returns The array of attenuation coefficients */
+    scitbx::af::shared<double> mus() const {
+      return copy(mu_);
+    }
+
+    /** @returns The array of strategy tags */
+    scitbx::af::shared<int> strategies() const {
+      return copy(strategy_);
+    }
+
+    /** @returns The d matrix of a panel */
+    const mat3<double>& get_d_matrix(std::size_t panel) const {
+      DXTBX_ASSERT(panel < size());
+      return d_[panel];
+    }
+
+    /** @returns The D matrix of a panel */
+    const mat3<double>& get_D_matrix(std::size_t panel) const {
+      DXTBX_ASSERT(panel < size());
+      DXTBX_ASSERT(has_D_[panel]);
+      return D_[panel];
+    }
+
+    /**
+     * Map a pixel coordinate to millimeters
+     * @param panel The panel index
+     * @param xy The pixel coordinate
+     * @returns The millimeter coordinate
+     */
+    vec2<double> pixel_to_millimeter(std::size_t panel, vec2<double> xy) const {
+      DXTBX_ASSERT(panel < size());
+      const tiny<double,2> &px = pixel_size_[panel];
+      vec2<double> mm(xy[0] * px[0], xy[1] * px[1]);
+      switch (strategy_[panel]) {
+      case SimpleStrategy:
+        return mm;
+      case ParallaxCorrectedStrategy:
+        return parallax_correction_inv2(
+            strategy_mu_[panel], strategy_t0_[panel], mm,
+            fast_axis(panel), slow_axis(panel), origin(panel));
+      default:
+        break;
+      }
+      const Panel &p = fallback_panel_[fallback_index_[panel]];
+      return p.pixel_to_millimeter(xy);
+    }
+
+    /**
+     * Map a millimeter coordinate to pixels
+     * @param panel The panel index
+     * @param xy The millimeter coordinate
+     * @returns The pixel coordinate
+     */
+    vec2<double> millimeter_to_pixel(std::size_t panel, vec2<double> xy) const {
+      DXTBX_ASSERT(panel < size());
+      const tiny<double,2> &px = pixel_size_[panel];
+      switch (strategy_[panel]) {
+      case SimpleStrategy:
+        return vec2<double>(xy[0] / px[0], xy[1] / px[1]);
+      case ParallaxCorrectedStrategy:
+        {
+          vec2<double> mm = parallax_correction2(
+              strategy_mu_[panel], strategy_t0_[panel], xy,
+              fast_axis(panel), slow_axis(panel), origin(panel));
+          return vec2<double>(mm[0] / px[0], mm[1] / px[1]);
+        }
+      default:
+        break;
+      }
+      const Panel &p = fallback_panel_[fallback_index_[panel]];
+      return p.millimeter_to_pixel(xy);
+    }
+
+    /**
+     * @param panel The panel index
+     * @param xy The pixel coordinate
+     * @returns The lab coordinate of the pixel
+     */
+    vec3<double> get_pixel_lab_coord(std::size_t panel, vec2<double> xy) const {
+      vec2<double> mm = pixel_to_millimeter(panel, xy);
+      return d_[panel] * vec3<double>(mm[0], mm[1], 1.0);
+    }
+
+    /**
+     * Get the intersection of a ray with the detector
+     * @param s1 The ray vector
+     * @returns The (panel, mm) coordinate or (-1, (0, 0)) if no intersection
+     */
+    std::pair<int, vec2<double> > get_ray_intersection(vec3<double> s1) const {
+      std::pair<int, vec2<double> > pxy(-1, vec2<double>(0, 0));
+      double w_max = 0;
+      for (std::size_t i = 0; i < size(); ++i) {
+        if (!has_D_[i]) {
+          continue;
+        }
+        vec3<double> v = D_[i] * s1;
+        if (v[2] > w_max) {
+          vec2<double> xy(v[0] / v[2], v[1] / v[2]);
+          if (is_coord_valid_mm(i, xy)) {
+            pxy = std::pair<int, vec2<double> >((int)i, xy);
+            w_max = v[2];
+          }
+        }
+      }
+      return pxy;
+    }
+
+    /**
+     * Get the intersection of an array of rays with the detector
+     * @param s1 The ray vectors
+     * @param panel The output panel indices (-1 for no intersection)
+     * @param xy The output millimeter coordinates
+     */
+    void get_ray_intersections(
+        const scitbx::af::const_ref< vec3<double> > &s1,
+        scitbx::af::ref<int> panel,
+        scitbx::af::ref< vec2<double> > xy) const {
+      DXTBX_ASSERT(panel.size() == s1.size());
+      DXTBX_ASSERT(xy.size() == s1.size());
+      for (std::size_t i = 0; i < s1.size(); ++i) {
+        std::pair<int, vec2<double> > result = get_ray_intersection(s1[i]);
+        panel[i] = result.first;
+        xy[i] = result.second;
+      }
+    }
+
+    /** Check the millimeter coordinate is on the panel */
+    bool is_coord_valid_mm(std::size_t panel, vec2<double> xy) const {
+      const tiny<double,2> &px = pixel_size_[panel];
+      const tiny<std::size_t,2> &sz = image_size_[panel];
+      return (0 <= xy[0] && xy[0] < sz[0] * px[0])
+          && (0 <= xy[1] && xy[1] < sz[1] * px[1]);
+    }
+
+    /** Check the value is in the trusted range of the panel */
+    bool is_value_in_trusted_range(std::size_t panel, double value) const {
+      const tiny<double,2> &tr = trusted_range_[panel];
+      return (tr[0] <= value && value < tr[1]);
+    }
+
+  protected:
+
+    /** Copy an array so the snapshot cannot be modified through it */
+    template <typename T>
+    static scitbx::af::shared<T> copy(const scitbx::af::shared<T> &a) {
+      return scitbx::af::shared<T>(a.begin(), a.end());
+    }
+
+    vec3<double> fast_axis(std::size_t i) const {
+      const mat3<double> &d = d_[i];
+      return vec3<double>(d[0], d[3], d[6]);
+    }
+
+    vec3<double> slow_axis(std::size_t i) const {
+      const mat3<double> &d = d_[i];
+      return vec3<double>(d[1], d[4], d[7]);
+    }
+
+    vec3<double> origin(std::size_t i) const {
+      const mat3<double> &d = d_[i];
+      return vec3<double>(d[2], d[5], d[8]);
+    }
+
+    /**
+     * Compute an FNV-1a digest of everything the snapshot copies from the
+     * detector. The strategy object identity is included so that replacing a
+     * strategy invalidates the snapshot.
+     */
+    static std::size_t compute_version(const Detector &detector) {
+      std::size_t hash = 2166136261u;
+      for (std::size_t i = 0; i < detector.size(); ++i) {
+        const Panel &panel = detector[i];
+        mat3<double> d = panel.get_d_matrix();
+        tiny<double,2> pixel_size = panel.get_pixel_size();
+        tiny<std::size_t,2> image_size = panel.get_image_size();
+        tiny<double,2> trusted_range = panel.get_trusted_range();
+        double thickness = panel.get_thickness();
+        double mu = panel.get_mu();
+        const PxMmStrategy *strategy = panel.get_px_mm_strategy().get();
+        hash = hash_bytes(hash, d.begin(), 9 * sizeof(double));
+        hash = hash_bytes(hash, pixel_size.begin(), 2 * sizeof(double));
+        hash = hash_bytes(hash, image_size.begin(), 2 * sizeof(std::size_t));
+        hash = hash_bytes(hash, trusted_range.begin(), 2 * sizeof(double));
+        hash = hash_bytes(hash, &thickness, sizeof(double));
+        hash = hash_bytes(hash, &mu, sizeof(double));
+        hash = hash_bytes(hash, &strategy, sizeof(strategy));
+      }
+      return hash;
+    }
+
+    static std::size_t hash_bytes(std::size_t hash, const void *data, std::size_t n) {
+      const unsigned char *bytes = reinterpret_cast<const unsigned char*>(data);
+      for (std::size_t i = 0; i < n; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+      }
+      return hash;
+    }
+
+    std::size_t version_;
+    scitbx::af::shared< mat3<double> > d_;
+    scitbx::af::shared< mat3<double> > D_;
+    scitbx::af::shared<bool> has_D_;
+    scitbx::af::shared< vec3<double> > normal_;
+    scitbx::af::shared< tiny<double,2> > pixel_size_;
+    scitbx::af::shared< tiny<std::size_t,2> > image_size_;
+    scitbx::af::shared< tiny<double,2> > trusted_range_;
+    scitbx::af::shared<double> thickness_;
+    scitbx::af::shared<double> mu_;
+    scitbx::af::shared<int> strategy_;
+    scitbx::af::shared<double> strategy_mu_;
+    scitbx::af::shared<double> strategy_t0_;
+    std::vector<int> fallback_index_;
+    std::vector<Panel> fallback_panel_;
+  };
+
+}} // namespace dxtbx::model
+
+#endif // DXTBX_MODEL_FLAT_DETECTOR_H
@@ -11,8 +11,11 @@
 #ifndef DXTBX_MODEL_PANEL_H
 #define DXTBX_MODEL_PANEL_H
 
+#include <cmath>
+#include <limits>
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include <boost/shared_ptr.hpp>
 #include <scitbx/array_family/shared.h>
 #include <scitbx/array_family/versa.h>
@@ -32,6 +35,94 @@ namespace dxtbx { namespace model {
   using boost::shared_ptr;
   using scitbx::af::tiny;
 
+  namespace detail {
+
+    /**
+     * Test whether a pixel value lies strictly inside the trusted range. The
+     * generic version compares in double precision; the value is promoted
+     * which is exact for all the pixel types we read.
+     */
+    template <typename T>
+    class TrustedRangeTest {
+    public:
+
+      TrustedRangeTest(tiny<double,2> trusted_range)
+        : min_(trusted_range[0]),
+          max_(trusted_range[1]) {}
+
+      bool operator()(T value) const {
+        return (min_ < value) & (value < max_);
+      }
+
+    protected:
+      double min_;
+      double max_;
+    };
+
+    /**
+     * Trusted range test for integer pixels. The strict double bounds are
+     * converted once to inclusive bounds in the pixel type, clamped to its
+     * range, so the per-pixel test is a pair of integer comparisons.
+     */
+    template <typename T>
+    class IntegerTrustedRangeTest {
+    public:
+
+      IntegerTrustedRangeTest(tiny<double,2> trusted_range) {
+        double type_min = (double)std::numeric_limits<T>::min();
+        double type_max = (double)std::numeric_limits<T>::max();
+        double lower = std::floor(trusted_range[0]) + 1.0;
+        double upper = std::ceil(trusted_range[1]) - 1.0;
+        if (!(lower <= upper) || lower > type_max || upper < type_min) {
+          // Nothing is trusted: use an empty inclusive range
+          min_ = std::numeric_limits<T>::max();
+          max_ = std::numeric_limits<T>::min();
+        } else {
+          min_ = (T)std::max(lower, type_min);
+          max_ = (T)std::min(upper, type_max);
+        }
+      }
+
+      bool operator()(T value) const {
+        return (min_ <= value) & (value <= max_);
+      }
+
+    protected:
+      T min_;
+      T max_;
+    };
+
+    template <>
+    class TrustedRangeTest<int> : public IntegerTrustedRangeTest<int> {
+    public:
+      TrustedRangeTest(tiny<double,2> trusted_range)
+        : IntegerTrustedRangeTest<int>(trusted_range) {}
+    };
+
+    template <>
+    class TrustedRangeTest<unsigned short>
+        : public IntegerTrustedRangeTest<unsigned short> {
+    public:
+      TrustedRangeTest(tiny<double,2> trusted_range)
+        : IntegerTrustedRangeTest<unsigned short>(trusted_range) {}
+    };
+
+    /**
+     * AND the trusted range test into a row of mask values
+     */
+    template <typename T>
+    void apply_trusted_range(
+        const TrustedRangeTest<T> &test,
+        const T *data,
+        bool *mask,
+        std::size_t n) {
+      for (std::size_t i = 0; i < n; ++i) {
+        mask[i] = mask[i] & test(data[i]);
+      }
+    }
+
+  }
+
   /**
    * A panel class.
    */
@@ -288,21 +379,20 @@ namespace dxtbx { namespace model {
      */
     void apply_untrusted_rectangle_mask(
         scitbx::af::ref< bool,scitbx::af::c_grid<2> > mask) const {
-      using scitbx::af::int4;
       std::size_t xsize = get_image_size()[0];
       std::size_t ysize = get_image_size()[1];
-      scitbx::af::shared<int4> untrusted_rectangle = get_mask();
-      for (std::size_t j = 0; j < untrusted_rectangle.size(); ++j) {
-        int x0 = std::max(untrusted_rectangle[j][0], 0);
-        int y0 = std::max(untrusted_rectangle[j][1], 0);
-        int x1 = std::min(untrusted_rectangle[j][2], (int)xsize);
-        int y1 = std::min(untrusted_rectangle[j][3], (int)ysize);
+      DXTBX_ASSERT(mask.accessor()[0] == ysize);
+      DXTBX_ASSERT(mask.accessor()[1] == xsize);
+      for (std::size_t j = 0; j < mask_.size(); ++j) {
+        int x0 = std::max(mask_[j][0], 0);
+        int y0 = std::max(mask_[j][1], 0);
+        int x1 = std::min(mask_[j][2], (int)xsize);
+        int y1 = std::min(mask_[j][3], (int)ysize);
         DXTBX_ASSERT(x0 < x1);
         DXTBX_ASSERT(y0 < y1);
         for (std::size_t y = y0; y < y1; ++y) {
-          for (std::size_t x = x0; x < x1; ++x) {
-            mask(y, x) = false;
-          }
+          bool *row = &mask[y * xsize];
+          std::fill(row + x0, row + x1, false);
         }
       }
     }
@@ -330,9 +420,11 @@ namespace dxtbx { namespace model {
       DXTBX_ASSERT(data.accessor()[0] == image_size_[1]);
       DXTBX_ASSERT(data.accessor()[1] == image_size_[0]);
       DXTBX_ASSERT(data.accessor().all_eq(mask.accessor()));
-      for (std::size_t i = 0; i < mask.size(); ++i) {
-        mask[i] = mask[i] && (trusted_range_[0] < data[i] && data[i] < trusted_range_[1]);
-      }
+      detail::apply_trusted_range(
+          detail::TrustedRangeTest<T>(trusted_range_),
+          data.begin(),
+          mask.begin(),
+          mask.size());
     }
 
     /**
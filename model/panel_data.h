@@ -145,6 +145,11 @@ namespace dxtbx { namespace model {
       return result;
     }
 
+    /** Get a view of the mask array without copying it */
+    scitbx::af::const_ref<int4> get_mask_const_ref() const {
+      return mask_.const_ref();
+    }
+
     /** Set the mask */
     void set_mask(const scitbx::af::const_ref<int4> &mask) {
       mask_.clear();
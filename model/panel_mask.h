@@ -0,0 +1,324 @@
+/*
+ * panel_mask.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_PANEL_MASK_H
+#define DXTBX_MODEL_PANEL_MASK_H
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <boost/predef/other/endian.h>
+#include <scitbx/array_family/ref.h>
+#include <scitbx/array_family/versa.h>
+#include <scitbx/array_family/accessors/c_grid.h>
+#include <scitbx/array_family/tiny_types.h>
+#include <dxtbx/model/panel.h>
+#include <dxtbx/model/bit_tile.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace model {
+
+  using scitbx::af::int3;
+  using scitbx::af::int4;
+  using scitbx::af::tiny;
+
+  namespace detail {
+
+    /**
+     * Pack 64 flags (each 0 or 1) into a word, flag b going to bit b. On
+     * little endian machines each group of 8 flags is loaded as one word and
+     * gathered into a byte with a single multiply.
+     */
+    inline
+    BitTile::word_type pack_flags(const unsigned char *flags) {
+      BitTile::word_type w = 0;
+#if BOOST_ENDIAN_LITTLE_BYTE
+      for (std::size_t k = 0; k < 8; ++k) {
+        boost::uint64_t x;
+        std::memcpy(&x, flags + 8 * k, 8);
+        w |= ((x * 0x0102040810204080ULL) >> 56) << (8 * k);
+      }
+#else
+      for (std::size_t b = 0; b < BitTile::bits_per_word; ++b) {
+        w |= (BitTile::word_type)flags[b] << b;
+      }
+#endif
+      return w;
+    }
+
+  }
+
+  /**
+   * A precompiled mask for a single panel.
+   *
+   * The untrusted rectangles of the panel are rasterised once into a BitTile
+   * (a set bit is a trusted pixel) and into a list of (row, x0, x1)
+   * spans of untrusted pixels, with overlapping rectangles merged. Together
+   * with the trusted range this lets the full static plus trusted range mask
+   * of an image be computed in a single pass, with the output written as a
+   * bool mask, as packed bits or by overwriting bad pixels with a sentinel.
+   */
+  class PanelMask {
+  public:
+
+    typedef BitTile::word_type word_type;
+    typedef scitbx::af::c_grid<2> accessor_type;
+
+    enum { bits_per_word = BitTile::bits_per_word };
+
+    /** Construct an empty mask */
+    PanelMask()
+      : xsize_(0),
+        ysize_(0),
+        words_per_row_(0),
+        trusted_range_(0, 0) {}
+
+    /**
+     * Compile the mask for a panel
+     * @param panel The panel
+     */
+    PanelMask(const Panel &panel)
+      : xsize_(panel.get_image_size()[0]),
+        ysize_(panel.get_image_size()[1]),
+        words_per_row_(BitTile::words_for(xsize_)),
+        trusted_range_(panel.get_trusted_range()),
+        bits_(accessor_type(ysize_, xsize_), true) {
+
+      // Rasterise the untrusted rectangles
+      scitbx::af::shared<int4> rectangles = panel.get_mask();
+      rectangles_.assign(rectangles.begin(), rectangles.end());
+      for (std::size_t j = 0; j < rectangles_.size(); ++j) {
+        int x0 = std::max(rectangles_[j][0], 0);
+        int y0 = std::max(rectangles_[j][1], 0);
+        int x1 = std::min(rectangles_[j][2], (int)xsize_);
+        int y1 = std::min(rectangles_[j][3], (int)ysize_);
+        DXTBX_ASSERT(x0 < x1);
+        DXTBX_ASSERT(y0 < y1);
+        for (std::size_t y = y0; y < (std::size_t)y1; ++y) {
+          clear_bits(&bits_.words()[y * words_per_row_], x0, x1);
+        }
+      }
+
+      // Extract the merged runs of untrusted pixels from the bit mask
+      for (std::size_t y = 0; y < ysize_; ++y) {
+        std::size_t x = 0;
+        while (x < xsize_) {
+          if (bits_.get(y, x)) {
+            ++x;
+            continue;
+          }
+          std::size_t x0 = x;
+          while (x < xsize_ && !bits_.get(y, x)) {
+            ++x;
+          }
+          spans_.push_back(int3((int)y, (int)x0, (int)x));
+        }
+      }
+    }
+
+    /**
+     * Check if the mask is up to date with a panel, i.e. if the panel has
+     * the same image size, trusted range and untrusted rectangles as the
+     * panel the mask was compiled from.
+     * @param panel The panel
+     * @returns True if the mask is valid for the panel
+     */
+    bool is_valid_for(const Panel &panel) const {
+      if (panel.get_image_size()[0] != xsize_ ||
+          panel.get_image_size()[1] != ysize_ ||
+          !(panel.get_trusted_range() == trusted_range_)) {
+        return false;
+      }
+      scitbx::af::const_ref<int4> rectangles = panel.get_mask_const_ref();
+      return rectangles.size() == rectangles_.size() &&
+        std::equal(rectangles.begin(), rectangles.end(), rectangles_.begin());
+    }
+
+    /** @returns The image size */
+    tiny<std::size_t,2> image_size() const {
+      return tiny<std::size_t,2>(xsize_, ysize_);
+    }
+
+    /** @returns The trusted range */
+    tiny<double,2> trusted_range() const {
+      return trusted_range_;
+    }
+
+    /** @returns The number of 64 bit words per row of the packed mask */
+    std::size_t words_per_row() const {
+      return words_per_row_;
+    }
+
+    /** @returns The (row, x0, x1) spans of untrusted pixels */
+    scitbx::af::shared<int3> spans() const {
+      return scitbx::af::shared<int3>(spans_.begin(), spans_.end());
+    }
+
+    /** @returns The number of pixels in untrusted rectangles */
+    std::size_t num_untrusted() const {
+      std::size_t count = 0;
+      for (std::size_t i = 0; i < spans_.size(); ++i) {
+        count += spans_[i][2] - spans_[i][1];
+      }
+      return count;
+    }
+
+    /** @returns Is the pixel outside the untrusted rectangles */
+    bool get_bit(std::size_t y, std::size_t x) const {
+      return bits_.get(y, x);
+    }
+
+    /** @returns A copy of the packed static mask */
+    BitTile get_static_bits() const {
+      return bits_.deep_copy();
+    }
+
+    /**
+     * Apply the untrusted rectangles to a bool mask
+     * @param mask The mask to modify
+     */
+    void apply_static(scitbx::af::ref<bool, accessor_type> mask) const {
+      check_size(mask.accessor());
+      bool *m = mask.begin();
+      for (std::size_t i = 0; i < spans_.size(); ++i) {
+        bool *row = m + spans_[i][0] * xsize_;
+        std::fill(row + spans_[i][1], row + spans_[i][2], false);
+      }
+    }
+
+    /**
+     * Apply the untrusted rectangles and the trusted range to a bool mask in
+     * a single pass over the image.
+     * @param data The image data
+     * @param mask The mask to modify
+     */
+    template <typename T>
+    void apply(
+        const scitbx::af::const_ref<T, accessor_type> &data,
+        scitbx::af::ref<bool, accessor_type> mask) const {
+      check_size(data.accessor());
+      check_size(mask.accessor());
+      detail::TrustedRangeTest<T> test(trusted_range_);
+      const T *d = data.begin();
+      bool *m = mask.begin();
+      std::size_t s = 0;
+      for (std::size_t y = 0; y < ysize_; ++y) {
+        detail::apply_trusted_range(test, d + y * xsize_, m + y * xsize_, xsize_);
+        for (; s < spans_.size() && (std::size_t)spans_[s][0] == y; ++s) {
+          std::fill(
+              m + y * xsize_ + spans_[s][1],
+              m + y * xsize_ + spans_[s][2],
+              false);
+        }
+      }
+    }
+
+    /**
+     * Compute the combined mask of an image
+     * @param data The image data
+     * @returns The mask
+     */
+    template <typename T>
+    scitbx::af::versa<bool, accessor_type> get_mask(
+        const scitbx::af::const_ref<T, accessor_type> &data) const {
+      scitbx::af::versa<bool, accessor_type> mask(data.accessor(), true);
+      apply(data, mask.ref());
+      return mask;
+    }
+
+    /**
+     * Apply the untrusted rectangles and the trusted range to a packed mask.
+     * The static bits are ANDed a word at a time. The trusted range of each
+     * 64 pixels is first tested into a byte per pixel, in a branch free
+     * loop the compiler can vectorise, and the bytes are then packed into
+     * a word.
+     * @param data The image data
+     * @param mask The packed mask to modify
+     */
+    template <typename T>
+    void apply_packed(
+        const scitbx::af::const_ref<T, accessor_type> &data,
+        BitTile mask) const {
+      check_size(data.accessor());
+      check_size(mask.accessor());
+      scitbx::af::ref<word_type> words = mask.words();
+      scitbx::af::const_ref<word_type> bits = bits_.words();
+      detail::TrustedRangeTest<T> test(trusted_range_);
+      const T *d = data.begin();
+      unsigned char flags[bits_per_word];
+      for (std::size_t y = 0; y < ysize_; ++y) {
+        const T *row = d + y * xsize_;
+        for (std::size_t k = 0; k < words_per_row_; ++k) {
+          std::size_t x0 = k * bits_per_word;
+          std::size_t n = std::min((std::size_t)bits_per_word, xsize_ - x0);
+          for (std::size_t b = 0; b < n; ++b) {
+            flags[b] = test(row[x0 + b]);
+          }
+          std::fill(flags + n, flags + bits_per_word, 0);
+          std::size_t i = y * words_per_row_ + k;
+          words[i] &= detail::pack_flags(flags) & bits[i];
+        }
+      }
+    }
+
+    /**
+     * Overwrite all untrusted pixels (in an untrusted rectangle or outside
+     * the trusted range) with a sentinel value.
+     * @param data The image data to modify
+     * @param value The sentinel value
+     */
+    template <typename T>
+    void apply_sentinel(
+        scitbx::af::ref<T, accessor_type> data,
+        T value) const {
+      check_size(data.accessor());
+      detail::TrustedRangeTest<T> test(trusted_range_);
+      T *d = data.begin();
+      for (std::size_t i = 0; i < data.size(); ++i) {
+        d[i] = test(d[i]) ? d[i] : value;
+      }
+      for (std::size_t i = 0; i < spans_.size(); ++i) {
+        T *row = d + spans_[i][0] * xsize_;
+        std::fill(row + spans_[i][1], row + spans_[i][2], value);
+      }
+    }
+
+  protected:
+
+    void check_size(const accessor_type &accessor) const {
+      DXTBX_ASSERT(accessor[0] == ysize_);
+      DXTBX_ASSERT(accessor[1] == xsize_);
+    }
+
+    /**
+     * Clear the bits [x0, x1) of a row
+     */
+    static void clear_bits(word_type *row, std::size_t x0, std::size_t x1) {
+      for (std::size_t x = x0; x < x1; ) {
+        std::size_t k = x / bits_per_word;
+        std::size_t b = x % bits_per_word;
+        std::size_t n = std::min((std::size_t)bits_per_word - b, x1 - x);
+        word_type m = (n == bits_per_word)
+          ? ~word_type(0)
+          : (((word_type(1) << n) - 1) << b);
+        row[k] &= ~m;
+        x += n;
+      }
+    }
+
+    std::size_t xsize_;
+    std::size_t ysize_;
+    std::size_t words_per_row_;
+    tiny<double,2> trusted_range_;
+    std::vector<int4> rectangles_;
+    BitTile bits_;
+    std::vector<int3> spans_;
+  };
+
+}} // namespace dxtbx::model
+
+#endif // DXTBX_MODEL_PANEL_MASK_H
@@ -16,6 +16,7 @@
 #include <map>
 #include <scitbx/vec2.h>
 #include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/ref.h>
 #include <scitbx/array_family/simple_io.h>
 #include <scitbx/array_family/simple_tiny_io.h>
 #include <dxtbx/error.h>
@@ -41,7 +42,8 @@ namespace dxtbx { namespace model {
       image_range_(0, 0),
       oscillation_(0.0, 0.0),
       num_images_(0),
-      batch_offset_(0) {}
+      batch_offset_(0),
+      offset_(0) {}
 
     /**
      * Initialise the class
@@ -60,7 +62,8 @@ namespace dxtbx { namespace model {
         num_images_(1 + image_range_[1] - image_range_[0]),
         batch_offset_(batch_offset),
         exposure_times_(num_images_, 0.0),
-        epochs_(num_images_, 0.0) {
+        epochs_(num_images_, 0.0),
+        offset_(0) {
       DXTBX_ASSERT(num_images_ >= 0);
     }
 
@@ -85,7 +88,8 @@ namespace dxtbx { namespace model {
         num_images_(1 + image_range_[1] - image_range_[0]),
         batch_offset_(batch_offset),
         exposure_times_(exposure_times),
-        epochs_(epochs) {
+        epochs_(epochs),
+        offset_(0) {
       DXTBX_ASSERT(num_images_ >= 0);
       if (exposure_times_.size() == 1 && num_images_ > 1) {
         // assume same exposure time for all images - there is
@@ -102,20 +106,20 @@ namespace dxtbx { namespace model {
       DXTBX_ASSERT(oscillation_[1] >= 0.0);
     }
 
-    /** Copy */
+    /**
+     * Copy. The epoch and exposure time arrays are shared with the copy and
+     * are only copied when either scan modifies them; the getters always
+     * return copies, so the shared arrays are never exposed.
+     */
     Scan(const Scan &rhs)
       : image_range_(rhs.image_range_),
         valid_image_ranges_(rhs.valid_image_ranges_),
         oscillation_(rhs.oscillation_),
         num_images_(rhs.num_images_),
         batch_offset_(rhs.batch_offset_),
-        exposure_times_(scitbx::af::reserve(rhs.exposure_times_.size())),
-        epochs_(scitbx::af::reserve(rhs.epochs_.size())) {
-      std::copy(rhs.epochs_.begin(), rhs.epochs_.end(),
-        std::back_inserter(epochs_));
-      std::copy(rhs.exposure_times_.begin(), rhs.exposure_times_.end(),
-        std::back_inserter(exposure_times_));
-    }
+        exposure_times_(rhs.exposure_times_),
+        epochs_(rhs.epochs_),
+        offset_(rhs.offset_) {}
 
     /** Virtual destructor */
     virtual ~Scan() {}
@@ -192,16 +196,17 @@ namespace dxtbx { namespace model {
 
     /** Get the exposure time */
     scitbx::af::shared<double> get_exposure_times() const {
-      return exposure_times_;
+      return get_view(exposure_times_);
     }
 
     /** Get the image epochs */
     scitbx::af::shared<double> get_epochs() const {
-      return epochs_;
+      return get_view(epochs_);
     }
 
     /** Set the image range */
     void set_image_range(vec2 <int> image_range) {
+      detach();
       image_range_ = image_range;
       num_images_ = 1 + image_range_[1] - image_range_[0];
       epochs_.resize(num_images_);
@@ -223,12 +228,14 @@ namespace dxtbx { namespace model {
     /** Set the exposure time */
     void set_exposure_times(scitbx::af::shared<double> exposure_times) {
       DXTBX_ASSERT(exposure_times.size() == num_images_);
+      detach();
       exposure_times_ = exposure_times;
     }
 
     /** Set the image epochs */
     void set_epochs(const scitbx::af::shared<double> &epochs) {
       DXTBX_ASSERT(epochs.size() == num_images_);
+      detach();
       epochs_ = epochs;
     }
 
@@ -249,12 +256,12 @@ namespace dxtbx { namespace model {
     /** Get the image epoch */
     double get_image_epoch(int index) const {
       DXTBX_ASSERT(image_range_[0] <= index && index <= image_range_[1]);
-      return epochs_[index - image_range_[0]];
+      return epochs_[offset_ + index - image_range_[0]];
     }
 
     double get_image_exposure_time(int index) const {
       DXTBX_ASSERT(image_range_[0] <= index && index <= image_range_[1]);
-      return exposure_times_[index - image_range_[0]];
+      return exposure_times_[offset_ + index - image_range_[0]];
     }
 
     /** Check the scans are the same */
@@ -264,8 +271,8 @@ namespace dxtbx { namespace model {
           && batch_offset_ == rhs.batch_offset_
           && std::abs(oscillation_[0] - rhs.oscillation_[0]) < eps
           && std::abs(oscillation_[1] - rhs.oscillation_[1]) < eps
-          && exposure_times_.const_ref().all_approx_equal(rhs.exposure_times_.const_ref(), eps)
-          && epochs_.const_ref().all_approx_equal(rhs.epochs_.const_ref(), eps);
+          && exposure_times_ref().all_approx_equal(rhs.exposure_times_ref(), eps)
+          && epochs_ref().all_approx_equal(rhs.epochs_ref(), eps);
     }
 
     /** Check the scans are not the same */
@@ -309,14 +316,13 @@ namespace dxtbx { namespace model {
       double diff_abs = std::abs(get_oscillation_range()[1] -
                                  rhs.get_oscillation_range()[0]);
       DXTBX_ASSERT(std::min(diff_2pi, diff_abs) < eps * get_num_images());
+      detach();
       image_range_[1] = rhs.image_range_[1];
       num_images_ = 1 + image_range_[1] - image_range_[0];
-      exposure_times_.reserve(exposure_times_.size() + exposure_times_.size());
-      epochs_.reserve(epochs_.size() + epochs_.size());
-      std::copy(rhs.exposure_times_.begin(), rhs.exposure_times_.end(),
-        std::back_inserter(exposure_times_));
-      std::copy(rhs.epochs_.begin(), rhs.epochs_.end(),
-        std::back_inserter(epochs_));
+      scitbx::af::const_ref<double> rhs_exposure_times = rhs.exposure_times_ref();
+      scitbx::af::const_ref<double> rhs_epochs = rhs.epochs_ref();
+      exposure_times_.extend(rhs_exposure_times.begin(), rhs_exposure_times.end());
+      epochs_.extend(rhs_epochs.begin(), rhs_epochs.end());
     }
 
     /**
@@ -445,28 +451,162 @@ namespace dxtbx { namespace model {
       return result;
     }
 
-    Scan operator[](int index) const {
-      // Check index
-      DXTBX_ASSERT((index >= 0) && (index < get_num_images()));
-      int image_index = get_image_range()[0] + index;
+    /**
+     * Check if each of the angles is in the range of angles covered by the
+     * scan.
+     * @param angles The angles (radians)
+     * @returns An array of flags
+     */
+    scitbx::af::shared<bool> is_angle_valid(
+        const scitbx::af::const_ref<double> &angles) const {
+      vec2<double> range = get_oscillation_range();
+      scitbx::af::shared<bool> result(angles.size());
+      #pragma omp parallel for
+      for (int i = 0; i < (int)angles.size(); ++i) {
+        result[i] = is_angle_in_range(range, angles[i]);
+      }
+      return result;
+    }
 
-      // Create the new epoch array
-      scitbx::af::shared<double> new_epochs(1);
-      new_epochs[0] = get_image_epoch(image_index );
-      scitbx::af::shared<double> new_exposure_times(1);
-      new_exposure_times[0] = get_image_exposure_time(image_index );
+    /**
+     * Calculate the angles corresponding to the given zero based frames
+     * @param index The frame numbers
+     * @returns The angles at the given frames
+     */
+    scitbx::af::shared<double> get_angle_from_array_index(
+        const scitbx::af::const_ref<double> &index) const {
+      scitbx::af::shared<double> result(index.size());
+      for (std::size_t i = 0; i < index.size(); ++i) {
+        result[i] = get_angle_from_array_index(index[i]);
+      }
+      return result;
+    }
 
-      // Return scan
-      return Scan(vec2<int>(image_index, image_index),
-        get_image_oscillation(image_index ),
-        new_exposure_times, new_epochs,
-        get_batch_offset());
+    /**
+     * Calculate the zero based frames corresponding to the given angles
+     * @param angles The angles
+     * @returns The frames at the given angles
+     */
+    scitbx::af::shared<double> get_array_index_from_angle(
+        const scitbx::af::const_ref<double> &angles) const {
+      scitbx::af::shared<double> result(angles.size());
+      for (std::size_t i = 0; i < angles.size(); ++i) {
+        result[i] = get_array_index_from_angle(angles[i]);
+      }
+      return result;
+    }
+
+    /**
+     * Calculate the zero based frame numbers at which reflections with each
+     * of the given rotation angles will be observed. The results are
+     * returned in compressed form: the angles and frames for angles[i] are
+     * elements offsets[i] to offsets[i+1]-1 of result_angles and
+     * result_frames.
+     * @param angles The rotation angles of the reflections
+     * @param padding The padding to add to the oscillation range
+     * @param deg Is the padding in degrees
+     * @param offsets The output offsets (angles.size() + 1 elements)
+     * @param result_angles The output equivalent angles
+     * @param result_frames The output frame numbers
+     */
+    void get_array_indices_with_angle(
+        const scitbx::af::const_ref<double> &angles,
+        double padding,
+        bool deg,
+        scitbx::af::shared<std::size_t> &offsets,
+        scitbx::af::shared<double> &result_angles,
+        scitbx::af::shared<double> &result_frames) const {
+      DXTBX_ASSERT(padding >= 0);
+      if (deg == true) {
+        padding = padding * pi / 180.0;
+      }
+      vec2<double> range = get_oscillation_range();
+      range[0] -= padding;
+      range[1] += padding;
+      get_mod2pi_angles_in_range(range, angles, offsets, result_angles);
+      result_frames = get_array_index_from_angle(result_angles.const_ref());
+    }
+
+    /**
+     * Get the scan covering the given range of zero based array indices of
+     * this scan. The new scan references the epoch and exposure time arrays
+     * of this scan rather than copying them.
+     * @param first The first array index
+     * @param last One past the last array index
+     * @returns The sub scan
+     */
+    Scan slice(int first, int last) const {
+      DXTBX_ASSERT(first >= 0);
+      DXTBX_ASSERT(last <= get_num_images());
+      DXTBX_ASSERT(first < last);
+      Scan result;
+      result.image_range_ = vec2<int>(
+          image_range_[0] + first,
+          image_range_[0] + last - 1);
+      result.oscillation_ = get_image_oscillation(result.image_range_[0]);
+      result.num_images_ = last - first;
+      result.batch_offset_ = batch_offset_;
+      result.exposure_times_ = exposure_times_;
+      result.epochs_ = epochs_;
+      result.offset_ = offset_ + first;
+      return result;
+    }
+
+    Scan operator[](int index) const {
+      DXTBX_ASSERT((index >= 0) && (index < get_num_images()));
+      return slice(index, index + 1);
     }
 
     friend std::ostream& operator<<(std::ostream &os, const Scan &s);
 
   private:
 
+    /** @returns The exposure times of the images in this scan */
+    scitbx::af::const_ref<double> exposure_times_ref() const {
+      return scitbx::af::const_ref<double>(
+          exposure_times_.begin() + offset_, num_images_);
+    }
+
+    /** @returns The epochs of the images in this scan */
+    scitbx::af::const_ref<double> epochs_ref() const {
+      return scitbx::af::const_ref<double>(
+          epochs_.begin() + offset_, num_images_);
+    }
+
+    /**
+     * Copy the part of a shared array used by this scan. The array itself
+     * is never returned since it may be shared with other scans.
+     */
+    scitbx::af::shared<double> get_view(
+        const scitbx::af::shared<double> &data) const {
+      return scitbx::af::shared<double>(
+          data.begin() + offset_,
+          data.begin() + offset_ + num_images_);
+    }
+
+    /**
+     * Give the scan its own copy of the epoch and exposure time arrays
+     * before they are modified, if they are shared with another scan or
+     * only partly used by this one.
+     */
+    void detach() {
+      if (offset_ != 0
+          || epochs_.size() != num_images_
+          || exposure_times_.size() != num_images_
+          || epochs_.use_count() > 1
+          || exposure_times_.use_count() > 1) {
+        scitbx::af::shared<double> exposure_times(
+            exposure_times_.begin() + offset_,
+            exposure_times_.begin() + offset_ + num_images_);
+        scitbx::af::shared<double> epochs(
+            epochs_.begin() + offset_,
+            epochs_.begin() + offset_ + num_images_);
+        exposure_times_ = exposure_times;
+        epochs_ = epochs;
+        offset_ = 0;
+      }
+    }
+
     vec2 <int> image_range_;
     ExpImgRangeMap valid_image_ranges_; /** initialised as an empty map **/
     vec2 <double> oscillation_;
@@ -474,6 +614,7 @@ namespace dxtbx { namespace model {
     int batch_offset_;
     scitbx::af::shared<double> exposure_times_;
     scitbx::af::shared<double> epochs_;
+    std::size_t offset_; /** index of the first image in the arrays above **/
   };
 
   /** Print Scan information */
@@ -487,7 +628,7 @@ namespace dxtbx { namespace model {
     os << "    image range:   " << s.get_image_range().const_ref() << "\n";
     os << "    oscillation:   " << oscillation.const_ref() << "\n";
     if (s.num_images_ > 0) {
-      os << "    exposure time: " << s.exposure_times_.const_ref()[0] << "\n";
+      os << "    exposure time: " << s.exposure_times_ref()[0] << "\n";
     }
     return os;
   }
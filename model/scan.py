@@ -222,9 +222,53 @@ class ScanFactory:
 
     @staticmethod
     def add(scans):
-        """Sum a list of scans wrapping the sligtly clumsy idiomatic method:
-        sum(scans[1:], scans[0])."""
-        return sum(scans[1:], scans[0])
+        """Sum a list of consecutive scans. The per image exposure times and
+        epochs are gathered and the scan constructed once, rather than
+        appending the scans one at a time. If the scans do not obviously
+        follow on from each other they are appended in turn, which raises
+        the usual error if they are inconsistent."""
+        from math import pi
+        from scitbx.array_family import flex
+
+        if len(scans) == 1:
+            return scans[0]
+
+        first = scans[0]
+        image_range = first.get_image_range()
+        start, width = first.get_oscillation(deg=False)
+        eps = 0.01 * abs(width)
+        consistent = eps > 0
+        for scan in scans[1:]:
+            if not consistent:
+                break
+            num_images = image_range[1] - image_range[0] + 1
+            end = start + num_images * width
+            next_start, next_width = scan.get_oscillation(deg=False)
+            diff_abs = abs(end - next_start)
+            diff_2pi = abs(end % (2 * pi) - next_start % (2 * pi))
+            consistent = (
+                scan.get_image_range()[0] == image_range[1] + 1
+                and abs(width - next_width) < eps
+                and scan.get_batch_offset() == first.get_batch_offset()
+                and min(diff_abs, diff_2pi) < eps * num_images
+            )
+            image_range = (image_range[0], scan.get_image_range()[1])
+        if not consistent:
+            return sum(scans[1:], scans[0])
+
+        exposure_times = flex.double()
+        epochs = flex.double()
+        for scan in scans:
+            exposure_times.extend(scan.get_exposure_times())
+            epochs.extend(scan.get_epochs())
+        return Scan(
+            image_range,
+            (start, width),
+            exposure_times,
+            epochs,
+            first.get_batch_offset(),
+            False,
+        )
 
     @staticmethod
     def search(filename):
@@ -13,9 +13,11 @@
 
 #include <cmath>
 #include <limits>
+#include <algorithm>
 #include <scitbx/constants.h>
 #include <scitbx/vec2.h>
 #include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/ref.h>
 #include <dxtbx/error.h>
 
 namespace dxtbx { namespace model {
@@ -93,6 +95,57 @@ namespace dxtbx { namespace model {
     return result;
   }
 
+  /**
+   * Get the number of angles mod 2pi of a given angle that lie in the range
+   * @param range The angular range
+   * @param angle The angle to use
+   * @returns The number of angles
+   */
+  inline
+  std::size_t get_num_mod2pi_angles_in_range(vec2 <double> range, double angle) {
+    vec2 <double> angle_range = get_range_of_mod2pi_angles(range, angle);
+    int n_angles = 1 + (int)floor((angle_range[1] - angle_range[0]) / two_pi);
+    return (std::size_t)std::max(n_angles, 0);
+  }
+
+  /**
+   * Get all the angles mod 2pi of each of a list of angles that lie in the
+   * given range. The result is returned in compressed form: the angles
+   * equivalent to angle[i] are result[offsets[i]] to result[offsets[i+1]-1].
+   * The counts and then the angles are computed in parallel when OpenMP is
+   * available.
+   * @param range The angular range
+   * @param angles The angles to use
+   * @param offsets The output offsets (angles.size() + 1 elements)
+   * @param result The output angles
+   */
+  inline
+  void get_mod2pi_angles_in_range(
+      vec2 <double> range,
+      const scitbx::af::const_ref<double> &angles,
+      scitbx::af::shared<std::size_t> &offsets,
+      scitbx::af::shared<double> &result) {
+    offsets = scitbx::af::shared<std::size_t>(angles.size() + 1, 0);
+    std::size_t *count = offsets.begin() + 1;
+    #pragma omp parallel for
+    for (int i = 0; i < (int)angles.size(); ++i) {
+      count[i] = get_num_mod2pi_angles_in_range(range, angles[i]);
+    }
+    for (std::size_t i = 1; i < offsets.size(); ++i) {
+      offsets[i] += offsets[i-1];
+    }
+    result = scitbx::af::shared<double>(offsets.back());
+    double *out = result.begin();
+    const std::size_t *first = offsets.begin();
+    #pragma omp parallel for
+    for (int i = 0; i < (int)angles.size(); ++i) {
+      double a0 = get_range_of_mod2pi_angles(range, angles[i])[0];
+      for (std::size_t j = first[i]; j < first[i+1]; ++j) {
+        out[j] = a0 + (j - first[i]) * two_pi;
+      }
+    }
+  }
+
 }} // namespace dxtbx::model
 
 #endif // DXTBX_MODEL_SCAN_HELPERS_H
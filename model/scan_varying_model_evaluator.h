@@ -0,0 +1,399 @@
+/*
+ * scan_varying_model_evaluator.h
+ *
+ *  This code is distributed under the BSD license, a copy of which is
+ *  included in the root directory of this package.
+ */
+#ifndef DXTBX_MODEL_SCAN_VARYING_MODEL_EVALUATOR_H
+#define DXTBX_MODEL_SCAN_VARYING_MODEL_EVALUATOR_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <boost/shared_ptr.hpp>
+#include <scitbx/vec2.h>
+#include <scitbx/vec3.h>
+#include <scitbx/mat3.h>
+#include <scitbx/math/r3_rotation.h>
+#include <scitbx/array_family/ref.h>
+#include <scitbx/array_family/shared.h>
+#include <scitbx/array_family/tiny_types.h>
+#include <dxtbx/model/experiment.h>
+#include <dxtbx/error.h>
+
+namespace dxtbx { namespace model {
+
+  using scitbx::vec2;
+  using scitbx::vec3;
+  using scitbx::mat3;
+  using scitbx::math::r3_rotation::axis_and_angle_as_matrix;
+  using scitbx::math::r3_rotation::matrix_as_unit_quaternion;
+
+  namespace detail {
+
+    typedef scitbx::af::tiny<double,4> quaternion;
+
+    /**
+     * Convert a unit quaternion (w, x, y, z) to a rotation matrix
+     */
+    inline
+    mat3<double> unit_quaternion_as_matrix(const quaternion &q) {
+      return scitbx::math::r3_rotation::unit_quaternion_as_matrix(
+          q[0], q[1], q[2], q[3]);
+    }
+
+    /**
+     * The slerp parameters of the interval between two unit quaternions,
+     * which depend only on the end points
+     */
+    struct slerp_interval {
+      quaternion q0;
+      quaternion q1;
+      double theta;
+      double sin_theta;
+    };
+
+    /**
+     * Compute the slerp parameters of the interval between two unit
+     * quaternions, taking the shorter arc
+     */
+    inline
+    slerp_interval make_slerp_interval(const quaternion &q0, quaternion q1) {
+      double d = q0[0]*q1[0] + q0[1]*q1[1] + q0[2]*q1[2] + q0[3]*q1[3];
+      if (d < 0) {
+        for (std::size_t i = 0; i < 4; ++i) {
+          q1[i] = -q1[i];
+        }
+        d = -d;
+      }
+      slerp_interval result;
+      result.q0 = q0;
+      result.q1 = q1;
+      if (d > 0.9995) {
+        result.theta = 0;
+        result.sin_theta = 0;
+      } else {
+        result.theta = std::acos(d);
+        result.sin_theta = std::sin(result.theta);
+      }
+      return result;
+    }
+
+    /**
+     * Spherical linear interpolation within a precomputed interval. Nearly
+     * parallel quaternions are interpolated linearly and renormalised.
+     */
+    inline
+    quaternion slerp(const slerp_interval &interval, double t) {
+      double a, b;
+      if (interval.sin_theta == 0) {
+        a = 1.0 - t;
+        b = t;
+      } else {
+        a = std::sin((1.0 - t) * interval.theta) / interval.sin_theta;
+        b = std::sin(t * interval.theta) / interval.sin_theta;
+      }
+      quaternion q;
+      for (std::size_t i = 0; i < 4; ++i) {
+        q[i] = a * interval.q0[i] + b * interval.q1[i];
+      }
+      double n = std::sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+      for (std::size_t i = 0; i < 4; ++i) {
+        q[i] /= n;
+      }
+      return q;
+    }
+
+    /**
+     * Spherical linear interpolation between two unit quaternions
+     */
+    inline
+    quaternion slerp(const quaternion &q0, const quaternion &q1, double t) {
+      return slerp(make_slerp_interval(q0, q1), t);
+    }
+
+    /**
+     * Linear interpolation
+     */
+    template <typename T>
+    T lerp(const T &a, const T &b, double t) {
+      return a * (1.0 - t) + b * t;
+    }
+
+  }
+
+  /**
+   * Evaluate the scan varying models of an experiment at arbitrary
+   * (fractional) array index positions.
+   *
+   * Scan point i of a model is taken to be at array index
+   * array_range[0] + i, so a sweep of N images has N + 1 scan points.
+   * Positions outside the scan points are clamped to the first or last
+   * scan point; models with no scan points return their static values.
+   * The beam direction and crystal B matrix are interpolated linearly.
+   * Rotations (the setting rotation and the crystal U matrix) are either
+   * interpolated linearly or with quaternion slerp. For slerp, a table
+   * of the slerp parameters of each frame (the interval between
+   * consecutive scan points) and the B matrix at each scan point are
+   * computed once on construction, so evaluating a position costs one
+   * table lookup and a few trigonometric calls. The batch methods
+   * evaluate their positions in parallel when OpenMP is available.
+   */
+  class ScanVaryingModelEvaluator {
+  public:
+
+    enum Interpolation { Linear, Slerp };
+
+    /**
+     * Initialise from the models of an experiment
+     * @param experiment The experiment
+     * @param interpolation The interpolation mode for rotations
+     */
+    ScanVaryingModelEvaluator(
+        const Experiment &experiment,
+        Interpolation interpolation = Linear)
+      : interpolation_(interpolation),
+        has_beam_(experiment.get_beam().get() != NULL),
+        has_goniometer_(experiment.get_goniometer().get() != NULL),
+        has_crystal_(experiment.get_crystal().get() != NULL) {
+      DXTBX_ASSERT(experiment.get_scan().get() != NULL);
+      DXTBX_ASSERT(interpolation == Linear || interpolation == Slerp);
+      scan_ = *experiment.get_scan();
+      array_range_start_ = scan_.get_array_range()[0];
+      if (has_beam_) {
+        s0_ = experiment.get_beam()->get_s0();
+        s0_at_scan_points_ = experiment.get_beam()->get_s0_at_scan_points();
+      }
+      if (has_goniometer_) {
+        const Goniometer &gonio = *experiment.get_goniometer();
+        rotation_axis_ = gonio.get_rotation_axis_datum();
+        F_ = gonio.get_fixed_rotation();
+        S_ = gonio.get_setting_rotation();
+        S_at_scan_points_ = gonio.get_setting_rotation_at_scan_points();
+        if (interpolation_ == Slerp) {
+          std::vector<detail::quaternion> q;
+          for (std::size_t i = 0; i < S_at_scan_points_.size(); ++i) {
+            q.push_back(matrix_as_unit_quaternion(S_at_scan_points_[i]));
+          }
+          S_frames_ = make_slerp_table(q);
+        }
+      }
+      if (has_crystal_) {
+        const CrystalBase &crystal = *experiment.get_crystal();
+        A_ = crystal.get_A();
+        A_at_scan_points_ = crystal.get_A_at_scan_points();
+        if (interpolation_ == Slerp) {
+          std::vector<detail::quaternion> q;
+          for (std::size_t i = 0; i < A_at_scan_points_.size(); ++i) {
+            q.push_back(matrix_as_unit_quaternion(crystal.get_U_at_scan_point(i)));
+            B_at_scan_points_.push_back(crystal.get_B_at_scan_point(i));
+          }
+          U_frames_ = make_slerp_table(q);
+        }
+      }
+    }
+
+    /** @returns The interpolation mode */
+    Interpolation get_interpolation() const {
+      return interpolation_;
+    }
+
+    /**
+     * @param frame The array index position
+     * @returns The s0 vector
+     */
+    vec3<double> get_s0(double frame) const {
+      DXTBX_ASSERT(has_beam_);
+      return s0_at(frame);
+    }
+
+    /**
+     * @param frame The array index position
+     * @returns The goniometer setting rotation
+     */
+    mat3<double> get_setting_rotation(double frame) const {
+      DXTBX_ASSERT(has_goniometer_);
+      return setting_rotation_at(frame);
+    }
+
+    /**
+     * @param frame The array index position
+     * @returns The crystal setting matrix (UB)
+     */
+    mat3<double> get_A(double frame) const {
+      DXTBX_ASSERT(has_crystal_);
+      return A_at(frame);
+    }
+
+    /**
+     * Get the full goniometer rotation S * R(phi) * F, where R is the
+     * rotation about the datum axis by the scan angle at the position.
+     * @param frame The array index position
+     * @returns The combined rotation matrix
+     */
+    mat3<double> get_rotation(double frame) const {
+      DXTBX_ASSERT(has_goniometer_);
+      return rotation_at(frame);
+    }
+
+    /** @returns The s0 vector at each position */
+    scitbx::af::shared< vec3<double> > get_s0(
+        const scitbx::af::const_ref<double> &frame) const {
+      DXTBX_ASSERT(has_beam_);
+      scitbx::af::shared< vec3<double> > result(frame.size());
+      #pragma omp parallel for
+      for (int i = 0; i < (int)frame.size(); ++i) {
+        result[i] = s0_at(frame[i]);
+      }
+      return result;
+    }
+
+    /** @returns The setting rotation at each position */
+    scitbx::af::shared< mat3<double> > get_setting_rotation(
+        const scitbx::af::const_ref<double> &frame) const {
+      DXTBX_ASSERT(has_goniometer_);
+      scitbx::af::shared< mat3<double> > result(frame.size());
+      #pragma omp parallel for
+      for (int i = 0; i < (int)frame.size(); ++i) {
+        result[i] = setting_rotation_at(frame[i]);
+      }
+      return result;
+    }
+
+    /** @returns The crystal setting matrix at each position */
+    scitbx::af::shared< mat3<double> > get_A(
+        const scitbx::af::const_ref<double> &frame) const {
+      DXTBX_ASSERT(has_crystal_);
+      scitbx::af::shared< mat3<double> > result(frame.size());
+      #pragma omp parallel for
+      for (int i = 0; i < (int)frame.size(); ++i) {
+        result[i] = A_at(frame[i]);
+      }
+      return result;
+    }
+
+    /** @returns The combined rotation at each position */
+    scitbx::af::shared< mat3<double> > get_rotation(
+        const scitbx::af::const_ref<double> &frame) const {
+      DXTBX_ASSERT(has_goniometer_);
+      scitbx::af::shared< mat3<double> > result(frame.size());
+      #pragma omp parallel for
+      for (int i = 0; i < (int)frame.size(); ++i) {
+        result[i] = rotation_at(frame[i]);
+      }
+      return result;
+    }
+
+  protected:
+
+    /**
+     * The evaluation methods below do not check that the model exists, and
+     * do not throw, so they can be called from within a parallel region;
+     * the public methods check before calling them.
+     */
+
+    vec3<double> s0_at(double frame) const {
+      if (s0_at_scan_points_.size() == 0) {
+        return s0_;
+      }
+      std::size_t i;
+      double t;
+      locate(frame, s0_at_scan_points_.size(), i, t);
+      if (t == 0) {
+        return s0_at_scan_points_[i];
+      }
+      return detail::lerp(s0_at_scan_points_[i], s0_at_scan_points_[i+1], t);
+    }
+
+    mat3<double> setting_rotation_at(double frame) const {
+      if (S_at_scan_points_.size() == 0) {
+        return S_;
+      }
+      std::size_t i;
+      double t;
+      locate(frame, S_at_scan_points_.size(), i, t);
+      if (t == 0) {
+        return S_at_scan_points_[i];
+      }
+      if (interpolation_ == Slerp) {
+        return detail::unit_quaternion_as_matrix(
+            detail::slerp(S_frames_[i], t));
+      }
+      return detail::lerp(S_at_scan_points_[i], S_at_scan_points_[i+1], t);
+    }
+
+    mat3<double> A_at(double frame) const {
+      if (A_at_scan_points_.size() == 0) {
+        return A_;
+      }
+      std::size_t i;
+      double t;
+      locate(frame, A_at_scan_points_.size(), i, t);
+      if (t == 0) {
+        return A_at_scan_points_[i];
+      }
+      if (interpolation_ == Slerp) {
+        mat3<double> U = detail::unit_quaternion_as_matrix(
+            detail::slerp(U_frames_[i], t));
+        return U * detail::lerp(B_at_scan_points_[i], B_at_scan_points_[i+1], t);
+      }
+      return detail::lerp(A_at_scan_points_[i], A_at_scan_points_[i+1], t);
+    }
+
+    mat3<double> rotation_at(double frame) const {
+      double phi = scan_.get_angle_from_array_index(frame);
+      return setting_rotation_at(frame)
+        * axis_and_angle_as_matrix(rotation_axis_, phi)
+        * F_;
+    }
+
+    /**
+     * Find the scan point interval containing the position
+     * @param frame The array index position
+     * @param n The number of scan points, which must be > 0
+     * @param i The first scan point of the interval
+     * @param t The fraction of the way through the interval
+     */
+    void locate(double frame, std::size_t n, std::size_t &i, double &t) const {
+      double z = std::min(std::max(frame - array_range_start_, 0.0), (double)(n - 1));
+      i = std::min((std::size_t)std::floor(z), n > 1 ? n - 2 : 0);
+      t = z - i;
+    }
+
+    /**
+     * Compute the slerp parameters of each interval between consecutive
+     * scan points
+     * @param q The quaternion at each scan point
+     * @returns The slerp parameters of each interval
+     */
+    static scitbx::af::shared<detail::slerp_interval> make_slerp_table(
+        const std::vector<detail::quaternion> &q) {
+      scitbx::af::shared<detail::slerp_interval> result;
+      for (std::size_t i = 0; i + 1 < q.size(); ++i) {
+        result.push_back(detail::make_slerp_interval(q[i], q[i+1]));
+      }
+      return result;
+    }
+
+    Interpolation interpolation_;
+    bool has_beam_;
+    bool has_goniometer_;
+    bool has_crystal_;
+    Scan scan_;
+    int array_range_start_;
+    vec3<double> s0_;
+    vec3<double> rotation_axis_;
+    mat3<double> F_;
+    mat3<double> S_;
+    mat3<double> A_;
+    scitbx::af::shared< vec3<double> > s0_at_scan_points_;
+    scitbx::af::shared< mat3<double> > S_at_scan_points_;
+    scitbx::af::shared< mat3<double> > A_at_scan_points_;
+    scitbx::af::shared< mat3<double> > B_at_scan_points_;
+    scitbx::af::shared< detail::slerp_interval > S_frames_;
+    scitbx::af::shared< detail::slerp_interval > U_frames_;
+  };
+
+}} // namespace dxtbx::model
+
+#endif // DXTBX_MODEL_SCAN_VARYING_MODEL_EVALUATOR_H
@@ -87,14 +87,7 @@ namespace dxtbx { namespace model {
     void set_local_frame(const vec3<double> &d1,
                          const vec3<double> &d2,
                          const vec3<double> &d0) {
-      const double EPS = 1e-7;
-      DXTBX_ASSERT(d1.length() > 0);
-      DXTBX_ASSERT(d2.length() > 0);
-      DXTBX_ASSERT((double)(d1 * d2) < EPS);
-      local_origin_ = d0;
-      local_fast_axis_ = d1.normalize();
-      local_slow_axis_ = d2.normalize();
-      local_normal_ = local_fast_axis_.cross(local_slow_axis_);
+      assign_local_frame(d1, d2, d0);
       update_global_frame();
     }
 
@@ -108,14 +101,7 @@ namespace dxtbx { namespace model {
     void set_parent_frame(const vec3<double> &d1,
                           const vec3<double> &d2,
                           const vec3<double> &d0) {
-      const double EPS = 1e-7;
-      DXTBX_ASSERT(d1.length() > 0);
-      DXTBX_ASSERT(d2.length() > 0);
-      DXTBX_ASSERT((double)(d1 * d2) < EPS);
-      parent_origin_ = d0;
-      parent_fast_axis_ = d1.normalize();
-      parent_slow_axis_ = d2.normalize();
-      parent_normal_ = parent_fast_axis_.cross(parent_slow_axis_);
+      assign_parent_frame(d1, d2, d0);
       update_global_frame();
     }
 
@@ -176,6 +162,53 @@ namespace dxtbx { namespace model {
       return D_.get();
     }
 
+    /**
+     * Get the derivatives of the d matrix with respect to the local frame
+     * parameters: the elements of the local origin, fast axis and slow axis
+     * vectors as passed to set_local_frame, in that order. Since
+     * d = P * (f | s | o) + (0 | 0 | parent origin), where P is the parent
+     * orientation, a change in the origin moves column 2 of d along P. The
+     * axes are normalised by set_local_frame, so a change in the unit axis a
+     * moves its column of d along P * (I - a * a^T).
+     * @returns The 9 derivatives
+     */
+    scitbx::af::shared< mat3<double> > get_d_matrix_derivatives() const {
+      mat3<double> parent_orientation(
+        parent_fast_axis_[0], parent_slow_axis_[0], parent_normal_[0],
+        parent_fast_axis_[1], parent_slow_axis_[1], parent_normal_[1],
+        parent_fast_axis_[2], parent_slow_axis_[2], parent_normal_[2]);
+      scitbx::af::shared< mat3<double> > result;
+      for (std::size_t k = 0; k < 3; ++k) {
+        result.push_back(column_derivative(2, parent_orientation.get_column(k)));
+      }
+      const vec3<double> *axes[2] = { &local_fast_axis_, &local_slow_axis_ };
+      for (std::size_t j = 0; j < 2; ++j) {
+        const vec3<double> &a = *axes[j];
+        for (std::size_t k = 0; k < 3; ++k) {
+          vec3<double> da = a * (-a[k]);
+          da[k] += 1.0;
+          result.push_back(column_derivative(j, parent_orientation * da));
+        }
+      }
+      return result;
+    }
+
+    /**
+     * Get the derivatives of the D matrix with respect to the local frame
+     * parameters, in the order of get_d_matrix_derivatives. They are
+     * computed from the d matrix derivatives as -D * dd * D.
+     * @returns The 9 derivatives
+     */
+    scitbx::af::shared< mat3<double> > get_D_matrix_derivatives() const {
+      DXTBX_ASSERT(D_);
+      mat3<double> D = D_.get();
+      scitbx::af::shared< mat3<double> > result = get_d_matrix_derivatives();
+      for (std::size_t i = 0; i < result.size(); ++i) {
+        result[i] = (D * result[i] * D) * -1.0;
+      }
+      return result;
+    }
+
     /** @returns The origin vector. */
     vec3<double> get_origin() const {
       return vec3<double>(d_[2], d_[5], d_[8]);
@@ -273,6 +306,48 @@ namespace dxtbx { namespace model {
 
   protected:
 
+    /**
+     * Set the local frame without updating the global frame.
+     */
+    void assign_local_frame(const vec3<double> &d1,
+                            const vec3<double> &d2,
+                            const vec3<double> &d0) {
+      const double EPS = 1e-7;
+      DXTBX_ASSERT(d1.length() > 0);
+      DXTBX_ASSERT(d2.length() > 0);
+      DXTBX_ASSERT((double)(d1 * d2) < EPS);
+      local_origin_ = d0;
+      local_fast_axis_ = d1.normalize();
+      local_slow_axis_ = d2.normalize();
+      local_normal_ = local_fast_axis_.cross(local_slow_axis_);
+    }
+
+    /**
+     * Set the parent frame without updating the global frame.
+     */
+    void assign_parent_frame(const vec3<double> &d1,
+                             const vec3<double> &d2,
+                             const vec3<double> &d0) {
+      const double EPS = 1e-7;
+      DXTBX_ASSERT(d1.length() > 0);
+      DXTBX_ASSERT(d2.length() > 0);
+      DXTBX_ASSERT((double)(d1 * d2) < EPS);
+      parent_origin_ = d0;
+      parent_fast_axis_ = d1.normalize();
+      parent_slow_axis_ = d2.normalize();
+      parent_normal_ = parent_fast_axis_.cross(parent_slow_axis_);
+    }
+
+    /**
+     * @returns A matrix which is zero apart from the given column
+     */
+    static mat3<double> column_derivative(std::size_t column,
+                                          const vec3<double> &v) {
+      mat3<double> result(0, 0, 0, 0, 0, 0, 0, 0, 0);
+      result.set_column(column, v);
+      return result;
+    }
+
     /**
      * Update the global frame. Construct a matrix of the parent orientation
      * and multiply the origin, fast and slow vectors of the local frame
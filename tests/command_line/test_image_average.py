@@ -0,0 +1,30 @@
+from __future__ import absolute_import, division, print_function
+
+from dxtbx.command_line.image_average import panel_data
+from dxtbx.format.image import ImageStatistics
+from dxtbx.model import Panel
+from scitbx.array_family import flex
+
+
+def test_panel_data():
+    panel = Panel()
+    panel.set_image_size((4, 3))
+
+    # 1D int data keeps its type and takes the panel shape
+    raw = flex.int(range(12))
+    data = panel_data(raw, panel)
+    assert isinstance(data, flex.int)
+    assert data.all() == (3, 4)
+    assert raw.all() == (12,)
+
+    # Other types are converted to double
+    data = panel_data(flex.float(range(12)), panel)
+    assert isinstance(data, flex.double)
+    assert data.all() == (3, 4)
+
+    # Both can be added to the statistics
+    stats = ImageStatistics()
+    stats.add((panel_data(raw, panel),))
+    stats.add((panel_data(flex.size_t(range(12)), panel),))
+    assert stats.count() == 2
+    assert list(stats.mean().tile(0).data()) == list(range(12))
@@ -0,0 +1,90 @@
+from __future__ import absolute_import, division, print_function
+
+import math
+
+from dxtbx.model import AzimuthalIntegrator, BeamFactory, DetectorFactory
+from scitbx.array_family import flex
+
+import pytest
+
+
+@pytest.fixture
+def beam():
+    return BeamFactory.simple(1.0)
+
+
+@pytest.fixture
+def detector():
+    # A 100 x 100 pixel panel 100 mm from the sample with the beam at the centre
+    return DetectorFactory.simple(
+        "PAD", 100, (5, 5), "+x", "-y", (0.1, 0.1), (100, 100), (-1, 1e6)
+    )
+
+
+def test_assignment(beam, detector):
+    integrator = AzimuthalIntegrator(beam, detector, n_q_bins=20, n_subdivide=2)
+    assert integrator.n_q_bins() == 20
+    assert integrator.n_chi_bins() == 1
+    assert integrator.q_min() == 0
+
+    # The corner of the panel is at the largest angle
+    two_theta = math.atan(math.sqrt(50.0) / 100)
+    assert integrator.q_max() == pytest.approx(4 * math.pi * math.sin(two_theta / 2))
+    assert len(integrator.q_centres()) == 20
+
+    # Every pixel is assigned in full
+    weights = integrator.bin_weights()
+    assert weights.all() == (1, 20)
+    assert flex.sum(weights) == pytest.approx(100 * 100)
+
+    # A flat image has a flat profile
+    data = flex.int(flex.grid(100, 100), 10)
+    profile = integrator.integrate(data)
+    assert profile.count().all_approx_equal(weights)
+    assert profile.mean().all_approx_equal(flex.double(flex.grid(1, 20), 10))
+    assert flex.max(profile.standard_deviation()) == pytest.approx(0)
+
+    # The geometry can be reused while the models do not change
+    assert integrator.is_similar_to(beam, detector)
+    beam.set_wavelength(0.9)
+    assert not integrator.is_similar_to(beam, detector)
+
+
+def test_radial_profile(beam, detector):
+    integrator = AzimuthalIntegrator(beam, detector, n_q_bins=10, n_chi_bins=4)
+    assert integrator.bin_weights().all() == (4, 10)
+
+    # An image whose value is the q of each pixel
+    s0 = beam.get_s0()
+    panel = detector[0]
+    data = flex.double(flex.grid(100, 100))
+    for j in range(100):
+        for i in range(100):
+            two_theta = panel.get_two_theta_at_pixel(s0, (i + 0.5, j + 0.5))
+            data[j, i] = 4 * math.pi * math.sin(two_theta / 2)
+    profile = integrator.integrate(data)
+    mean = profile.mean()
+    q = integrator.q_centres()
+    width = (integrator.q_max() - integrator.q_min()) / 10
+    for chi in range(4):
+        for i in range(10):
+            if profile.count()[chi, i] > 0:
+                assert abs(mean[chi, i] - q[i]) < width
+
+
+def test_mask_and_corrections(beam, detector):
+    data = flex.int(flex.grid(100, 100), 10)
+    mask = flex.bool([False] * 5000 + [True] * 5000)
+    mask.reshape(flex.grid(100, 100))
+
+    integrator = AzimuthalIntegrator(beam, detector, n_q_bins=5)
+    profile = integrator.integrate(data, mask=mask)
+    assert flex.sum(profile.count()) == pytest.approx(50 * 100)
+
+    # The corrected values increase away from the beam
+    integrator = AzimuthalIntegrator(
+        beam, detector, n_q_bins=5, solid_angle=True, polarization=True
+    )
+    mean = integrator.integrate((data,)).mean()
+    assert mean[0, 0] == pytest.approx(10, rel=1e-3)
+    assert all(mean[0, i] < mean[0, i + 1] for i in range(4))
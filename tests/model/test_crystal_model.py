@@ -1,5 +1,6 @@
 from __future__ import absolute_import, division, print_function
 
+import copy
 import math
 import random
 import pytest
@@ -414,6 +415,55 @@ def test_change_basis_mosaic_crystal():
     assert mosaic_model.is_similar_to(mosaic_model2)
 
 
+def test_scan_point_decomposition():
+    model = Crystal(
+        real_space_a=(10, 0, 0),
+        real_space_b=(0, 11, 0),
+        real_space_c=(0, 0, 12),
+        space_group_symbol="P 1",
+    )
+    A_list = []
+    for i in range(5):
+        uc = uctbx.unit_cell((10 + i, 11, 12, 90, 90, 90))
+        B = matrix.sqr(uc.fractionalization_matrix()).transpose()
+        U = random_rotation()
+        A_list.append(U * B)
+    model.set_A_at_scan_points(A_list)
+
+    U_list = model.get_U_at_scan_points()
+    B_list = model.get_B_at_scan_points()
+    assert len(U_list) == len(B_list) == 5
+    for i in range(5):
+        assert approx_equal(matrix.sqr(U_list[i]) * matrix.sqr(B_list[i]), A_list[i])
+        assert approx_equal(U_list[i], model.get_U_at_scan_point(i))
+        assert approx_equal(B_list[i], model.get_B_at_scan_point(i))
+        assert model.get_unit_cell_at_scan_point(i).parameters()[0] == pytest.approx(
+            10 + i
+        )
+
+    # A copy has its own scan points, decomposed on construction
+    model_copy = copy.deepcopy(model)
+    for i in range(5):
+        assert approx_equal(model_copy.get_U_at_scan_point(i), U_list[i])
+        assert approx_equal(model_copy.get_B_at_scan_point(i), B_list[i])
+
+    # The decomposition follows changes to the scan points
+    model.rotate_around_origin((0, 0, 1), 10, deg=True)
+    R = matrix.col((0, 0, 1)).axis_and_angle_as_r3_rotation_matrix(10, deg=True)
+    for i in range(5):
+        assert approx_equal(
+            matrix.sqr(model.get_U_at_scan_point(i)), R * matrix.sqr(U_list[i])
+        )
+        assert approx_equal(matrix.sqr(model.get_A_at_scan_point(i)), R * A_list[i])
+        assert approx_equal(model_copy.get_U_at_scan_point(i), U_list[i])
+        assert approx_equal(matrix.sqr(model_copy.get_A_at_scan_point(i)), A_list[i])
+    model.set_A_at_scan_points(A_list[:2])
+    assert len(model.get_U_at_scan_points()) == 2
+    assert approx_equal(model.get_U_at_scan_point(1), U_list[1])
+    model.reset_scan_points()
+    assert len(model.get_U_at_scan_points()) == 0
+
+
 def test_check_old_vs_new():
     from dxtbx.tests.model.crystal_model_old import crystal_model_old
 
@@ -563,3 +613,21 @@ def test_set_scan_varying_B_covariance(crystal_class):
         assert cov_B_at_scan_point == cov_B_2d
         cell_sd_at_scan_point = xl.get_cell_parameter_sd_at_scan_point(i)
         assert cell_sd_at_scan_point == pytest.approx(cell_sd)
+
+    # Check the batch cell sd at all scan points
+    cell_sd_at_scan_points = xl.get_cell_parameter_sd_at_scan_points()
+    cell_volume_sd_at_scan_points = xl.get_cell_volume_sd_at_scan_points()
+    assert cell_sd_at_scan_points.all() == (20, 6)
+    assert len(cell_volume_sd_at_scan_points) == 20
+    for i in range(20):
+        sd = [cell_sd_at_scan_points[i, j] for j in range(6)]
+        assert sd == pytest.approx(cell_sd)
+        assert cell_volume_sd_at_scan_points[i] == pytest.approx(
+            xl.get_cell_volume_sd()
+        )
+        assert xl.get_cell_parameter_sd_at_scan_point(i) == pytest.approx(cell_sd)
+
+    # Replacing the scan points drops the covariance that went with them
+    xl.set_A_at_scan_points(A_list[:5])
+    assert len(xl.get_B_covariance_at_scan_points()) == 0
+    assert len(xl.get_cell_volume_sd_at_scan_points()) == 0
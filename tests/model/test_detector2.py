@@ -206,6 +206,117 @@ def test_get_valid_D_matrix(detector):
     assert abs(matrix.col(p4.get_slow_axis()) - p4_d2) < eps
 
 
+def test_batch_update(detector):
+    """ Stage several frame changes and check commit matches immediate mode. """
+    from copy import deepcopy
+    from scitbx import matrix
+
+    frames = [
+        ((1, 0, 0), (0, 1, 0), (0, 0, 100)),
+        ((1, 1, 0), (-1, 1, 0), (10, 10, 0)),
+        ((1, -1, 0), (1, 1, 0), (20, 20, 0)),
+    ]
+
+    reference = deepcopy(detector)
+    root = reference.hierarchy()
+    root.set_local_frame(*frames[0])
+    root[0].set_local_frame(*frames[1])
+    root[1].set_local_frame(*frames[2])
+
+    detector.begin_batch_update()
+    assert detector.is_batch_updating()
+    root = detector.hierarchy()
+    root.set_local_frame(*frames[0])
+    root[0].set_local_frame(*frames[1])
+    root[1].set_local_frame(*frames[2])
+    assert root.is_dirty()
+    assert root[0].is_dirty()
+    detector.commit()
+    assert not detector.is_batch_updating()
+    assert not root.is_dirty()
+    assert not root[0].is_dirty()
+
+    for p1, p2 in zip(detector, reference):
+        assert matrix.sqr(p1.get_d_matrix()).elems == pytest.approx(
+            matrix.sqr(p2.get_d_matrix()).elems
+        )
+
+
+def test_batch_update_set_frame(detector):
+    """ A staged global frame is applied relative to the committed parent. """
+    from copy import deepcopy
+    from scitbx import matrix
+
+    local = ((1, 1, 0), (-1, 1, 0), (10, 10, 0))
+    frame = ((0, 1, 0), (1, 0, 0), (5, 5, 200))
+
+    reference = deepcopy(detector)
+    root = reference.hierarchy()
+    root[0].set_local_frame(*local)
+    root[0][0].set_frame(*frame)
+
+    detector.begin_batch_update()
+    root = detector.hierarchy()
+    origin = root[0].get_origin()
+    root[0].set_local_frame(*local)
+    root[0][0].set_frame(*frame)
+
+    # Nothing is recomputed until commit
+    assert root[0].get_origin() == origin
+    assert root[0][0].is_dirty()
+
+    # A copy taken mid-batch commits to the same frames
+    copied = deepcopy(detector)
+    detector.commit()
+    assert root[0][0].get_origin() == pytest.approx(frame[2])
+    for other in (reference, copied):
+        for p1, p2 in zip(detector, other):
+            assert matrix.sqr(p1.get_d_matrix()).elems == pytest.approx(
+                matrix.sqr(p2.get_d_matrix()).elems
+            )
+
+
+def test_d_matrix_derivatives(detector):
+    """ Compare the analytical d and D matrix derivatives to finite differences """
+    from scitbx import matrix
+
+    root = detector.hierarchy()
+    root.set_local_frame((1, 0, 0), (0, 1, 0), (0, 0, 100))
+    group = root[0]
+    group.set_local_frame((1, 1, 0), (-1, 1, 0), (10, 10, 0))
+    panel = group[0]
+    panel.set_local_frame((1, -1, 0), (1, 1, 0), (5, 0, 10))
+
+    dd = panel.get_d_matrix_derivatives()
+    dD = panel.get_D_matrix_derivatives()
+    assert len(dd) == 9
+    assert len(dD) == 9
+
+    # The derivatives are with respect to the elements of the local origin,
+    # fast axis and slow axis, in that order. The step is small enough for
+    # the perturbed axes to pass the orthogonality check.
+    delta = 1e-8
+    frame = [
+        list(panel.get_local_origin()),
+        list(panel.get_local_fast_axis()),
+        list(panel.get_local_slow_axis()),
+    ]
+    for i in range(9):
+        results = []
+        for sign in (1, -1):
+            shifted = [list(v) for v in frame]
+            shifted[i // 3][i % 3] += sign * delta
+            panel.set_local_frame(shifted[1], shifted[2], shifted[0])
+            results.append(
+                (matrix.sqr(panel.get_d_matrix()), matrix.sqr(panel.get_D_matrix()))
+            )
+        fd_d = (results[0][0] - results[1][0]) / (2 * delta)
+        fd_D = (results[0][1] - results[1][1]) / (2 * delta)
+        assert fd_d.elems == pytest.approx(dd[i], abs=1e-5)
+        assert fd_D.elems == pytest.approx(dD[i], abs=1e-5)
+    panel.set_local_frame(frame[1], frame[2], frame[0])
+
+
 def test_copy_and_reference(detector):
     from copy import deepcopy
 
@@ -3,6 +3,7 @@
 from __future__ import absolute_import, division, print_function
 
 import os
+import struct
 from glob import glob
 
 import pytest
@@ -287,6 +288,91 @@ def test_experimentlist_to_dict(experiment_list):
         assert eobj["scan"] == s[i]
 
 
+def test_experimentlist_binary(experiment_list, tmpdir):
+    from dxtbx.model.experiment_list import ExperimentListBinaryReader
+
+    experiment_list[2].crystal = Crystal(
+        (10, 0, 0), (0, 11, 0), (0, 0, 12), space_group_symbol="P1"
+    )
+    A = experiment_list[2].crystal.get_A()
+    experiment_list[2].crystal.set_A_at_scan_points([A] * 10)
+    experiment_list.append(Experiment(beam=experiment_list[0].beam))
+
+    # Random access to single experiments
+    data = ExperimentListDumper(experiment_list).as_binary()
+    reader = ExperimentListBinaryReader(data)
+    assert len(reader) == len(experiment_list)
+    e = reader[2]
+    assert e.identifier == "bacon"
+    assert e.beam == experiment_list[2].beam
+    assert e.crystal == experiment_list[2].crystal
+    assert e.crystal.num_scan_points == 10
+    assert e.crystal.get_A_at_scan_point(9) == pytest.approx(A)
+    assert reader[-1].identifier == ""
+    assert reader[-1].detector is None
+    with pytest.raises(IndexError):
+        reader[len(experiment_list)]
+
+    # Load the whole list through a file
+    filename = tmpdir.join("experiments.bin").strpath
+    ExperimentListDumper(experiment_list).as_file(filename)
+    experiments = ExperimentListFactory.from_serialized_format(filename)
+    assert len(experiments) == len(experiment_list)
+    assert list(experiments.identifiers()) == list(experiment_list.identifiers())
+    for e1, e2 in zip(experiments, experiment_list):
+        assert e1.beam == e2.beam
+        assert e1.detector == e2.detector
+        assert e1.goniometer == e2.goniometer
+        assert e1.scan == e2.scan
+
+    # Shared models are stored once and stay shared
+    assert len(experiments.beams()) == len(experiment_list.beams())
+    assert experiments[0].beam is experiments[4].beam
+    assert experiments[0].beam is experiments[5].beam
+
+
+def test_experimentlist_binary_does_not_unpickle(tmpdir):
+    from dxtbx.model import BinaryContainerWriter
+
+    # A container whose beam is a pickle is rejected, not unpickled
+    writer = BinaryContainerWriter(9)
+    record = flex.int([writer.add_item(0, b"bacon")] + [-1] * 8)
+    record[1] = writer.add_item(1, pickle.dumps(Beam()))
+    writer.add_record(record)
+    filename = tmpdir.join("experiments.bin").strpath
+    with open(filename, "wb") as outfile:
+        outfile.write(writer.data())
+    with pytest.raises(Exception):
+        ExperimentListFactory.from_binary_file(filename)
+
+
+def test_binary_container_rejects_bad_headers():
+    from dxtbx.model import BinaryContainerReader, BinaryContainerWriter
+
+    writer = BinaryContainerWriter(2)
+    writer.add_record(flex.int([writer.add_item(0, b"a"), writer.add_item(1, b"b")]))
+    data = writer.data()
+    assert BinaryContainerReader(data).item(1, 0) == b"b"
+
+    def with_count(offset, value):
+        return data[:offset] + struct.pack("<Q", value) + data[offset + 8 :]
+
+    bad = [
+        data[:-1],
+        data[:40],
+        # Pool, record and item counts which are too large, or which wrap
+        # around when multiplied out to table sizes
+        with_count(16, 2 ** 64 - 1),
+        with_count(16, 2 ** 61),
+        with_count(24, 2 ** 62),
+        with_count(32, 2 ** 64 - 1),
+        with_count(32, 2 ** 61),
+    ]
+    for d in bad:
+        with pytest.raises(RuntimeError):
+            BinaryContainerReader(d)
+
+
 def test_experimentlist_where(experiment_list):
     for beam in experiment_list.beams():
         assert beam is not None
@@ -728,6 +814,65 @@ def test_experimentlist_with_identifiers():
     assert list(experiments.identifiers()) == ["bacon", "ham"]
 
 
+def test_experimentlist_lookups_after_modification():
+    beam1, beam2 = Beam(), Beam()
+    experiments = ExperimentList()
+    for i in range(5):
+        experiments.append(Experiment(beam=beam1, identifier=str(i)))
+    assert experiments.find("3") == 3
+    assert list(experiments.indices(beam1)) == [0, 1, 2, 3, 4]
+    assert beam2 not in experiments
+
+    # Changes made to the experiments in place are seen by the lookups
+    experiments[3].identifier = "spam"
+    experiments[1].beam = beam2
+    assert experiments.find("3") == -1
+    assert experiments.find("spam") == 3
+    assert list(experiments.indices(beam1)) == [0, 2, 3, 4]
+    assert list(experiments.indices(beam2)) == [1]
+    assert list(experiments.where(beam=beam2)) == [1]
+
+    experiments[0] = Experiment(beam=beam2, identifier="eggs")
+    assert experiments.find("eggs") == 0
+    assert list(experiments.where(beam=beam2)) == [0, 1]
+
+    del experiments[0]
+    assert experiments.find("spam") == 2
+    assert list(experiments.indices(beam2)) == [0]
+
+    experiments.remove_on_experiment_identifiers(["1"])
+    assert list(experiments.identifiers()) == ["2", "spam", "4"]
+    assert beam2 not in experiments
+    assert experiments.find("4") == 2
+
+    # Experiments appended before the list grew still report changes
+    for i in range(5, 100):
+        experiments.append(Experiment(beam=beam1, identifier=str(i)))
+    assert experiments.find("2") == 0
+    experiments[0].identifier = "toast"
+    assert experiments.find("2") == -1
+    assert experiments.find("toast") == 0
+
+
+def test_experimentlist_remove_duplicate_identifiers():
+    experiments = ExperimentList()
+    for identifier in ["a", "b", "c", "d"]:
+        experiments.append(Experiment(identifier=identifier))
+    experiments[2].identifier = "a"
+
+    # Each identifier given removes the first experiment it matches
+    experiments.remove_on_experiment_identifiers(["a"])
+    assert list(experiments.identifiers()) == ["b", "a", "d"]
+    experiments[0].identifier = "a"
+    experiments.remove_on_experiment_identifiers(["a", "a"])
+    assert list(experiments.identifiers()) == ["d"]
+
+    # Asking to remove more experiments than match is an error
+    with pytest.raises(RuntimeError):
+        experiments.remove_on_experiment_identifiers(["d", "d"])
+    assert list(experiments.identifiers()) == ["d"]
+
+
 def test_load_models(dials_regression):
     filename = os.path.join(
         dials_regression,
@@ -0,0 +1,91 @@
+from __future__ import absolute_import, division, print_function
+
+from dxtbx.model import Detector, FlatDetector, FlatDetectorStrategy, Panel
+from dxtbx.model import ParallaxCorrectedPxMmStrategy
+from scitbx import matrix
+from scitbx.array_family import flex
+
+import pytest
+
+
+@pytest.fixture
+def detector():
+    detector = Detector()
+    root = detector.hierarchy()
+    root.set_frame((1, 0, 0), (0, 1, 0), (0, 0, 200))
+    for i in range(2):
+        quad = root.add_group()
+        quad.set_local_frame((1, 0, 0), (0, 1, 0), (i * 100, 0, 0))
+        for j in range(2):
+            panel = quad.add_panel()
+            panel.set_local_frame((1, 0, 0), (0, 1, 0), (0, j * 100, 0))
+            panel.set_pixel_size((0.1, 0.1))
+            panel.set_image_size((500, 500))
+            panel.set_trusted_range((-1, 1000))
+    return detector
+
+
+def test_flat_detector_matches_detector(detector):
+    flat = FlatDetector(detector)
+    assert len(flat) == len(detector)
+    d = flat.d_matrices()
+    D = flat.D_matrices()
+    for i, panel in enumerate(detector):
+        assert matrix.sqr(d[i]) == matrix.sqr(panel.get_d_matrix())
+        assert matrix.sqr(D[i]) == matrix.sqr(panel.get_D_matrix())
+        assert flat.image_sizes()[i] == panel.get_image_size()
+        assert flat.pixel_sizes()[i] == panel.get_pixel_size()
+        assert flat.trusted_ranges()[i] == panel.get_trusted_range()
+        assert flat.strategies()[i] == FlatDetectorStrategy.Simple
+        for xy in [(0, 0), (10.5, 20.5), (499, 499)]:
+            assert flat.get_pixel_lab_coord(i, xy) == pytest.approx(
+                panel.get_pixel_lab_coord(xy)
+            )
+
+
+def test_flat_detector_ray_intersection(detector):
+    flat = FlatDetector(detector)
+    s1 = flex.vec3_double([(5, 5, 200), (105, 105, 200), (-5, -5, 200)])
+    panel, xy = flat.get_ray_intersections(s1)
+    assert list(panel) == [0, 3, -1]
+    for i in range(2):
+        expected = detector.get_ray_intersection(s1[i])
+        assert expected[0] == panel[i]
+        assert expected[1] == pytest.approx(xy[i])
+
+
+def test_flat_detector_parallax():
+    strategy = ParallaxCorrectedPxMmStrategy(3.96, 0.32)
+    panel = Panel(
+        "",
+        "",
+        (1, 0, 0),
+        (0, 1, 0),
+        (-50, -50, 200),
+        (0.172, 0.172),
+        (512, 512),
+        (0, 1000),
+        0.32,
+        "Si",
+        strategy,
+    )
+    detector = Detector(panel)
+    flat = FlatDetector(detector)
+    assert flat.strategies()[0] == FlatDetectorStrategy.ParallaxCorrected
+    for xy in [(0, 0), (100, 200), (511, 511)]:
+        assert flat.pixel_to_millimeter(0, xy) == pytest.approx(
+            detector[0].pixel_to_millimeter(xy)
+        )
+        mm = detector[0].pixel_to_millimeter(xy)
+        assert flat.millimeter_to_pixel(0, mm) == pytest.approx(
+            detector[0].millimeter_to_pixel(mm)
+        )
+
+
+def test_flat_detector_version(detector):
+    flat = FlatDetector(detector)
+    assert flat.is_valid_for(detector)
+    assert FlatDetector(detector).version() == flat.version()
+    detector.hierarchy()[0].set_local_frame((1, 0, 0), (0, 1, 0), (1, 0, 0))
+    assert not flat.is_valid_for(detector)
+    assert FlatDetector(detector).version() != flat.version()
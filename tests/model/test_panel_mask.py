@@ -0,0 +1,76 @@
+from __future__ import absolute_import, division, print_function
+
+from dxtbx.model import Panel, PanelMask
+from scitbx.array_family import flex
+
+import pytest
+
+
+@pytest.fixture
+def panel():
+    panel = Panel()
+    panel.set_image_size((100, 80))
+    panel.add_mask(40, 0, 60, 80)
+    panel.add_mask(0, 30, 100, 50)
+    panel.add_mask(50, 10, 70, 20)
+    panel.set_trusted_range((-1, 10))
+    return panel
+
+
+@pytest.fixture
+def data():
+    data = flex.int(flex.grid(80, 100), 0)
+    data[10, 10] = -1
+    data[20, 20] = 10
+    data[25, 30] = 100
+    data[60, 90] = -10
+    data[70, 5] = 9
+    return data
+
+
+def test_spans(panel):
+    mask = PanelMask(panel)
+    assert mask.image_size() == (100, 80)
+    assert mask.words_per_row() == 2
+    static = mask.get_static_mask()
+    assert static.all_eq(panel.get_untrusted_rectangle_mask())
+    assert mask.num_untrusted() == static.count(False)
+
+    # Overlapping rectangles are merged into a single span per run
+    spans = [s for s in mask.spans() if s[0] == 15]
+    assert spans == [(15, 40, 70)]
+    spans = [s for s in mask.spans() if s[0] == 40]
+    assert spans == [(40, 0, 100)]
+
+
+def test_is_valid_for(panel):
+    mask = PanelMask(panel)
+    assert mask.is_valid_for(panel)
+    panel.set_trusted_range((0, 10))
+    assert not mask.is_valid_for(panel)
+    mask = PanelMask(panel)
+    panel.add_mask(0, 0, 1, 1)
+    assert not mask.is_valid_for(panel)
+    assert PanelMask(panel).is_valid_for(panel)
+
+
+def test_combined_mask(panel, data):
+    mask = PanelMask(panel)
+    expected = panel.get_untrusted_rectangle_mask() & panel.get_trusted_range_mask(
+        data
+    )
+    assert mask.get_mask(data).all_eq(expected)
+    assert mask.get_mask(data.as_double()).all_eq(expected)
+
+    m = flex.bool(flex.grid(80, 100), True)
+    m[0, 0] = False
+    mask.apply(data, m)
+    expected[0, 0] = False
+    assert m.all_eq(expected)
+
+
+def test_sentinel(panel, data):
+    mask = PanelMask(panel)
+    expected = mask.get_mask(data)
+    mask.apply_sentinel(data, -2)
+    assert (data == -2).all_eq(~expected)
@@ -39,6 +39,54 @@ def test_scan_slice(scan):
     assert scan1.get_batch_offset() == scan.get_batch_offset()
 
 
+def test_scan_slice_copy_on_write():
+    from scitbx.array_family import flex
+
+    scan = Scan((1, 10), (0, 1), flex.double(range(10)), flex.double(range(10, 20)))
+    sub = scan[2:5]
+    assert sub.get_image_range() == (3, 5)
+    assert sub.get_oscillation() == pytest.approx((2, 1))
+    assert list(sub.get_exposure_times()) == [2, 3, 4]
+    assert list(sub.get_epochs()) == [12, 13, 14]
+    assert sub.get_image_epoch(4) == 13
+    assert sub == Scan((3, 5), (2, 1), flex.double([2, 3, 4]), flex.double([12, 13, 14]))
+
+    single = sub[1]
+    assert single.get_image_range() == (4, 4)
+    assert list(single.get_epochs()) == [13]
+    assert single.get_image_exposure_time(4) == 3
+
+    # Modifying a slice does not change the parent or the other slices
+    sub.set_epochs(flex.double([0, 0, 0]))
+    sub.append(scan[5:6])
+    assert list(sub.get_epochs()) == [0, 0, 0, 15]
+    assert list(scan.get_epochs()) == list(range(10, 20))
+    assert list(single.get_epochs()) == [13]
+
+    # Nor does modifying the parent change its slices
+    scan.set_image_range((1, 3))
+    assert list(scan.get_epochs()) == [10, 11, 12]
+    assert list(single.get_epochs()) == [13]
+
+
+def test_scan_copy_does_not_share_arrays():
+    import copy
+    from scitbx.array_family import flex
+
+    scan = Scan((1, 3), (0, 1), flex.double([1, 2, 3]), flex.double([4, 5, 6]))
+    for other in [copy.copy(scan), copy.deepcopy(scan)]:
+        epochs = other.get_epochs()
+        epochs[0] = 100
+        exposure_times = other.get_exposure_times()
+        exposure_times[0] = 100
+        assert list(other.get_epochs()) == [4, 5, 6]
+        assert list(scan.get_epochs()) == [4, 5, 6]
+        assert list(scan.get_exposure_times()) == [1, 2, 3]
+        other.set_epochs(epochs)
+        assert list(other.get_epochs()) == [100, 5, 6]
+        assert list(scan.get_epochs()) == [4, 5, 6]
+
+
 def test_is_angle_valid(scan):
     """Check that the is_angle_valid function behaves properly."""
     oscillation_range = scan.get_oscillation_range()
@@ -52,6 +100,44 @@ def test_is_angle_valid(scan):
         assert scan.is_angle_valid(i) is False
 
 
+def test_batch_angle_queries():
+    """Check the array versions of the angle/frame conversions."""
+    from scitbx.array_family import flex
+
+    scan = Scan((1, 720), (-10, 1))
+    angles = flex.double([-20, 0, 45, 355, 400, 800])
+    valid = scan.is_angle_valid(angles)
+    assert list(valid) == [scan.is_angle_valid(a) for a in angles]
+
+    frames = flex.double([0, 1.5, 100, 719])
+    assert list(scan.get_angle_from_array_index(frames)) == pytest.approx(
+        [scan.get_angle_from_array_index(z) for z in frames]
+    )
+    assert list(scan.get_array_index_from_angle(angles)) == pytest.approx(
+        [scan.get_array_index_from_angle(a) for a in angles]
+    )
+
+    offsets, phi, z = scan.get_array_indices_with_angle(angles)
+    assert len(offsets) == len(angles) + 1
+    assert offsets[-1] == len(phi) == len(z)
+    for i, a in enumerate(angles):
+        expected = scan.get_array_indices_with_angle(a)
+        assert offsets[i + 1] - offsets[i] == len(expected)
+        for j, (e_phi, e_z) in enumerate(expected):
+            assert phi[offsets[i] + j] == pytest.approx(e_phi)
+            assert z[offsets[i] + j] == pytest.approx(e_z)
+
+    # Padding extends the range at both ends
+    offsets, phi, z = scan.get_array_indices_with_angle(flex.double([-20]))
+    assert list(phi) == pytest.approx([340, 700])
+    offsets, phi, z = scan.get_array_indices_with_angle(
+        flex.double([-20]), padding=15
+    )
+    assert list(offsets) == [0, 3]
+    assert list(phi) == pytest.approx([-20, 340, 700])
+    assert list(z) == pytest.approx([-10, 350, 710])
+
+
 def test_is_frame_valid(scan):
     """Check that the is_frame_valid function behaves properly."""
     image_range = scan.get_image_range()
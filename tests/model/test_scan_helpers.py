@@ -4,6 +4,8 @@ from dxtbx.model import is_angle_in_range
 from dxtbx.model import get_range_of_mod2pi_angles
 from dxtbx.model import get_mod2pi_angles_in_range
 
+import pytest
+
 # Run tests for the scan_helpers.h module.
 
 
@@ -92,3 +94,19 @@ def test_get_mod2pi_angles_in_range():
     # With 1080 deg range, have 3 angles
     a = get_mod2pi_angles_in_range((-360, 720), 180, deg=True)
     assert len(a) == 3 and a[0] == -180 and a[1] == 180 and a[2] == 540
+
+
+def test_get_mod2pi_angles_in_range_multiple():
+    """Get the equivalent angles for a list of angles in compressed form."""
+    from scitbx.array_family import flex
+
+    angles = flex.double([180, 0, 90, -720])
+    for r in [(0, 360), (181, 360), (0, 720), (-360, 720)]:
+        offsets, a = get_mod2pi_angles_in_range(r, angles, deg=True)
+        assert len(offsets) == len(angles) + 1
+        assert offsets[-1] == len(a)
+        for i, angle in enumerate(angles):
+            expected = get_mod2pi_angles_in_range(r, angle, deg=True)
+            assert list(a[offsets[i] : offsets[i + 1]]) == pytest.approx(
+                list(expected)
+            )
@@ -0,0 +1,121 @@
+from __future__ import absolute_import, division, print_function
+
+from dxtbx.model import (
+    Beam,
+    Crystal,
+    Experiment,
+    Goniometer,
+    Scan,
+    ScanVaryingInterpolation,
+    ScanVaryingModelEvaluator,
+)
+from scitbx import matrix
+from scitbx.array_family import flex
+
+import pytest
+
+
+@pytest.fixture
+def experiment():
+    # A 4 image sweep with 5 scan points
+    scan = Scan((1, 4), (0, 1), flex.double(4, 0.1), flex.double(range(4)), 0, True)
+
+    beam = Beam((0, 0, 1), 1.0)
+    beam.set_s0_at_scan_points([(0, 0.01 * i, -1) for i in range(5)])
+
+    gonio = Goniometer((1, 0, 0))
+    axis = matrix.col((0, 0, 1))
+    gonio.set_setting_rotation_at_scan_points(
+        [axis.axis_and_angle_as_r3_rotation_matrix(0.1 * i) for i in range(5)]
+    )
+
+    crystal = Crystal((10, 0, 0), (0, 11, 0), (0, 0, 12), space_group_symbol="P1")
+    A = matrix.sqr(crystal.get_A())
+    axis = matrix.col((0, 1, 0))
+    crystal.set_A_at_scan_points(
+        [axis.axis_and_angle_as_r3_rotation_matrix(0.2 * i) * A for i in range(5)]
+    )
+
+    return Experiment(beam=beam, goniometer=gonio, scan=scan, crystal=crystal)
+
+
+def test_scan_points(experiment):
+    evaluator = ScanVaryingModelEvaluator(experiment)
+    for i in range(5):
+        assert evaluator.get_s0(i) == pytest.approx(
+            experiment.beam.get_s0_at_scan_point(i)
+        )
+        assert evaluator.get_setting_rotation(i) == pytest.approx(
+            experiment.goniometer.get_setting_rotation_at_scan_point(i)
+        )
+        assert evaluator.get_A(i) == pytest.approx(
+            experiment.crystal.get_A_at_scan_point(i)
+        )
+
+    # Positions outside the scan are clamped
+    assert evaluator.get_s0(-1) == pytest.approx(evaluator.get_s0(0))
+    assert evaluator.get_s0(10) == pytest.approx(evaluator.get_s0(4))
+
+
+def test_linear_interpolation(experiment):
+    evaluator = ScanVaryingModelEvaluator(experiment, ScanVaryingInterpolation.Linear)
+    s0a = matrix.col(experiment.beam.get_s0_at_scan_point(1))
+    s0b = matrix.col(experiment.beam.get_s0_at_scan_point(2))
+    assert evaluator.get_s0(1.25) == pytest.approx((0.75 * s0a + 0.25 * s0b).elems)
+
+    Aa = matrix.sqr(experiment.crystal.get_A_at_scan_point(1))
+    Ab = matrix.sqr(experiment.crystal.get_A_at_scan_point(2))
+    assert evaluator.get_A(1.5) == pytest.approx((0.5 * Aa + 0.5 * Ab).elems)
+
+    frames = flex.double([0, 0.5, 1.25, 3.75])
+    s0 = evaluator.get_s0(frames)
+    A = evaluator.get_A(frames)
+    R = evaluator.get_rotation(frames)
+    for k, z in enumerate(frames):
+        assert s0[k] == pytest.approx(evaluator.get_s0(z))
+        assert A[k] == pytest.approx(evaluator.get_A(z))
+        assert R[k] == pytest.approx(evaluator.get_rotation(z))
+
+
+def test_slerp_interpolation(experiment):
+    evaluator = ScanVaryingModelEvaluator(experiment, ScanVaryingInterpolation.Slerp)
+    assert evaluator.get_interpolation() == ScanVaryingInterpolation.Slerp
+
+    # The setting rotation is exactly a rotation about z by 0.1 per scan point
+    axis = matrix.col((0, 0, 1))
+    S = matrix.sqr(evaluator.get_setting_rotation(2.3))
+    assert S.elems == pytest.approx(axis.axis_and_angle_as_r3_rotation_matrix(0.23))
+
+    # The crystal rotation is exactly a rotation about y by 0.2 per scan point
+    axis = matrix.col((0, 1, 0))
+    A = matrix.sqr(experiment.crystal.get_A())
+    expected = axis.axis_and_angle_as_r3_rotation_matrix(0.3) * A
+    assert evaluator.get_A(1.5) == pytest.approx(expected.elems)
+
+
+def test_rotation(experiment):
+    evaluator = ScanVaryingModelEvaluator(experiment)
+    gonio = experiment.goniometer
+    axis = matrix.col(gonio.get_rotation_axis_datum())
+    F = matrix.sqr(gonio.get_fixed_rotation())
+    for z in [0, 1, 2.5]:
+        phi = experiment.scan.get_angle_from_array_index(z, deg=False)
+        S = matrix.sqr(evaluator.get_setting_rotation(z))
+        R = axis.axis_and_angle_as_r3_rotation_matrix(phi)
+        assert evaluator.get_rotation(z) == pytest.approx((S * R * F).elems)
+
+
+def test_batch_slerp_and_missing_models(experiment):
+    evaluator = ScanVaryingModelEvaluator(experiment, ScanVaryingInterpolation.Slerp)
+    frames = flex.double([-1, 0, 0.3, 1.5, 2.99, 3.5, 10])
+    S = evaluator.get_setting_rotation(frames)
+    A = evaluator.get_A(frames)
+    for k, z in enumerate(frames):
+        assert S[k] == pytest.approx(evaluator.get_setting_rotation(z))
+        assert A[k] == pytest.approx(evaluator.get_A(z))
+
+    # Models that are missing are reported before evaluating any position
+    evaluator = ScanVaryingModelEvaluator(Experiment(scan=experiment.scan))
+    for method in ["get_s0", "get_setting_rotation", "get_A", "get_rotation"]:
+        with pytest.raises(RuntimeError):
+            getattr(evaluator, method)(frames)
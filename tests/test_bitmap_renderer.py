@@ -0,0 +1,101 @@
+from __future__ import absolute_import, division, print_function
+
+import struct
+import zlib
+
+from dxtbx.format.image import BitmapRenderer
+from dxtbx.model import BeamFactory, Detector, DetectorFactory
+from scitbx.array_family import flex
+
+import pytest
+
+
+@pytest.fixture
+def beam():
+    return BeamFactory.simple(1.0)
+
+
+def make_panel(detector, origin):
+    panel = detector.add_panel()
+    panel.set_frame((1, 0, 0), (0, -1, 0), origin)
+    panel.set_image_size((40, 20))
+    panel.set_pixel_size((0.1, 0.1))
+    panel.set_trusted_range((-1, 1000))
+    return panel
+
+
+def make_image(detector):
+    panels = []
+    for i, panel in enumerate(detector):
+        width, height = panel.get_image_size()
+        data = flex.double(flex.grid(height, width), 1)
+        data[0] = 10 * (i + 1)
+        panels.append(data)
+    return tuple(panels)
+
+
+def read_png(filename):
+    with open(filename, "rb") as infile:
+        data = infile.read()
+    assert data[:8] == b"\x89PNG\r\n\x1a\n"
+    position = 8
+    compressed = b""
+    while position < len(data):
+        length, = struct.unpack(">I", data[position : position + 4])
+        chunk = data[position + 4 : position + 8 + length]
+        crc, = struct.unpack(">I", data[position + 8 + length : position + 12 + length])
+        assert zlib.crc32(chunk) & 0xFFFFFFFF == crc
+        if chunk[:4] == b"IHDR":
+            width, height = struct.unpack(">II", chunk[4:12])
+        elif chunk[:4] == b"IDAT":
+            compressed += chunk[4:]
+        position += 12 + length
+    raw = zlib.decompress(compressed)
+    stride = 3 * width + 1
+    assert len(raw) == height * stride
+    return width, height, b"".join(raw[j * stride + 1 : (j + 1) * stride] for j in range(height))
+
+
+def test_single_panel(beam):
+    detector = DetectorFactory.simple(
+        "PAD", 100, (2, 1), "+x", "-y", (0.1, 0.1), (40, 20), (-1, 1000)
+    )
+    for binning in [1, 2, 4]:
+        renderer = BitmapRenderer(detector, beam, binning=binning)
+        assert renderer.width() == 40 // binning
+        assert renderer.height() == 20 // binning
+        rgb = renderer.render(make_image(detector))
+        assert len(rgb) == 3 * renderer.width() * renderer.height()
+
+    # Greyscale: bright pixels are dark, background is light
+    renderer = BitmapRenderer(detector, beam, colour_scheme=0)
+    rgb = renderer.render(make_image(detector))
+    assert rgb[0:3] == b"\x00\x00\x00"
+    assert rgb[3] > 128
+
+    with pytest.raises(RuntimeError):
+        BitmapRenderer(detector, beam, binning=3)
+
+
+def test_mosaic(beam, tmpdir):
+    # Two panels one above the other, with a 5 pixel gap
+    detector = Detector()
+    make_panel(detector, (-4, 2, -100))
+    make_panel(detector, (-4, -0.5, -100))
+    renderer = BitmapRenderer(detector, beam)
+    assert renderer.width() == 40
+    assert renderer.height() == 45
+
+    image = make_image(detector)
+    rgb = renderer.render(image)
+    row = 3 * renderer.width()
+    assert rgb[0:3] == b"\x00\x00\x00"
+    assert rgb[22 * row : 23 * row] == b"\xff" * row
+    assert rgb[25 * row : 25 * row + 3] == b"\x00\x00\x00"
+
+    # The PNG files hold the same pixels
+    filenames = [tmpdir.join("image_%d.png" % i).strpath for i in range(4)]
+    renderer.write_png_batch([image] * 4, filenames)
+    renderer.write_png(image, filenames[0])
+    for filename in filenames:
+        assert read_png(filename) == (40, 45, rgb)
@@ -234,3 +234,114 @@ def test_with_external_lookup(centroid_test_data):
     assert imageset.external_lookup.mask.data.tile(0).data().all_eq(True)
     assert imageset.external_lookup.gain.data.tile(0).data().all_eq(1)
     assert imageset.external_lookup.pedestal.data.tile(0).data().all_eq(0)
+
+
+def test_format_cache(single_sweep_filenames, tmpdir):
+    cache_file = tmpdir.join("format_cache.json").strpath
+    blocks1 = DataBlockFactory.from_filenames(single_sweep_filenames)
+    blocks2 = DataBlockFactory.from_filenames(
+        single_sweep_filenames, format_cache=cache_file
+    )
+    assert os.path.exists(cache_file)
+
+    # Re-importing from the cache should not need to read the files
+    def fail(*args, **kwargs):
+        raise RuntimeError("file opened")
+
+    from dxtbx import datablock
+
+    original = datablock._scan_file_metadata
+    datablock._scan_file_metadata = fail
+    try:
+        blocks3 = DataBlockFactory.from_filenames(
+            single_sweep_filenames, format_cache=cache_file
+        )
+    finally:
+        datablock._scan_file_metadata = original
+
+    for blocks in (blocks2, blocks3):
+        assert len(blocks) == 1
+        sweeps = blocks[0].extract_sweeps()
+        assert len(sweeps) == 1
+        assert len(sweeps[0]) == 9
+        assert sweeps[0].get_beam() == blocks1[0].extract_sweeps()[0].get_beam()
+        assert sweeps[0].get_scan() == blocks1[0].extract_sweeps()[0].get_scan()
+
+
+def test_format_cache_format_kwargs(single_sweep_filenames, tmpdir):
+    from dxtbx import datablock
+
+    cache_file = tmpdir.join("format_cache.json").strpath
+    DataBlockFactory.from_filenames(single_sweep_filenames, format_cache=cache_file)
+
+    # Reading the same files with other format keyword arguments must not be
+    # served from the entries made without them
+    scanned = []
+    original = datablock._scan_file_metadata
+
+    def scan(*args, **kwargs):
+        scanned.append(args)
+        return original(*args, **kwargs)
+
+    datablock._scan_file_metadata = scan
+    try:
+        for format_kwargs in ({"dynamic_shadowing": True}, {"dynamic_shadowing": True}):
+            blocks = DataBlockFactory.from_filenames(
+                single_sweep_filenames,
+                format_kwargs=format_kwargs,
+                format_cache=cache_file,
+            )
+            assert len(blocks[0].extract_sweeps()[0]) == 9
+        assert len(scanned) == 1
+    finally:
+        datablock._scan_file_metadata = original
+
+    cache = datablock.FormatMetadataCache(cache_file)
+    filename = single_sweep_filenames[0]
+    assert cache.get(filename) is not None
+    assert cache.get(filename, {"dynamic_shadowing": True}) is not None
+    assert cache.get(filename, {"dynamic_shadowing": False}) is None
+
+    # The keyword arguments are keyed independently of their order
+    key1 = cache._key(filename, {"a": 1, "b": 2})
+    key2 = cache._key(filename, {"b": 2, "a": 1})
+    assert key1 == key2
+    assert key1 != cache._key(filename, {"a": 2, "b": 1})
+
+
+def test_create_multiple_sweeps_in_parallel(multiple_sweep_filenames):
+    blocks = DataBlockFactory.from_filenames(multiple_sweep_filenames, nproc=2)
+    assert len(blocks) == 1
+    sweeps = blocks[0].extract_sweeps()
+    assert len(sweeps) == 2
+    assert len(sweeps[0]) == 3
+    assert len(sweeps[1]) == 3
+
+
+def test_format_cache_save_is_atomic(tmpdir, monkeypatch):
+    from dxtbx import datablock
+
+    cache_file = tmpdir.join("format_cache.json").strpath
+    image = tmpdir.join("image.cbf")
+    image.write("")
+
+    cache = datablock.FormatMetadataCache(cache_file)
+    cache.set(image.strpath, "FormatCBF", ({"a": 1}, None, None, None))
+    cache.save()
+    assert sorted(tmpdir.listdir()) == sorted([tmpdir.join("format_cache.json"), image])
+    with open(cache_file) as infile:
+        saved = infile.read()
+
+    # A failed save leaves the previous cache in place and no temporary file
+    def broken_dump(obj, outfile):
+        outfile.write("{")
+        raise ValueError("disk full")
+
+    monkeypatch.setattr(datablock.json, "dump", broken_dump)
+    cache.set(image.strpath, "FormatCBF", ({"a": 2}, None, None, None))
+    with pytest.raises(ValueError):
+        cache.save()
+    assert sorted(tmpdir.listdir()) == sorted([tmpdir.join("format_cache.json"), image])
+    with open(cache_file) as infile:
+        assert infile.read() == saved
+    assert json.loads(saved)["version"] == datablock.FormatMetadataCache.version
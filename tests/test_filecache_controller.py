@@ -1,6 +1,8 @@
 # coding: utf-8
 from __future__ import absolute_import, division, print_function
 
+import os
+
 import dxtbx.filecache
 import dxtbx.filecache_controller as fcc
 from mock import Mock, create_autospec
@@ -37,3 +39,64 @@ def test_invalid_cache(monkeypatch):
     cache.check("not_working", lambda: good_file_opener)
     mocklazy.assert_called_with(good_file_opener)
     mocklazy.return_value.open.assert_called()
+
+
+def test_lru_controller(tmpdir):
+    filenames = []
+    for i in range(4):
+        filename = tmpdir.join("file_%d" % i).strpath
+        with open(filename, "wb") as fh:
+            fh.write(b"line %d\n" % i * 1000)
+        filenames.append(filename)
+
+    cache = fcc.lru_controller(max_bytes=20000, max_files=2, mmap_threshold=None)
+
+    def read(filename, size=-1):
+        with cache.check(filename, lambda: open(filename, "rb")) as fh:
+            return fh.read(size)
+
+    # Too many files evicts the least recently used
+    for filename in filenames[:3]:
+        assert read(filename, 7) == read(filename)[:7]
+    stats = cache.statistics()
+    assert stats["misses"] == 3
+    assert stats["hits"] == 3
+    assert stats["files"] == 2
+    assert stats["evictions"] == 1
+    read(filenames[1])
+    read(filenames[3])
+    read(filenames[1])
+    assert cache.statistics()["misses"] == 4
+    read(filenames[2])
+    assert cache.statistics()["misses"] == 5
+
+    # Exceeding the memory budget evicts the least recently used
+    cache = fcc.lru_controller(max_bytes=10000, max_files=10, mmap_threshold=None)
+    read(filenames[0])
+    read(filenames[1])
+    read(filenames[2], 7)
+    stats = cache.statistics()
+    assert stats["files"] == 2
+    assert stats["evictions"] == 1
+
+    # A modified file is read again
+    assert read(filenames[3]) == b"line 3\n" * 1000
+    with open(filenames[3], "wb") as fh:
+        fh.write(b"modified\n")
+    os.utime(filenames[3], (0, 0))
+    assert read(filenames[3]) == b"modified\n"
+
+
+def test_lru_controller_mmap(tmpdir):
+    filename = tmpdir.join("large").strpath
+    with open(filename, "wb") as fh:
+        fh.write(b"first line\nsecond line\n" + b"x" * 10000)
+
+    cache = fcc.lru_controller(mmap_threshold=1000)
+    with cache.check(filename, lambda: open(filename, "rb")) as fh:
+        assert fh.readline() == b"first line\n"
+        assert fh.readline(3) == b"sec"
+        fh.seek(23)
+        assert fh.read() == b"x" * 10000
+        assert fh.read(10) == b""
+    assert cache.statistics()["bytes"] == 0
@@ -0,0 +1,93 @@
+from __future__ import absolute_import, division, print_function
+
+import threading
+
+import six.moves.cPickle as pickle
+
+from dxtbx.format.Format import FormatInstanceCache, FormatInstanceHandle
+
+
+class DummyFormat(object):
+    created = []
+
+    def __init__(self, filename, **kwargs):
+        self.filename = filename
+        self.kwargs = kwargs
+        DummyFormat.created.append(filename)
+
+    @classmethod
+    def get_instance(Class, filename, **kwargs):
+        return cache.get(Class, filename, kwargs)
+
+
+cache = FormatInstanceCache(max_size=2)
+
+
+def test_format_instance_cache():
+    del DummyFormat.created[:]
+    cache.clear()
+    a = cache.get(DummyFormat, "a", {})
+    assert cache.get(DummyFormat, "a", {}) is a
+    assert cache.get(DummyFormat, "a", {"x": [1, 2]}) is not a
+    assert cache.find(DummyFormat, "a").kwargs == {"x": [1, 2]}
+
+    # The least recently used instance is dropped
+    cache.get(DummyFormat, "b", {})
+    assert cache.get(DummyFormat, "a", {}) is not a
+    assert DummyFormat.created == ["a", "a", "b", "a"]
+
+    cache.clear(DummyFormat, "a")
+    assert cache.find(DummyFormat, "a") is None
+    assert cache.find(DummyFormat, "b") is not None
+
+
+def test_format_instance_cache_threads():
+    cache.clear()
+    results = []
+
+    def worker(name):
+        for i in range(100):
+            results.append(cache.get(DummyFormat, name, {}).filename == name)
+
+    threads = [threading.Thread(target=worker, args=(n,)) for n in "abcd"]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    assert all(results)
+
+
+def test_format_instance_handle():
+    cache.clear()
+    handle = FormatInstanceHandle(DummyFormat, {})
+    a = handle.get("a")
+    assert handle.peek("a") is a
+    assert handle.peek("b") is None
+
+    # The handle does not keep an instance dropped from the cache alive
+    other = FormatInstanceHandle(DummyFormat, {})
+    for name in "bcd":
+        other.get(name)
+    assert cache.find(DummyFormat, "a") is None
+    assert handle.get("a") is a
+    del a
+    assert handle.peek("a") is None
+    a = handle.get("a")
+    assert cache.find(DummyFormat, "a") is a
+
+    # The instance is not pickled
+    handle = pickle.loads(pickle.dumps(handle))
+    assert handle.peek("a") is None
+
+
+def test_model_digest_is_exact():
+    from dxtbx.format.Format import _freeze
+    from dxtbx.model import Beam
+
+    # Still models are only shared between files when every serialised field
+    # matches; the == operator allows a tolerance
+    a = Beam((0, 0, -1), 1.0)
+    b = Beam((0, 0, -1), 1.0 + 1e-9)
+    assert a == b
+    assert _freeze(a.to_dict()) != _freeze(b.to_dict())
+    assert _freeze(a.to_dict()) == _freeze(Beam((0, 0, -1), 1.0).to_dict())
@@ -0,0 +1,44 @@
+from __future__ import absolute_import, division, print_function
+
+import os
+
+from dxtbx.format.Registry import Registry, format_signatures
+from dxtbx.format.RegistryHelpers import IndexFormatClasses
+
+
+def test_index_format_classes(tmpdir):
+    index_file = tmpdir.join("format_index.json").strpath
+    classes, unparsed = IndexFormatClasses(index_file)
+    assert os.path.exists(index_file)
+    module, fqname, path, bases = classes["FormatCBFMiniPilatus"]
+    assert fqname == "dxtbx.format.FormatCBFMiniPilatus"
+    assert "FormatCBFMini" in bases
+    assert classes["FormatCBF"][3] == ["Format"]
+
+    # The second time the index is read back from the file
+    assert IndexFormatClasses(index_file)[0] == classes
+
+    # Every signature is for a root format
+    roots = set(name for name in classes if "Format" in classes[name][3])
+    assert set(format_signatures).issubset(roots)
+
+
+def test_find_matches_full_search(dials_regression):
+    filename = os.path.join(
+        dials_regression, "centroid_test_data", "centroid_0001.cbf"
+    )
+    format_class = Registry.find(filename)
+
+    # Search every registered format the slow way
+    def recurse(format):
+        for child in sorted(format._children, key=lambda x: x.__name__):
+            if child.understand(filename):
+                return recurse(child)
+        return format
+
+    for format in sorted(Registry.get(), key=lambda x: x.__name__):
+        if format.understand(filename):
+            assert recurse(format) is format_class
+            break
+    else:
+        assert False, "no format found"
@@ -343,3 +343,137 @@ def test_hdf5(dials_regression, hdf5_image):
     assert data1.all()[1] == data2.all()[1]
     diff = flex.abs(data1 - data2)
     assert flex.max(diff) < 1e-7
+
+
+def make_eiger_stream_frame(values, elem_size, block_size):
+    """Bitshuffle-LZ4 compress a list of values as an Eiger stream frame.
+    The LZ4 blocks encode the first long run of a repeated byte as an
+    overlapping match and everything else as literals."""
+    import struct
+
+    def lz4_length(n):
+        out = bytearray()
+        while n >= 255:
+            out.append(255)
+            n -= 255
+        out.append(n)
+        return out
+
+    def lz4_sequence(literals, match=0):
+        out = bytearray()
+        out.append((min(len(literals), 15) << 4) | (min(match - 4, 15) if match else 0))
+        if len(literals) >= 15:
+            out += lz4_length(len(literals) - 15)
+        out += literals
+        if match:
+            out += struct.pack("<H", 1)
+            if match - 4 >= 15:
+                out += lz4_length(match - 19)
+        return out
+
+    def lz4(data):
+        for first in range(len(data)):
+            last = first + 1
+            while last < len(data) and data[last] == data[first]:
+                last += 1
+            if last - first > 8 and len(data) - last >= 5:
+                return bytes(
+                    lz4_sequence(data[: first + 1], last - first - 1)
+                    + lz4_sequence(data[last:])
+                )
+        return bytes(lz4_sequence(data))
+
+    def bitshuffle(block):
+        n = len(block)
+        out = bytearray(n * elem_size)
+        for b in range(8 * elem_size):
+            for i, value in enumerate(block):
+                if (value >> b) & 1:
+                    out[b * (n // 8) + i // 8] |= 1 << (i % 8)
+        return bytes(out)
+
+    fmt = "<" + {2: "H", 4: "I"}[elem_size]
+    frame = bytearray(
+        struct.pack(">QI", len(values) * elem_size, block_size * elem_size)
+    )
+    blocked = len(values) - len(values) % 8
+    for first in range(0, blocked, block_size):
+        block = lz4(bitshuffle(values[first : min(first + block_size, blocked)]))
+        frame += struct.pack(">I", len(block)) + block
+    for value in values[blocked:]:
+        frame += struct.pack(fmt, value)
+    return bytes(frame)
+
+
+def test_eiger_stream_known_frame():
+    """Decode a frame worked out by hand from the bitshuffle and LZ4 block
+    formats, independently of make_eiger_stream_frame"""
+    from dxtbx.format.image import decode_eiger_stream_frame
+    import binascii
+
+    # 18 16 bit pixels: one bitshuffled block of 16 and 2 trailing raw pixels
+    frame = binascii.unhexlify(
+        # Uncompressed size (36 bytes) and block size (32 bytes), big endian
+        "0000000000000024"
+        "00000020"
+        # Compressed size of the block
+        "00000014"
+        # Bit planes 0-3 then 00 80 twelve times: 10 literals, then a match
+        # of 16 bytes at offset 2, then 6 literals
+        "ac"
+        "aaaaccccf0f000ff0080"
+        "0200"
+        "60"
+        "008000800080"
+        # Trailing pixels, little endian
+        "3412"
+        "ffff"
+    )
+    data = decode_eiger_stream_frame(frame, 6, 3, 16)
+    assert data.all() == (3, 6)
+    assert list(data) == list(range(15)) + [-1, 0x1234, -1]
+
+
+@pytest.mark.parametrize("bit_depth", [16, 32])
+def test_eiger_stream(tmpdir, bit_depth):
+    from dxtbx.format.image import (
+        EigerStreamReader,
+        decode_eiger_stream_frame,
+        read_eiger_stream_frame,
+    )
+    from scitbx.array_family import flex
+    import random
+    import struct
+
+    random.seed(0)
+    nx, ny = 37, 11
+    saturated = 2 ** bit_depth - 1
+    values = [0] * 100 + [
+        random.choice([0, 1, 7, 300, 65534, saturated]) for i in range(nx * ny - 100)
+    ]
+    frame = make_eiger_stream_frame(values, bit_depth // 8, 64)
+    expected = flex.int([-1 if v == saturated else v for v in values])
+
+    data = decode_eiger_stream_frame(frame, nx, ny, bit_depth)
+    assert data.all() == (ny, nx)
+    assert list(data) == list(expected)
+
+    # A 0MQ dump file is a msgpack array of the message parts
+    message = (
+        b"\x93\xa5dummy\x81\xa1k\x01\xc6"
+        + struct.pack(">I", len(frame))
+        + frame
+    )
+    assert list(read_eiger_stream_frame(message, nx, ny, bit_depth)) == list(expected)
+
+    filename = str(tmpdir.join("frame_000001"))
+    with open(filename, "wb") as fh:
+        fh.write(message)
+    reader = EigerStreamReader(flex.std_string([filename]), nx, ny, bit_depth)
+    assert len(reader) == 1
+    image = reader.image(0).as_int()
+    assert image.n_tiles() == 1
+    assert list(image.tile(0).data()) == list(expected)
+
+    with pytest.raises(RuntimeError):
+        decode_eiger_stream_frame(frame[:-10], nx, ny, bit_depth)
@@ -0,0 +1,163 @@
+from __future__ import absolute_import, division, print_function
+
+import math
+import pickle
+import random
+
+import pytest
+
+
+def make_images(n, seed=0):
+    from scitbx.array_family import flex
+
+    random.seed(seed)
+    images = []
+    for i in range(n):
+        panels = []
+        for height, width in [(4, 5), (3, 2)]:
+            data = flex.int([random.randint(0, 1000) for j in range(height * width)])
+            data.reshape(flex.grid(height, width))
+            panels.append(data)
+        images.append(tuple(panels))
+    return images
+
+
+def check_statistics(stats, images):
+    assert stats.count() == len(images)
+    assert stats.n_panels() == 2
+    n = len(images)
+    for p in range(2):
+        mean = stats.mean().tile(p).data()
+        variance = stats.variance().tile(p).data()
+        stddev = stats.standard_deviation().tile(p).data()
+        minimum = stats.min().tile(p).data()
+        maximum = stats.max().tile(p).data()
+        assert mean.all() == images[0][p].all()
+        for i in range(len(mean)):
+            values = [image[p][i] for image in images]
+            expected_mean = sum(values) / n
+            expected_variance = sum((v - expected_mean) ** 2 for v in values) / (n - 1)
+            assert mean[i] == pytest.approx(expected_mean)
+            assert variance[i] == pytest.approx(expected_variance)
+            assert stddev[i] == pytest.approx(math.sqrt(expected_variance))
+            assert minimum[i] == min(values)
+            assert maximum[i] == max(values)
+
+
+def test_image_statistics():
+    from dxtbx.format.image import ImageStatistics
+
+    images = make_images(20)
+    stats = ImageStatistics()
+    for image in images:
+        stats.add(image)
+    check_statistics(stats, images)
+
+    # Double images are accepted as well as ints
+    stats = ImageStatistics()
+    for image in images:
+        stats.add(tuple(panel.as_double() for panel in image))
+    check_statistics(stats, images)
+
+
+def test_image_statistics_merge_and_pickle():
+    from dxtbx.format.image import ImageStatistics
+
+    images = make_images(25, seed=1)
+    partial = []
+    for subset in [images[0:1], images[1:10], images[10:], []]:
+        stats = ImageStatistics()
+        for image in subset:
+            stats.add(image)
+        partial.append(pickle.loads(pickle.dumps(stats)))
+
+    merged = ImageStatistics()
+    for stats in partial:
+        merged.merge(stats)
+    check_statistics(merged, images)
+
+
+def test_image_statistics_histogram():
+    from dxtbx.format.image import ImageStatistics
+
+    images = make_images(30, seed=2)
+    stats = ImageStatistics(0, 1000, 10)
+    for image in images:
+        stats.add(image)
+    stats = pickle.loads(pickle.dumps(stats))
+
+    histogram = stats.histogram(0)
+    assert histogram.all() == (4, 5, 10)
+    for i in range(20):
+        expected = [0] * 10
+        for image in images:
+            expected[min(image[0][i] // 100, 9)] += 1
+        assert list(histogram.as_1d()[i * 10 : (i + 1) * 10]) == expected
+
+    # Histograms must match to merge
+    with pytest.raises(RuntimeError):
+        stats.merge(ImageStatistics())
+
+
+class Reader(object):
+    def __init__(self, images):
+        self._images = images
+
+    def paths(self):
+        return ["" for im in self._images]
+
+    def identifiers(self):
+        return self.paths()
+
+    def __len__(self):
+        return len(self._images)
+
+    def read(self, index):
+        if self._images[index] is None:
+            raise IOError("Unable to read image %d" % index)
+        return self._images[index]
+
+    def is_single_file_reader(self):
+        return False
+
+    def master_path(self):
+        return ""
+
+
+class Masker(Reader):
+    def get(self, index, goniometer=None):
+        return None
+
+
+def test_imageset_statistics_accumulator():
+    from dxtbx.format.image import ImageStatistics
+    from dxtbx.imageset import ImageSet, ImageSetData
+    from dxtbx_imageset_ext import ImageSetStatisticsAccumulator
+    from scitbx.array_family import flex
+
+    images = make_images(23, seed=3)
+    unreadable = images[:]
+    unreadable[5] = None
+    imageset = ImageSet(ImageSetData(Reader(unreadable), Masker(unreadable)))
+
+    # The unreadable image is skipped and reported
+    stats = ImageStatistics(0, 1000, 10)
+    accumulator = ImageSetStatisticsAccumulator(batch_size=4)
+    skipped = accumulator.accumulate(stats, imageset)
+    assert list(skipped) == [5]
+    expected = images[:5] + images[6:]
+    check_statistics(stats, expected)
+
+    # The result is the same as adding the images one at a time
+    serial = ImageStatistics(0, 1000, 10)
+    for image in expected:
+        serial.add(image)
+    for p in range(2):
+        assert list(stats.histogram(p)) == list(serial.histogram(p))
+
+    # Accumulate a subset of the images onto existing statistics
+    stats = ImageStatistics()
+    stats.add(images[0])
+    skipped = accumulator.accumulate(stats, imageset, flex.size_t([1, 2, 3]))
+    assert len(skipped) == 0
+    check_statistics(stats, images[0:4])
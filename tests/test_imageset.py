@@ -89,6 +89,40 @@ def test_image_buffer():
     assert b.is_empty() is False
 
 
+def test_bit_image():
+    import dxtbx.format.image
+    from scitbx.array_family import flex
+
+    mask = flex.bool(flex.grid(10, 70), True)
+    mask[0, 0] = False
+    mask[5, 65] = False
+    mask[9, 69] = False
+    tile = dxtbx.format.image.BitTile(mask)
+    assert tile.accessor() == (10, 70)
+    assert tile.words_per_row() == 2
+    assert tile.as_bool().all_eq(mask)
+    assert tile.count() == mask.count(True)
+    assert tile.get(5, 65) is False
+    assert tile.get(5, 64) is True
+
+    other = flex.bool(flex.grid(10, 70), True)
+    other[1, 1] = False
+    tile &= dxtbx.format.image.BitTile(other)
+    assert tile.as_bool().all_eq(mask & other)
+    tile.invert()
+    assert tile.as_bool().all_eq(~(mask & other))
+
+    image = dxtbx.format.image.ImageBool(
+        dxtbx.format.image.ImageTileBool(mask)
+    )
+    bits = dxtbx.format.image.BitImage(image)
+    assert bits.n_tiles() == 1
+    assert bits.count() == mask.count(True)
+    assert bits.as_image().tile(0).data().all_eq(mask)
+    bits2 = pickle.loads(pickle.dumps(bits))
+    assert bits2.as_image().tile(0).data().all_eq(mask)
+
+
 def test_external_lookup():
     import dxtbx.format.image
     from dxtbx.imageset import ExternalLookup
@@ -344,6 +378,11 @@ class TestImageSweep(object):
         self.tst_get_array_range(sweep, (0, 9))
         self.tst_set_models(sweep)
 
+        # The scan read from the header alone is the same as the full one
+        for filename in centroid_files:
+            scan = format_class(filename).get_scan()
+            assert format_class.get_scan_from_file(filename) == scan
+
     def tst_get_item(self, sweep):
         image = sweep[0]
         with pytest.raises(Exception):
@@ -587,6 +626,35 @@ def test_pickle_imageset(centroid_files):
     # Read the 5th image
     image = sweep[4]
 
+    # The packed mask matches the bool mask
+    mask = sweep.get_mask(4)
+    bits = sweep.get_mask_bits(4).as_image()
+    assert len(mask) == bits.n_tiles()
+    for i in range(len(mask)):
+        assert bits.tile(i).data().all_eq(mask[i])
+
+    # The compiled panel masks follow changes to the detector
+    count = sweep.get_mask_bits(4).count()
+    detector = sweep.get_detector()
+    trusted_range = detector[0].get_trusted_range()
+    detector[0].set_trusted_range((0, 10))
+    try:
+        bits = sweep.get_mask_bits(4)
+        assert bits.count() < count
+        assert bits.as_image().tile(0).data().all_eq(sweep.get_mask(4)[0])
+    finally:
+        detector[0].set_trusted_range(trusted_range)
+    assert sweep.get_mask_bits(4).count() == count
+
+    # The models are de-duplicated, with the per-image indices packed
+    from scitbx.array_family import flex
+
+    (beams, beam_indices), _, _, (scans, scan_indices) = sweep.data().__getstate__()[0]
+    assert len(beams) == 1
+    assert isinstance(beam_indices, flex.size_t)
+    assert list(beam_indices) == [0] * len(scans)
+    assert list(scan_indices) == list(range(len(scans)))
+
     # Pickle, then unpickle
     sweep2 = pickle.loads(pickle.dumps(sweep))
 
@@ -603,3 +671,31 @@ def test_pickle_imageset(centroid_files):
     sweep4 = sweep3[0:2]
     sweep4.get_detectorbase(0)
     sweep4[0]
+
+
+def test_imageset_data_params_and_format(centroid_files):
+    from dxtbx.imageset import ImageSetFactory
+
+    sweep = ImageSetFactory.new(centroid_files)[0]
+    data = sweep.data()
+    format_class = data.get_format_class()
+    params = {"a": 1, "b": [1, 2]}
+    data.set_params(params)
+    params["b"].append(3)
+    assert data.get_params() == {"a": 1, "b": [1, 2]}
+
+    # The stored params are returned without copying
+    assert data.get_params() is data.get_params()
+    data.set_params({"a": 1})
+
+    # The state holds the objects themselves
+    state = data.__getstate__()
+    assert state[4] == {"a": 1}
+    assert state[5] is format_class
+
+    # Older pickles hold them as pickled strings
+    old_state = state[:4] + (pickle.dumps(state[4]), pickle.dumps(state[5]))
+    data2 = data.__class__(*data.__getinitargs__())
+    data2.__setstate__(old_state)
+    assert data2.get_params() == {"a": 1}
+    assert data2.get_format_class() is format_class
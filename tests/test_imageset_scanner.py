@@ -0,0 +1,105 @@
+from __future__ import absolute_import, division, print_function
+
+import pytest
+
+
+class Reader(object):
+    def __init__(self, images):
+        self._images = images
+
+    def paths(self):
+        return ["" for im in self._images]
+
+    def identifiers(self):
+        return self.paths()
+
+    def __len__(self):
+        return len(self._images)
+
+    def read(self, index):
+        return self._images[index]
+
+    def is_single_file_reader(self):
+        return False
+
+    def master_path(self):
+        return ""
+
+
+class Masker(Reader):
+    def __init__(self, masks):
+        self._images = masks
+
+    def get(self, index, goniometer=None):
+        return self._images[index]
+
+
+def make_imageset(images, masks):
+    from dxtbx.imageset import ImageSet, ImageSetData
+    from dxtbx.model import DetectorFactory
+
+    detector = DetectorFactory.simple(
+        "PAD", 100, (0, 0), "+x", "-y", (0.1, 0.1), (4, 3), (-1, 100), [(0, 0, 1, 1)]
+    )
+    imageset = ImageSet(ImageSetData(Reader(images), Masker(masks)))
+    for i in range(len(images)):
+        imageset.set_detector(detector, i)
+    return imageset
+
+
+def test_imageset_scanner():
+    from dxtbx.imageset import ImageSetScanner
+    from scitbx.array_family import flex
+
+    images = []
+    masks = []
+    for i in range(5):
+        data = flex.int([10 * i, -1, 5, 200, 50, 60, 70, 80, 1, 2, 3, 4])
+        data.reshape(flex.grid(3, 4))
+        images.append(data)
+        if i % 2:
+            mask = flex.bool(flex.grid(3, 4), True)
+            mask[2, 3] = False
+            masks.append(mask)
+        else:
+            masks.append(None)
+    imageset = make_imageset(images, masks)
+
+    scanner = ImageSetScanner(hit_threshold=50, batch_size=2)
+    table = scanner.scan(imageset)
+    assert len(table) == 5
+    assert table.n_panels() == 1
+    assert list(table.indices()) == list(range(5))
+
+    for i in range(5):
+        # The first pixel is in the untrusted rectangle, the second below the
+        # trusted range and the fourth overloaded
+        valid = [5, 50, 60, 70, 80, 1, 2, 3, 4]
+        masked = 2
+        if i % 2:
+            valid.remove(4)
+            masked += 1
+        assert table.sum()[i] == sum(valid)
+        assert table.raw_sum()[i] == 10 * i + 5 + 200 + sum(range(50, 90, 10)) + 10
+        assert table.max()[i] == 200
+        assert table.raw_max()[i] == 200
+        assert table.n_valid()[i] == len(valid)
+        assert table.n_overloads()[i] == 1
+        assert table.n_masked()[i] == masked
+        assert table.n_hits()[i] == 4
+        assert table.panel_sum()[i, 0] == table.sum()[i]
+        assert table.panel_raw_sum()[i, 0] == table.raw_sum()[i]
+        assert table.panel_raw_max()[i, 0] == table.raw_max()[i]
+
+    # Scan a range of images
+    table = scanner.scan(imageset, 2, 4)
+    assert list(table.indices()) == [2, 3]
+    assert "Overloads" in table.as_str()
+    assert len(table.as_str(hits=False).split("\n")) == 3
+
+    # The raw maximum includes masked pixels
+    data = flex.int([1000, -1, 5, 200, 50, 60, 70, 80, 1, 2, 3, 4])
+    data.reshape(flex.grid(3, 4))
+    table = scanner.scan(make_imageset([data], [None]))
+    assert table.max()[0] == 200
+    assert table.raw_max()[0] == 1000
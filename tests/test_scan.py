@@ -90,6 +90,12 @@ def test_xScanFactory():
 
     a + b
 
+    # The scan built in one step is the same as appending one at a time
+    assert ScanFactory.add(xscans) == sum(xscans[1:], xscans[0])
+    assert list(ScanFactory.add(xscans).get_epochs()) == list(range(20))
+    with pytest.raises(RuntimeError):
+        ScanFactory.add(xscans[:5] + xscans[6:])
+
     filename = scan_helper_image_files.template_directory_index_to_image(
         template, directory, 1
     )
@@ -0,0 +1,151 @@
+from __future__ import absolute_import, division, print_function
+
+import multiprocessing
+import os
+import sys
+import time
+
+import pytest
+
+from dxtbx.format import stream
+
+pytestmark = pytest.mark.skipif(
+    not sys.platform.startswith("linux"),
+    reason="stream transports are tested on linux only",
+)
+
+NX, NY = 5, 4
+
+
+def make_beam(wavelength):
+    from dxtbx.model import Beam
+
+    return Beam((0, 0, -1), wavelength)
+
+
+def produce(producer, num_images):
+    """Send a header, the frames and the end of stream, changing the beam
+    half way through."""
+    producer.send(stream.header_message(num_images, beam=make_beam(1.0)))
+    for i in range(num_images):
+        if i == num_images // 2:
+            producer.send(stream.header_message(num_images, beam=make_beam(2.0)))
+        values = [i] * (NX * NY - 1) + [65535]
+        encoding = stream.UINT16 if i % 2 else stream.INT32
+        producer.send(stream.frame_message(i, NX, NY, values, encoding))
+    producer.send(stream.end_message())
+
+
+def socket_producer(path, num_images):
+    producer = stream.SocketStreamProducer(path)
+    try:
+        producer.accept(timeout=30)
+        produce(producer, num_images)
+        time.sleep(1)
+    finally:
+        producer.close()
+
+
+def shm_producer(name, num_images):
+    producer = stream.SharedMemoryStreamProducer(name, n_slots=2, slot_size=4096)
+    try:
+        produce(producer, num_images)
+        time.sleep(1)
+    finally:
+        producer.close()
+
+
+def check_stream_imageset(source):
+    from dxtbx.imageset import ImageSetFactory
+
+    imageset = ImageSetFactory.from_stream(source, window=3, timeout=30)
+    assert len(imageset) == 10
+    assert imageset.get_beam(0).get_wavelength() == pytest.approx(1.0)
+
+    for i in [0, 1, 2, 6, 9]:
+        data = imageset.get_raw_data(i)[0]
+        assert data.all() == (NY, NX)
+        assert data.as_1d()[0] == i
+        # The saturated value is mapped to -1 for 16 bit frames
+        assert data.as_1d()[NX * NY - 1] == (-1 if i % 2 else 65535)
+
+    # Frames which have left the sliding window can not be read again
+    with pytest.raises(RuntimeError):
+        imageset.reader().stream().image(2)
+
+    # The second header applies from frame 5 onwards
+    assert imageset.reader().update_models(imageset) == 1
+    assert imageset.get_beam(4).get_wavelength() == pytest.approx(1.0)
+    assert imageset.get_beam(5).get_wavelength() == pytest.approx(2.0)
+
+    # The end of stream message follows the last frame
+    reader = imageset.reader().stream()
+    assert reader.wait(30)
+    assert reader.finished()
+    assert not reader.wait(30)
+
+
+def test_socket_stream(tmpdir):
+    from dxtbx.format.image import SocketStreamSource
+
+    path = str(tmpdir.join("stream.sock"))
+    process = multiprocessing.Process(target=socket_producer, args=(path, 10))
+    process.start()
+    try:
+        for attempt in range(100):
+            if os.path.exists(path):
+                break
+            time.sleep(0.05)
+        check_stream_imageset(SocketStreamSource(path))
+    finally:
+        process.join()
+
+
+def test_shared_memory_stream():
+    from dxtbx.format.image import SharedMemoryStreamSource
+
+    name = "/dxtbx_test_stream_%d" % os.getpid()
+    process = multiprocessing.Process(target=shm_producer, args=(name, 10))
+    process.start()
+    try:
+        for attempt in range(100):
+            if os.path.exists("/dev/shm" + name):
+                break
+            time.sleep(0.05)
+        # The ring only has two slots, so the producer is held back until
+        # the frames are read
+        source = SharedMemoryStreamSource(name)
+        assert source.n_slots() == 2
+        check_stream_imageset(source)
+    finally:
+        process.join()
+
+
+def test_waiting_releases_the_gil(tmpdir):
+    import socket
+    import threading
+
+    from dxtbx.format.image import SocketStreamSource, StreamReader
+
+    # A producer which accepts the connection but never sends anything
+    path = str(tmpdir.join("silent.sock"))
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    server.bind(path)
+    server.listen(1)
+    try:
+        reader = StreamReader(SocketStreamSource(path), 1, 1, 30)
+        waiter = threading.Thread(target=reader.wait, args=(2.0,))
+        start = time.time()
+        waiter.start()
+
+        # Other python threads keep running while the reader waits
+        time.sleep(0.05)
+        count = 0
+        while waiter.is_alive() and time.time() - start < 1.0:
+            count += 1
+        assert waiter.is_alive()
+        assert count > 1000
+        assert reader.n_received() == 0
+        waiter.join()
+    finally:
+        server.close()
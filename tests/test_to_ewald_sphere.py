@@ -0,0 +1,74 @@
+from __future__ import absolute_import, division, print_function
+
+from dxtbx import ImageToEwaldSphere
+from dxtbx.model import Beam, Detector, Goniometer, Scan
+from scitbx import matrix
+from scitbx.array_family import flex
+
+import pytest
+
+
+@pytest.fixture
+def models():
+    beam = Beam((0, 0, 1), 1.5)
+    detector = Detector()
+    for i, size in enumerate([(20, 10), (8, 12)]):
+        panel = detector.add_panel()
+        panel.set_frame((1, 0, 0), (0, 1, 0), (i * 10 - 10, -5, 100))
+        panel.set_pixel_size((0.5, 0.5))
+        panel.set_image_size(size)
+    gonio = Goniometer((1, 0, 0))
+    scan = Scan(
+        (1, 5), (0, 1), flex.double(5, 0.1), flex.double(range(5)), 0, True
+    )
+    return beam, detector, gonio, scan
+
+
+def expected_map(models, frame, panel):
+    beam, detector, gonio, scan = models
+    axis = matrix.col(gonio.get_rotation_axis())
+    phi = scan.get_angle_from_array_index(frame - 0.5, deg=False)
+    p = detector[panel]
+    result = []
+    for j in range(p.get_image_size()[1]):
+        for i in range(p.get_image_size()[0]):
+            s1 = matrix.col(p.get_pixel_lab_coord((i, j))).normalize()
+            s1 = s1.rotate_around_origin(axis, phi)
+            result.append(s1 / beam.get_wavelength())
+    return result
+
+
+def test_image_to_ewald_sphere(models):
+    mapper = ImageToEwaldSphere(*models)
+    assert mapper.n_panels() == 2
+    assert mapper.n_pixels() == 20 * 10 + 8 * 12
+    assert mapper.panel_offset(1) == 20 * 10
+
+    for panel in range(2):
+        x = mapper(2, panel)
+        assert x.all() == (models[1][panel].get_image_size()[1],) + (
+            models[1][panel].get_image_size()[0],
+        )
+        for a, b in zip(x, expected_map(models, 2, panel)):
+            assert a == pytest.approx(b)
+
+    # All panels of a range of frames in one buffer
+    x = mapper.map_frames(1, 3)
+    assert len(x) == 2 * mapper.n_pixels()
+    for frame in range(1, 3):
+        offset = (frame - 1) * mapper.n_pixels()
+        for panel in range(2):
+            y = mapper(frame, panel)
+            start = offset + mapper.panel_offset(panel)
+            for k in range(len(y)):
+                assert x[start + k] == pytest.approx(y[k])
+
+    # Only the pixels in the mask
+    mask = flex.bool(flex.grid(12, 8), False)
+    mask[3, 4] = True
+    mask[7, 1] = True
+    index, y = mapper.map_masked(2, 1, mask)
+    assert list(index) == [3 * 8 + 4, 7 * 8 + 1]
+    full = mapper(2, 1)
+    for k, i in enumerate(index):
+        assert y[k] == pytest.approx(full[i])